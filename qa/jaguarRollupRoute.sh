@@ -0,0 +1,94 @@
+#!/bin/bash
+
+# Rollup routing test: an aggregate select of a time-series table that is routed
+# to a rollup table (table@window) must return the same result as a raw scan.
+# Script Name: jaguarRollupRoute.sh
+#
+# Each query is run twice:
+#   routed: time bounds at window boundaries, so the server reads the rollup table
+#   raw:    the lower bound is one second past the boundary, so the server scans the
+#           raw rows; no row falls in that second, so both results must be equal
+# Inserts are followed at once by the queries, so the routed side also covers the
+# rollup rows still in the buffer (ROLLUP_BUFFER=yes).
+# The routed query must show up as routed in the server log (s30281, JAG_LOG_LEVEL=2).
+# Last, rroute@1d gets a retention of 1 day: its 2020 rows may expire while the raw
+# rows stay, so a query of 2020 must not be routed to it.
+
+port=`grep PORT $HOME/jaguar/conf/server.conf |grep -v '#' | awk -F= '{print $2}'`
+loglevel=`grep JAG_LOG_LEVEL $HOME/jaguar/conf/server.conf |grep -v '#' | awk -F= '{print $2}'`
+serverlog=$HOME/jaguar/log/jaguar.log
+
+/bin/mkdir -p jaguarRollupRoute.log
+logf="jaguarRollupRoute.log/jaguarRollupRoute_`date +%Y%m%d_%H%M%S`.log"
+jql="$HOME/jaguar/bin/jql -u admin -p jaguar -d test -h 127.0.0.1:$port"
+
+echo "##### Rollup Routing Test #####" 2>&1 | tee -a $logf
+
+# rows from 2020-01-01 00:00:05, never in the first second of a window
+sqlf=jaguarRollupRoute.log/data.sql
+echo "drop table if exists rroute;" > $sqlf
+echo "create table timeseries(5m,1h,1d) rroute ( key: ts datetimesec, dev char(8), value: v rollup int, w int );" >> $sqlf
+for ((i=0; i<600; ++i)); do
+	h=$(( i / 50 )); m=$(( (i * 7) % 60 )); s=$(( 5 + i % 50 ))
+	printf "insert into rroute values ( '2020-01-01 %02d:%02d:%02d', 'd%d', %d, %d );\n" $h $m $s $(( i % 4 )) $(( i * 13 % 101 )) $i >> $sqlf
+done
+$jql < $sqlf >> $logf 2>&1
+
+lo="2020-01-01 00:00:00"
+rawlo="2020-01-01 00:00:01"
+hi="2020-01-02 00:00:00"
+queries=(
+	"select count(*) as c, sum(v) as s, min(v) as mn, max(v) as mx from rroute where ts >= 'LO' and ts < 'HI';"
+	"select dev, count(*) as c, sum(v) as s from rroute where ts >= 'LO' and ts < 'HI' group by dev order by dev;"
+	"select sum(v) as s, max(v) as mx from rroute where ts >= 'LO' and ts < 'HI' and dev = 'd2';"
+	"select count(*) as c, sum(v) as s from rroute where ts >= 'LO' and ts < '2020-01-01 06:00:00';"
+)
+
+fails=0
+if [ "$loglevel" != "2" ] || [ ! -f $serverlog ]; then
+	echo "FAIL routing can not be checked: set JAG_LOG_LEVEL=2 in server.conf" 2>&1 | tee -a $logf
+	((++fails))
+fi
+
+# run query q routed and raw; results must be equal
+# table: rollup table the routed query must go to, "none" if it must not be routed
+check()
+{
+	q="$1"; table="$2"
+	routed=`echo "$q" | sed "s/LO/$lo/; s/HI/$hi/"`
+	raw=`echo "$q" | sed "s/LO/$rawlo/; s/HI/$hi/"`
+	lines=`wc -l < $serverlog 2>/dev/null`
+	r1=`$jql -e "$routed" 2>&1`
+	route=`tail -n +$(( lines + 1 )) $serverlog 2>/dev/null | grep "s30281" | grep -o "from test\.rroute@[0-9a-zA-Z]*" | tail -1`
+	r2=`$jql -e "$raw" 2>&1`
+	echo "routed: $routed" >> $logf
+	echo "$route" >> $logf
+	echo "$r1" >> $logf
+	echo "raw:    $raw" >> $logf
+	echo "$r2" >> $logf
+	if [ -z "$r1" ] || [ "$r1" != "$r2" ]; then
+		echo "FAIL $q" 2>&1 | tee -a $logf
+		((++fails))
+	elif [ "$table" = "none" ] && [ -n "$route" ]; then
+		echo "FAIL $q: routed to $route" 2>&1 | tee -a $logf
+		((++fails))
+	elif [ "$table" != "none" ] && [ "$route" != "from test.$table" ]; then
+		echo "FAIL $q: not routed to $table [$route]" 2>&1 | tee -a $logf
+		((++fails))
+	else
+		echo "OK   $q" 2>&1 | tee -a $logf
+	fi
+}
+
+check "${queries[0]}" rroute@1d
+check "${queries[1]}" rroute@1d
+check "${queries[2]}" rroute@1d
+check "${queries[3]}" rroute@1h
+
+# rows of 2020 are past the retention of rroute@1d: route to 1h or scan
+$jql -e "alter table rroute@1d retention 1d;" >> $logf 2>&1
+check "${queries[0]}" rroute@1h
+
+$jql -e "drop table rroute;" >> $logf 2>&1
+echo "fails=$fails" 2>&1 | tee -a $logf
+exit $fails
@@ -65,6 +65,7 @@ void  JagCompFile::_open()
 
 		if ( 0==strcmp(dirp->d_name, "files" ) ) { continue; }
 		if ( strstr(dirp->d_name, ".bid" ) ) { continue; }
+		if ( strstr(dirp->d_name, ".compact" ) ) { continue; }
 		prt(("s30247 simpfile vec.append(%s)\n", dirp->d_name ));
 		vec.push_back( JagFileName(dirp->d_name) );
 	}
@@ -200,6 +201,16 @@ jagint JagCompFile::pwrite(const char *buf, jagint offset, jagint len )
 	return totalWrite;
 }
 
+// block-compressed simpfiles have no byte range to send from file to file
+void JagCompFile::copySimpData( JagSimpFile *dest, JagSimpFile *src, jagint srcOffset, jagint len )
+{
+	if ( ! dest->_compressed && ! src->_compressed ) {
+		::sendfile( dest->_fd, src->_fd, NULL, len );
+	} else {
+		dest->appendFrom( src, srcOffset, len );
+	}
+}
+
 jagint JagCompFile::insert(const char *buf, jagint position, jagint len )
 {
 	jagint partOffset;
@@ -220,7 +231,7 @@ jagint JagCompFile::insert(const char *buf, jagint position, jagint len )
 	pName = longToStr( offsetIdx );
 	fpath = _pathDir + "/" + pName;
 	JagSimpFile *newfile1 = new JagSimpFile( this, fpath, _KLEN, _VLEN );
-	::sendfile( newfile1->_fd, simpf->_fd, NULL, localOffset );
+	copySimpData( newfile1, simpf, 0, localOffset );
 	jagint globalOffset = partOffset;
 	(*_offsetMap)[offsetIdx] = JagOffsetSimpfPair(globalOffset, AbaxBuffer(newfile1) );  // replace
 
@@ -273,7 +284,7 @@ jagint JagCompFile::insert(const char *buf, jagint position, jagint len )
 		_keyMap->insert( kopair );
 	}
 
-	::sendfile( newf->_fd, simpf->_fd, NULL, simpf->_length - localOffset );
+	copySimpData( newf, simpf, localOffset, simpf->_length - localOffset );
 	delete simpf;
 
 	jagint startIdx;
@@ -338,7 +349,7 @@ jagint JagCompFile::remove( jagint position, jagint len )
 	sf = (JagSimpFile*) (*_offsetMap)[endOffsetIdx].value.value();
 	getMinKOPair( sf, 0, kopair );
 	sf->seekTo( endLocalOffset );
-	::sendfile( simpf->_fd, sf->_fd, NULL, sf->_length - endLocalOffset );
+	copySimpData( simpf, sf, endLocalOffset, sf->_length - endLocalOffset );
 	sf->removeFile();
 	delete sf;
 	_offsetMap->remove( (*_offsetMap)[endOffsetIdx] );
@@ -420,6 +431,7 @@ float JagCompFile::computeMergeCost( const JagDBMap *pairmap, jagint seqReadSpee
 	tsec = 0.0;
 
 	jagint lastSimpfPos = -1;
+	jagint lastBucket = -1;
 	for ( jagint i = 0; i < arrlen; ++i ) {
 		if ( _offsetMap->isNull(i) ) { continue; }
 		lastSimpfPos = i;
@@ -430,6 +442,7 @@ float JagCompFile::computeMergeCost( const JagDBMap *pairmap, jagint seqReadSpee
 		if ( rc < 0 ) {
 			continue; 
 		} 
+		if ( _family ) lastBucket = _family->timeBucket( kbuf );
 		JagDBPair maxPair(kbuf, _KLEN );
 		rightIter = pairmap->getPredOrEqual( maxPair );
 		if ( rightIter == pairmap->_map->end() ) {
@@ -463,15 +476,39 @@ float JagCompFile::computeMergeCost( const JagDBMap *pairmap, jagint seqReadSpee
 	if ( leftIter !=  pairmap->_map->end() ) {
 		int veclen = vec.size();
 		if ( veclen > 0 ) {
-			seg.leftIter = leftIter;
+			// keys of a newer time bucket go to new simpfiles of their own; the keys before
+			// them are still in the bucket of the last simpfile and are merged into it
+			// (buckets are of the first key column, so they only grow in key order)
+			JagFixMapIterator splitIter = leftIter;
+			if ( ! _family || _family->timeBucket( leftIter->first.c_str() ) < 0 ) {
+				splitIter = pairmap->_map->end();
+			} else {
+				while ( splitIter != pairmap->_map->end() 
+						&& _family->timeBucket( splitIter->first.c_str() ) <= lastBucket ) {
+					++splitIter;
+				}
+			}
+
+			if ( splitIter != leftIter ) {
+				seg.leftIter = leftIter;
+				rightIter = splitIter;
+				-- rightIter;
+				seg.rightIter = rightIter;
+				seg.simpfPos = lastSimpfPos;
+				vec.push_back( seg );
+			}
+
+			if ( splitIter != pairmap->_map->end() ) {
+				seg.leftIter = splitIter;
+				rightIter = pairmap->_map->end();
+				-- rightIter;
+				seg.rightIter = rightIter;
+				seg.simpfPos = -1;
+				vec.push_back( seg );
+			}
 
 			rightIter = pairmap->_map->end();
 			-- rightIter;
-			seg.rightIter = rightIter;
-
-			seg.simpfPos = lastSimpfPos;
-			vec.push_back( seg );
-
 			numBufferKeys = std::distance( leftIter, rightIter ) + 1;
 			wr = (float)(numBufferKeys*_KVLEN )/(float)ONE_MEGA_BYTES;
 			tsec += wr/(float)seqWriteSpeed;
@@ -490,6 +527,10 @@ jagint JagCompFile::mergeBufferToFile( const JagDBMap *pairmap, const JagVector<
 
 	for ( int i=0; i < vec.size(); ++i ) {
 		simpfPos = vec[i].simpfPos;  
+		if ( simpfPos < 0 ) {
+			cnt += flushSegmentToNewSimpFiles( vec[i].leftIter, vec[i].rightIter )*_KVLEN;
+			continue;
+		}
 		simpf = (JagSimpFile*)(*_offsetMap)[simpfPos].value.value();
 		bytes = simpf->mergeSegment( vec[i] );
 		cnt += bytes;
@@ -594,6 +635,21 @@ void JagCompFile::flushBlockIndexToDisk()
 	}
 }
 
+// append the blocks of compressed simpfiles patched in memory
+// return 0: OK  -1: error
+int JagCompFile::flushDirtyBlocks()
+{
+	int rc = 0;
+	jagint arrlen =  _offsetMap->size();
+	JagSimpFile *simpf;
+	for ( int i = 0; i < arrlen; ++i ) {
+		if ( _offsetMap->isNull(i) ) { continue; }
+		simpf = (JagSimpFile*) (*_offsetMap)[i].value.value();
+		if ( simpf && simpf->flushDirtyBlocks() < 0 ) rc = -1;
+	}
+	return rc;
+}
+
 void JagCompFile::removeBlockIndexIndDisk()
 {
 	jagint arrlen =  _offsetMap->size();
@@ -609,8 +665,14 @@ void JagCompFile::removeBlockIndexIndDisk()
 
 jagint JagCompFile::flushBufferToNewSimpFile( const JagDBMap *pairmap )
 {
+	if ( _family && _family->timeBucket( pairmap->_map->begin()->first.c_str() ) >= 0 ) {
+		JagFixMapIterator rightIter = pairmap->_map->end();
+		-- rightIter;
+		return flushSegmentToNewSimpFiles( pairmap->_map->begin(), rightIter );
+	}
+
 	jagint offset = _length;
-	Jstr fpath =  _pathDir + "/" + longToStr( offset ); 
+	Jstr fpath = newSimpFilePath();
 
 	JagSimpFile *simpf = new JagSimpFile( this, fpath, _KLEN, _VLEN );
 	simpf->flushBufferToNewFile( pairmap );
@@ -625,6 +687,146 @@ jagint JagCompFile::flushBufferToNewSimpFile( const JagDBMap *pairmap )
 	return simpf->_length/_KVLEN;
 }
 
+// append sorted records as a new simpfile; keys must be greater than all keys in this file
+jagint JagCompFile::flushSortedToNewSimpFile( const char *kvbufs, jagint num )
+{
+	jagint offset = _length;
+	Jstr fpath = newSimpFilePath();
+
+	JagSimpFile *simpf = new JagSimpFile( this, fpath, _KLEN, _VLEN );
+	simpf->flushSortedToNewFile( kvbufs, num );
+	JagOffsetSimpfPair pair( offset, AbaxBuffer(simpf) );
+	_offsetMap->insert( pair );
+
+	JagKeyOffsetPair kopair;
+	getMinKOPair( simpf, offset, kopair );
+	_keyMap->insert( kopair );
+
+	_length += simpf->_length; 
+	return simpf->_length/_KVLEN;
+}
+
+// append buffer rows leftIter..rightIter (inclusive) as new simpfiles; keys must be greater
+// than all keys in this file. Time partitioned: one simpfile per time bucket.
+// return number of rows written
+jagint JagCompFile::flushSegmentToNewSimpFiles( JagFixMapIterator leftIter, JagFixMapIterator rightIter )
+{
+	JagFixMapIterator endIter = rightIter;
+	++ endIter;
+
+	JagMergeSeg seg;
+	seg.simpfPos = -1;
+	jagint cnt = 0;
+	jagint bucket, bytes;
+	while ( leftIter != endIter ) {
+		seg.leftIter = leftIter;
+		seg.rightIter = leftIter;
+		bucket = _family ? _family->timeBucket( leftIter->first.c_str() ) : -1;
+		++ leftIter;
+		if ( bucket < 0 ) {
+			seg.rightIter = rightIter;
+			leftIter = endIter;
+		} else {
+			while ( leftIter != endIter && _family->timeBucket( leftIter->first.c_str() ) == bucket ) {
+				seg.rightIter = leftIter;
+				++ leftIter;
+			}
+		}
+
+		bytes = appendSimpFile( seg );
+		if ( bytes < 0 ) break;
+		cnt += bytes/_KVLEN;
+	}
+	return cnt;
+}
+
+// write rows of seg to a new simpfile after the last one; return bytes written
+jagint JagCompFile::appendSimpFile( const JagMergeSeg &seg )
+{
+	jagint offset = _length;
+	JagSimpFile *simpf = new JagSimpFile( this, newSimpFilePath(), _KLEN, _VLEN );
+	jagint bytes = simpf->mergeSegment( seg );
+	if ( bytes < 0 ) {
+		simpf->removeFile();
+		delete simpf;
+		return -1;
+	}
+
+	JagOffsetSimpfPair pair( offset, AbaxBuffer(simpf) );
+	_offsetMap->insert( pair );
+
+	JagKeyOffsetPair kopair;
+	getMinKOPair( simpf, offset, kopair );
+	_keyMap->insert( kopair );
+
+	_length += simpf->_length; 
+	return bytes;
+}
+
+// simpfiles are ordered by their numeric names when opened; a new simpfile gets a name
+// greater than all existing ones
+Jstr JagCompFile::newSimpFilePath() const
+{
+	jagint name = _length;
+	jagint arrlen = _offsetMap->size();
+	JagSimpFile *simpf;
+	for ( jagint i = 0; i < arrlen; ++i ) {
+		if ( _offsetMap->isNull(i) ) { continue; }
+		simpf = (JagSimpFile*) (*_offsetMap)[i].value.value();
+		if ( simpf && atoll( simpf->_fname.c_str() ) >= name ) {
+			name = atoll( simpf->_fname.c_str() ) + 1;
+		}
+	}
+	return _pathDir + "/" + longToStr( name );
+}
+
+// remove simpfiles whose rows are all in a deleted range of the family
+// caller holds the family write lock
+// return number of rows dropped
+jagint JagCompFile::dropCoveredSimpFiles()
+{
+	if ( ! _family ) return 0;
+
+	JagVector<JagOffsetSimpfPair> keep;
+	jagint arrlen = _offsetMap->size();
+	JagSimpFile *simpf;
+	char minkbuf[_KLEN+1];
+	char maxkbuf[_KLEN+1];
+	jagint cnt = 0;
+	int ndrop = 0;
+	for ( jagint i = 0; i < arrlen; ++i ) {
+		if ( _offsetMap->isNull(i) ) { continue; }
+		simpf = (JagSimpFile*) (*_offsetMap)[i].value.value();
+		if ( ! simpf ) { continue; }
+
+		memset( minkbuf, 0, _KLEN+1 );
+		memset( maxkbuf, 0, _KLEN+1 );
+		if ( simpf->getMinKeyBuf( minkbuf ) && 0 == simpf->getMaxKeyBuf( maxkbuf )
+			 && _family->rangeDeleted( minkbuf, maxkbuf ) ) {
+			cnt += simpf->reclaimRows();
+			simpf->removeBlockIndexIndDisk();
+			simpf->removeFile();
+			delete simpf;
+			++ndrop;
+			continue;
+		}
+		keep.push_back( (*_offsetMap)[i] );
+	}
+
+	if ( ndrop < 1 ) return 0;
+
+	delete _offsetMap;
+	_offsetMap = new JagArray< JagOffsetSimpfPair >();
+	_offsetMap->useHash( true );
+	for ( int i = 0; i < keep.size(); ++i ) {
+		_offsetMap->insert( keep[i] );
+	}
+	refreshAllSimpfileOffsets();
+
+	raydebug( stdout, JAG_LOG_LOW, "s40398 %s dropped %d simpfiles %l rows\n", _pathDir.c_str(), ndrop, cnt );
+	return cnt;
+}
+
 int JagCompFile::removePair( const JagDBPair &pair )
 {
 	JagSimpFile *simpf = getSimpFile( pair );
@@ -84,8 +84,14 @@ class JagCompFile
 	void 		buildInitIndex( bool force );
 	int  		buildInitIndexFromIdxFile();
 	void 		flushBlockIndexToDisk();
+	int 		flushDirtyBlocks();
 	void 		removeBlockIndexIndDisk();
 	jagint 		flushBufferToNewSimpFile( const JagDBMap *pairmap );
+	jagint 		flushSortedToNewSimpFile( const char *kvbufs, jagint num );
+	jagint 		flushSegmentToNewSimpFiles( JagFixMapIterator leftIter, JagFixMapIterator rightIter );
+	jagint 		appendSimpFile( const JagMergeSeg &seg );
+	Jstr 		newSimpFilePath() const;
+	jagint 		dropCoveredSimpFiles();
 	void 		getMinKOPair( const JagSimpFile *simpf, jagint offset, JagKeyOffsetPair &kopair );
 	void 		makeKOPair( const char *buf, jagint offset, JagKeyOffsetPair &kopair );
 	int 		removePair( const JagDBPair &pair );
@@ -96,6 +102,7 @@ class JagCompFile
 	JagSimpFile *getSimpFile(  const JagDBPair &pair );
 	void     	_open();
 	void 		refreshAllSimpfileOffsets();
+	void 		copySimpData( JagSimpFile *dest, JagSimpFile *src, jagint srcOffset, jagint len );
 	void 		print();
 
 
@@ -53,11 +53,27 @@ void JagDBMap::init()
 
 // returns false if item actually exists in array
 // otherwise returns true
+// false if key of newpair exists
 bool JagDBMap::insert( const JagDBPair &newpair )
 {
-	_map->emplace( newpair.key, newpair.value);
+	return _map->emplace( newpair.key, newpair.value).second;
+}
+
+// insert-if-absent with one tree search
+// true: newpair inserted at iter; false: key exists, iter is at the existing entry
+bool JagDBMap::insertIfAbsent( const JagDBPair &newpair, JagFixMapIterator &iter )
+{
+	iter = _map->lower_bound( newpair.key );
+	if ( iter != _map->end() && iter->first == newpair.key ) {
+		return false;
+	}
+	iter = _map->emplace_hint( iter, newpair.key, newpair.value );
 	return true;
+}
 
+JagFixMapIterator JagDBMap::find( const JagDBPair &pair ) const
+{
+	return _map->find( pair.key );
 }
 
 bool JagDBMap::remove( const JagDBPair &pair )
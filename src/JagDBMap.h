@@ -64,7 +64,9 @@ class JagDBMap
 		~JagDBMap();
 
 		bool insert( const JagDBPair &newpair );
+		bool insertIfAbsent( const JagDBPair &newpair, JagFixMapIterator &iter );
 		// bool upsert( const JagDBPair &newpair );
+		JagFixMapIterator find( const JagDBPair &pair ) const; // _map->end() if not found
 		bool exist( const JagDBPair &pair ) const;
 		bool remove( const JagDBPair &pair );
 		bool get( JagDBPair &pair ) const; 
@@ -72,6 +72,7 @@
 #include <JagSingleMergeReader.h>
 #include <JagDBLogger.h>
 #include <JaguarAPI.h>
+#include <JagDataCenterQueue.h>
 #include <JagParser.h>
 #include <JagLineFile.h>
 #include <JagCrypt.h>
@@ -86,7 +87,6 @@ jagint JagDBServer::g_lastHostTime = 0;
 
 pthread_mutex_t JagDBServer::g_dbschemamutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t JagDBServer::g_flagmutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t JagDBServer::g_wallogmutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t JagDBServer::g_dlogmutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t JagDBServer::g_dinsertmutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t JagDBServer::g_datacentermutex = PTHREAD_MUTEX_INITIALIZER;
@@ -133,14 +133,29 @@ JagDBServer::JagDBServer()
 	_nextindexschema = NULL;
 
 	_dinsertCommandFile = NULL;
-	_delPrevOriCommandFile = NULL;
-	_delPrevRepCommandFile = NULL;
-	_delPrevOriRepCommandFile = NULL;
-	_delNextOriCommandFile = NULL;
-	_delNextRepCommandFile = NULL;
-	_delNextOriRepCommandFile = NULL;
-	_recoveryRegCommandFile = NULL;
-	_recoverySpCommandFile = NULL;
+	_walWriter = NULL;
+	_deltaWriter = NULL;
+	pthread_rwlock_init( &_deltaPathLock, NULL );
+	_dcAsync = false;
+	_dcBatchSize = 1000;
+	_dcRetryMax = 60;
+	_dcWriter = NULL;
+	pthread_rwlock_init( &_dcQueueLock, NULL );
+	_indexDeferred = false;
+	_counterMerge = true;
+	_rangeDelete = true;
+	_timeSeriesPartition = 0;
+	_blockCompressAll = false;
+	_indexDeferMax = 100000;
+	_indexDeferReadMax = 10000;
+	_indexDeferInterval = 50;
+	pthread_mutex_init( &_deferIndexMutex, NULL );
+	_rollupBuffered = false;
+	_rollupBufferMax = 100000;
+	_rollupFlushInterval = 1000;
+	_rollupLazyStars = false;
+	_rollupRouting = false;
+	pthread_mutex_init( &_rollupTableMutex, NULL );
 
 	_objectLock = new JagServerObjectLock( this );
 	_jagUUID = new JagUUID();
@@ -326,6 +341,26 @@ void JagDBServer::destroy()
 		_nextindexschema = NULL;
 	}
 
+	if ( _walWriter ) {
+		delete _walWriter;
+		_walWriter = NULL;
+	}
+
+	if ( _deltaWriter ) {
+		delete _deltaWriter;
+		_deltaWriter = NULL;
+	}
+
+	for ( int i = 0; i < _dcQueueAll.size(); ++i ) {
+		delete _dcQueueAll[i];
+	}
+	_dcQueueAll.clean();
+	_dcQueues.clean();
+	if ( _dcWriter ) {
+		delete _dcWriter;
+		_dcWriter = NULL;
+	}
+
 	if ( _dbConnector ) {
 		delete _dbConnector;
 		_dbConnector = NULL;
@@ -361,56 +396,19 @@ void JagDBServer::destroy()
 		_internalHostNum = NULL;
 	}
 
-	if ( _delPrevOriCommandFile ) {
-		jagfclose( _delPrevOriCommandFile );
-		_delPrevOriCommandFile = NULL;
-	}
-
-	if ( _delPrevRepCommandFile ) {
-		jagfclose( _delPrevRepCommandFile );
-		_delPrevRepCommandFile = NULL;
-	}
-
-	if ( _delPrevOriRepCommandFile ) {
-		jagfclose( _delPrevOriRepCommandFile );
-		_delPrevOriRepCommandFile = NULL;
-	}
-
-	if ( _delNextOriCommandFile ) {
-		jagfclose( _delNextOriCommandFile );
-		_delNextOriCommandFile = NULL;
-	}
-
-	if ( _delNextRepCommandFile ) {
-		jagfclose( _delNextRepCommandFile );
-		_delNextRepCommandFile = NULL;
-	}
-
-	if ( _delNextOriRepCommandFile ) {
-		jagfclose( _delNextOriRepCommandFile );
-		_delNextOriRepCommandFile = NULL;
-	}
-
-	if ( _recoveryRegCommandFile ) {
-		jagfclose( _recoveryRegCommandFile );
-		_recoveryRegCommandFile = NULL;
-	}
-
-	if ( _recoverySpCommandFile ) {
-		jagfclose( _recoverySpCommandFile );
-		_recoverySpCommandFile = NULL;
-	}
-
 
 	if ( _blockIPList )  delete _blockIPList;
 	if ( _allowIPList )  delete _allowIPList;
 	pthread_rwlock_destroy(&_aclrwlock);
+	pthread_rwlock_destroy( &_deltaPathLock );
+	pthread_rwlock_destroy( &_dcQueueLock );
+	pthread_mutex_destroy( &_deferIndexMutex );
+	pthread_mutex_destroy( &_rollupTableMutex );
 
 	delete _dbLogger;
 
 	pthread_mutex_destroy( &g_dbschemamutex );
 	pthread_mutex_destroy( &g_flagmutex );
-	pthread_mutex_destroy( &g_wallogmutex );
 	pthread_mutex_destroy( &g_dlogmutex );
 	pthread_mutex_destroy( &g_dinsertmutex );
 	pthread_mutex_destroy( &g_datacentermutex );
@@ -439,7 +437,6 @@ int JagDBServer::main(int argc, char*argv[])
 
 	pthread_mutex_init( &g_dbschemamutex, NULL );
 	pthread_mutex_init( &g_flagmutex, NULL );
-	pthread_mutex_init( &g_wallogmutex, NULL );
 	pthread_mutex_init( &g_dlogmutex, NULL );
 	pthread_mutex_init( &g_dinsertmutex, NULL );
 	pthread_mutex_init( &g_datacentermutex, NULL );
@@ -490,6 +487,7 @@ int JagDBServer::main(int argc, char*argv[])
 		rotateDinsertLog();
 
 		refreshDataCenterConnections( seq );
+		reportDataCenterLag();
 
 		if ( 0 == (seq%15) ) {
 			refreshACL( 1 );
@@ -547,54 +545,32 @@ int JagDBServer::processMultiSingleCmd( JagRequest &req, const char *mesg, jagin
 	bool sucsync = true;
 	JagParseAttribute jpa( this, req.session->timediff, servtimediff, req.session->dbname, _cfg );
 	Jstr reterr, rowFilter;
+	req.redoOnly = redoOnly;
 		
 	if ( req.batchReply ) {
 		JagStrSplitWithQuote split( mesg, ';' );
-		int msgnum = split.length();
+		JagVector<int> parsedVec, rejectVec;
 		if ( ! _isGate ) {
-			JagParser parser((void*)this);
-			JagParseParam pparam( &parser ); 
-    		for ( int i = 0; i < msgnum; ++i ) {
-				bool brc = parser.parseCommand( jpa, split[i], &pparam, reterr );
-    			if ( brc ) {
-					// before do insert, need to check permission of this user for insert
-					rc = checkUserCommandPermission( NULL, req, pparam, 0, rowFilter, reterr );
-					if ( rc ) {
-						if ( ! redoOnly && req.batchReply ) {
-							logCommand( &pparam, req.session, split[i].c_str(), split[i].size(), 2 );
-						}
-						
-						rc = doInsert( req, pparam, reterr, split[i] );
-    					if ( ! rc ) {
-    					} 
-					} else {
-					}
-    			} else {
-    			}
-    		}
+			doBatchInsert( req, jpa, split, threadQueryTime, threadSchemaTime, parsedVec, rejectVec );
 		} else {
 			// if is gate, do not store data locally
+			JagParser parser((void*)this);
+			JagParseParam pparam( &parser );
+    		for ( int i = 0; i < split.length(); ++i ) {
+				if ( parser.parseCommand( jpa, split[i], &pparam, reterr ) ) {
+					parsedVec.append( i );
+				} else {
+					rejectVec.append( i );
+				}
+			}
 		}
 
 		//raydebug( stdout, JAG_LOG_LOW, "s22389 done %d batch insert\n", msgnum );
 		// sync command to other data-centers
 		if ( req.dorep ) {
-			JagParser parser((void*)this);
-			JagParseParam pparam( &parser );
-			JAG_BLURT jaguar_mutex_lock ( &g_datacentermutex ); JAG_OVER;
-			for ( int i = 0; i < msgnum; ++i ) {
-				if ( ! parser.parseCommand( jpa, split[i], &pparam, reterr ) ) {
-					continue; 
-				}
-
-				if ( JAG_FINSERT_OP == pparam.opcode ) {
-					synchToOtherDataCenters( split[i].c_str(), sucsync, req );
-					// finsert to insert
-				} else {
-					synchToOtherDataCenters( split[i].c_str(), sucsync, req );
-				}	
+			for ( int i = 0; i < parsedVec.size(); ++i ) {
+				replicateToOtherDataCenters( split[ parsedVec[i] ].c_str(), sucsync, req );
 			}
-			jaguar_mutex_unlock ( &g_datacentermutex );
 		}
 
 		// check timestamp to see if need to update schema for client SC
@@ -609,9 +585,19 @@ int JagDBServer::processMultiSingleCmd( JagRequest &req, const char *mesg, jagin
 			threadHostTime = g_lastHostTime;
 		}
 
-		Jstr endmsg = Jstr("_END_[T=20|E=|]");
+		// a datacenter queue moves the rejected statements aside; other clients see them in the log
+		Jstr endmsg = Jstr("_END_[T=20|E=|]"), resstr = "ED";
+		if ( req.session->datacenter && rejectVec.size() > 0 ) {
+			endmsg = Jstr("_END_[T=20|E=E20417 rejected ");
+			for ( int i = 0; i < rejectVec.size(); ++i ) {
+				if ( i > 0 ) endmsg += ",";
+				endmsg += intToStr( rejectVec[i] );
+			}
+			endmsg += "|]";
+			resstr = "ER";
+		}
 		if ( req.hasReply && !redoOnly ) {
-			sendMessageLength( req, endmsg.c_str(), endmsg.length(), "ED" );
+			sendMessageLength( req, endmsg.c_str(), endmsg.length(), resstr.c_str() );
 		} else {
 			//	endmsg.c_str(), req.hasReply, redoOnly ));
 		}
@@ -634,21 +620,23 @@ int JagDBServer::processMultiSingleCmd( JagRequest &req, const char *mesg, jagin
     		if ( ! _isGate ) {
         		if ( !redoOnly && isReadOrWriteCommand == JAG_WRITE_SQL ) { // write related commands, store in wallog
 					if ( JAG_INSERT_OP == pparam.opcode ) {
-        				logCommand(&pparam, req.session, mesg, msglen, 2 );
-					} else if ( JAG_UPDATE_OP == pparam.opcode || JAG_DELETE_OP == pparam.opcode ) {
-        				logCommand(&pparam, req.session, mesg, msglen, 1 );
+						// logged as encoded pairs by the table in doInsert()
+					} else if ( JAG_UPDATE_OP == pparam.opcode ) {
+						// logged in processCmd() under the table lock
+					} else if ( JAG_DELETE_OP == pparam.opcode ) {
+        				if ( ! logCommand(&pparam, req.session, mesg, msglen, 1 ) ) reterr = "E20316 Error write wallog";
 					} else if ( JAG_FINSERT_OP == pparam.opcode || JAG_CINSERT_OP == pparam.opcode ) {
-        				logCommand(&pparam, req.session, mesg, msglen, 2 );
+        				if ( ! logCommand(&pparam, req.session, mesg, msglen, 2 ) ) reterr = "E20316 Error write wallog";
 					} else {
 						// other commands (e.g. scheme changes) have no logs
 					}
         		}
 
-				rc = processCmd( jpa, req, mesg, pparam, reterr, threadQueryTime, threadSchemaTime );
+				if ( reterr.size() < 1 ) {
+					rc = processCmd( jpa, req, mesg, pparam, reterr, threadQueryTime, threadSchemaTime );
+				}
     			if ( reterr.size()< 1 && req.dorep && req.syncDataCenter && 0 == req.session->replicateType ) {
-    				JAG_BLURT jaguar_mutex_lock ( &g_datacentermutex ); JAG_OVER;
-    				synchToOtherDataCenters( mesg, sucsync, req );
-    				jaguar_mutex_unlock ( &g_datacentermutex );
+    				replicateToOtherDataCenters( mesg, sucsync, req );
     			}
 
     		} else {
@@ -663,9 +651,7 @@ int JagDBServer::processMultiSingleCmd( JagRequest &req, const char *mesg, jagin
 					} else {
 						rc = processCmd( jpa, req, mesg, pparam, reterr, threadQueryTime, threadSchemaTime );
     					if ( reterr.size() < 1 && req.dorep && req.syncDataCenter && 0 == req.session->replicateType ) {
-    						JAG_BLURT jaguar_mutex_lock ( &g_datacentermutex ); JAG_OVER;
-    						synchToOtherDataCenters( mesg, sucsync, req );
-    						jaguar_mutex_unlock ( &g_datacentermutex );
+    						replicateToOtherDataCenters( mesg, sucsync, req );
     					}
 					}
 			} 
@@ -760,6 +746,10 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 
 		if ( parseParam.objectVec[pos].indexName.length() > 0 ) {
 			// known index
+			if ( _rollupBuffered && parseParam.objectVec[pos].tableName.containsChar('@') ) {
+				// buffered rollup rows reach the indexes of a rollup table when they are written
+				flushRollupBuffer( parseParam.objectVec[pos].dbName, parseParam.objectVec[pos].tableName, req.session->replicateType );
+			}
 			pindex = _objectLock->readLockIndex( parseParam.opcode, parseParam.objectVec[pos].dbName, 
 												  tabName, parseParam.objectVec[pos].indexName,
 												  req.session->replicateType, 0 );
@@ -769,6 +759,29 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 			// table object or index object
 			ptab = _objectLock->readLockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
 												parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+			if ( ptab && ptab->rollupPending() > 0 ) {
+				// select from a rollup table sees its buffered rollups: write them first
+				_objectLock->readUnlockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
+										   	  parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+				flushRollupBuffer( parseParam.objectVec[pos].dbName, parseParam.objectVec[pos].tableName, req.session->replicateType );
+				ptab = _objectLock->readLockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
+													parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+			}
+			jagint starMask;
+			if ( ptab && ptab->missingStarPattern( &parseParam, starMask ) ) {
+				// first query of a '*' combination of a lazy rollup table: build its rows
+				_objectLock->readUnlockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
+										   	  parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+				ptab = _objectLock->writeLockTable( JAG_INSERT_OP, parseParam.objectVec[pos].dbName, 
+													parseParam.objectVec[pos].tableName, tableschema, req.session->replicateType, 0 );
+				if ( ptab ) {
+					ptab->materializeStars( starMask );
+					_objectLock->writeUnlockTable( JAG_INSERT_OP, parseParam.objectVec[pos].dbName, 
+												   parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+				}
+				ptab = _objectLock->readLockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
+													parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+			}
 			if ( !ptab ) {
 				pindex = _objectLock->readLockIndex( parseParam.opcode, parseParam.objectVec[pos].dbName, 
 											      tabName, parseParam.objectVec[pos].tableName,
@@ -812,6 +825,22 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 				} else {
 				}
 
+				Jstr rollupTable, rollupCmd;
+				if ( _rollupRouting && ! _isGate && 0 == pos && rowFilter.size() < 1 && JAG_SELECT_OP == parseParam.opcode
+				     && ptab->routeToRollup( req.session->timediff, &parseParam, rollupTable, rollupCmd ) ) {
+					JagParser rparser( (void*)this );
+					JagParseParam rparam( &rparser );
+					if ( rparser.parseCommand( jpa, rollupCmd, &rparam, errmsg ) ) {
+						// select from the rollup table instead, with its buffered rollups written first
+						_objectLock->readUnlockTable( parseParam.opcode, parseParam.objectVec[pos].dbName, 
+													  parseParam.objectVec[pos].tableName, req.session->replicateType, 0 );
+						flushRollupBuffer( parseParam.objectVec[pos].dbName, rollupTable, req.session->replicateType );
+						raydebug( stdout, JAG_LOG_HIGH, "s30281 [%s] routed to [%s]\n", cmd, rollupCmd.s() );
+						return processCmd( jpa, req, rollupCmd.c_str(), rparam, reterr, threadQueryTime, threadSchemaTime );
+					}
+					errmsg = "";
+				}
+
 				if ( parseParam.exportType == JAG_EXPORT ) {
 					Jstr dbtab = dbname + "." + parseParam.objectVec[pos].tableName;
 					Jstr dirpath = jaguarHome() + "/export/" + dbtab;
@@ -864,16 +893,35 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 	} else if ( JAG_UPDATE_OP == parseParam.opcode ) {
 		rc = checkUserCommandPermission( NULL, req, parseParam, 0, rowFilter, reterr );
 		if ( rc ) {
-			ptab = _objectLock->writeLockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName,
-												tableschema, req.session->replicateType, 0 );
-			if ( !ptab ) {
-				reterr = "E4283 Update can only been applied to tables";
-			} else {
-				Jstr dbobj = parseParam.objectVec[0].dbName + "." + parseParam.objectVec[0].tableName;
-				cnt = ptab->update( req, &parseParam, false, errmsg );
+			// blind counter updates share the table with inserts and each other
+			cnt = -2;
+			if ( _counterMerge && ! _isGate ) {
+				ptab = _objectLock->insertLockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName,
+													 req.session->replicateType, 0 );
+				if ( ptab ) {
+					cnt = ptab->mergeUpdate( req, &parseParam, cmd, errmsg );
+					_objectLock->insertUnlockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName, 
+													req.session->replicateType, 0 );
+				}
+			}
+
+			if ( -2 == cnt ) {
+				cnt = 0;
+				ptab = _objectLock->writeLockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName,
+													tableschema, req.session->replicateType, 0 );
+				if ( !ptab ) {
+					reterr = "E4283 Update can only been applied to tables";
+				} else {
+					if ( ! _isGate && ! req.redoOnly && ! logCommand( &parseParam, req.session, cmd, strlen(cmd), 1 ) ) {
+						errmsg = "E20316 Error write wallog";
+						cnt = -1;
+					} else {
+						cnt = ptab->update( req, &parseParam, false, errmsg );
+					}
 
-				_objectLock->writeUnlockTable( parseParam.opcode, dbname, 
-												parseParam.objectVec[0].tableName, req.session->replicateType, 0 );
+					_objectLock->writeUnlockTable( parseParam.opcode, dbname, 
+													parseParam.objectVec[0].tableName, req.session->replicateType, 0 );
+				}
 			}
 	
 			if ( ! _isGate ) {
@@ -912,6 +960,8 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 			if ( ptab ) {
                 Jstr dbobj = parseParam.objectVec[0].dbName + "." + parseParam.objectVec[0].tableName;
                 cnt = ptab->remove( req, &parseParam, errmsg );
+				// the trim drops update records; pending counter deltas are written to rows first
+				ptab->_darrFamily->foldMergeDeltas();
 				jagint trimLimit = JAG_WALLOG_TRIM_RATIO * (JAG_SIMPFILE_LIMIT_BYTES/ptab->KEYVALLEN );
 				if ( 1 || cnt > trimLimit ) {
 					trimWalLogFile( ptab, dbname, parseParam.objectVec[0].tableName, 
@@ -964,6 +1014,13 @@ jagint JagDBServer::processCmd(  const JagParseAttribute &jpa, JagRequest &req,
 				// table object or index object
 				ptab = _objectLock->readLockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName,
 													req.session->replicateType, 0 );
+				if ( ptab && ptab->rollupPending() > 0 ) {
+					// count of a rollup table includes its buffered rollups
+					_objectLock->readUnlockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName, req.session->replicateType, 0 );
+					flushRollupBuffer( dbname, parseParam.objectVec[0].tableName, req.session->replicateType );
+					ptab = _objectLock->readLockTable( parseParam.opcode, dbname, parseParam.objectVec[0].tableName,
+														req.session->replicateType, 0 );
+				}
 				if ( !ptab ) {
 					pindex = _objectLock->readLockIndex( parseParam.opcode, dbname, tabName, parseParam.objectVec[0].tableName,
 														  req.session->replicateType, 0 );
@@ -1265,6 +1322,7 @@ int JagDBServer::isValidInternalCommand( const char *mesg )
 	else if ( 0 == strncmp( mesg, "_mon_remote_backuphosts", 23 ) ) return JAG_SCMD_MONBACKUPHOSTS;
 	else if ( 0 == strncmp( mesg, "_mon_local_stat6", 16 ) ) return JAG_SCMD_MONLOCALSTAT;
 	else if ( 0 == strncmp( mesg, "_mon_cluster_stat6", 18 ) ) return JAG_SCMD_MONCLUSTERSTAT;
+	else if ( 0 == strncmp( mesg, "_mon_indexlag", 13 ) ) return JAG_SCMD_MONINDEXLAG;
 	else if ( 0 == strncmp( mesg, "_ex_proclocalbackup", 19 ) ) return JAG_SCMD_EXPROCLOCALBACKUP;
 	else if ( 0 == strncmp( mesg, "_ex_procremotebackup", 20 ) ) return JAG_SCMD_EXPROCREMOTEBACKUP;
 	else if ( 0 == strncmp( mesg, "_ex_restorefromremote", 21 ) ) return JAG_SCMD_EXRESTOREFROMREMOTE;
@@ -1274,6 +1332,8 @@ int JagDBServer::isValidInternalCommand( const char *mesg )
 	else if ( 0 == strncmp( mesg, "_ex_addcluster", 14 ) ) return JAG_SCMD_EXADDCLUSTER;
 	else if ( 0 == strncmp( mesg, "_ex_importtable", 15 ) ) return JAG_SCMD_IMPORTTABLE;
 	else if ( 0 == strncmp( mesg, "_ex_truncatetable", 17 ) ) return JAG_SCMD_TRUNCATETABLE;
+	else if ( 0 == strncmp( mesg, "_ex_ingestsorted", 16 ) ) return JAG_SCMD_INGESTSORTED;
+	else if ( 0 == strncmp( mesg, "_ex_loadcsv", 11 ) ) return JAG_SCMD_LOADCSV;
 	else if ( 0 == strncmp( mesg, "_exe_shutdown", 13 ) ) return JAG_SCMD_EXSHUTDOWN;
 	else if ( 0 == strncmp( mesg, "_getpubkey", 10 ) ) return JAG_SCMD_GETPUBKEY;
 	// more commands to be added
@@ -3555,6 +3615,34 @@ void *JagDBServer::monitorTimeSeries( void *ptr )
    	return NULL;
 }
 
+// applies queued index records of deferred indexes
+// static
+void *JagDBServer::monitorIndexQueue( void *ptr )
+{
+	JagPass *jp = (JagPass*)ptr;
+
+	while ( 1 ) {
+		jagsleep( jp->servobj->_indexDeferInterval, JAG_MSEC );
+		jp->servobj->applyDeferIndexes();
+	}
+
+	delete jp;
+   	return NULL;
+}
+
+void *JagDBServer::monitorRollupBuffers( void *ptr )
+{
+	JagPass *jp = (JagPass*)ptr;
+
+	while ( 1 ) {
+		jagsleep( jp->servobj->_rollupFlushInterval, JAG_MSEC );
+		jp->servobj->flushRollupBuffers();
+	}
+
+	delete jp;
+   	return NULL;
+}
+
 // thread for local doRemoteBackup on host0
 // static
 void * JagDBServer::threadRemoteBackup( void *ptr )
@@ -3684,6 +3772,9 @@ int JagDBServer::mainInit()
 		recoverWalLog();
 		raydebug(stdout, JAG_LOG_LOW, "done recover wallog\n");
 	}
+	_walWriter->start();
+	_deltaWriter->start();
+	_dcWriter->start();
 	// resetWalLog(); // reopen
 
 	// recover un-flushed dinsert data
@@ -3758,6 +3849,24 @@ int JagDBServer::mainInit()
     	pthread_detach( threadmo );
 	}
 
+	if ( _indexDeferred ) {
+    	pthread_t  threadmo;
+		JagPass *jp = new JagPass();
+		jp->servobj = this;
+		raydebug( stdout, JAG_LOG_LOW, "Initializing thread for deferred index\n");
+    	jagpthread_create( &threadmo, NULL, monitorIndexQueue, (void*)jp );
+    	pthread_detach( threadmo );
+	}
+
+	if ( _rollupBuffered ) {
+    	pthread_t  threadmo;
+		JagPass *jp = new JagPass();
+		jp->servobj = this;
+		raydebug( stdout, JAG_LOG_LOW, "Initializing thread for rollup buffers\n");
+    	jagpthread_create( &threadmo, NULL, monitorRollupBuffers, (void*)jp );
+    	pthread_detach( threadmo );
+	}
+
 
 	return 1;
 }
@@ -3766,7 +3875,6 @@ int JagDBServer::mainClose()
 {
 	pthread_mutex_destroy( &g_dbschemamutex );
 	pthread_mutex_destroy( &g_flagmutex );
-	pthread_mutex_destroy( &g_wallogmutex );
 	pthread_mutex_destroy( &g_dlogmutex );
 	pthread_mutex_destroy( &g_dinsertmutex );
 	pthread_mutex_destroy( &g_datacentermutex );
@@ -4704,6 +4812,129 @@ int JagDBServer::initConfigs()
 		raydebug( stdout, JAG_LOG_LOW, "WAL Log %s\n", cs.c_str() );
 	}
 
+	// WAL_DURABILITY: async | write | sync   (default: write)
+	// WAL_FLUSH_INTERVAL: max milliseconds between group writes of the wallog
+	// WAL_BUFFER_SIZE: buffered bytes per wallog file that force a write (MB)
+	cs = _cfg->getValue("WAL_DURABILITY", "write");
+	int walDurability = JagWalWriter::durabilityFromStr( cs );
+	cs = _cfg->getValue("WAL_FLUSH_INTERVAL", "10");
+	int walInterval = atoi( cs.c_str() );
+	cs = _cfg->getValue("WAL_BUFFER_SIZE", "4");
+	jagint walBufBytes = jagatoll( cs.c_str() ) * ONE_MEGA_BYTES;
+	if ( _walWriter ) delete _walWriter;
+	_walWriter = new JagWalWriter( walDurability, walInterval, walBufBytes );
+	_walWriter->setFileHeader( JAG_WAL_FILE_MAGIC );
+	raydebug( stdout, JAG_LOG_LOW, "WAL durability %s flush interval %d ms\n", 
+			  JagWalWriter::durabilityStr(walDurability), walInterval );
+
+	// DELTA_LOG_DURABILITY: async | write | sync   (default: sync)
+	// delta logs of peers that are down and recovery logs are group committed like the wallog
+	cs = _cfg->getValue("DELTA_LOG_DURABILITY", "sync");
+	int deltaDurability = JagWalWriter::durabilityFromStr( cs );
+	if ( _deltaWriter ) delete _deltaWriter;
+	_deltaWriter = new JagWalWriter( deltaDurability, walInterval, walBufBytes );
+	_deltaWriter->setFileHeader( JAG_WAL_FILE_MAGIC );
+	raydebug( stdout, JAG_LOG_LOW, "Delta log durability %s\n", JagWalWriter::durabilityStr(deltaDurability) );
+
+	// DATACENTER_ASYNC: yes: writes to other datacenters are queued on disk and sent in the background
+	// DATACENTER_QUEUE_DURABILITY: async | write | sync   (default: write)
+	// DATACENTER_BATCH: max commands sent to a datacenter in one round
+	// DATACENTER_RETRY_MAX: max seconds between retries of an unreachable datacenter
+	cs = _cfg->getValue("DATACENTER_ASYNC", "yes");
+	_dcAsync = startWith( cs, 'y' );
+	cs = _cfg->getValue("DATACENTER_QUEUE_DURABILITY", "write");
+	int dcDurability = JagWalWriter::durabilityFromStr( cs );
+	cs = _cfg->getValue("DATACENTER_BATCH", "1000");
+	_dcBatchSize = atoi( cs.c_str() );
+	if ( _dcBatchSize < 1 ) _dcBatchSize = 1;
+	cs = _cfg->getValue("DATACENTER_RETRY_MAX", "60");
+	_dcRetryMax = atoi( cs.c_str() );
+	if ( _dcRetryMax < 1 ) _dcRetryMax = 1;
+	if ( _dcWriter ) delete _dcWriter;
+	_dcWriter = new JagWalWriter( dcDurability, walInterval, walBufBytes );
+	_dcWriter->setFileHeader( JAG_WAL_FILE_MAGIC );
+	if ( _dcAsync ) {
+		raydebug( stdout, JAG_LOG_LOW, "Datacenter async replication queue durability %s batch %d\n", 
+				  JagWalWriter::durabilityStr(dcDurability), _dcBatchSize );
+	}
+
+	// INDEX_DEFERRED: yes: index records of inserts are queued and applied in batches
+	// INDEX_DEFER_INTERVAL: milliseconds between background applies of the queues
+	// INDEX_DEFER_MAX: queued records of an index that force an inline apply
+	// INDEX_DEFER_READ_MAX: queued records of an index a reader applies before it reads
+	cs = _cfg->getValue("INDEX_DEFERRED", "no");
+	if ( startWith( cs, 'y' ) ) {
+		_indexDeferred = true;
+	}
+	_indexDeferInterval = _cfg->getIntValue("INDEX_DEFER_INTERVAL", 50);
+	if ( _indexDeferInterval < 1 ) _indexDeferInterval = 1;
+	cs = _cfg->getValue("INDEX_DEFER_MAX", "100000");
+	_indexDeferMax = jagatoll( cs.c_str() );
+	if ( _indexDeferMax < 1 ) _indexDeferMax = 1;
+	cs = _cfg->getValue("INDEX_DEFER_READ_MAX", "10000");
+	_indexDeferReadMax = jagatoll( cs.c_str() );
+	if ( _indexDeferReadMax < 1 ) _indexDeferReadMax = 1;
+	raydebug( stdout, JAG_LOG_LOW, "INDEX_DEFERRED %d interval %d ms max %l read max %l\n", 
+			  (int)_indexDeferred, _indexDeferInterval, _indexDeferMax, _indexDeferReadMax );
+
+	// ROLLUP_BUFFER: yes: rollups of time-series inserts are aggregated in memory per rollup row;
+	//                    a select from a rollup table writes its buffered rows first
+	// ROLLUP_FLUSH_INTERVAL: milliseconds between background flushes of the aggregates to rollup tables
+	// ROLLUP_BUFFER_MAX: buffered rollup rows of a table that force an inline flush
+	cs = _cfg->getValue("ROLLUP_BUFFER", "yes");
+	_rollupBuffered = startWith( cs, 'y' );
+	_rollupFlushInterval = _cfg->getIntValue("ROLLUP_FLUSH_INTERVAL", 1000);
+	if ( _rollupFlushInterval < 1 ) _rollupFlushInterval = 1;
+	cs = _cfg->getValue("ROLLUP_BUFFER_MAX", "100000");
+	_rollupBufferMax = jagatoll( cs.c_str() );
+	if ( _rollupBufferMax < 1 ) _rollupBufferMax = 1;
+	raydebug( stdout, JAG_LOG_LOW, "ROLLUP_BUFFER %d interval %d ms max %l\n", 
+			  (int)_rollupBuffered, _rollupFlushInterval, _rollupBufferMax );
+
+	// ROLLUP_STARS: eager: every '*' combination of the dimension keys is rolled up on insert
+	//               lazy: only the finest rows; a combination is built when it is first queried
+	cs = _cfg->getValue("ROLLUP_STARS", "eager");
+	_rollupLazyStars = startWith( cs, 'l' );
+	raydebug( stdout, JAG_LOG_LOW, "ROLLUP_STARS %s\n", _rollupLazyStars ? "lazy" : "eager" );
+
+	// ROLLUP_ROUTING: yes: aggregate selects of a time-series table are answered from its coarsest matching rollup
+	cs = _cfg->getValue("ROLLUP_ROUTING", "yes");
+	_rollupRouting = startWith( cs, 'y' );
+	raydebug( stdout, JAG_LOG_LOW, "ROLLUP_ROUTING %d\n", (int)_rollupRouting );
+
+	// COUNTER_MERGE: yes: "update t set c=c+n where <all keys>" adds a delta without reading the row
+	cs = _cfg->getValue("COUNTER_MERGE", "yes");
+	_counterMerge = startWith( cs, 'y' );
+	raydebug( stdout, JAG_LOG_LOW, "COUNTER_MERGE %d\n", (int)_counterMerge );
+
+	// RANGE_DELETE: yes: "delete from t where k1=.. [and k2 > ..]" saves the deleted key range
+	// instead of removing rows of data files one by one
+	cs = _cfg->getValue("RANGE_DELETE", "yes");
+	_rangeDelete = startWith( cs, 'y' );
+	raydebug( stdout, JAG_LOG_LOW, "RANGE_DELETE %d\n", (int)_rangeDelete );
+
+	// TIMESERIES_PARTITION: no or a period such as 1d: new data files of a time-series table hold
+	// one period each, so retention removes whole files of expired periods
+	cs = _cfg->getValue("TIMESERIES_PARTITION", "no");
+	if ( ! startWith( cs, 'n' ) ) {
+		_timeSeriesPartition = JagSchemaRecord::getRetentionSeconds( cs );
+		if ( _timeSeriesPartition < 0 ) _timeSeriesPartition = 0;
+	}
+	raydebug( stdout, JAG_LOG_LOW, "TIMESERIES_PARTITION %l seconds\n", (jagint)_timeSeriesPartition );
+
+	// BLOCK_COMPRESS: no, yes (all tables) or db.table names separated by comma: data files of
+	// the tables are written as snappy compressed blocks. Existing files convert when they are merged
+	cs = _cfg->getValue("BLOCK_COMPRESS", "no");
+	if ( startWith( cs, 'y' ) ) {
+		_blockCompressAll = true;
+	} else if ( ! startWith( cs, 'n' ) ) {
+		JagStrSplit sp( cs, ',', true );
+		for ( int i = 0; i < sp.length(); ++i ) {
+			_blockCompressTables.append( trimChar( sp[i], ' ' ) );
+		}
+	}
+	raydebug( stdout, JAG_LOG_LOW, "BLOCK_COMPRESS %s\n", cs.c_str() );
+
 	cs = _cfg->getValue("FLUSH_WAIT", "1");
 	_flushWait = atoi( cs.c_str() );
 
@@ -4763,27 +4994,46 @@ void JagDBServer::dinsertlogCommand( JagSession *session, const char *mesg, jagi
 // spMode = 0 : special cmds, create/drop etc. 
 // spMode = 1 : single regular cmds, update/delete etc.
 // spMode = 2 : batch regular cmds, insert/cinsert/dinsert etc. 
-void JagDBServer::logCommand( const JagParseParam *pparam, JagSession *session, const char *mesg, jagint msglen, int spMode )
+// return 1: logged  0: wallog write error
+int JagDBServer::logCommand( const JagParseParam *pparam, JagSession *session, const char *mesg, jagint msglen, int spMode ) const
 {
 	Jstr db = pparam->objectVec[0].dbName;
 	Jstr tab = pparam->objectVec[0].tableName;
-	if ( db.size() < 1 || tab.size() <1 ) { return; }
+	if ( db.size() < 1 || tab.size() <1 ) { return 1; }
+
+	Jstr fpath = _cfg->getWalLogHOME() + "/" + db + "." + tab + ".wallog";
 
-	JAG_BLURT jaguar_mutex_lock ( &g_wallogmutex ); JAG_OVER;
+	int isInsert;
+	if ( 2==spMode ) isInsert = 1; else isInsert = 0;
+	JagWalRecord rec;
+	rec.addSQL( session->replicateType, session->timediff, isInsert, mesg, msglen );
+	// group commit: concurrent sessions share one write/sync of the wallog
+	if ( ! _walWriter->append( fpath, rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "error write wallog %s\n", fpath.c_str() );
+		return 0;
+	}
+	return 1;
+}
 
+// log encoded insert pairs of table db.tab to its wallog
+// replay applies them to the table without parsing
+// return 1: logged  0: wallog write error
+int JagDBServer::logInsertPairs( const Jstr &db, const Jstr &tab, const JagSession *session, 
+								  const JagVector<JagDBPair> &pairVec ) const
+{
+	if ( pairVec.size() < 1 ) return 1;
 	Jstr fpath = _cfg->getWalLogHOME() + "/" + db + "." + tab + ".wallog";
 
-	FILE *walFile = _walLogMap.ensureFile( fpath );
-	if ( NULL == walFile ) {
-		raydebug( stdout, JAG_LOG_LOW, "error open wallog %s\n", fpath.c_str() );
-	} else {
-		int isInsert;
-		if ( 2==spMode ) isInsert = 1; else isInsert = 0;
-		fprintf( walFile, "%d;%d;%d;%010ld%s",
-		         session->replicateType, session->timediff, isInsert, msglen, mesg );
-	    fflush( walFile );
+	JagWalRecord rec;
+	for ( int i = 0; i < pairVec.size(); ++i ) {
+		rec.addKV( session->replicateType, session->timediff, pairVec[i].key.s(), pairVec[i].key.size(),
+				   pairVec[i].value.s(), pairVec[i].value.size() );
+	}
+	if ( ! _walWriter->append( fpath, rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "error write wallog %s\n", fpath.c_str() );
+		return 0;
 	}
-	JAG_BLURT jaguar_mutex_unlock ( &g_wallogmutex ); 
+	return 1;
 }
 
 // log command to the recovery log file
@@ -4791,31 +5041,25 @@ void JagDBServer::logCommand( const JagParseParam *pparam, JagSession *session,
 // spMode = 2 : batch regular cmds, insert/cinsert/dinsert etc. 
 void JagDBServer::regSplogCommand( JagSession *session, const char *mesg, jagint len, int spMode )
 {
-	// logformat
-	// JAG_REDO_MSGLEN is 10, %010ld--> prepend 0, max 10 long digits 
-	JAG_BLURT jaguar_mutex_lock ( &g_dlogmutex ); JAG_OVER;
-	if ( 0 == spMode && session->servobj->_recoverySpCommandFile ) {
-		fprintf( session->servobj->_recoverySpCommandFile, "%d;%d;0;%010ld%s",
-			     session->replicateType, session->timediff, len, mesg );
-		jagfdatasync( fileno(session->servobj->_recoverySpCommandFile ) );
-	} else if ( 0 != spMode && session->servobj->_recoveryRegCommandFile ) {
-		fprintf( session->servobj->_recoverySpCommandFile, "%d;%d;%d;%010ld%s",
-			     session->replicateType, session->timediff, 2==spMode, len, mesg );
-		if ( 2 == spMode ) {
-			jagfdatasync( fileno(session->servobj->_recoveryRegCommandFile ) );
-		}
+	JagDBServer *servobj = session->servobj;
+	const Jstr &fpath = ( 0 == spMode ) ? servobj->_recoverySpCmdPath : servobj->_recoveryRegCmdPath;
+	if ( fpath.size() < 1 ) return;
+
+	// binary SQL record, group committed with other sessions
+	JagWalRecord rec;
+	rec.addSQL( session->replicateType, session->timediff, 2==spMode, mesg, len );
+	if ( ! servobj->_deltaWriter->append( fpath, rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "error write recovery log %s\n", fpath.c_str() );
 	}
-	jaguar_mutex_unlock ( &g_dlogmutex );
 }
 
 // mode: replicateType 012 0: YYY; 1: YYN; 2: YNY; 3: YNN; 4: NYY; 5: NYN; 6: NNY;
+// the command is appended to the delta log of each peer that missed it; appends of concurrent
+// sessions to one delta log share a write and sync (group commit)
 void JagDBServer::deltalogCommand( int mode, JagSession *session, const char *mesg, bool isBatch )
 {	
-	JAG_BLURT jaguar_mutex_lock ( &g_dlogmutex ); JAG_OVER;
-	int rc, needSync = 0;
+	int rc;
 	Jstr cmd;
-	FILE *f1 = NULL;
-	FILE *f2 = NULL;
 	
 	if ( !isBatch ) { // not batch command, parse and rebuild cmd with dbname inside
 		Jstr reterr;
@@ -4827,147 +5071,167 @@ void JagDBServer::deltalogCommand( int mode, JagSession *session, const char *me
 		if ( rc ) {
 			cmd = parseParam.dbNameCmd;
 		}
-		if ( parseParam.opcode != JAG_UPDATE_OP && parseParam.opcode != JAG_DELETE_OP ) {
-			needSync = 1;
-		}
 	} else { // batch command, insert/cinsert/dinsert
 		cmd = mesg;
-		needSync = 1;
 	}
 	
-	if ( session->servobj->_faultToleranceCopy == 2 ) {
+	if ( _faultToleranceCopy == 2 ) {
 		if ( 1 == mode ) mode = 0;
 		else if ( 3 == mode ) mode = 2;
 		else if ( 5 == mode ) mode = 4;
 	}
 
 	// store to correct delta files
+	Jstr f1, f2;
+	pthread_rwlock_rdlock( &_deltaPathLock );
 	if ( 1 == mode ) {
 		if ( 0 == session->replicateType ) {
-			f1 = session->servobj->_delPrevRepCommandFile;
+			f1 = _actdelPRpath;
 		} else if ( 1 == session->replicateType ) {
-			f1 = session->servobj->_delPrevOriRepCommandFile;
+			f1 = _actdelPORpath;
 		} 
 	} else if ( 2 == mode ) {
 		if ( 0 == session->replicateType ) {
-			f1 = session->servobj->_delNextRepCommandFile;
+			f1 = _actdelNRpath;
 		} else if ( 2 == session->replicateType ) {
-			f1 = session->servobj->_delNextOriRepCommandFile;
+			f1 = _actdelNORpath;
 		} 
 	} else if ( 3 == mode ) {
 		if ( 0 == session->replicateType ) {
-			f1 = session->servobj->_delPrevRepCommandFile;
-			f2 = session->servobj->_delNextRepCommandFile;
+			f1 = _actdelPRpath;
+			f2 = _actdelNRpath;
 		} 
 	} else if ( 4 == mode ) {
 		if ( 1 == session->replicateType ) {
-			f1 = session->servobj->_delPrevOriCommandFile;
+			f1 = _actdelPOpath;
 		} else if ( 2 == session->replicateType ) {
-			f1 = session->servobj->_delNextOriCommandFile;		
+			f1 = _actdelNOpath;
 		} 
 	} else if ( 5 == mode ) {
 		if ( 1 == session->replicateType ) {
-			f1 = session->servobj->_delPrevOriCommandFile;
-			f2 = session->servobj->_delPrevOriRepCommandFile;
+			f1 = _actdelPOpath;
+			f2 = _actdelPORpath;
 		}
 	} else if ( 6 == mode ) {
 		if ( 2 == session->replicateType ) {
-			f1 = session->servobj->_delNextOriCommandFile;
-			f2 = session->servobj->_delNextOriRepCommandFile;
+			f1 = _actdelNOpath;
+			f2 = _actdelNORpath;
 		}
 	}
+	pthread_rwlock_unlock( &_deltaPathLock );
 	
-	// deltalogformat
-	if ( f1 ) {
-		fprintf( f1, "%d;%d;%s\n", session->timediff, isBatch, cmd.c_str() );
-	}
-	if ( f2 ) {
-		fprintf( f2, "%d;%d;%s\n", session->timediff, isBatch, cmd.c_str() );
+	if ( f1.size() < 1 && f2.size() < 1 ) return;
+
+	JagWalRecord rec;
+	rec.addSQL( session->replicateType, session->timediff, isBatch, cmd.c_str(), cmd.size() );
+	if ( f1.size() > 0 && ! _deltaWriter->append( f1 + ".bin", rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "error write delta log %s\n", f1.c_str() );
 	}
-	if ( needSync ) {
-		if ( f1 ) {
-			jagfdatasync( fileno( f1 ) );
-		}
-		if ( f2 ) {
-			jagfdatasync( fileno( f2 ) );
-		}
-		if ( 0 == session->replicateType && ! session->origserv ) {
-			// if ( f1 || f2 ) JagStrSplitWithQuote split( mesg, ';' );
-		}
+	if ( f2.size() > 0 && ! _deltaWriter->append( f2 + ".bin", rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "error write delta log %s\n", f2.c_str() );
 	}
-
-	jaguar_mutex_unlock ( &g_dlogmutex );
 }
 
 // method to recover delta log immediately after delta log written, if connection has already been recovered
+// binary records of all delta logs are moved to their text files, which are replayed to the peers together
 void JagDBServer::onlineRecoverDeltaLog()
 {
 	if ( _faultToleranceCopy <= 1 ) return; // no replicate
 	Jstr fpaths;
-	// use client to recover delta log
-	if ( _delPrevOriCommandFile && JagFileMgr::fileSize(_actdelPOpath) > 0 ) {
-		if ( fpaths.size() < 1 ) fpaths = _actdelPOpath;
-		else fpaths += Jstr("|") + _actdelPOpath;
-		jagfclose( _delPrevOriCommandFile );
-		_delPrevOriCommandFile = NULL;
-	}
-	if ( _delPrevRepCommandFile && JagFileMgr::fileSize(_actdelPRpath) > 0 ) { 
-		if ( fpaths.size() < 1 ) fpaths = _actdelPRpath;
-		else fpaths += Jstr("|") + _actdelPRpath;
-		jagfclose( _delPrevRepCommandFile );
-		_delPrevRepCommandFile = NULL;
-	}
-	if ( _delPrevOriRepCommandFile && JagFileMgr::fileSize(_actdelPORpath) > 0 ) {
-		if ( fpaths.size() < 1 ) fpaths = _actdelPORpath;
-		else fpaths += Jstr("|") + _actdelPORpath;
-		jagfclose( _delPrevOriRepCommandFile );
-		_delPrevOriRepCommandFile = NULL;
-	}
-	if ( _delNextOriCommandFile && JagFileMgr::fileSize(_actdelNOpath) > 0 ) {
-		if ( fpaths.size() < 1 ) fpaths = _actdelNOpath;
-		else fpaths += Jstr("|") + _actdelNOpath;
-		jagfclose( _delNextOriCommandFile );
-		_delNextOriCommandFile = NULL;
-	}
-	if ( _delNextRepCommandFile && JagFileMgr::fileSize(_actdelNRpath) > 0 ) {
-		if ( fpaths.size() < 1 ) fpaths = _actdelNRpath;
-		else fpaths += Jstr("|") + _actdelNRpath;
-		jagfclose( _delNextRepCommandFile );
-		_delNextRepCommandFile = NULL;
-	}
-	if ( _delNextOriRepCommandFile && JagFileMgr::fileSize(_actdelNORpath) > 0 ) {
-		if ( fpaths.size() < 1 ) fpaths = _actdelNORpath;
-		else fpaths += Jstr("|") + _actdelNORpath;
-		jagfclose( _delNextOriRepCommandFile );
-		_delNextOriRepCommandFile = NULL;
+	pthread_rwlock_rdlock( &_deltaPathLock );
+	const Jstr *paths[6] = { &_actdelPOpath, &_actdelPRpath, &_actdelPORpath, 
+							 &_actdelNOpath, &_actdelNRpath, &_actdelNORpath };
+	for ( int i = 0; i < 6; ++i ) {
+		if ( paths[i]->size() < 1 ) continue;
+		convertDeltaLog( *paths[i] );
+		if ( JagFileMgr::fileSize( *paths[i] ) > 0 ) {
+			if ( fpaths.size() < 1 ) fpaths = *paths[i];
+			else fpaths += Jstr("|") + *paths[i];
+		}
 	}
+	pthread_rwlock_unlock( &_deltaPathLock );
 
 	if ( fpaths.size() > 0 ) { // has delta files, recover using delta
 		raydebug( stdout, JAG_LOG_LOW, "begin online recoverDeltaLog %s ...\n", fpaths.c_str() );
 		_dbConnector->_parentCli->recoverDeltaLog( fpaths );
 		raydebug( stdout, JAG_LOG_LOW, "end online recoverDeltaLog\n");
 	}
+}
+
+// Move binary records of delta log fpath.bin to the end of text file fpath, the replay input
+// of the client: timediff;isBatch;command\n
+// The binary log is renamed first; appends wait only for the rename.
+// A torn or corrupt record ends the binary log.
+// return number of commands moved
+jagint JagDBServer::convertDeltaLog( const Jstr &fpath )
+{
+	Jstr binpath = fpath + ".bin";
+	Jstr replaypath = binpath + "_replay";
+	// replay file left by an earlier round is moved before newer records
+	if ( ! JagFileMgr::exist( replaypath ) ) {
+		if ( JagFileMgr::fileSize( binpath ) <= JAG_WAL_FILE_MAGIC_LEN ) return 0;
+		_deltaWriter->suspendFile( binpath );
+		jagrename( binpath.s(), replaypath.s() );
+		_deltaWriter->resumeFile( binpath );
+	}
 
-	if ( !_delPrevOriCommandFile ) {
-		_delPrevOriCommandFile = loopOpen( _actdelPOpath.c_str(), "ab" );
+	FILE *fp = fopen( replaypath.s(), "rb" );
+	if ( ! fp ) return 0;
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+	if ( fread( magic, 1, JAG_WAL_FILE_MAGIC_LEN, fp ) != JAG_WAL_FILE_MAGIC_LEN 
+	     || 0 != memcmp( magic, JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN ) ) {
+		fclose( fp );
+		jagunlink( replaypath.s() );
+		return 0;
 	}
-	if ( !_delNextRepCommandFile ) {
-		_delNextRepCommandFile = loopOpen( _actdelNRpath.c_str(), "ab" );
+
+	FILE *outfp = loopOpen( fpath.c_str(), "ab" );
+	if ( ! outfp ) {
+		fclose( fp );
+		return 0;
 	}
-	if ( 3 == _faultToleranceCopy ) {
-		if ( !_delPrevRepCommandFile ) {
-			_delPrevRepCommandFile = loopOpen( _actdelPRpath.c_str(), "ab" );
-		}
-		if ( !_delPrevOriRepCommandFile ) {
-			_delPrevOriRepCommandFile = loopOpen( _actdelPORpath.c_str(), "ab" );
-		}
-		if ( !_delNextOriCommandFile ) {
-			_delNextOriCommandFile = loopOpen( _actdelNOpath.c_str(), "ab" );
-		}
-		if ( !_delNextOriRepCommandFile ) {
-			_delNextOriRepCommandFile = loopOpen( _actdelNORpath.c_str(), "ab" );
+
+	char *body = NULL;
+	jagint bodycap = 0, bodylen = 0, plen, cnt = 0;
+	char type;
+	int  replicateType, timediff, rc;
+	const char *payload;
+	while ( 1 ) {
+		rc = JagWalRecord::readRecord( fp, body, bodycap, bodylen );
+		if ( 0 == rc ) break;
+		if ( rc < 0 || ! JagWalRecord::parseBody( body, bodylen, type, replicateType, timediff, payload, plen )
+			 || JAG_WAL_REC_SQL != type ) {
+			raydebug( stdout, JAG_LOG_LOW, "E20287 torn or corrupt record in delta log [%s] after %l records\n", 
+					  binpath.s(), cnt );
+			break;
 		}
+		fprintf( outfp, "%d;%d;", timediff, (int)payload[0] );
+		fwrite( payload+1, 1, plen-1, outfp );
+		fputc( '\n', outfp );
+		++cnt;
 	}
+	if ( body ) free( body );
+	fclose( fp );
+
+	fflush( outfp );
+	jagfdatasync( fileno( outfp ) );
+	jagfclose( outfp );
+	jagunlink( replaypath.s() );
+	return cnt;
+}
+
+// bytes of commands in delta log fpath, text and binary
+jagint JagDBServer::deltaLogSize( const Jstr &fpath ) const
+{
+	if ( fpath.size() < 1 ) return 0;
+	jagint sz = 0, n;
+	n = JagFileMgr::fileSize( fpath );
+	if ( n > 0 ) sz += n;
+	n = JagFileMgr::fileSize( fpath + ".bin" );
+	if ( n > JAG_WAL_FILE_MAGIC_LEN ) sz += n - JAG_WAL_FILE_MAGIC_LEN;
+	n = JagFileMgr::fileSize( fpath + ".bin_replay" );
+	if ( n > 0 ) sz += n;
+	return sz;
 }
 
 // close and reopen delta log file, for replicate use only
@@ -5009,76 +5273,45 @@ void JagDBServer::resetDeltaLog()
 	host3 = sp[pos3];
 	host4 = sp[pos4];
 	
+	// delta logs are opened by _deltaWriter on first append
+	pthread_rwlock_wrlock( &_deltaPathLock );
 	if ( _faultToleranceCopy == 2 ) {
-		if ( _delPrevOriCommandFile ) {
-			jagfclose( _delPrevOriCommandFile );
-		}
-		if ( _delNextRepCommandFile ) {
-			jagfclose( _delNextRepCommandFile );
-		}
-		
 		fpath = deltahome + "/" + host2 + "_0";
-		_delPrevOriCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelPOpath = fpath;
 		_actdelPOhost = host2;
 		
 		fpath = deltahome + "/" + host0 + "_1";	
-		_delNextRepCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelNRpath = fpath;
 		_actdelNRhost = host1;
 	} else if ( _faultToleranceCopy == 3 ) {
-		if ( _delPrevOriCommandFile ) {
-			jagfclose( _delPrevOriCommandFile );
-		}
-		if ( _delPrevRepCommandFile ) {
-			jagfclose( _delPrevRepCommandFile );
-		}
-		if ( _delPrevOriRepCommandFile ) {
-			jagfclose( _delPrevOriRepCommandFile );
-		}
-		if ( _delNextOriCommandFile ) {
-			jagfclose( _delNextOriCommandFile );
-		}
-		if ( _delNextRepCommandFile ) {
-			jagfclose( _delNextRepCommandFile );
-		}
-		if ( _delNextOriRepCommandFile ) {
-			jagfclose( _delNextOriRepCommandFile );
-		}
-		
 		fpath = deltahome + "/" + host2 + "_0";
-		_delPrevOriCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelPOpath = fpath;
 		_actdelPOhost = host2;
 		fpath = deltahome + "/" + host0 + "_2";
-		_delPrevRepCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelPRpath = fpath;
 		_actdelPRhost = host2;
 		fpath = deltahome + "/" + host2 + "_2";
-		_delPrevOriRepCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelPORpath = fpath;
 		_actdelPORhost = host4; 
 		fpath = deltahome + "/" + host1 + "_0";
-		_delNextOriCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelNOpath = fpath;
 		_actdelNOhost = host1;
 		fpath = deltahome + "/" + host0 + "_1";
-		_delNextRepCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelNRpath = fpath;
 		_actdelNRhost = host1;
 		fpath = deltahome + "/" + host1 + "_1";
-		_delNextOriRepCommandFile = loopOpen( fpath.c_str(), "ab" );
 		_actdelNORpath = fpath;
 		_actdelNORhost = host3;
 	}
+	pthread_rwlock_unlock( &_deltaPathLock );
 	raydebug( stdout, JAG_LOG_LOW, "end resetDeltaLog\n");
 }
 
 int JagDBServer::checkDeltaFileStatus()
 {
-	if ( JagFileMgr::fileSize(_actdelPOpath) > 0 || JagFileMgr::fileSize(_actdelPRpath) > 0 ||
-		 JagFileMgr::fileSize(_actdelPORpath) > 0 || JagFileMgr::fileSize(_actdelNOpath) > 0 ||
-		 JagFileMgr::fileSize(_actdelNRpath) > 0 || JagFileMgr::fileSize(_actdelNORpath) > 0 ) {
+	if ( deltaLogSize(_actdelPOpath) > 0 || deltaLogSize(_actdelPRpath) > 0 ||
+		 deltaLogSize(_actdelPORpath) > 0 || deltaLogSize(_actdelNOpath) > 0 ||
+		 deltaLogSize(_actdelNRpath) > 0 || deltaLogSize(_actdelNORpath) > 0 ) {
 		// has delta content
 		return 1;
 	} else {
@@ -5389,20 +5622,16 @@ void JagDBServer::resetRegSpLog()
 	raydebug( stdout, JAG_LOG_LOW, "begin reset data/schema log\n" );
 	
     Jstr deltahome = JagFileMgr::getLocalLogDir("delta");
-    Jstr fpath = deltahome + "/redodata.log";
-    if ( _recoveryRegCommandFile ) {
-        jagfclose( _recoveryRegCommandFile );
-    }
-    if ( _recoverySpCommandFile ) {
-        jagfclose( _recoverySpCommandFile );
-    }
-	
-	_recoveryRegCmdPath = fpath;
-    _recoveryRegCommandFile = loopOpen( fpath.c_str(), "ab" );
-	
-	fpath = deltahome + "/redometa.log";
-	_recoverySpCmdPath = fpath;
-    _recoverySpCommandFile = loopOpen( fpath.c_str(), "ab" );
+	_recoveryRegCmdPath = deltahome + "/redodata.log";
+	_recoverySpCmdPath = deltahome + "/redometa.log";
+
+	// logs written in text format by older version take binary records from now on
+	if ( JagFileMgr::fileSize( _recoveryRegCmdPath ) > 0 && ! JagWalRecord::isBinaryLog( _recoveryRegCmdPath ) ) {
+		convertLegacyWalLog( _recoveryRegCmdPath );
+	}
+	if ( JagFileMgr::fileSize( _recoverySpCmdPath ) > 0 && ! JagWalRecord::isBinaryLog( _recoverySpCmdPath ) ) {
+		convertLegacyWalLog( _recoverySpCmdPath );
+	}
 	raydebug( stdout, JAG_LOG_LOW, "end reset data/schema log\n" );
 }
 
@@ -5415,34 +5644,44 @@ void JagDBServer::recoverRegSpLog()
 	JAG_BLURT jaguar_mutex_lock ( &g_flagmutex ); JAG_OVER;
 
 	// check sp command first
-	if ( _recoverySpCommandFile && JagFileMgr::fileSize(_recoverySpCmdPath) > 0 ) {
-		jagfclose( _recoverySpCommandFile );
-		_recoverySpCommandFile = NULL;
-		raydebug( stdout, JAG_LOG_LOW, "begin redo metadata [%s] ...\n", _recoverySpCmdPath.c_str() );
-		cnt = redoWalLog( _recoverySpCmdPath );
-		raydebug( stdout, JAG_LOG_LOW, "end redo metadata [%s] count=%l\n", _recoverySpCmdPath.c_str(), cnt );
-		jagunlink( _recoverySpCmdPath.c_str() );
-		_recoverySpCommandFile = loopOpen( _recoverySpCmdPath.c_str(), "ab" );
-	}
+	raydebug( stdout, JAG_LOG_LOW, "begin redo metadata [%s] ...\n", _recoverySpCmdPath.c_str() );
+	cnt = redoRecoveryLog( _recoverySpCmdPath );
+	raydebug( stdout, JAG_LOG_LOW, "end redo metadata [%s] count=%l\n", _recoverySpCmdPath.c_str(), cnt );
 
 	// unlock global lock
 	_restartRecover = 0;
 	jaguar_mutex_unlock ( &g_flagmutex );
 
 	// check reg command to redo log
-	if ( _recoveryRegCommandFile && JagFileMgr::fileSize(_recoveryRegCmdPath) > 0 ) {
-		jagfclose( _recoveryRegCommandFile );
-		_recoveryRegCommandFile = NULL;
-		raydebug( stdout, JAG_LOG_LOW, "begin redo data [%s] ...\n", _recoveryRegCmdPath.c_str() );
-		cnt = redoWalLog( _recoveryRegCmdPath );
-		raydebug( stdout, JAG_LOG_LOW, "end redo data [%s] count=%l\n", _recoveryRegCmdPath.c_str(), cnt );
-		jagunlink( _recoveryRegCmdPath.c_str() );
-		_recoveryRegCommandFile = loopOpen( _recoveryRegCmdPath.c_str(), "ab" );
-	}
+	raydebug( stdout, JAG_LOG_LOW, "begin redo data [%s] ...\n", _recoveryRegCmdPath.c_str() );
+	cnt = redoRecoveryLog( _recoveryRegCmdPath );
+	raydebug( stdout, JAG_LOG_LOW, "end redo data [%s] count=%l\n", _recoveryRegCmdPath.c_str(), cnt );
 
 	raydebug( stdout, JAG_LOG_LOW, "end redo data and schema\n" );
 }
 
+// redo binary recovery log fpath; the log is renamed first so that commands logged
+// meanwhile go to a new log
+jagint JagDBServer::redoRecoveryLog( const Jstr &fpath )
+{
+	Jstr redopath = fpath + "_replay";
+	jagint cnt = 0;
+	if ( JagFileMgr::exist( redopath ) ) {
+		// left by an interrupted redo
+		cnt += redoBinaryWalLog( redopath );
+		jagunlink( redopath.s() );
+	}
+
+	if ( JagFileMgr::fileSize( fpath ) > JAG_WAL_FILE_MAGIC_LEN ) {
+		_deltaWriter->suspendFile( fpath );
+		jagrename( fpath.s(), redopath.s() );
+		_deltaWriter->resumeFile( fpath );
+		cnt += redoBinaryWalLog( redopath );
+		jagunlink( redopath.s() );
+	}
+	return cnt;
+}
+
 // open new dinsert active log
 void JagDBServer::resetDinsertLog()
 {
@@ -5562,6 +5801,7 @@ jagint JagDBServer::redoDinsertLog( const Jstr &fpath )
 }
 
 // read uncommited logs in cmd/ dir and execute them
+// each table has its own wallog, so logs are replayed by a pool of workers (WAL_RECOVER_THREADS)
 void JagDBServer::recoverWalLog( )
 {
 	if ( ! _walLog ) return;
@@ -5570,14 +5810,180 @@ void JagDBServer::recoverWalLog( )
 	Jstr fpath;
 	Jstr fileNames = JagFileMgr::listObjects( walpath, ".wallog" );
 	JagStrSplit sp( fileNames, '|');
+	std::vector< std::pair<jagint, Jstr> > files;
 	for ( int i=0; i < sp.size(); ++i ) {
 		fpath = walpath + "/" + sp[i];
+		if ( JagFileMgr::fileSize( fpath ) <= 0 ) continue;
+
+		if ( ! JagWalRecord::isBinaryLog( fpath ) ) {
+			// wallog written by older version in text format
+			jagint ccnt = convertLegacyWalLog( fpath );
+			raydebug( stdout, JAG_LOG_LOW, "converted text wallog %s cnt=%l\n",  fpath.c_str(), ccnt );
+		}
+		files.push_back( std::make_pair( JagFileMgr::fileSize( fpath ), fpath ) );
+	}
+	if ( files.size() < 1 ) return;
+
+	// largest logs first so that workers finish about the same time
+	std::sort( files.begin(), files.end(), 
+			   []( const std::pair<jagint,Jstr> &a, const std::pair<jagint,Jstr> &b ) { return a.first > b.first; } );
+
+	JagVector<Jstr> fpaths;
+	JagVector<jagint> fsizes;
+	jagint totalBytes = 0;
+	for ( int i=0; i < files.size(); ++i ) {
+		fsizes.append( files[i].first );
+		fpaths.append( files[i].second );
+		totalBytes += files[i].first;
+	}
+
+	int numThreads = _cfg->getIntValue("WAL_RECOVER_THREADS", 0 );
+	if ( numThreads < 1 ) numThreads = _numCPUs;
+	if ( numThreads > fpaths.size() ) numThreads = fpaths.size();
+	if ( numThreads < 1 ) numThreads = 1;
+	raydebug( stdout, JAG_LOG_LOW, "recover %d wallog files %l bytes with %d threads ...\n", 
+			  (int)fpaths.size(), totalBytes, numThreads );
+
+	std::atomic<jagint> nextFile(0), doneFiles(0), doneBytes(0), doneRecords(0);
+	JagRecoverPass pass;
+	pass.servobj = this;
+	pass.fpaths = &fpaths;
+	pass.fsizes = &fsizes;
+	pass.nextFile = &nextFile;
+	pass.doneFiles = &doneFiles;
+	pass.doneBytes = &doneBytes;
+	pass.doneRecords = &doneRecords;
+	pass.totalBytes = totalBytes;
+
+	if ( 1 == numThreads ) {
+		recoverWalLogWorker( (void*)&pass );
+	} else {
+		pthread_t thr[numThreads];
+		for ( int i = 0; i < numThreads; ++i ) {
+			jagpthread_create( &thr[i], NULL, recoverWalLogWorker, (void*)&pass );
+		}
+		for ( int i = 0; i < numThreads; ++i ) {
+			pthread_join( thr[i], NULL );
+		}
+	}
+
+	raydebug( stdout, JAG_LOG_LOW, "recovered %l wallog files %l records\n", (jagint)doneFiles, (jagint)doneRecords );
+}
+
+// static: take next wallog from the shared list until all are replayed
+void *JagDBServer::recoverWalLogWorker( void *ptr )
+{
+	JagRecoverPass *pass = (JagRecoverPass*)ptr;
+	jagint total = pass->fpaths->size();
+	while ( 1 ) {
+		jagint i = (*pass->nextFile)++;
+		if ( i >= total ) break;
+
+		const Jstr &fpath = (*pass->fpaths)[i];
 		raydebug( stdout, JAG_LOG_LOW, "begin redoWalLog %s ...\n",  fpath.c_str() );
+		jagint cnt = pass->servobj->redoBinaryWalLog( fpath );
+
+		jagint files = ++(*pass->doneFiles);
+		jagint bytes = ( *pass->doneBytes += (*pass->fsizes)[i] );
+		*pass->doneRecords += cnt;
+		raydebug( stdout, JAG_LOG_LOW, "end redoWalLog %s cnt=%l  progress %l/%l files %l%% bytes\n",  
+				  fpath.c_str(), cnt, files, total, 
+				  pass->totalBytes > 0 ? bytes*100/pass->totalBytes : 100 );
+	}
+	return NULL;
+}
+
+// read one text log record from fd
+// replicateType;client_timediff;isBatch;ddddddddddqstr
+// msg is allocated and must be freed by caller
+// return 1: got record  0: end of log or bad record
+int JagDBServer::readTextLogRecord( int fd, int &replicateType, int &timediff, int &isBatch, char *&msg, jagint &msglen )
+{
+	char buf16[17];
+	char c;
+	int i;
 
-		jagint cnt = redoWalLog( fpath );
+	msg = NULL;
+	i = 0;
+	memset( buf16, 0, 4 );
+	while( 1==read(fd, &c, 1) ) {
+		buf16[i] = c;
+		if ( c == ';' ) {
+			buf16[i] =  '\0';
+			break;
+		} else {
+			if ( i > 0 ) {
+				return 0;
+			}
+		}
+		++i;
+	}
+
+	if ( buf16[0] == '\0' ) {
+		return 0;
+	}
+	if ( buf16[0] != '0' && buf16[0] != '1' && buf16[0] != '2' ) {
+		return 0;
+	}
+	replicateType = atoi( buf16 );
+
+	// get time zone diff
+	i = 0;
+	memset( buf16, 0, 17 );
+	while( 1==read(fd, &c, 1) ) {
+		buf16[i] = c;
+		if ( c == ';' ) {
+			buf16[i] =  '\0';
+			break;
+		} else {
+			if ( i > 15 ) {
+				return 0;
+			}
+		}
+		++i;
+	}
+	if ( buf16[0] == '\0' ) {
+		return 0;
+	}
+	timediff = atoi( buf16 );
+
+	// get isBatch
+	i = 0;
+	memset( buf16, 0, 4 );
+	while( 1==read(fd, &c, 1) ) {
+		buf16[i] = c;
+		if ( c == ';' ) {
+			buf16[i] =  '\0';
+			break;
+		} else {
+			if ( i > 0 ) {
+				return 0;
+			}
+		}
+		++i;
+	}
+
+	if ( buf16[0] == '\0' ) {
+		return 0;
+	}
+	isBatch = atoi( buf16 );
+
+	// get mesg len
+	memset( buf16, 0, JAG_REDO_MSGLEN+1 );
+	if ( raysaferead( fd, buf16, JAG_REDO_MSGLEN ) < JAG_REDO_MSGLEN ) {
+		return 0;
+	}
+	msglen = jagatoll( buf16 );
+	if ( msglen < 0 ) return 0;
 
-		raydebug( stdout, JAG_LOG_LOW, "end redoWalLog %s cnt=%l\n",  fpath.c_str(), cnt );
+	msg = (char*)jagmalloc(msglen+1);
+	memset(msg, 0, msglen+1);
+	if ( raysaferead( fd, msg, msglen ) < msglen ) {
+		free( msg );
+		msg = NULL;
+		return 0;
 	}
+	return 1;
 }
 
 // execute commands in fpath one by one
@@ -5588,13 +5994,12 @@ jagint JagDBServer::redoWalLog( const Jstr &fpath )
 		return 0;
 	}
 
-	int i, fd = jagopen( fpath.c_str(), O_RDONLY|JAG_NOATIME );
+	int fd = jagopen( fpath.c_str(), O_RDONLY|JAG_NOATIME );
 	if ( fd < 0 ) return 0;
 
-	char buf16[17];
 	jagint len;
-	char c;
 	char *buf = NULL;
+	int  replicateType, timediff, isBatch;
 	JagRequest req;
 	JagSession session;
 	req.hasReply = false;
@@ -5606,105 +6011,179 @@ jagint JagDBServer::redoWalLog( const Jstr &fpath )
 	session.drecoverConn = 3;
 
 	jagint cnt = 0;
-	while ( 1 ) {
-		i = 0;
-		memset( buf16, 0, 4 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 0 ) {
-					jagclose( fd );
-					return cnt;
-				}
-			}
-			++i;
-		}
-
-		if ( buf16[0] == '\0' ) {
-			break;
-		}
-		session.replicateType = atoi( buf16 );
-		if ( buf16[0] != '0' && buf16[0] != '1' && buf16[0] != '2' ) {
-			raydebug( stdout, JAG_LOG_LOW, "Error in wal file [%s]. Please fix it and then restart jaguardb. cnt=%lld\n", fpath.c_str(), cnt );
-			break;
+	while ( readTextLogRecord( fd, replicateType, timediff, isBatch, buf, len ) ) {
+		session.replicateType = replicateType;
+		session.timediff = timediff;
+		req.batchReply = isBatch;
+		try {
+			processMultiSingleCmd( req, buf, len, g_lastSchemaTime, g_lastHostTime, 0, true, 1 );
+		} catch ( const char *e ) {
+			raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught exception [%s]\n", buf, e );
+		} catch ( ... ) {
+			raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught unknown exception\n", buf );
 		}
 
-		// get time zone diff
-		i = 0;
-		memset( buf16, 0, 17 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 15 ) {
-					jagclose( fd );
-					return cnt;
-				}
-			}
-			++i;
-		}
-		if ( buf16[0] == '\0' ) {
-			printf("s3398 end timediff 0 is 0\n");
-			break;
-		}
-		session.timediff = atoi( buf16 );
+		free( buf );
+		buf = NULL;
+		if ( req.session->replicateType == 0 ) ++cnt;
 
-		// get isBatch
-		i = 0;
-		memset( buf16, 0, 4 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 0 ) {
-					jagclose( fd );
-					return cnt;
-				}
-			}
-			++i;
+		if ( (cnt%50000) == 0 ) {
+			raydebug( stdout, JAG_LOG_LOW, "redo count=%d\n", cnt );
 		}
+	}
 
-		if ( buf16[0] == '\0' ) {
-			printf("s3398 end isBatch 0 is 0\n");
+	jagclose( fd );
+	raydebug( stdout, JAG_LOG_LOW, "redoWalLog done count=%d\n", cnt );
+	return cnt;
+}
+
+// rewrite a text wallog of older version into binary records of SQL commands
+jagint JagDBServer::convertLegacyWalLog( const Jstr &fpath )
+{
+	int fd = jagopen( fpath.c_str(), O_RDONLY|JAG_NOATIME );
+	if ( fd < 0 ) return 0;
+
+	Jstr newLogPath = fpath + ".binXYZ";
+	FILE *newLogFP = fopen( newLogPath.s(), "w" );
+	if ( ! newLogFP ) {
+		jagclose(fd);
+		raydebug( stdout, JAG_LOG_LOW, "E20285 Error open write [%s]\n", newLogPath.s() );
+		return 0;
+	}
+	fwrite( JAG_WAL_FILE_MAGIC, 1, JAG_WAL_FILE_MAGIC_LEN, newLogFP );
+
+	jagint len, cnt = 0;
+	char *buf = NULL;
+	int  replicateType, timediff, isBatch;
+	JagWalRecord rec;
+	while ( readTextLogRecord( fd, replicateType, timediff, isBatch, buf, len ) ) {
+		rec.clear();
+		rec.addSQL( replicateType, timediff, isBatch, buf, len );
+		fwrite( rec.data(), 1, rec.size(), newLogFP );
+		free( buf );
+		buf = NULL;
+		++cnt;
+	}
+
+	jagclose( fd );
+	jagfdatasync( fileno(newLogFP) );
+	fclose( newLogFP );
+	jagrename( newLogPath.s(), fpath.s() );
+	return cnt;
+}
+
+// replay binary wallog of table db.tab
+// pair records are applied to the table directly; command records go through processMultiSingleCmd
+// a torn or corrupt record ends the log and the file is truncated there
+jagint JagDBServer::redoBinaryWalLog( const Jstr &fpath )
+{
+	FILE *fp = fopen( fpath.s(), "rb" );
+	if ( ! fp ) return 0;
+
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+	if ( fread( magic, 1, JAG_WAL_FILE_MAGIC_LEN, fp ) != JAG_WAL_FILE_MAGIC_LEN 
+	     || 0 != memcmp( magic, JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN ) ) {
+		fclose( fp );
+		return 0;
+	}
+
+	// fpath: walhome/db.tab.wallog
+	Jstr dbname, tabname;
+	JagStrSplit fsp( JagFileMgr::baseName( fpath ), '.' );
+	if ( fsp.length() == 3 ) {
+		dbname = fsp[0];
+		tabname = fsp[1];
+	}
+
+	JagRequest req;
+	JagSession session;
+	req.hasReply = false;
+	req.session = &session;
+	session.servobj = this;
+	session.dbname = "test";
+	session.uid = "admin";
+	session.origserv = 1;
+	session.drecoverConn = 3;
+
+	// redo of different tables may run in parallel
+	jagint schemaTime = g_lastSchemaTime, hostTime = g_lastHostTime;
+	JagTable *ptab[3] = { NULL, NULL, NULL };
+	char *body = NULL;
+	jagint bodycap = 0, bodylen = 0;
+	char type;
+	int  replicateType, timediff, rc;
+	const char *payload;
+	jagint plen;
+	jagint cnt = 0, goodpos = JAG_WAL_FILE_MAGIC_LEN;
+
+	while ( 1 ) {
+		rc = JagWalRecord::readRecord( fp, body, bodycap, bodylen );
+		if ( 0 == rc ) break;
+		if ( rc < 0 || ! JagWalRecord::parseBody( body, bodylen, type, replicateType, timediff, payload, plen ) 
+			 || replicateType < 0 || replicateType > 2 ) {
+			raydebug( stdout, JAG_LOG_LOW, "E20286 torn or corrupt record in wallog [%s] at %l, truncated\n", fpath.s(), goodpos );
+			int tfd = jagopen( fpath.s(), O_WRONLY|JAG_NOATIME );
+			if ( tfd >= 0 ) {
+				jagftruncate( tfd, goodpos );
+				jagclose( tfd );
+			}
 			break;
 		}
+		goodpos += JAG_WAL_REC_HDR_LEN + bodylen;
 
-		req.batchReply = atoi( buf16 );
+		if ( JAG_WAL_REC_KV == type ) {
+			JagTable *tab = ptab[replicateType];
+			if ( ! tab && dbname.size() > 0 ) {
+				tab = _objectLock->writeLockTable( JAG_INSERT_OP, dbname, tabname, getTableSchema( replicateType ), replicateType, 0 );
+				ptab[replicateType] = tab;
+			}
+			if ( ! tab ) continue;
 
-		// get mesg len
-		memset( buf16, 0, JAG_REDO_MSGLEN+1 );
-		raysaferead( fd, buf16, JAG_REDO_MSGLEN );
-		len = jagatoll( buf16 );
+			unsigned int klen;
+			memcpy( &klen, payload, 4 );
+			jagint vlen = plen - 4 - klen;
+			if ( klen != tab->KEYLEN || vlen != tab->VALLEN ) {
+				// schema of table changed since the record was logged
+				continue;
+			}
+			JagDBPair pair( payload+4, klen, payload+4+klen, vlen );
+			tab->insertPair( pair, 0, false );
+		} else {
+			// command may lock the table itself
+			for ( int k = 0; k < 3; ++k ) {
+				if ( ptab[k] ) {
+					_objectLock->writeUnlockTable( JAG_INSERT_OP, dbname, tabname, k, 0 );
+					ptab[k] = NULL;
+				}
+			}
 
-		buf = (char*)jagmalloc(len+1);
-		memset(buf, 0, len+1);
-		raysaferead( fd, buf, len );
-		try {
-			processMultiSingleCmd( req, buf, len, g_lastSchemaTime, g_lastHostTime, 0, true, 1 );
-		} catch ( const char *e ) {
-			raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught exception [%s]\n", buf, e );
-		} catch ( ... ) {
-			raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught unknown exception\n", buf );
+			session.replicateType = replicateType;
+			session.timediff = timediff;
+			req.batchReply = payload[0];
+			Jstr cmd( payload+1, plen-1, plen-1 );
+			try {
+				processMultiSingleCmd( req, cmd.s(), cmd.size(), schemaTime, hostTime, 0, true, 1 );
+			} catch ( const char *e ) {
+				raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught exception [%s]\n", cmd.s(), e );
+			} catch ( ... ) {
+				raydebug( stdout, JAG_LOG_LOW, "redo log processMultiSingleCmd [%s] caught unknown exception\n", cmd.s() );
+			}
 		}
 
-		free( buf );
-		buf = NULL;
-		if ( req.session->replicateType == 0 ) ++cnt;
-
-		if ( (cnt%50000) == 0 ) {
+		if ( replicateType == 0 ) ++cnt;
+		if ( cnt > 0 && (cnt%50000) == 0 ) {
 			raydebug( stdout, JAG_LOG_LOW, "redo count=%d\n", cnt );
 		}
 	}
 
-	jagclose( fd );
-	raydebug( stdout, JAG_LOG_LOW, "redoWalLog done count=%d\n", cnt );
+	for ( int k = 0; k < 3; ++k ) {
+		if ( ptab[k] ) {
+			_objectLock->writeUnlockTable( JAG_INSERT_OP, dbname, tabname, k, 0 );
+		}
+	}
+
+	if ( body ) free( body );
+	fclose( fp );
 	return cnt;
 }
 
@@ -5857,7 +6336,20 @@ int JagDBServer::doInsert( JagRequest &req, JagParseParam &parseParam,
 	Jstr dbName = parseParam.objectVec[0].dbName;
 	Jstr tableName = parseParam.objectVec[0].tableName;
 
-	if ( parseParam.objectVec.size() > 0 ) {
+	// plain inserts share the table lock and lock keys in the family;
+	// timeseries, finsert, cinsert and dinsert keep the exclusive table lock
+	bool sharedInsert = false;
+	if ( parseParam.objectVec.size() > 0 && JAG_INSERT_OP == parseParam.opcode ) {
+		ptab = _objectLock->insertLockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+		if ( ptab && ptab->hasTimeSeries() ) {
+			_objectLock->insertUnlockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+			ptab = NULL;
+		} else if ( ptab ) {
+			sharedInsert = true;
+		}
+	}
+
+	if ( ! sharedInsert && parseParam.objectVec.size() > 0 ) {
 		ptab = _objectLock->writeLockTable( parseParam.opcode, dbName, tableName, 
 											tableschema, req.session->replicateType, 0 );
 	}
@@ -5870,17 +6362,42 @@ int JagDBServer::doInsert( JagRequest &req, JagParseParam &parseParam,
 	}
 
 	if ( JAG_INSERT_OP == parseParam.opcode ) {
-		// cnt = ptab->insert( req, &parseParam, reterr, insertCode, false );
-		cnt = ptab->insert( req, &parseParam, reterr );
-		++ numInserts;
-		if ( 1 == cnt ) {
-			this->_dbLogger->logmsg( req, "INS", oricmd );
-			Jstr tser;
-			if ( ptab->hasTimeSeries( tser ) ) {
-				insertToTimeSeries( ptab->_tableRecord, req, parseParam, tser, dbName, tableName, tableschema, req.session->replicateType, oricmd );
+		// timeseries rollups are derived from the command, so log the command text;
+		// other tables log the encoded pairs in JagTable::insert()
+		if ( ! req.redoOnly && ptab->hasTimeSeries() 
+			 && ! logCommand( &parseParam, req.session, oricmd.c_str(), oricmd.size(), 2 ) ) {
+			_objectLock->writeUnlockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+			reterr = "E20316 Error write wallog";
+			return 0;
+		}
+
+		// rollups of timeseries are computed from one row at a time;
+		// other tables insert all rows of values (...),(...) at once
+		JagVector<JagVector<OtherAttribute> > tsRowsVec;
+		JagVector<OtherAttribute> firstRow;
+		if ( ptab->hasTimeSeries() && parseParam.insertRowsVec.size() > 0 ) {
+			tsRowsVec = parseParam.insertRowsVec;
+			parseParam.insertRowsVec.clean();
+			firstRow = parseParam.otherVec;
+		}
+
+		for ( int r = -1; r < tsRowsVec.size(); ++r ) {
+			if ( tsRowsVec.size() > 0 ) {
+				parseParam.otherVec = ( r < 0 ) ? firstRow : tsRowsVec[r];
+				parseParam.objectVec[0].tableName = tableName;
+			}
+			// cnt = ptab->insert( req, &parseParam, reterr, insertCode, false );
+			cnt = ptab->insert( req, &parseParam, reterr );
+			++ numInserts;
+			if ( 1 == cnt ) {
+				this->_dbLogger->logmsg( req, "INS", oricmd );
+				Jstr tser;
+				if ( ptab->hasTimeSeries( tser ) ) {
+					insertToTimeSeries( ptab->_tableRecord, req, parseParam, tser, dbName, tableName, tableschema, req.session->replicateType, oricmd );
+				}
+			} else {
+				_dbLogger->logerr( req, reterr, oricmd );
 			}
-		} else {
-			_dbLogger->logerr( req, reterr, oricmd );
 		}
 
 	} else if ( JAG_FINSERT_OP == parseParam.opcode ) {
@@ -5908,11 +6425,172 @@ int JagDBServer::doInsert( JagRequest &req, JagParseParam &parseParam,
 		cnt = ptab->dinsert( req, &parseParam, reterr );
 	}
 
-	_objectLock->writeUnlockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+	if ( sharedInsert ) {
+		_objectLock->insertUnlockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+	} else {
+		_objectLock->writeUnlockTable( parseParam.opcode, dbName, tableName, req.session->replicateType, 0 );
+	}
 	
 	return 1;
 }
 
+// Execute statements of a batch. A run of plain inserts into the same table is one group:
+// one permission check, one shared table lock, one wallog append and one key-sorted insert
+// into the table. Other inserts (and tables with timeseries) go through doInsert one by one;
+// other write commands (e.g. update, delete from a datacenter queue) run as single commands in order.
+// parsedVec: positions of statements that were parsed OK
+// rejectVec: positions of statements that failed
+void JagDBServer::doBatchInsert( JagRequest &req, const JagParseAttribute &jpa, const JagStrSplitWithQuote &split, 
+								 jagint threadQueryTime, jagint &threadSchemaTime,
+								 JagVector<int> &parsedVec, JagVector<int> &rejectVec )
+{
+	JagParser parser((void*)this);
+	JagParseParam pparam( &parser ); 
+	Jstr reterr, rowFilter, errmsg;
+	int  repType = req.session->replicateType;
+
+	JagTable *gtab = NULL;
+	Jstr gdb, gtable;
+	JagVector<JagDBPair> gpairs, pairs;
+	JagVector<int> gstmts;  // statement position of each pair in gpairs
+
+	for ( int i = 0; i < split.length(); ++i ) {
+		if ( ! parser.parseCommand( jpa, split[i], &pparam, reterr ) ) {
+			rejectVec.append( i );
+			continue;
+		}
+		parsedVec.append( i );
+
+		if ( ! isBatchInsertOp( pparam.opcode ) ) {
+			if ( gtab ) {
+				flushInsertGroup( req, gtab, split, gpairs, gstmts, rejectVec );
+				_objectLock->insertUnlockTable( JAG_INSERT_OP, gdb, gtable, repType, 0 );
+				gtab = NULL;
+			}
+			if ( ! doBatchCommand( req, jpa, pparam, split[i], threadQueryTime, threadSchemaTime ) ) {
+				rejectVec.append( i );
+			}
+			continue;
+		}
+
+		bool plainInsert = ( JAG_INSERT_OP == pparam.opcode && pparam.objectVec.size() > 0 );
+		bool sameGroup = ( plainInsert && gtab && gdb == pparam.objectVec[0].dbName 
+						   && gtable == pparam.objectVec[0].tableName );
+		if ( gtab && ! sameGroup ) {
+			flushInsertGroup( req, gtab, split, gpairs, gstmts, rejectVec );
+			_objectLock->insertUnlockTable( JAG_INSERT_OP, gdb, gtable, repType, 0 );
+			gtab = NULL;
+		}
+
+		if ( ! sameGroup ) {
+			// before do insert, need to check permission of this user for insert
+			if ( ! checkUserCommandPermission( NULL, req, pparam, 0, rowFilter, reterr ) ) {
+				rejectVec.append( i );
+				continue;
+			}
+
+			if ( plainInsert ) {
+				gdb = pparam.objectVec[0].dbName;
+				gtable = pparam.objectVec[0].tableName;
+				gtab = _objectLock->insertLockTable( JAG_INSERT_OP, gdb, gtable, repType, 0 );
+				if ( gtab && gtab->hasTimeSeries() ) {
+					_objectLock->insertUnlockTable( JAG_INSERT_OP, gdb, gtable, repType, 0 );
+					gtab = NULL;
+				}
+			} else if ( ! req.redoOnly ) {
+				// inserts are logged as encoded pairs by the table
+				if ( ! logCommand( &pparam, req.session, split[i].c_str(), split[i].size(), 2 ) ) {
+					_dbLogger->logerr( req, "E20316 Error write wallog", split[i] );
+					rejectVec.append( i );
+					continue;
+				}
+			}
+
+			if ( ! gtab ) {
+				reterr = "";
+				doInsert( req, pparam, reterr, split[i] );
+				if ( reterr.size() > 0 ) rejectVec.append( i );
+				continue;
+			}
+		}
+
+		pairs.clean();
+		++ numInserts;
+		if ( gtab->parsePair( req.session->timediff, &pparam, pairs, errmsg ) ) {
+			for ( int k = 0; k < pairs.size(); ++k ) {
+				gpairs.append( pairs[k] );
+				gstmts.append( i );
+			}
+		} else {
+			_dbLogger->logerr( req, errmsg, split[i] );
+			rejectVec.append( i );
+		}
+	}
+
+	if ( gtab ) {
+		flushInsertGroup( req, gtab, split, gpairs, gstmts, rejectVec );
+		_objectLock->insertUnlockTable( JAG_INSERT_OP, gdb, gtable, repType, 0 );
+	}
+}
+
+// opcodes of a batch that go through doInsert or an insert group
+bool JagDBServer::isBatchInsertOp( int opcode )
+{
+	return JAG_INSERT_OP == opcode || JAG_INSERTSELECT_OP == opcode || JAG_CINSERT_OP == opcode 
+		   || JAG_FINSERT_OP == opcode || JAG_DINSERT_OP == opcode;
+}
+
+// run a write command of a batch that is not an insert, logged as in processMultiSingleCmd()
+// return true if done without error
+bool JagDBServer::doBatchCommand( JagRequest &req, const JagParseAttribute &jpa, JagParseParam &pparam, 
+								  const Jstr &cmd, jagint threadQueryTime, jagint &threadSchemaTime )
+{
+	Jstr reterr;
+	if ( ! _isGate && ! req.redoOnly && JAG_DELETE_OP == pparam.opcode
+		 && ! logCommand( &pparam, req.session, cmd.c_str(), cmd.size(), 1 ) ) {
+		_dbLogger->logerr( req, "E20316 Error write wallog", cmd );
+		return false;
+	}
+
+	processCmd( jpa, req, cmd.c_str(), pparam, reterr, threadQueryTime, threadSchemaTime );
+	if ( reterr.size() > 0 ) {
+		_dbLogger->logerr( req, reterr, cmd );
+		return false;
+	}
+	return true;
+}
+
+// insert pairs of a group into table ptab and report result of each statement
+// rejectVec: gets the position of each statement with a pair not inserted
+void JagDBServer::flushInsertGroup( JagRequest &req, JagTable *ptab, const JagStrSplitWithQuote &split,
+									JagVector<JagDBPair> &pairVec, JagVector<int> &stmtVec, JagVector<int> &rejectVec )
+{
+	JagVector<int> okVec;
+	ptab->insertPairs( req, pairVec, okVec );
+
+	// pairs of one statement are adjacent in pairVec
+	int k = 0;
+	while ( k < pairVec.size() ) {
+		int stmt = stmtVec[k];
+		Jstr errmsg;
+		for ( ; k < pairVec.size() && stmtVec[k] == stmt; ++k ) {
+			if ( ! okVec[k] ) {
+				errmsg = Jstr("E2108 InsertPair error key: ") + pairVec[k].key.s();
+			}
+		}
+
+		if ( errmsg.size() < 1 ) {
+			_dbLogger->logmsg( req, "INS", split[stmt] );
+		} else {
+			_dbLogger->logerr( req, errmsg, split[stmt] );
+			rejectVec.append( stmt );
+		}
+	}
+
+	pairVec.clean();
+	stmtVec.clean();
+}
+
 // handle signals
 #ifndef _WINDOWS64_
 int JagDBServer::processSignal( int sig )
@@ -7036,10 +7714,8 @@ int JagDBServer::dropTable( JagRequest &req, JagParseParam *parseParam, Jstr &re
 		ptab = NULL;
 	}
 	schemaChangeCommandSyncRemove( scdbobj );
-	JAG_BLURT jaguar_mutex_lock ( &g_wallogmutex ); JAG_OVER;
 	Jstr fpath = _cfg->getWalLogHOME() + "/" + dbname + "." + tabname + ".wallog";
-	jagunlink( fpath.s() );
-	JAG_BLURT jaguar_mutex_unlock ( &g_wallogmutex ); 
+	_walWriter->resetFile( fpath );
 
 	if ( parseParam->hasForce ) {
 		raydebug( stdout, JAG_LOG_LOW, "user [%s] force drop table [%s]\n", req.session->uid.c_str(), dbobj.c_str() );		
@@ -7079,10 +7755,8 @@ int JagDBServer::dropSimpleTable( const JagRequest &req, const JagParseParam *pa
 	}
 
 	// remove wallog
-	JAG_BLURT jaguar_mutex_lock ( &g_wallogmutex ); JAG_OVER;
 	Jstr fpath = _cfg->getWalLogHOME() + "/" + dbname + "." + tabname + ".wallog";
-	jagunlink( fpath.s() );
-	JAG_BLURT jaguar_mutex_unlock ( &g_wallogmutex ); 
+	_walWriter->resetFile( fpath );
 	
 	// drop table and related indexs
 	if ( ptab ) {
@@ -7283,10 +7957,8 @@ int JagDBServer::truncateTable( JagRequest &req, JagParseParam *parseParam, Jstr
 		raydebug( stdout, JAG_LOG_LOW, "user [%s] truncate table [%s]\n", req.session->uid.c_str(), dbobj.c_str() );
 
 		// remove wallog
-		JAG_BLURT jaguar_mutex_lock ( &g_wallogmutex ); JAG_OVER;
 		Jstr fpath = _cfg->getWalLogHOME() + "/" + dbname + "." + tabname + ".wallog";
-		jagunlink( fpath.s() );
-		JAG_BLURT jaguar_mutex_unlock ( &g_wallogmutex ); 
+		_walWriter->resetFile( fpath );
 	}
 
 	schemaChangeCommandSyncRemove( scdbobj );
@@ -7319,27 +7991,27 @@ void JagDBServer::sendHostInfo( const char *mesg, const JagRequest &req )
 void JagDBServer::checkDeltaFiles( const char *mesg, const JagRequest &req )
 {
 	Jstr str;
-	if ( _actdelPOhost == req.session->ip && JagFileMgr::fileSize(_actdelPOpath) > 0 ) {
+	if ( _actdelPOhost == req.session->ip && deltaLogSize(_actdelPOpath) > 0 ) {
 		str = _actdelPOpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
-	if ( _actdelPRhost == req.session->ip && JagFileMgr::fileSize(_actdelPRpath) > 0 ) {
+	if ( _actdelPRhost == req.session->ip && deltaLogSize(_actdelPRpath) > 0 ) {
 		str = _actdelPRpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
-	if ( _actdelPORhost == req.session->ip && JagFileMgr::fileSize(_actdelPORpath) > 0 ) {
+	if ( _actdelPORhost == req.session->ip && deltaLogSize(_actdelPORpath) > 0 ) {
 		str = _actdelPORpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
-	if ( _actdelNOhost == req.session->ip && JagFileMgr::fileSize(_actdelNOpath) > 0 ) {
+	if ( _actdelNOhost == req.session->ip && deltaLogSize(_actdelNOpath) > 0 ) {
 		str = _actdelNOpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
-	if ( _actdelNRhost == req.session->ip && JagFileMgr::fileSize(_actdelNRpath) > 0 ) {
+	if ( _actdelNRhost == req.session->ip && deltaLogSize(_actdelNRpath) > 0 ) {
 		str = _actdelNRpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
-	if ( _actdelNORhost == req.session->ip && JagFileMgr::fileSize(_actdelNORpath) > 0 ) { 
+	if ( _actdelNORhost == req.session->ip && deltaLogSize(_actdelNORpath) > 0 ) { 
 		str = _actdelNORpath + " not empty";
 		sendMessage( req, str.c_str(), "OK" );
 	}
@@ -7829,6 +8501,14 @@ void JagDBServer::sendLocalStat6( const char *mesg, const JagRequest &req )
 	sendMessageLength( req, line, strlen(line), "OK" );
 }
 
+// lines of "db.table.index|pending|lagms" of deferred indexes on this server
+// pmesg: "_mon_indexlag"
+void JagDBServer::sendIndexLagInfo( const char *mesg, const JagRequest &req )
+{
+	Jstr res = getIndexLagInfo();
+	sendMessageLength( req, res.c_str(), res.size(), "OK" );
+}
+
 // client expects: "%lld|%lld|%lld|%lld|%.2f|%lld", totalDiskGB, usedDiskGB, freeDiskGB, nproc, loadvg, tcp
 // loadvg is avg, others are accumulative from all nodes
 // pmesg: "_mon_cluster_stat6"
@@ -9056,18 +9736,25 @@ void JagDBServer::shutDown( const char *mesg, const JagRequest &req )
 		raydebug( stdout, JAG_LOG_LOW, "Shutdown waits other tasks to finish ...\n");
 	}
 
-	JAG_BLURT jaguar_mutex_lock ( &g_dlogmutex ); JAG_OVER;
-	
-	if ( _delPrevOriCommandFile ) jagfsync( fileno( _delPrevOriCommandFile ) );
-	if ( _delPrevRepCommandFile ) jagfsync( fileno( _delPrevRepCommandFile ) );
-	if ( _delPrevOriRepCommandFile ) jagfsync( fileno( _delPrevOriRepCommandFile ) );
-	if ( _delNextOriCommandFile ) jagfsync( fileno( _delNextOriCommandFile ) );
-	if ( _delNextRepCommandFile ) jagfsync( fileno( _delNextRepCommandFile ) );
-	if ( _delNextOriRepCommandFile ) jagfsync( fileno( _delNextOriRepCommandFile ) );
-	if ( _recoveryRegCommandFile ) jagfsync( fileno( _recoveryRegCommandFile ) );
-	if ( _recoverySpCommandFile ) jagfsync( fileno( _recoverySpCommandFile ) );
+	raydebug( stdout, JAG_LOG_LOW, "Shutdown: Flushing delta log buffers ...\n");
+	_deltaWriter->stop();
+
+	raydebug( stdout, JAG_LOG_LOW, "Shutdown: Stopping datacenter queues ...\n");
+	stopDataCenterQueues();
+	_dcWriter->stop();
+
+	if ( _rollupBuffered ) {
+		raydebug( stdout, JAG_LOG_LOW, "Shutdown: Flushing rollup buffers ...\n");
+		flushRollupBuffers();
+	}
+
+	if ( _indexDeferred ) {
+		raydebug( stdout, JAG_LOG_LOW, "Shutdown: Applying deferred index records ...\n");
+		applyDeferIndexes();
+	}
 
-	jaguar_mutex_unlock ( &g_dlogmutex );
+	raydebug( stdout, JAG_LOG_LOW, "Shutdown: Flushing wallog buffers ...\n");
+	_walWriter->stop();
 
 	raydebug( stdout, JAG_LOG_LOW, "Shutdown: Flushing block index to disk ...\n");
 	flushAllBlockIndexToDisk();
@@ -11046,12 +11733,31 @@ void JagDBServer::getTableIndexSchema( int replicateType, JagTableSchema *& tabl
 	}
 }
 
-int JagDBServer::synchToOtherDataCenters( const char *mesg, bool &sucsync, const JagRequest &req )
+// send write command mesg to other datacenters
+// with DATACENTER_ASYNC the command is queued for each datacenter and sent by its queue thread;
+// finsert from gate is always sent inline since its file pieces are streamed from the client
+int JagDBServer::replicateToOtherDataCenters( const char *mesg, bool &sucsync, const JagRequest &req )
+{
+	if ( _dcAsync ) {
+		Jstr host;
+		const char *pp = dataCenterCommand( mesg, host );
+		if ( ! _isGate || 0 != strncasecmp( pp, "finsert", 7 ) ) {
+			sucsync = true;
+			return queueToOtherDataCenters( mesg, req );
+		}
+	}
+
+	JAG_BLURT jaguar_mutex_lock ( &g_datacentermutex ); JAG_OVER;
+	int cnt = synchToOtherDataCenters( mesg, sucsync, req );
+	jaguar_mutex_unlock ( &g_datacentermutex );
+	return cnt;
+}
+
+// command part of mesg; host is set for "insertsyncdconly|host| cmd" which goes to one datacenter only
+const char *JagDBServer::dataCenterCommand( const char *mesg, Jstr &host ) const
 {
-	jagint rc = 0, cnt = 0, onedc = 0;
-	sucsync = true;
 	const char *pp, *qq;
-	Jstr host;
+	host = "";
     if ( 0 == strncasecmp( mesg, "insertsyncdconly|", 17 ) ) {
 		pp = mesg+17;
 		qq = strchr( pp, '|' );
@@ -11059,10 +11765,19 @@ int JagDBServer::synchToOtherDataCenters( const char *mesg, bool &sucsync, const
 		pp = strchr( pp, ' ' );
 		while ( *pp == ' ' ) ++pp;
 		host = JagNet::getIPFromHostName( host );
-		onedc = 1;
 	} else {
 		pp = mesg;
 	}
+	return pp;
+}
+
+int JagDBServer::synchToOtherDataCenters( const char *mesg, bool &sucsync, const JagRequest &req )
+{
+	jagint rc = 0, cnt = 0, onedc = 0;
+	sucsync = true;
+	Jstr host;
+	const char *pp = dataCenterCommand( mesg, host );
+	if ( host.size() > 0 ) onedc = 1;
 	JagVector<int> useindex;
 	
 	for ( int i = 0; i < _numDataCenter; ++i ) {
@@ -11222,6 +11937,77 @@ int JagDBServer::synchToOtherDataCenters( const char *mesg, bool &sucsync, const
 	return cnt;
 }
 
+// append write command mesg to the queue of each datacenter it goes to
+// return number of queues
+int JagDBServer::queueToOtherDataCenters( const char *mesg, const JagRequest &req )
+{
+	Jstr host;
+	const char *pp = dataCenterCommand( mesg, host );
+	if ( 0 == strncasecmp( pp, "finsert", 7 ) ) {
+		if ( req.session->replicateType != 0 ) {
+			return 0;
+		}
+		++pp;
+	}
+
+	int cnt = 0;
+	jagint len = strlen( pp );
+	pthread_rwlock_rdlock( &_dcQueueLock );
+	for ( int i = 0; i < _dcQueues.size(); ++i ) {
+		JagDataCenterQueue *q = _dcQueues[i];
+		if ( req.session->dcfrom == JAG_DATACENTER_HOST && q->destType() == JAG_DATACENTER_HOST ) {
+			continue;
+		}
+		if ( req.session->dcfrom == JAG_DATACENTER_GATE && q->destType() == JAG_DATACENTER_GATE ) {
+			continue;
+		}
+		if ( host.size() > 0 && ! q->hasHost( host ) ) {
+			continue;
+		}
+		if ( q->enqueue( req.session->timediff, pp, len ) ) {
+			++cnt;
+		}
+	}
+	pthread_rwlock_unlock( &_dcQueueLock );
+	return cnt;
+}
+
+// queue of datacenter hostPort (line of datacenter.conf), created and started if not yet
+JagDataCenterQueue *JagDBServer::getDataCenterQueue( const Jstr &hostPort )
+{
+	for ( int i = 0; i < _dcQueueAll.size(); ++i ) {
+		if ( _dcQueueAll[i]->hostPort() == hostPort ) return _dcQueueAll[i];
+	}
+	JagDataCenterQueue *q = new JagDataCenterQueue( this, _dcWriter, hostPort, _dcBatchSize, _dcRetryMax );
+	_dcQueueAll.append( q );
+	q->start();
+	return q;
+}
+
+void JagDBServer::stopDataCenterQueues()
+{
+	pthread_rwlock_rdlock( &_dcQueueLock );
+	for ( int i = 0; i < _dcQueueAll.size(); ++i ) {
+		_dcQueueAll[i]->stop();
+	}
+	pthread_rwlock_unlock( &_dcQueueLock );
+}
+
+// log replication lag of datacenters that are behind
+void JagDBServer::reportDataCenterLag()
+{
+	pthread_rwlock_rdlock( &_dcQueueLock );
+	for ( int i = 0; i < _dcQueueAll.size(); ++i ) {
+		JagDataCenterQueue *q = _dcQueueAll[i];
+		jagint bytes = q->pendingBytes();
+		if ( bytes < 1 ) continue;
+		raydebug( stdout, JAG_LOG_LOW, "Datacenter [%s] replication lag %l seconds, %l bytes queued, sent %l/%l retries %l rejected %l\n",
+				  q->hostPort().s(), q->lagSeconds(), bytes, (jagint)q->_numSent, (jagint)q->_numQueued, (jagint)q->_numRetries,
+				  (jagint)q->_numRejected );
+	}
+	pthread_rwlock_unlock( &_dcQueueLock );
+}
+
 int JagDBServer::synchFromOtherDataCenters( const JagRequest &req, const char *mesg, const JagParseParam &pparam )
 {
 	const char *pmsg;
@@ -11422,6 +12208,11 @@ void JagDBServer::openDataCenterConnection()
 	for ( int i = 0; i < JAG_DATACENTER_MAX; ++i ) {
 		_dataCenter[i] = NULL;
 	}
+	if ( _dcAsync ) {
+		pthread_rwlock_wrlock( &_dcQueueLock );
+		_dcQueues.clean();
+		pthread_rwlock_unlock( &_dcQueueLock );
+	}
 
 	for ( int i =0; i < sp.length() && i < JAG_DATACENTER_MAX; ++i ) {
 		if ( strchr( sp[i].c_str(), '#' ) ) continue;
@@ -11438,6 +12229,11 @@ void JagDBServer::openDataCenterConnection()
 
 		raydebug( stdout, JAG_LOG_LOW, "Connecting to datacenter [%s]\n", host.c_str() );
 		_centerHostPort[_numDataCenter] = uphost;
+		if ( _dcAsync ) {
+			pthread_rwlock_wrlock( &_dcQueueLock );
+			_dcQueues.append( getDataCenterQueue( uphost ) );
+			pthread_rwlock_unlock( &_dcQueueLock );
+		}
 		_dataCenter[_numDataCenter] = newObject<JaguarAPI>();
 		if ( JAG_LOG_LEVEL == JAG_LOG_HIGH ) {
 			prt(("s4807 datac setDebug(true)\n" ));
@@ -11521,6 +12317,35 @@ long JagDBServer::getDataCenterQueryCount( const Jstr &ip, bool doLock )
 	return cnt;
 }
 
+// one connection attempt to datacenter hostPort (line of datacenter.conf)
+// return NULL if it cannot connect
+JaguarAPI *JagDBServer::newDataCenterConnection( const Jstr &hostPort )
+{
+	Jstr host, port, destType;
+	Jstr adminpass = "dummy";
+	int stype, dtype;
+	getDestHostPortType( hostPort, host, port, destType );
+
+	JaguarAPI *api = newObject<JaguarAPI>();
+	if ( JAG_LOG_LEVEL == JAG_LOG_HIGH ) {
+		api->setDebug( true );
+	}
+	if ( destType == "GATE" ) { dtype = JAG_DATACENTER_GATE; } 
+	else if ( destType == "PGATE" ) { dtype = JAG_DATACENTER_PGATE; }
+	else { dtype = JAG_DATACENTER_HOST; }
+	if ( _isGate ) { stype = JAG_DATACENTER_GATE; } else { stype = JAG_DATACENTER_HOST; }
+	api->setDatcType( stype, dtype );
+
+	Jstr unixSocket = Jstr("/DATACENTER=1") + Jstr("/TOKEN=") + _servToken;
+	unixSocket += srcDestType( _isGate, destType );
+	if ( ! api->connect( host.c_str(), atoi( port.c_str() ), "admin", adminpass.c_str(), "test", unixSocket.c_str() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "Error connect to datacenter [%s], %s\n", hostPort.s(), api->error() );
+		delete api;
+		return NULL;
+	}
+	return api;
+}
+
 // reconnect to one data center ip : is one of peerip from peer datacenter
 // is from datacenter.conf one line host
 void JagDBServer::reconnectDataCenter( const Jstr &ip, bool doLock )
@@ -12375,6 +13200,9 @@ void JagDBServer::processInternalCommands( int rc, const JagRequest &req, const
 	} else if ( JAG_SCMD_MONCLUSTERSTAT == rc ) {
 		sendClusterStat6( pmesg, req );
 		sendMessage( req, "_END_[T=30|E=]", "ED" );
+	} else if ( JAG_SCMD_MONINDEXLAG == rc ) {
+		sendIndexLagInfo( pmesg, req );
+		sendMessage( req, "_END_[T=30|E=]", "ED" );
 	} else if ( JAG_SCMD_EXPROCLOCALBACKUP == rc ) {
 		// no _END_ ED sent, already sent in method
 		processLocalBackup( pmesg, req );
@@ -12400,6 +13228,10 @@ void JagDBServer::processInternalCommands( int rc, const JagRequest &req, const
 		importTableDirect( pmesg, req );
 	} else if ( JAG_SCMD_TRUNCATETABLE == rc ) {
 		truncateTableDirect( pmesg, req );
+	} else if ( JAG_SCMD_INGESTSORTED == rc ) {
+		ingestSortedDirect( pmesg, req );
+	} else if ( JAG_SCMD_LOADCSV == rc ) {
+		loadCSVDirect( pmesg, req );
 	} else if ( JAG_SCMD_EXSHUTDOWN == rc ) {
 		// no _END_ ED sent, already sent in method
 		shutDown( pmesg, req );
@@ -12858,6 +13690,103 @@ void JagDBServer::importTableDirect( const char *mesg, const JagRequest &req )
 	raydebug( stdout, JAG_LOG_LOW, "s300873 importTableDirect() is done\n" );
 }
 
+// method to attach a sorted file on this server as a new data file of a table
+// pmesg: "_ex_ingestsorted|replicate_type(0/1/2)|db|table|format(kv/csv)|filepath"
+void JagDBServer::ingestSortedDirect( const char *mesg, const JagRequest &req )
+{
+	if ( req.session->uid!="admin" ) {
+		raydebug( stdout, JAG_LOG_LOW, "ingestSortedDirect rejected. admin login is required\n" );
+		sendMessage( req, "_END_[T=130|E=Command Failed. admin login is required]", "ER" );
+		return;
+	}
+
+	JagStrSplit sp( mesg, '|');
+	if ( sp.length() < 6 ) {
+		raydebug( stdout, JAG_LOG_LOW, "ingestSortedDirect rejected. wrong command [%s]\n", mesg );
+		sendMessage( req, "_END_[T=130|E=Command Failed. ingestSortedDirect rejected. wrong command]", "ER" );
+		return;
+	}
+
+	int replicateType = sp[1].toInt();
+	Jstr db = sp[2];
+	Jstr tab = sp[3];
+	Jstr format = sp[4];
+	Jstr fpath = sp[5];
+
+	JagTableSchema *tableschema;
+	JagIndexSchema *indexschema;
+	getTableIndexSchema( replicateType, tableschema, indexschema );
+
+	Jstr reterr;
+	jagint cnt = -1;
+	JagTable *ptab = _objectLock->writeLockTable( JAG_IMPORT_OP, db, tab, tableschema, replicateType, 0 );
+	if ( ptab ) {
+		cnt = ptab->ingestSortedFile( req, fpath, format, reterr );
+		_objectLock->writeUnlockTable( JAG_IMPORT_OP, db, tab, replicateType, 0 );
+	} else {
+		reterr = Jstr("E5037 table ") + db + "." + tab + " not found";
+	}
+
+	if ( cnt < 0 ) {
+		raydebug( stdout, JAG_LOG_LOW, "ingestSortedDirect %s.%s %s error [%s]\n", db.s(), tab.s(), fpath.s(), reterr.s() );
+		Jstr err = Jstr("_END_[T=130|E=Command Failed. ") + reterr + "]";
+		sendMessage( req, err.c_str(), "ER" );
+		return;
+	}
+
+	raydebug( stdout, JAG_LOG_LOW, "user [%s] ingested %l rows of %s into %s.%s\n", 
+			  req.session->uid.c_str(), cnt, fpath.s(), db.s(), tab.s() );
+	Jstr res = longToStr( cnt );
+	sendMessageLength( req, res.c_str(), res.size(), "OK" );
+	sendMessage( req, "_END_[T=30|E=]", "ED" );
+}
+
+// method to load a csv file on this server into a table, parsed on parallel threads
+// pmesg: "_ex_loadcsv|replicate_type(0/1/2)|db|table|filepath"
+void JagDBServer::loadCSVDirect( const char *mesg, const JagRequest &req )
+{
+	if ( req.session->uid!="admin" ) {
+		raydebug( stdout, JAG_LOG_LOW, "loadCSVDirect rejected. admin login is required\n" );
+		sendMessage( req, "_END_[T=130|E=Command Failed. admin login is required]", "ER" );
+		return;
+	}
+
+	JagStrSplit sp( mesg, '|');
+	if ( sp.length() < 5 ) {
+		raydebug( stdout, JAG_LOG_LOW, "loadCSVDirect rejected. wrong command [%s]\n", mesg );
+		sendMessage( req, "_END_[T=130|E=Command Failed. loadCSVDirect rejected. wrong command]", "ER" );
+		return;
+	}
+
+	int replicateType = sp[1].toInt();
+	Jstr db = sp[2];
+	Jstr tab = sp[3];
+	Jstr fpath = sp[4];
+
+	Jstr reterr;
+	jagint cnt = -1;
+	JagTable *ptab = _objectLock->insertLockTable( JAG_INSERT_OP, db, tab, replicateType, 0 );
+	if ( ptab ) {
+		cnt = ptab->loadCSVFile( req, fpath, reterr );
+		_objectLock->insertUnlockTable( JAG_INSERT_OP, db, tab, replicateType, 0 );
+	} else {
+		reterr = Jstr("E5037 table ") + db + "." + tab + " not found";
+	}
+
+	if ( cnt < 0 ) {
+		raydebug( stdout, JAG_LOG_LOW, "loadCSVDirect %s.%s %s error [%s]\n", db.s(), tab.s(), fpath.s(), reterr.s() );
+		Jstr err = Jstr("_END_[T=130|E=Command Failed. ") + reterr + "]";
+		sendMessage( req, err.c_str(), "ER" );
+		return;
+	}
+
+	raydebug( stdout, JAG_LOG_LOW, "user [%s] loaded %l rows of %s into %s.%s\n", 
+			  req.session->uid.c_str(), cnt, fpath.s(), db.s(), tab.s() );
+	Jstr res = longToStr( cnt );
+	sendMessageLength( req, res.c_str(), res.size(), "OK" );
+	sendMessage( req, "_END_[T=30|E=]", "ED" );
+}
+
 // method to truncate a table
 // pmesg: "_ex_truncatetable|replicate_type(0/1/2)|db|table"
 void JagDBServer::truncateTableDirect( const char *mesg, const JagRequest &req )
@@ -13309,12 +14238,12 @@ jagint JagDBServer::trimWalLogFile( const JagTable *ptab, const Jstr &db, const
 {
 	if ( db.size() < 1 || tab.size() <1 ) { return 0; }
 
-	JAG_BLURT jaguar_mutex_lock ( &g_wallogmutex ); JAG_OVER;
-
 	Jstr fpath = _cfg->getWalLogHOME() + "/" + db + "." + tab + ".wallog";
-	jagint cnt = doTrimWalLogFile( ptab, fpath, db, insertBufferMap, keyChecker );
 
-	JAG_BLURT jaguar_mutex_unlock ( &g_wallogmutex ); 
+	// appends are held in the writer buffer while the file is rewritten
+	_walWriter->suspendFile( fpath );
+	jagint cnt = doTrimWalLogFile( ptab, fpath, db, insertBufferMap, keyChecker );
+	_walWriter->resumeFile( fpath );
 	return cnt;
 }
 
@@ -13325,148 +14254,214 @@ jagint JagDBServer::doTrimWalLogFile( const JagTable *ptab, const Jstr &fpath, c
 		return 0;
 	}
 
-	int i, fd = jagopen( fpath.c_str(), O_RDONLY|JAG_NOATIME );
-	if ( fd < 0 ) return 0;
+	FILE *fp = fopen( fpath.s(), "rb" );
+	if ( ! fp ) return 0;
+
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+	if ( fread( magic, 1, JAG_WAL_FILE_MAGIC_LEN, fp ) != JAG_WAL_FILE_MAGIC_LEN 
+	     || 0 != memcmp( magic, JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN ) ) {
+		fclose( fp );
+		return 0;
+	}
 
 	Jstr newLogPath = fpath + ".trimmedXYZ";
 	FILE *newLogFP = fopen( newLogPath.s(), "w" );
 	if ( ! newLogFP ) {
-		close(fd);
+		fclose( fp );
 		raydebug( stdout, JAG_LOG_LOW, "E20281 Error open write [%s]\n", newLogPath.s() );
 		return 0;
 	}
+	fwrite( JAG_WAL_FILE_MAGIC, 1, JAG_WAL_FILE_MAGIC_LEN, newLogFP );
 
-	char buf16[17];
-	jagint msglen;
-	char c;
-	char *msgbuf = NULL;
-	int replicateType;
-	int timediff;
-	int batchReply;
+	char *body = NULL;
+	jagint bodycap = 0, bodylen = 0;
+	char type;
+	int  replicateType, timediff;
+	const char *payload;
+	jagint plen;
 	Jstr reterr;
+	char kbuf[ptab->KEYLEN+1];
 
 	jagint cntwrite = 0;
 	jagint cntdel = 0;
-	while ( 1 ) {
-		i = 0;
-		memset( buf16, 0, 4 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 0 ) {
-					jagclose( fd );
-					return cntwrite;
-				}
-			}
-			++i;
-		}
-
-		if ( buf16[0] == '\0' ) {
+	while ( 1 == JagWalRecord::readRecord( fp, body, bodycap, bodylen ) ) {
+		if ( ! JagWalRecord::parseBody( body, bodylen, type, replicateType, timediff, payload, plen ) ) {
 			break;
 		}
 
-		replicateType = atoi( buf16 );
-
-		i = 0;
-		memset( buf16, 0, 17 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 15 ) {
-					jagclose( fd );
-					return cntwrite;
-				}
-			}
-			++i;
-		}
-		if ( buf16[0] == '\0' ) {
-			break;
-		}
-		timediff = atoi( buf16 );
-
-		i = 0;
-		memset( buf16, 0, 4 );
-		while( 1==read(fd, &c, 1) ) {
-			buf16[i] = c;
-			if ( c == ';' ) {
-				buf16[i] =  '\0';
-				break;
-			} else {
-				if ( i > 0 ) {
-					jagclose( fd );
-					return cntwrite;
-				}
-			}
-			++i;
-		}
-
-		if ( buf16[0] == '\0' ) {
-			printf("s3398 end isBatch 0 is 0\n");
-			break;
-		}
-
-		batchReply = atoi( buf16 );
-
-		memset( buf16, 0, JAG_REDO_MSGLEN+1 );
-		raysaferead( fd, buf16, JAG_REDO_MSGLEN );
-		msglen = jagatoll( buf16 );
-
-		msgbuf = (char*)jagmalloc(msglen+1);
-		memset(msgbuf, 0, msglen+1);
-		raysaferead( fd, msgbuf, msglen );
-
-		JagParseAttribute jpa( this, timediff, servtimediff, dbname, _cfg );
-		JagParser parser((void*)this);
-		JagParseParam pparam( &parser );
-		JagVector<JagDBPair> pairVec;
+		// keep insert records whose keys still exist
 		bool exist = false;
-		bool brc = parser.parseCommand( jpa, msgbuf, &pparam, reterr );
-		if ( brc && pparam.opcode == JAG_INSERT_OP ) {
-			int prc = ptab->parsePair( timediff, &pparam, pairVec, reterr );
-			if ( prc ) {
-				if ( insertBufferMap->exist( pairVec[0] ) ) {
+		if ( JAG_WAL_REC_KV == type ) {
+			unsigned int klen;
+			memcpy( &klen, payload, 4 );
+			if ( klen == ptab->KEYLEN && plen - 4 - klen == ptab->VALLEN ) {
+				JagDBPair pair( payload+4, klen );
+				if ( insertBufferMap->exist( pair ) ) {
 					exist = true;
 				} else {
-					char kbuf[ptab->KEYLEN+1];
 					memset( kbuf, 0, ptab->KEYLEN+1);
-					memcpy( kbuf, pairVec[0].key.c_str(), ptab->KEYLEN );
+					memcpy( kbuf, payload+4, ptab->KEYLEN );
 					if ( keyChecker->exist( kbuf )  ) {
 						exist = true;
 					}
 				}
-
-				if ( exist ) {
-					fprintf( newLogFP, "%d;%d;%d;%010ld%s", replicateType, timediff, batchReply, msglen, msgbuf );
-					++cntwrite;
-				} else {
-					++cntdel;
-				}
-
-			} else {
 			}
 		} else {
+			Jstr cmd( payload+1, plen-1, plen-1 );
+			JagParseAttribute jpa( this, timediff, servtimediff, dbname, _cfg );
+			JagParser parser((void*)this);
+			JagParseParam pparam( &parser );
+			JagVector<JagDBPair> pairVec;
+			bool brc = parser.parseCommand( jpa, cmd, &pparam, reterr );
+			if ( brc && pparam.opcode == JAG_INSERT_OP ) {
+				int prc = ptab->parsePair( timediff, &pparam, pairVec, reterr );
+				if ( prc ) {
+					if ( insertBufferMap->exist( pairVec[0] ) ) {
+						exist = true;
+					} else {
+						memset( kbuf, 0, ptab->KEYLEN+1);
+						memcpy( kbuf, pairVec[0].key.c_str(), ptab->KEYLEN );
+						if ( keyChecker->exist( kbuf )  ) {
+							exist = true;
+						}
+					}
+				}
+			}
 		}
 
-		free( msgbuf );
-		msgbuf = NULL;
+		if ( exist ) {
+			JagWalRecord::writeRecord( newLogFP, body, bodylen );
+			++cntwrite;
+		} else {
+			++cntdel;
+		}
 	}
 
-	jagclose( fd );
+	if ( body ) free( body );
+	fclose( fp );
 	fclose( newLogFP  );
 
 	jagunlink( fpath.s() );
 	jagrename( newLogPath.s(), fpath.s() );
 
-	_walLogMap.removeKey( fpath );
-
-	_walLogMap.ensureFile( fpath );
-
 	raydebug( stdout, JAG_LOG_LOW, "trimWalLogFile %s write=%d deleted=%d\n", fpath.s(),  cntwrite, cntdel );
 	return cntwrite;
 }
+
+// register an index whose insert records are queued
+void JagDBServer::addDeferIndex( JagIndex *pindex )
+{
+	jaguar_mutex_lock( &_deferIndexMutex );
+	_deferIndexes.append( pindex );
+	jaguar_mutex_unlock( &_deferIndexMutex );
+}
+
+void JagDBServer::removeDeferIndex( JagIndex *pindex )
+{
+	jaguar_mutex_lock( &_deferIndexMutex );
+	jagint pos;
+	if ( _deferIndexes.exist( pindex, &pos ) ) {
+		_deferIndexes.removepos( pos );
+	}
+	jaguar_mutex_unlock( &_deferIndexMutex );
+}
+
+// apply queued records of all deferred indexes
+// returns number of records applied
+jagint JagDBServer::applyDeferIndexes()
+{
+	jagint cnt = 0;
+	jaguar_mutex_lock( &_deferIndexMutex );
+	for ( int i = 0; i < _deferIndexes.size(); ++i ) {
+		if ( _deferIndexes[i]->pendingCount() > 0 ) {
+			cnt += _deferIndexes[i]->applyPending();
+		}
+	}
+	jaguar_mutex_unlock( &_deferIndexMutex );
+	return cnt;
+}
+
+// register a rollup table of a time series whose rollups are buffered
+// data files of table are block compressed
+bool JagDBServer::isBlockCompressed( const Jstr &dbName, const Jstr &tableName ) const
+{
+	if ( _blockCompressAll ) return true;
+	Jstr dbtab = dbName + "." + tableName;
+	for ( int i = 0; i < _blockCompressTables.size(); ++i ) {
+		if ( _blockCompressTables[i] == dbtab ) return true;
+	}
+	return false;
+}
+
+void JagDBServer::addRollupTable( JagTable *ptab )
+{
+	jaguar_mutex_lock( &_rollupTableMutex );
+	_rollupTables.append( ptab );
+	jaguar_mutex_unlock( &_rollupTableMutex );
+}
+
+void JagDBServer::removeRollupTable( JagTable *ptab )
+{
+	jaguar_mutex_lock( &_rollupTableMutex );
+	jagint pos;
+	if ( _rollupTables.exist( ptab, &pos ) ) {
+		_rollupTables.removepos( pos );
+	}
+	jaguar_mutex_unlock( &_rollupTableMutex );
+}
+
+// write buffered rollup rows of all rollup tables
+// tables are locked by name, so a table dropped meanwhile is skipped
+jagint JagDBServer::flushRollupBuffers()
+{
+	JagVector<Jstr> dbVec, tabVec;
+	JagVector<int> repVec;
+	jaguar_mutex_lock( &_rollupTableMutex );
+	for ( int i = 0; i < _rollupTables.size(); ++i ) {
+		if ( _rollupTables[i]->rollupPending() > 0 ) {
+			dbVec.append( _rollupTables[i]->getdbName() );
+			tabVec.append( _rollupTables[i]->getTableName() );
+			repVec.append( _rollupTables[i]->_replicateType );
+		}
+	}
+	jaguar_mutex_unlock( &_rollupTableMutex );
+
+	jagint cnt = 0;
+	JagTable *ptab;
+	for ( int i = 0; i < tabVec.size(); ++i ) {
+		ptab = _objectLock->writeLockTable( JAG_INSERT_OP, dbVec[i], tabVec[i], getTableSchema( repVec[i] ), repVec[i], 0 );
+		if ( ptab ) {
+			cnt += ptab->flushRollupBuffer();
+			_objectLock->writeUnlockTable( JAG_INSERT_OP, dbVec[i], tabVec[i], repVec[i], 0 );
+		}
+	}
+	return cnt;
+}
+
+// write buffered rollup rows of one rollup table
+jagint JagDBServer::flushRollupBuffer( const Jstr &dbName, const Jstr &tableName, int replicateType )
+{
+	if ( ! _rollupBuffered ) return 0;
+	jagint cnt = 0;
+	JagTable *ptab = _objectLock->writeLockTable( JAG_INSERT_OP, dbName, tableName, getTableSchema( replicateType ), replicateType, 0 );
+	if ( ptab ) {
+		if ( ptab->rollupPending() > 0 ) cnt = ptab->flushRollupBuffer();
+		_objectLock->writeUnlockTable( JAG_INSERT_OP, dbName, tableName, replicateType, 0 );
+	}
+	return cnt;
+}
+
+// "db.table.index|pending|lagms" lines of deferred indexes
+Jstr JagDBServer::getIndexLagInfo()
+{
+	Jstr res;
+	char buf[64];
+	jaguar_mutex_lock( &_deferIndexMutex );
+	for ( int i = 0; i < _deferIndexes.size(); ++i ) {
+		JagIndex *pindex = _deferIndexes[i];
+		sprintf( buf, "|%lld|%lld\n", pindex->pendingCount(), pindex->pendingLagMillis() );
+		res += pindex->getdbName() + "." + pindex->getTableName() + "." + pindex->getIndexName() + buf;
+	}
+	jaguar_mutex_unlock( &_deferIndexMutex );
+	return res;
+}
@@ -25,7 +25,7 @@
 #include <JagArray.h>
 #include <JagSystem.h>
 #include <JagMutexMap.h>
-#include <JagWalMap.h>
+#include <JagWalWriter.h>
 #include <JagHashIntInt.h>
 
 class JagKeyChecker;
@@ -57,6 +57,7 @@ class JagDBLogger;
 class JagMergeReader;
 class JagFamilyKeyChecker;
 class JagDBMap;
+class JagDataCenterQueue;
 
 template <class Pair> class JagVector;
 
@@ -106,6 +107,7 @@ class JagDBServer
 	void sendRemoteHostsInfo( const char *pmesg, const JagRequest &req );
 	void sendLocalStat6( const char *pmesg, const JagRequest &req );
 	void sendClusterStat6( const char *pmesg, const JagRequest &req );
+	void sendIndexLagInfo( const char *pmesg, const JagRequest &req );
 	void processLocalBackup( const char *pmesg, const JagRequest &req );
 	void processRemoteBackup( const char *pmesg, const JagRequest &req );
 	void processRestoreRemote( const char *pmesg, const JagRequest &req );
@@ -117,6 +119,8 @@ class JagDBServer
 	void addClusterMigrateComplete( const char *pmesg, const JagRequest &req );
 	void importTableDirect( const char *pmesg, const JagRequest &req );
 	void truncateTableDirect( const char *pmesg, const JagRequest &req );
+	void ingestSortedDirect( const char *pmesg, const JagRequest &req );
+	void loadCSVDirect( const char *pmesg, const JagRequest &req );
 	void sendSchemaToDataCenter( const char *mesg, const JagRequest &req );
 	void unpackSchemaInfo( const char *mesg, const JagRequest &req );
 	void askDataFromDC( const char *mesg, const JagRequest &req );
@@ -126,6 +130,7 @@ class JagDBServer
 
 	void joinRequestSend( const char *pmesg, const JagRequest &req );
 	void reconnectDataCenter( const Jstr &ip, bool doLock = true );
+	JaguarAPI *newDataCenterConnection( const Jstr &hostPort );
 	bool dbExist( const Jstr &dbName, int replicateType );
 	bool objExist( const Jstr &dbname, const Jstr &objName, int replicateType );
 
@@ -188,7 +193,6 @@ class JagDBServer
    	static pthread_mutex_t  g_dbschemamutex;
 
    	static pthread_mutex_t  g_flagmutex;
-   	static pthread_mutex_t  g_wallogmutex;
    	static pthread_mutex_t  g_dlogmutex;
    	static pthread_mutex_t  g_dinsertmutex;
    	static pthread_mutex_t  g_datacentermutex;
@@ -202,7 +206,44 @@ class JagDBServer
 	int			_scaleMode;
 
 	JagMutexMap   _walMutexMap;
-	JagWalMap     _walLogMap;
+	JagWalWriter  *_walWriter;
+	JagWalWriter  *_deltaWriter;  // delta logs of peers and recovery logs
+	int  logInsertPairs( const Jstr &db, const Jstr &tab, const JagSession *session, 
+						 const JagVector<JagDBPair> &pairVec ) const;
+	int  logCommand( const JagParseParam *ppram, JagSession *session, const char *mesg, jagint len, int spMode ) const;
+
+	// counter merge: blind increments of key-addressed rows are kept as deltas
+	bool		_counterMerge;
+
+	// range delete: deletes of a key prefix or key range are saved as deleted ranges
+	bool		_rangeDelete;
+
+	// time partition of time-series tables: seconds per simpfile time bucket; 0 none
+	time_t		_timeSeriesPartition;
+
+	// block compression of data files
+	bool		_blockCompressAll;
+	JagVector<Jstr>  _blockCompressTables;
+	bool		isBlockCompressed( const Jstr &dbName, const Jstr &tableName ) const;
+
+	// deferred index maintenance
+	bool		_indexDeferred;
+	jagint		_indexDeferMax;
+	jagint		_indexDeferReadMax;
+	void		addDeferIndex( JagIndex *pindex );
+	void		removeDeferIndex( JagIndex *pindex );
+	jagint		applyDeferIndexes();
+	Jstr		getIndexLagInfo();
+
+	// pre-aggregation buffers of time-series rollup tables
+	bool		_rollupBuffered;
+	jagint		_rollupBufferMax;
+	bool		_rollupLazyStars;
+	bool		_rollupRouting;
+	void		addRollupTable( JagTable *ptab );
+	void		removeRollupTable( JagTable *ptab );
+	jagint		flushRollupBuffers();
+	jagint		flushRollupBuffer( const Jstr &dbName, const Jstr &tableName, int replicateType );
 
   protected:
 	static int isValidInternalCommand( const char *mesg );
@@ -262,7 +303,6 @@ class JagDBServer
 	void showClusterStatus( const JagRequest &req );
 	void showDatacenter( const JagRequest &req );
 	void showTools( const JagRequest &req );
-	void logCommand( const JagParseParam *ppram, JagSession *session, const char *mesg, jagint len, int spMode );
 	static void dinsertlogCommand( JagSession *session, const char *mesg, jagint len );
 	void deltalogCommand( int mode, JagSession *session, const char *mesg, bool isBatch );
 	static void regSplogCommand( JagSession *session, const char *mesg, jagint len, int spMode );
@@ -281,6 +321,8 @@ class JagDBServer
    	static void	*monitorLog( void *sessionptr );
    	static void	*monitorRemoteBackup( void *sessionptr );
    	static void	*monitorTimeSeries( void *sessionptr );
+   	static void	*monitorIndexQueue( void *sessionptr );
+   	static void	*monitorRollupBuffers( void *sessionptr );
    	static void	*threadRemoteBackup( void *sessionptr );
    	static void	*threadRestoreRemote( void *sessionptr );
 	static void *joinRequestStatic( void * ptr );
@@ -345,6 +387,9 @@ class JagDBServer
 	void recoverDeltaLog( JagSession *session, bool force=false );
 	void resetRegSpLog();
 	void recoverRegSpLog();
+	jagint redoRecoveryLog( const Jstr &fpath );
+	jagint convertDeltaLog( const Jstr &fpath );
+	jagint deltaLogSize( const Jstr &fpath ) const;
 	void flushAllBlockIndexToDisk();
 	void removeAllBlockIndexInDisk();
 	void removeAllBlockIndexInDiskAll( const JagTableSchema *tableschema, const char *datapath );
@@ -353,12 +398,22 @@ class JagDBServer
 	void flushAllTableAndRelatedIndexsInsertBuffer();
 	jagint redoDinsertLog( const Jstr &fpath );
 	jagint redoWalLog( const Jstr &fpath );
+	jagint redoBinaryWalLog( const Jstr &fpath );
+	static void *recoverWalLogWorker( void *ptr );
+	jagint convertLegacyWalLog( const Jstr &fpath );
+	static int readTextLogRecord( int fd, int &replicateType, int &timediff, int &isBatch, char *&msg, jagint &msglen );
 	jagint redoWalLog( FILE *fp, bool isTopLevel );
 	Jstr 	getTaskIDsByThreadID( jagint threadID );
 	JagTableSchema *getTableSchema( int replicateType ) const;
 	void 	getTableIndexSchema( int replicateType, JagTableSchema *& tableschema, JagIndexSchema *&indexschema );
 	void 	openDataCenterConnection();
+	int 	replicateToOtherDataCenters( const char *mesg, bool &sucsync, const JagRequest &req );
 	int 	synchToOtherDataCenters(const char *mesg, bool &sucsync, const JagRequest &req);
+	int 	queueToOtherDataCenters( const char *mesg, const JagRequest &req );
+	const char *dataCenterCommand( const char *mesg, Jstr &host ) const;
+	JagDataCenterQueue *getDataCenterQueue( const Jstr &hostPort );
+	void 	stopDataCenterQueues();
+	void 	reportDataCenterLag();
 	int 	synchFromOtherDataCenters( const JagRequest &req, const char *mesg, const JagParseParam &pparam );
 	void 	closeDataCenterConnection();
 	int 	countOtherDataCenters();
@@ -381,6 +436,14 @@ class JagDBServer
 							  jagint &threadSchemaTime, jagint &threadHostTime, 
 							  jagint threadQueryTime, bool redoOnly, int isReadOrWriteCommand );
 	int  doInsert( JagRequest &req, JagParseParam &parseParam, Jstr &reterr, const Jstr &oricmd );
+	void doBatchInsert( JagRequest &req, const JagParseAttribute &jpa, const JagStrSplitWithQuote &split, 
+						jagint threadQueryTime, jagint &threadSchemaTime,
+						JagVector<int> &parsedVec, JagVector<int> &rejectVec );
+	bool doBatchCommand( JagRequest &req, const JagParseAttribute &jpa, JagParseParam &pparam, 
+						 const Jstr &cmd, jagint threadQueryTime, jagint &threadSchemaTime );
+	static bool isBatchInsertOp( int opcode );
+	void flushInsertGroup( JagRequest &req, JagTable *ptab, const JagStrSplitWithQuote &split,
+						   JagVector<JagDBPair> &pairVec, JagVector<int> &stmtVec, JagVector<int> &rejectVec );
 	void insertToTimeSeries( const JagSchemaRecord &schrec, const JagRequest &req, JagParseParam &pParam, const Jstr &tser, 
 							 const Jstr &dbName, const Jstr &tableName,
 	                         const JagTableSchema *tableschema, int replicateType, const Jstr &oricmd );
@@ -417,6 +480,12 @@ class JagDBServer
 
 	JAGSOCK	_sock;
 	int		_walLog;
+	JagVector<JagIndex*>	_deferIndexes;
+	pthread_mutex_t			_deferIndexMutex;
+	int						_indexDeferInterval;
+	JagVector<JagTable*>	_rollupTables;
+	pthread_mutex_t			_rollupTableMutex;
+	int						_rollupFlushInterval;
 	bool 	_clusterMode;
 	bool 	_cacheCommand;
 	jaguint _taskID;
@@ -433,20 +502,15 @@ class JagDBServer
 	
 	// replicate delta files
 	// e.g. serv 0,1,2,3,4
-	FILE *_delPrevOriCommandFile;    // 1 original on 2 for original delta
-	FILE *_delPrevRepCommandFile;	// 2 origianl to 1 on 2 for replicate delta
-	FILE *_delPrevOriRepCommandFile; // 1 original to 0 on 2 for replicate delta
-
-	FILE *_delNextOriCommandFile; // 3 original on 2 for original delta
-	FILE *_delNextRepCommandFile; // 2 original to 3 on 2 for replicate delta
-	FILE *_delNextOriRepCommandFile; // 3 original to 4 on 2 for replicate delta
-
-	Jstr _actdelPOpath;
-	Jstr _actdelPRpath;
-	Jstr _actdelPORpath;
-	Jstr _actdelNOpath;
-	Jstr _actdelNRpath;
-	Jstr _actdelNORpath;
+	// commands are appended as binary records to <path>.bin by _deltaWriter and moved
+	// to text file <path> for replay
+	Jstr _actdelPOpath;     // 1 original on 2 for original delta
+	Jstr _actdelPRpath;     // 2 origianl to 1 on 2 for replicate delta
+	Jstr _actdelPORpath;    // 1 original to 0 on 2 for replicate delta
+	Jstr _actdelNOpath;     // 3 original on 2 for original delta
+	Jstr _actdelNRpath;     // 2 original to 3 on 2 for replicate delta
+	Jstr _actdelNORpath;    // 3 original to 4 on 2 for replicate delta
+	pthread_rwlock_t _deltaPathLock;
 	Jstr _actdelPOhost;
 	Jstr _actdelPRhost;
 	Jstr _actdelPORhost;
@@ -454,9 +518,7 @@ class JagDBServer
 	Jstr _actdelNRhost;
 	Jstr _actdelNORhost;
 
-	// recovery commands log
-	FILE *_recoveryRegCommandFile;
-	FILE *_recoverySpCommandFile; 
+	// recovery commands log, binary records written by _deltaWriter
 	Jstr _recoveryRegCmdPath;
 	Jstr _recoverySpCmdPath;
 	Jstr _crecoverFpath;
@@ -478,6 +540,15 @@ class JagDBServer
 	JaguarAPI      *_dataCenter[JAG_DATACENTER_MAX];
 	int			    _numDataCenter;
 	Jstr  			_centerHostPort[JAG_DATACENTER_MAX];
+
+	// async datacenter replication: writes are queued per datacenter and sent by its queue thread
+	bool			_dcAsync;
+	int				_dcBatchSize;
+	int				_dcRetryMax;
+	JagWalWriter	*_dcWriter;      // queue files of datacenters
+	JagVector<JagDataCenterQueue*> _dcQueues;    // queues of datacenters in datacenter.conf
+	JagVector<JagDataCenterQueue*> _dcQueueAll;  // all queues, removed datacenters drain their backlog
+	pthread_rwlock_t _dcQueueLock;
 	bool            _debugClient;
 	bool            _isDirectorNode;
 
@@ -0,0 +1,509 @@
+/*
+ * Copyright (C) 2018 DataJaguar, Inc.
+ *
+ * This file is part of JaguarDB.
+ *
+ * JaguarDB is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JaguarDB is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JaguarDB (LICENSE.txt). If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JagGlobalDef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <JagDef.h>
+#include <JagUtil.h>
+#include <JagNet.h>
+#include <JagFileMgr.h>
+#include <JagStrSplit.h>
+#include <JagWalWriter.h>
+#include <JaguarAPI.h>
+#include <JagDBServer.h>
+#include <JagDataCenterQueue.h>
+
+// milliseconds the sender waits for new records when the queue is empty
+#define JAG_DC_QUEUE_IDLE_MS  200
+
+JagDataCenterQueue::JagDataCenterQueue( JagDBServer *servobj, JagWalWriter *writer, const Jstr &hostPort,
+										int batchSize, int retryMaxSec )
+{
+	_servobj = servobj;
+	_writer = writer;
+	_conn = NULL;
+	_hostPort = hostPort;
+	_batchSize = batchSize;
+	if ( _batchSize < 1 ) _batchSize = 1;
+	_retryMaxSec = retryMaxSec;
+	if ( _retryMaxSec < 1 ) _retryMaxSec = 1;
+	_started = false;
+	_stop = false;
+	_numQueued = 0;
+	_numSent = 0;
+	_numRetries = 0;
+	_numRejected = 0;
+	_liveSince = 0;
+	_sendSince = 0;
+	_sendPos = 0;
+	pthread_mutex_init( &_mutex, NULL );
+	pthread_cond_init( &_cond, NULL );
+
+	// "host:port:TYPE|host:port:TYPE"
+	_destType = JAG_DATACENTER_HOST;
+	JagStrSplit sp( _hostPort, '|', true );
+	for ( int i = 0; i < sp.length(); ++i ) {
+		JagStrSplit sp2( sp[i], ':', true );
+		if ( sp2.length() < 1 ) continue;
+		_hostIPs.append( sp2[0] );
+		_hostIPs.append( JagNet::getIPFromHostName( sp2[0] ) );
+		if ( 0 == i && sp2.length() > 2 ) {
+			if ( sp2[2] == "GATE" ) { _destType = JAG_DATACENTER_GATE; }
+			else if ( sp2[2] == "PGATE" ) { _destType = JAG_DATACENTER_PGATE; }
+		}
+	}
+
+	Jstr name = _hostPort;
+	char *p = (char*)name.c_str();
+	for ( ; *p; ++p ) {
+		if ( ! isalnum( *p ) && *p != '.' && *p != '-' ) *p = '_';
+	}
+	Jstr dir = JagFileMgr::getLocalLogDir("datacenter");
+	JagFileMgr::makedirPath( dir, 0700 );
+	_qpath = dir + "/" + name + ".dcq";
+	_spath = _qpath + "_send";
+	_ppath = _qpath + "_pos";
+	_bpath = _qpath + "_bad";
+	_dpath = _qpath + "_dead";
+
+	// records left by the last run
+	struct stat st;
+	if ( 0 == stat( _spath.s(), &st ) ) _sendSince = st.st_mtime;
+	if ( 0 == stat( _qpath.s(), &st ) && st.st_size > JAG_WAL_FILE_MAGIC_LEN ) _liveSince = st.st_mtime;
+}
+
+JagDataCenterQueue::~JagDataCenterQueue()
+{
+	stop();
+	pthread_mutex_destroy( &_mutex );
+	pthread_cond_destroy( &_cond );
+}
+
+void JagDataCenterQueue::start()
+{
+	if ( _started ) return;
+	_stop = false;
+	jagpthread_create( &_thread, NULL, senderThreadStatic, (void*)this );
+	_started = true;
+	raydebug( stdout, JAG_LOG_LOW, "Datacenter queue [%s] started batch=%d\n", _hostPort.s(), _batchSize );
+}
+
+// stop the sender after its current batch; queued records stay on disk
+void JagDataCenterQueue::stop()
+{
+	if ( ! _started ) return;
+	_stop = true;
+	jaguar_mutex_lock( &_mutex );
+	pthread_cond_signal( &_cond );
+	jaguar_mutex_unlock( &_mutex );
+	pthread_join( _thread, NULL );
+	_started = false;
+}
+
+// append one command to the queue
+// return 1: OK  0: error
+int JagDataCenterQueue::enqueue( int timediff, const char *cmd, jagint len )
+{
+	JagWalRecord rec;
+	rec.addSQL( 0, timediff, 0, cmd, len );
+
+	jaguar_mutex_lock( &_mutex );
+	if ( 0 == _liveSince ) _liveSince = time(NULL);
+	jaguar_mutex_unlock( &_mutex );
+
+	if ( ! _writer->append( _qpath, rec.data(), rec.size() ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20410 error append datacenter queue [%s]\n", _qpath.s() );
+		return 0;
+	}
+	++ _numQueued;
+	return 1;
+}
+
+// ip (or host name) is one of the hosts of this datacenter
+bool JagDataCenterQueue::hasHost( const Jstr &ip ) const
+{
+	for ( int i = 0; i < _hostIPs.size(); ++i ) {
+		if ( _hostIPs[i] == ip ) return true;
+	}
+	return false;
+}
+
+// bytes of records not yet sent
+jagint JagDataCenterQueue::pendingBytes()
+{
+	jagint bytes = JagFileMgr::fileSize( _qpath ) - JAG_WAL_FILE_MAGIC_LEN;
+	if ( bytes < 0 ) bytes = 0;
+	jaguar_mutex_lock( &_mutex );
+	if ( _sendSince > 0 ) {
+		jagint sbytes = JagFileMgr::fileSize( _spath ) - _sendPos;
+		if ( sbytes > 0 ) bytes += sbytes;
+	}
+	jaguar_mutex_unlock( &_mutex );
+	return bytes;
+}
+
+// seconds since the oldest unsent record was queued (upper bound), 0 if caught up
+jagint JagDataCenterQueue::lagSeconds()
+{
+	jaguar_mutex_lock( &_mutex );
+	time_t t = _sendSince > 0 ? _sendSince : _liveSince;
+	jaguar_mutex_unlock( &_mutex );
+	if ( t < 1 ) return 0;
+	return time(NULL) - t;
+}
+
+// move the live queue file aside for sending; appends wait only for the rename
+// return true if there are records to send
+bool JagDataCenterQueue::rotate()
+{
+	jaguar_mutex_lock( &_mutex );
+	bool has = ( _liveSince > 0 );
+	jaguar_mutex_unlock( &_mutex );
+	if ( ! has ) return false;
+
+	bool moved = false;
+	_writer->suspendFile( _qpath );
+	jaguar_mutex_lock( &_mutex );
+	if ( JagFileMgr::fileSize( _qpath ) > JAG_WAL_FILE_MAGIC_LEN ) {
+		jagrename( _qpath.s(), _spath.s() );
+		_sendSince = _liveSince;
+		_sendPos = 0;
+		moved = true;
+	}
+	_liveSince = 0;
+	jaguar_mutex_unlock( &_mutex );
+	_writer->resumeFile( _qpath );
+
+	if ( moved ) jagunlink( _ppath.s() );
+	return moved;
+}
+
+// send up to _batchSize records of fp starting at pos as one batch; an insert-select is sent alone
+// since it reads on the datacenter. Statements the datacenter rejects are moved to _dpath.
+// pos is moved past the batch once the datacenter acknowledges it and saved once per batch
+// return number of records sent, 0 at end of file, -1 connection error, -2 corrupt record at pos
+int JagDataCenterQueue::sendBatch( FILE *fp, jagint &pos )
+{
+	if ( 0 != fseek( fp, pos, SEEK_SET ) ) return -1;
+
+	char *body = NULL;
+	jagint bodycap = 0, bodylen = 0, plen;
+	char type;
+	int  replicateType, timediff, rc, n = 0;
+	bool bad = false, single = false;
+	const char *payload;
+	Jstr cmds, cmd;
+	JagVector<jagint> ends;   // end offset of each record of the batch
+	while ( n < _batchSize ) {
+		rc = JagWalRecord::readRecord( fp, body, bodycap, bodylen );
+		if ( 0 == rc ) break;
+		if ( rc < 0 || ! JagWalRecord::parseBody( body, bodylen, type, replicateType, timediff, payload, plen )
+			 || JAG_WAL_REC_SQL != type ) {
+			bad = true;
+			break;
+		}
+
+		cmd = Jstr( payload+1, plen-1, plen-1 );
+		single = ( 0 == strncasecmp( cmd.s(), "insert ", 7 ) && strcasestrskipquote( cmd.s(), " select " ) );
+		if ( single && n > 0 ) break;
+		if ( n > 0 ) cmds += ";";
+		cmds += cmd;
+		ends.append( ftell( fp ) );
+		++n;
+		if ( single ) break;
+	}
+	if ( body ) free( body );
+
+	if ( n < 1 ) return bad ? -2 : 0;
+
+	JagVector<int> rejected;
+	if ( single ) {
+		bool rej = false;
+		rc = sendOne( cmds, rej );
+		if ( rej ) rejected.append( 0 );
+	} else {
+		rc = sendCommands( cmds, rejected );
+	}
+	if ( ! rc ) return -1;
+
+	jagint start;
+	for ( int i = 0; i < rejected.size(); ++i ) {
+		if ( rejected[i] < 0 || rejected[i] >= n ) continue;
+		start = ( 0 == rejected[i] ) ? pos : ends[rejected[i]-1];
+		deadLetter( fp, start, ends[rejected[i]] );
+	}
+
+	pos = ends[n-1];
+	writePos( pos );
+	acked( pos, n );
+	return n;
+}
+
+// "E20417 rejected 2,5" from a datacenter: positions of the rejected statements of a batch
+// return false if err is not such a reply
+bool JagDataCenterQueue::parseRejected( const char *err, JagVector<int> &rejected )
+{
+	const char *tag = "E20417 rejected ";
+	if ( ! err || 0 != strncmp( err, tag, strlen(tag) ) ) return false;
+	JagStrSplit sp( err + strlen(tag), ',', true );
+	for ( int i = 0; i < sp.length(); ++i ) {
+		rejected.append( atoi( sp[i].c_str() ) );
+	}
+	return rejected.size() > 0;
+}
+
+// commands separated by ';' in one batch transfer
+// return 1: sent, rejected gets the statements the datacenter did not take  0: connection error
+int JagDataCenterQueue::sendCommands( const Jstr &cmds, JagVector<int> &rejected )
+{
+	_conn->setDataCenterSync();
+	if ( ! _conn->queryBatch( cmds.s(), cmds.size() ) ) {
+		if ( _conn->allSocketsBad() ) return 0;
+		if ( ! parseRejected( _conn->error(), rejected ) ) {
+			// not a reply about statements; the batch is sent again
+			raydebug( stdout, JAG_LOG_LOW, "E20412 datacenter [%s] did not take batch: %s\n", _hostPort.s(), _conn->error() );
+			return 0;
+		}
+		return 1;
+	}
+	_conn->replyAll();
+	return _conn->allSocketsBad() ? 0 : 1;
+}
+
+// return 1: sent, rejected is set if the datacenter did not take cmd  0: connection error
+int JagDataCenterQueue::sendOne( const Jstr &cmd, bool &rejected )
+{
+	_conn->setDataCenterSync();
+	rejected = false;
+	if ( ! _conn->query( cmd.s() ) ) {
+		if ( _conn->allSocketsBad() ) return 0;
+		rejected = true;
+		return 1;
+	}
+	_conn->replyAll();
+	return _conn->allSocketsBad() ? 0 : 1;
+}
+
+// keep a rejected record of _spath in _dpath so the datacenter does not diverge silently
+void JagDataCenterQueue::deadLetter( FILE *fp, jagint pos, jagint end )
+{
+	++ _numRejected;
+	if ( copyRecords( fp, pos, end, _dpath ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20413 datacenter [%s] rejected record at %l, moved to [%s]\n", 
+				  _hostPort.s(), pos, _dpath.s() );
+	} else {
+		raydebug( stdout, JAG_LOG_LOW, "E20413 datacenter [%s] rejected record at %l of [%s], not saved\n", 
+				  _hostPort.s(), pos, _spath.s() );
+	}
+}
+
+bool JagDataCenterQueue::connect()
+{
+	if ( _conn ) return true;
+	_conn = _servobj->newDataCenterConnection( _hostPort );
+	return ( _conn != NULL );
+}
+
+void JagDataCenterQueue::disconnect()
+{
+	if ( ! _conn ) return;
+	_conn->close();
+	delete _conn;
+	_conn = NULL;
+}
+
+void JagDataCenterQueue::waitFor( int ms )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec = ts.tv_nsec % 1000000000L;
+	jaguar_mutex_lock( &_mutex );
+	if ( ! _stop ) pthread_cond_timedwait( &_cond, &_mutex, &ts );
+	jaguar_mutex_unlock( &_mutex );
+}
+
+jagint JagDataCenterQueue::readPos()
+{
+	if ( ! JagFileMgr::exist( _ppath ) ) return 0;
+	Jstr str;
+	JagFileMgr::readTextFile( _ppath, str );
+	return jagatoll( str.c_str() );
+}
+
+void JagDataCenterQueue::writePos( jagint pos )
+{
+	char buf[32];
+	sprintf( buf, "%lld", pos );
+	JagFileMgr::writeTextFile( _ppath, buf );
+}
+
+// records of _spath up to pos are acknowledged by the datacenter; caller saves pos
+void JagDataCenterQueue::acked( jagint pos, int n )
+{
+	jaguar_mutex_lock( &_mutex );
+	_sendPos = pos;
+	jaguar_mutex_unlock( &_mutex );
+	_numSent += n;
+}
+
+// end of the corrupt record at pos: past its body if its length fits in the file,
+// else the end of the file since no later record can be found
+jagint JagDataCenterQueue::corruptEnd( FILE *fp, jagint pos )
+{
+	jagint fsize = JagFileMgr::fileSize( _spath );
+	char hdr[JAG_WAL_REC_HDR_LEN];
+	unsigned int blen;
+	if ( 0 == fseek( fp, pos, SEEK_SET ) && fread( hdr, 1, JAG_WAL_REC_HDR_LEN, fp ) == JAG_WAL_REC_HDR_LEN ) {
+		memcpy( &blen, hdr, 4 );
+		if ( blen >= JAG_WAL_REC_BODY_HDR && blen <= JAG_WAL_REC_MAX_BODY 
+			 && pos + JAG_WAL_REC_HDR_LEN + (jagint)blen <= fsize ) {
+			return pos + JAG_WAL_REC_HDR_LEN + blen;
+		}
+	}
+	return fsize;
+}
+
+// append bytes pos..end of fp to path
+// return 1: OK  0: error
+int JagDataCenterQueue::copyRecords( FILE *fp, jagint pos, jagint end, const Jstr &path )
+{
+	FILE *bfp = fopen( path.s(), "ab" );
+	if ( ! bfp ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20415 error open [%s]\n", path.s() );
+		return 0;
+	}
+
+	char buf[8192];
+	size_t n;
+	jagint left = end - pos;
+	int ok = ( 0 == fseek( fp, pos, SEEK_SET ) );
+	while ( ok && left > 0 ) {
+		n = fread( buf, 1, left < (jagint)sizeof(buf) ? left : sizeof(buf), fp );
+		if ( n < 1 || fwrite( buf, 1, n, bfp ) != n ) ok = 0;
+		left -= n;
+	}
+	if ( 0 != fflush( bfp ) || 0 != jagfdatasync( fileno( bfp ) ) ) ok = 0;
+	fclose( bfp );
+
+	if ( ! ok ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20415 error write [%s]\n", path.s() );
+	}
+	return ok;
+}
+
+void JagDataCenterQueue::runSender()
+{
+	FILE *fp = NULL;
+	jagint pos = 0, newpos;
+	int  n, backoff = 0;
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+
+	while ( ! _stop ) {
+		if ( ! fp ) {
+			if ( ! JagFileMgr::exist( _spath ) && ! rotate() ) {
+				waitFor( JAG_DC_QUEUE_IDLE_MS );
+				continue;
+			}
+			fp = fopen( _spath.s(), "rb" );
+			if ( ! fp ) {
+				waitFor( JAG_DC_QUEUE_IDLE_MS );
+				continue;
+			}
+			if ( fread( magic, 1, JAG_WAL_FILE_MAGIC_LEN, fp ) != JAG_WAL_FILE_MAGIC_LEN
+				 || 0 != memcmp( magic, JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN ) ) {
+				// the file is kept in _bpath; it is removed only once copied there
+				bool moved = copyRecords( fp, 0, JagFileMgr::fileSize( _spath ), _bpath );
+				fclose( fp );
+				fp = NULL;
+				if ( ! moved ) {
+					waitFor( _retryMaxSec * 1000 );
+					continue;
+				}
+				raydebug( stdout, JAG_LOG_LOW, "E20414 bad datacenter queue file [%s] moved to [%s]\n", _spath.s(), _bpath.s() );
+				jagunlink( _spath.s() );
+				jagunlink( _ppath.s() );
+				continue;
+			}
+			pos = readPos();
+			if ( pos < JAG_WAL_FILE_MAGIC_LEN ) pos = JAG_WAL_FILE_MAGIC_LEN;
+			jaguar_mutex_lock( &_mutex );
+			if ( 0 == _sendSince ) _sendSince = time(NULL);
+			_sendPos = pos;
+			jaguar_mutex_unlock( &_mutex );
+		}
+
+		n = -1;
+		if ( connect() ) {
+			n = sendBatch( fp, pos );
+		}
+
+		if ( -1 == n ) {
+			// resend from the first unacknowledged command after reconnect; backoff 1, 2, 4 ... _retryMaxSec seconds
+			disconnect();
+			++ _numRetries;
+			backoff = backoff > 0 ? backoff * 2 : 1;
+			if ( backoff > _retryMaxSec ) backoff = _retryMaxSec;
+			raydebug( stdout, JAG_LOG_LOW, "Datacenter [%s] unreachable, retry in %d seconds, lag %l seconds\n",
+					  _hostPort.s(), backoff, lagSeconds() );
+			waitFor( backoff * 1000 );
+			continue;
+		}
+		backoff = 0;
+
+		if ( -2 == n ) {
+			// skip the corrupt record once its bytes are kept in _bpath
+			newpos = corruptEnd( fp, pos );
+			if ( ! copyRecords( fp, pos, newpos, _bpath ) ) {
+				waitFor( _retryMaxSec * 1000 );
+				continue;
+			}
+			raydebug( stdout, JAG_LOG_LOW, "E20411 corrupt record in datacenter queue [%s] at %l, %l bytes moved to [%s]\n",
+					  _spath.s(), pos, newpos-pos, _bpath.s() );
+			pos = newpos;
+			writePos( pos );
+			acked( pos, 0 );
+			continue;
+		}
+
+		if ( 0 == n ) {
+			// all records are sent
+			fclose( fp );
+			fp = NULL;
+			jagunlink( _spath.s() );
+			jagunlink( _ppath.s() );
+			jaguar_mutex_lock( &_mutex );
+			_sendSince = 0;
+			_sendPos = 0;
+			jaguar_mutex_unlock( &_mutex );
+			continue;
+		}
+	}
+
+	if ( fp ) fclose( fp );
+	disconnect();
+}
+
+void *JagDataCenterQueue::senderThreadStatic( void *ptr )
+{
+	((JagDataCenterQueue*)ptr)->runSender();
+	return NULL;
+}
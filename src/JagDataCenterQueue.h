@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 DataJaguar, Inc.
+ *
+ * This file is part of JaguarDB.
+ *
+ * JaguarDB is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JaguarDB is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JaguarDB (LICENSE.txt). If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _jag_datacenter_queue_h_
+#define _jag_datacenter_queue_h_
+
+#include <pthread.h>
+#include <atomic>
+#include <abax.h>
+#include <JagVector.h>
+
+class JagDBServer;
+class JagWalWriter;
+class JaguarAPI;
+
+// Persistent outbound queue of write commands to one remote datacenter
+// Sessions append 'S' wallog records to <log>/datacenter/<name>.dcq through the
+// group-commit writer and return. A sender thread moves the queue file aside to
+// <name>.dcq_send, sends its records in batches over its own connection and keeps the
+// offset after the last acknowledged batch in <name>.dcq_pos, so a restart or reconnect
+// resends at most one batch. A failed send is retried with exponential backoff after a
+// reconnect. Statements the datacenter rejects are moved to <name>.dcq_dead and corrupt
+// records to <name>.dcq_bad; the send file is removed only after its last record is sent.
+class JagDataCenterQueue
+{
+  public:
+	JagDataCenterQueue( JagDBServer *servobj, JagWalWriter *writer, const Jstr &hostPort,
+						int batchSize, int retryMaxSec );
+	virtual ~JagDataCenterQueue();
+
+	void 	start();
+	void 	stop();
+	int		enqueue( int timediff, const char *cmd, jagint len );
+	bool	hasHost( const Jstr &ip ) const;
+	int		destType() const { return _destType; }
+	const Jstr &hostPort() const { return _hostPort; }
+	jagint	pendingBytes();
+	jagint	lagSeconds();
+
+	std::atomic<jagint>  _numQueued;
+	std::atomic<jagint>  _numSent;
+	std::atomic<jagint>  _numRetries;
+	std::atomic<jagint>  _numRejected;
+
+  protected:
+	bool	rotate();
+	int		sendBatch( FILE *fp, jagint &pos );
+	virtual int		sendCommands( const Jstr &cmds, JagVector<int> &rejected );
+	virtual int		sendOne( const Jstr &cmd, bool &rejected );
+	static bool	parseRejected( const char *err, JagVector<int> &rejected );
+	virtual bool	connect();
+	virtual void	disconnect();
+	void	waitFor( int ms );
+	jagint	readPos();
+	void	writePos( jagint pos );
+	void	acked( jagint pos, int n );
+	int		copyRecords( FILE *fp, jagint pos, jagint end, const Jstr &path );
+	void	deadLetter( FILE *fp, jagint pos, jagint end );
+	jagint	corruptEnd( FILE *fp, jagint pos );
+	void	runSender();
+	static void *senderThreadStatic( void *ptr );
+
+	JagDBServer			*_servobj;
+	JagWalWriter		*_writer;
+	JaguarAPI			*_conn;
+	Jstr				_hostPort;     // line of datacenter.conf
+	JagVector<Jstr>		_hostIPs;      // IP of each host in _hostPort
+	int					_destType;
+	int					_batchSize;
+	int					_retryMaxSec;
+	Jstr				_qpath;        // live queue file
+	Jstr				_spath;        // queue file being sent
+	Jstr				_ppath;        // sent offset in _spath
+	Jstr				_bpath;        // corrupt records taken out of _spath
+	Jstr				_dpath;        // records of _spath the datacenter rejected
+	time_t				_liveSince;    // time of first record in _qpath
+	time_t				_sendSince;    // time of first record in _spath
+	jagint				_sendPos;      // offset of next record to send in _spath
+	bool				_started;
+	std::atomic<bool>	_stop;
+	pthread_t			_thread;
+	pthread_mutex_t		_mutex;
+	pthread_cond_t		_cond;
+};
+
+#endif
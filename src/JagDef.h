@@ -190,6 +190,9 @@
 #define JAG_SCMD_CDEFVAL				692
 #define JAG_SCMD_IMPORTTABLE			694
 #define JAG_SCMD_TRUNCATETABLE			696
+#define JAG_SCMD_MONINDEXLAG			698
+#define JAG_SCMD_INGESTSORTED			700
+#define JAG_SCMD_LOADCSV				702
 
 #define JAG_RCMD_HELP					800
 #define JAG_RCMD_USE					802
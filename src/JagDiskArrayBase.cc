@@ -235,6 +235,12 @@ jagint JagDiskArrayBase::flushBufferToNewFile( const JagDBMap *pairmap )
 	return cnt;
 }
 
+jagint JagDiskArrayBase::flushSortedToNewFile( const char *kvbufs, jagint num )
+{
+	jagint cnt = _compf->flushSortedToNewSimpFile( kvbufs, num );
+	return cnt;
+}
+
 
 bool JagDiskArrayBase::checkSetPairCondition( const JagDBServer *servobj, const JagRequest &req, const JagDBPair &pair, char *buffers[], 
 												bool uniqueAndHasValueCol, 
@@ -94,6 +94,7 @@ class JagDiskArrayBase
 		jagint getRegionElements( jagint first, jagint length );
 		void insertMergeUpdateBlockIndex( char *kvbuf, jagint ipos, jagint &lastBlock );
 		jagint flushBufferToNewFile( const JagDBMap *pairmap );
+		jagint flushSortedToNewFile( const char *kvbufs, jagint num );
 		static bool checkSetPairCondition( const JagDBServer *servobj, const JagRequest &req, const JagDBPair &pair, char *buffers[], 
 									bool uniqueAndHasValueCol, ExprElementNode *root, 
 									const JagParseParam *parseParam, int numKeys, const JagSchemaAttribute *schAttr, 
@@ -28,6 +28,7 @@
 #include <JagFixKeyChecker.h>
 #include <JagDBMap.h>
 #include <JagCompFile.h>
+#include <JagMutex.h>
 
 JagDiskArrayFamily::JagDiskArrayFamily( const JagDBServer *servobj, const Jstr &filePathName, const JagSchemaRecord *record, 
 									    jagint length, bool buildInitIndex ) : _schemaRecord(record)
@@ -116,6 +117,23 @@ JagDiskArrayFamily::JagDiskArrayFamily( const JagDBServer *servobj, const Jstr &
 
 	_isFlushing = 0;
 	_doForceFlush = false;
+
+	pthread_rwlock_init( &_familyLock, NULL );
+	pthread_rwlock_init( &_flushLock, NULL );
+	pthread_rwlock_init( &_scanLock, NULL );
+	_preFlushHook = NULL;
+	_preFlushArg = NULL;
+	_mergeDeltaMap = new JagDBMap();
+	_numMergeDeltas = 0;
+	pthread_mutex_init( &_mergeDeltaMutex, NULL );
+	_rangeDeletedRows = -1;
+	loadRangeDeletes();
+	_timeOffset = _timeLength = 0;
+	_timeBucketLen = 0;
+	_blockCompress = false;
+	for ( int i = 0; i < JAG_FAMILY_KEY_STRIPES; ++i ) {
+		pthread_mutex_init( &_keyMutex[i], NULL );
+	}
 }
 
 jagint JagDiskArrayFamily::addKeyCheckerFromJDB( JagDiskArrayServer *ldarr, int activepos )
@@ -194,6 +212,19 @@ JagDiskArrayFamily::~JagDiskArrayFamily()
 		delete _insertBufferMap; 
 		_insertBufferMap=NULL; 
 	}
+
+	if ( _mergeDeltaMap ) {
+		delete _mergeDeltaMap;
+		_mergeDeltaMap = NULL;
+	}
+
+	pthread_rwlock_destroy( &_familyLock );
+	pthread_rwlock_destroy( &_flushLock );
+	pthread_rwlock_destroy( &_scanLock );
+	pthread_mutex_destroy( &_mergeDeltaMutex );
+	for ( int i = 0; i < JAG_FAMILY_KEY_STRIPES; ++i ) {
+		pthread_mutex_destroy( &_keyMutex[i] );
+	}
 }
 
 
@@ -202,6 +233,18 @@ jagint JagDiskArrayFamily::processFlushInsertBuffer()
 	jagint cnt = 0; 
 	bool doneFlush = false;
 
+	// pending counter deltas go into the rows before the wallog holding them is reset
+	jagint folded = foldMergeDeltas();
+	if ( _insertBufferMap->elements() < 1 ) {
+		if ( folded > 0 ) {
+			removeAndReopenWalLog();
+		}
+		return 0;
+	}
+
+	// buffered rows must not become file rows inside a deleted range
+	purgeBufferedRangeDeletes();
+
 	if ( _darrlist.size() < 1 ) {
 		doneFlush = false;  // new darr will be added, see below
 	} else {
@@ -239,6 +282,7 @@ jagint JagDiskArrayFamily::processFlushInsertBuffer()
 	if ( doneFlush ) {
 		raydebug(stdout, JAG_LOG_LOW, "cleanup insertbuffer\n" ); 
 		_insertBufferMap->clear();
+		_rangeDeletedRows = -1;
 
 		removeAndReopenWalLog();
 
@@ -248,6 +292,47 @@ jagint JagDiskArrayFamily::processFlushInsertBuffer()
 	return cnt;
 }
 
+// Write the insert buffer to a new file while open readers hold the scan lock. Files the
+// readers scan are not changed: pending counter deltas, range deletes and the wallog are left
+// to the next flush, and replayed inserts of the spilled rows are skipped as duplicates.
+// Rows inside a saved range delete stay buffered, since the range would hide them in a file.
+// caller holds the family write lock
+// return number of rows spilled
+jagint JagDiskArrayFamily::spillInsertBuffer()
+{
+	JagDBMap kept;
+	if ( _rangeDeletes.size() > 0 ) {
+		JagFixMapIterator iter = _insertBufferMap->_map->begin();
+		while ( iter != _insertBufferMap->_map->end() ) {
+			if ( rangeDeleted( iter->first.c_str() ) ) {
+				kept.insert( JagDBPair( iter->first, iter->second ) );
+				iter = _insertBufferMap->_map->erase( iter );
+			} else {
+				++iter;
+			}
+		}
+	}
+
+	jagint cnt = 0;
+	JagDiskArrayServer *darr = flushBufferToNewFile();
+	if ( darr != nullptr ) {
+		_darrlist.append( darr );
+		cnt = _insertBufferMap->elements();
+		addKeyCheckerFromInsertBuffer( _darrlist.size() - 1 );
+		_insertBufferMap->clear();
+	 	jagmalloc_trim(0);
+	}
+
+	JagFixMapIterator iter = kept._map->begin();
+	while ( iter != kept._map->end() ) {
+		_insertBufferMap->insert( JagDBPair( iter->first, iter->second ) );
+		++iter;
+	}
+
+	raydebug(stdout, JAG_LOG_LOW, "s20347 %s spilled %l buffered rows to a new file during scan\n", _objname.c_str(), cnt ); 
+	return cnt;
+}
+
 int JagDiskArrayFamily::findMinCostFile( JagVector<JagMergeSeg> &vec, bool forceFlush, int &mtype )
 {
 	jagint sequentialReadSpeed = _servobj->_cfg->getLongValue("SEQ_READ_SPEED", 200);
@@ -283,6 +368,9 @@ int JagDiskArrayFamily::findMinCostFile( JagVector<JagMergeSeg> &vec, bool force
 	}
 }
 
+// Inserts of the same table run concurrently under the shared table insert lock.
+// The family lock makes the uniqueness check and the buffer insert atomic;
+// selects hold it shared through readLockTable/readLockIndex.
 int JagDiskArrayFamily::insert( const JagDBPair &pair, bool doFirstRedist, 
 							    JagDBPair &retpair, bool noDupPrint )
 {
@@ -290,31 +378,126 @@ int JagDiskArrayFamily::insert( const JagDBPair &pair, bool doFirstRedist,
 	memset( kbuf, 0, _KLEN+1);
 	memcpy( kbuf, pair.key.c_str(), _KLEN );
 
-	if ( _keyChecker && _keyChecker->exist( kbuf ) ) {
-		return 0;
+	char v[2];
+	pthread_rwlock_wrlock( &_familyLock );
+	// one key checker probe gives both existence and the file of the row
+	if ( _keyChecker && _keyChecker->getValue( kbuf, v ) ) {
+		// a row hidden by a range delete is replaced
+		if ( ! rangeDeleted( kbuf ) || ! removeFileRow( kbuf, (jagbyte)v[0]*(JAG_BYTE_MAX+1)+(jagbyte)v[1] ) ) {
+			++_dupwrites;
+			pthread_rwlock_unlock( &_familyLock );
+			return 0;
+		}
+		_rangeDeletedRows = -1;
 	}
 
-    int rc;
-	if ( _insertBufferMap->exist( pair ) ) {
+	// duplicate check and placement in one search of the insert buffer
+    JagFixMapIterator iter;
+	if ( ! _insertBufferMap->insertIfAbsent( pair, iter ) ) {
+		++_dupwrites;
+		pthread_rwlock_unlock( &_familyLock );
 		prt(("s2038271 _pathname=[%s]\n", _pathname.s() ));
 		return 0;
 	}
-
-    rc = _insertBufferMap->insert( pair );
-    if ( !rc ) ++_dupwrites;
-	prt(("s22029 _insertBufferMap->insert rc=%d elem=%d\n", rc, _insertBufferMap->elements() ));
+	prt(("s22029 _insertBufferMap->insert elem=%d\n", _insertBufferMap->elements() ));
 
 	jagint  currentCnt = _insertBufferMap->elements();
 	jagint  currentMem = currentCnt *_KVLEN;
+	pthread_rwlock_unlock( &_familyLock );
 	if ( currentMem < JAG_SIMPFILE_LIMIT_BYTES ) {
 		return 1; // done put to buffer
 	}
 
-	processFlushInsertBuffer();
+	// caller may hold the flush lock shared (logged but not inserted yet); never wait here
+	flushIfFull( false );
 	
     return 1;
 }
 
+// Flush the insert buffer if it is full. The flush resets the wallog, so it must
+// not run while an inserter is between its wallog append and its buffer insert.
+// canWait false: give up if any inserter holds the flush lock; the next one flushes
+// canWait true:  caller holds no flush lock; wait for inserters if buffer is far over limit
+// return true if flushed
+bool JagDiskArrayFamily::flushIfFull( bool canWait )
+{
+	pthread_rwlock_rdlock( &_familyLock );
+	jagint currentMem = _insertBufferMap->elements() * _KVLEN;
+	pthread_rwlock_unlock( &_familyLock );
+	if ( _numMergeDeltas * _KVLEN > currentMem ) currentMem = _numMergeDeltas * _KVLEN;
+	if ( currentMem < JAG_SIMPFILE_LIMIT_BYTES ) return false;
+
+	if ( 0 != pthread_rwlock_trywrlock( &_flushLock ) ) {
+		if ( ! canWait || currentMem < 2*JAG_SIMPFILE_LIMIT_BYTES ) return false;
+		pthread_rwlock_wrlock( &_flushLock );
+	}
+
+	// the flush rewrites files that open readers are scanning; leave it to a later insert,
+	// but a buffer far over limit is spilled to a new file the readers do not list
+	if ( 0 != pthread_rwlock_trywrlock( &_scanLock ) ) {
+		bool spilled = false;
+		pthread_rwlock_wrlock( &_familyLock );
+		if ( _insertBufferMap->elements() * _KVLEN >= 2*JAG_SIMPFILE_LIMIT_BYTES ) {
+			spilled = spillInsertBuffer() > 0;
+		}
+		pthread_rwlock_unlock( &_familyLock );
+		pthread_rwlock_unlock( &_flushLock );
+		return spilled;
+	}
+
+	// owner writes out data derived from buffered records (e.g. deferred index records)
+	if ( _preFlushHook ) {
+		(*_preFlushHook)( _preFlushArg );
+	}
+
+	bool flushed = false;
+	pthread_rwlock_wrlock( &_familyLock );
+	if ( _insertBufferMap->elements() * _KVLEN >= JAG_SIMPFILE_LIMIT_BYTES 
+		 || _numMergeDeltas * _KVLEN >= JAG_SIMPFILE_LIMIT_BYTES ) {
+		processFlushInsertBuffer();
+		flushed = true;
+	}
+	pthread_rwlock_unlock( &_familyLock );
+	pthread_rwlock_unlock( &_scanLock );
+	pthread_rwlock_unlock( &_flushLock );
+	return flushed;
+}
+
+// lock key stripes of pairVec in ascending order, then hold flush lock shared
+// keeps wallog order and buffer order of the same key identical
+void JagDiskArrayFamily::lockInsertKeys( const JagVector<JagDBPair> &pairVec )
+{
+	JagVector<int> stripes;
+	getKeyStripes( pairVec, stripes );
+	for ( int i = 0; i < stripes.size(); ++i ) {
+		pthread_mutex_lock( &_keyMutex[ stripes[i] ] );
+	}
+	pthread_rwlock_rdlock( &_flushLock );
+}
+
+void JagDiskArrayFamily::unlockInsertKeys( const JagVector<JagDBPair> &pairVec )
+{
+	pthread_rwlock_unlock( &_flushLock );
+	JagVector<int> stripes;
+	getKeyStripes( pairVec, stripes );
+	for ( int i = stripes.size()-1; i >= 0; --i ) {
+		pthread_mutex_unlock( &_keyMutex[ stripes[i] ] );
+	}
+}
+
+// sorted distinct stripe numbers of keys in pairVec
+void JagDiskArrayFamily::getKeyStripes( const JagVector<JagDBPair> &pairVec, JagVector<int> &stripes )
+{
+	bool used[JAG_FAMILY_KEY_STRIPES];
+	memset( used, 0, sizeof(used) );
+	for ( int i = 0; i < pairVec.size(); ++i ) {
+		used[ jagcrc32( pairVec[i].key.c_str(), pairVec[i].key.size() ) % JAG_FAMILY_KEY_STRIPES ] = true;
+	}
+	for ( int i = 0; i < JAG_FAMILY_KEY_STRIPES; ++i ) {
+		if ( used[i] ) stripes.append( i );
+	}
+}
+
 jagint JagDiskArrayFamily::getCount( )
 {
 	jagint mem = 0;
@@ -324,6 +507,9 @@ jagint JagDiskArrayFamily::getCount( )
 	}
 
 	kchn = _keyChecker->size();
+	if ( _rangeDeletes.size() > 0 ) {
+		kchn -= countRangeDeleted();
+	}
 	return mem+kchn;	
 }
 
@@ -339,10 +525,8 @@ bool JagDiskArrayFamily::isFlushing()
 
 bool JagDiskArrayFamily::remove( const JagDBPair &pair )
 {
-	int rc = 0;
-	int pos = 0, div, rem;
-	char v[2];
-
+	JagReadWriteMutex mutex( &_familyLock, JagReadWriteMutex::WRITE_LOCK );
+	dropMergeDelta( pair );
 	if ( _insertBufferMap && _insertBufferMap->remove( pair ) ) {
 		return true;
 	}
@@ -350,25 +534,42 @@ bool JagDiskArrayFamily::remove( const JagDBPair &pair )
 	char kbuf[_KLEN+1];
 	memset( kbuf, 0, _KLEN+1);
 	memcpy( kbuf, pair.key.c_str(), _KLEN );
+	if ( rangeDeleted( kbuf ) ) {
+		return 0;
+	}
+
+	return removeFileRow( kbuf );
+}
+
+// remove key from its file and the key checker
+bool JagDiskArrayFamily::removeFileRow( const char *kbuf )
+{
+	int pos = 0, div, rem;
+	char v[2];
 
 	if ( _keyChecker->getValue( kbuf, v ) ) {
 		div = (jagbyte)v[0];
 		rem = (jagbyte)v[1];
 		pos = div*(JAG_BYTE_MAX+1)+rem;
-
-		rc = _darrlist[pos]->remove( pair );
-
-		if ( rc ) {
-			rc = _keyChecker->removeKey( pair.key.c_str() );
-		}
-		return rc;
+		return removeFileRow( kbuf, pos );
 	} else {
 		return 0;
 	}
 }
 
+// pos: file of the row, already looked up in the key checker
+bool JagDiskArrayFamily::removeFileRow( const char *kbuf, int pos )
+{
+	int rc = _darrlist[pos]->remove( JagDBPair( kbuf, _KLEN ) );
+	if ( rc ) {
+		rc = _keyChecker->removeKey( kbuf );
+	}
+	return rc;
+}
+
 bool JagDiskArrayFamily::exist( JagDBPair &pair )
 {
+	JagReadWriteMutex mutex( &_familyLock, JagReadWriteMutex::READ_LOCK );
 	if ( _insertBufferMap && _insertBufferMap->get( pair ) ) {
 		return true;
 	}
@@ -381,7 +582,7 @@ bool JagDiskArrayFamily::exist( JagDBPair &pair )
 	memset( kbuf, 0, _KLEN+1);
 	memcpy( kbuf, pair.key.c_str(), _KLEN );
 
-	if ( _keyChecker->getValue( kbuf, v ) ) {
+	if ( ! rangeDeleted( kbuf ) && _keyChecker->getValue( kbuf, v ) ) {
 		div = (jagbyte)v[0];
 		rem = (jagbyte)v[1];
 		pos = div*(JAG_BYTE_MAX+1)+rem;
@@ -394,7 +595,9 @@ bool JagDiskArrayFamily::exist( JagDBPair &pair )
 
 bool JagDiskArrayFamily::get( JagDBPair &pair )
 {
+	JagReadWriteMutex mutex( &_familyLock, JagReadWriteMutex::READ_LOCK );
 	if ( _insertBufferMap && _insertBufferMap->get( pair ) ) {
+		applyMergeDelta( pair );
 		return true;
 	}
 
@@ -406,12 +609,15 @@ bool JagDiskArrayFamily::get( JagDBPair &pair )
 	memset( kbuf, 0, _KLEN+1);
 	memcpy( kbuf, pair.key.c_str(), _KLEN );
 
-	if ( _keyChecker->getValue( kbuf, v ) ) {
+	if ( ! rangeDeleted( kbuf ) && _keyChecker->getValue( kbuf, v ) ) {
 		div = (jagbyte)v[0];
 		rem = (jagbyte)v[1];
 		pos = div*(JAG_BYTE_MAX+1)+rem;
 
 		rc = _darrlist[pos]->get( pair );
+		if ( rc ) {
+			applyMergeDelta( pair );
+		}
 
 		return rc;
 	} else {
@@ -419,8 +625,11 @@ bool JagDiskArrayFamily::get( JagDBPair &pair )
 	}
 }
 
+// the new value of a row replaces its pending counter deltas; get() included them
 bool JagDiskArrayFamily::set( const JagDBPair &pair )
 {
+	JagReadWriteMutex mutex( &_familyLock, JagReadWriteMutex::WRITE_LOCK );
+	dropMergeDelta( pair );
 	if ( _insertBufferMap && _insertBufferMap->set( pair ) ) {
 		return true;
 	}
@@ -431,7 +640,7 @@ bool JagDiskArrayFamily::set( const JagDBPair &pair )
 	char kbuf[_KLEN+1];
 	memset( kbuf, 0, _KLEN+1);
 	memcpy( kbuf, pair.key.c_str(), _KLEN );
-	if ( _keyChecker->getValue( kbuf, v ) ) {
+	if ( ! rangeDeleted( kbuf ) && _keyChecker->getValue( kbuf, v ) ) {
 		div = (jagbyte)v[0];
 		rem = (jagbyte)v[1];
 		pos = div*(JAG_BYTE_MAX+1)+rem;
@@ -444,42 +653,49 @@ bool JagDiskArrayFamily::set( const JagDBPair &pair )
 	}
 }
 
+// the row is located once (insert buffer entry or file of the key) and written back there
 bool JagDiskArrayFamily::setWithRange( const JagRequest &req, JagDBPair &pair, const char *buffers[], bool uniqueAndHasValueCol, 
 										ExprElementNode *root, const JagParseParam *pParam, int numKeys, const JagSchemaAttribute *schAttr, 
 										jagint setposlist[], JagDBPair &retpair )
 {
-	bool rc = get(pair); 
-	if ( ! rc ) {
-		return false;
+	JagReadWriteMutex mutex( &_familyLock, JagReadWriteMutex::WRITE_LOCK );
+	bool rc;
+	int pos = -1;
+	JagFixMapIterator iter;
+	bool inbuf = false;
+	if ( _insertBufferMap ) {
+		iter = _insertBufferMap->find( pair );
+		inbuf = ! _insertBufferMap->isAtEnd( iter );
 	}
 
+	if ( inbuf ) {
+		_insertBufferMap->iterToPair( iter, pair );
+	} else {
+		char v[2];
+		char kbuf[_KLEN+1];
+		memset( kbuf, 0, _KLEN+1);
+		memcpy( kbuf, pair.key.c_str(), _KLEN );
+		if ( rangeDeleted( kbuf ) || ! _keyChecker->getValue( kbuf, v ) ) {
+			return false;
+		}
+		pos = (jagbyte)v[0]*(JAG_BYTE_MAX+1)+(jagbyte)v[1];
+		if ( ! _darrlist[pos]->get( pair ) ) {
+			return false;
+		}
+	}
+	applyMergeDelta( pair );
+
     rc = JagDiskArrayBase::checkSetPairCondition( _servobj, req, pair, (char**)buffers, uniqueAndHasValueCol, root, pParam,
                                 				   numKeys, schAttr, _KLEN, _VLEN, setposlist, retpair );
     if ( ! rc ) return false;
 
-	if ( _insertBufferMap && _insertBufferMap->set( retpair ) ) {
+	dropMergeDelta( retpair );
+	if ( inbuf ) {
+		iter->second = retpair.value;
 		return true;
 	}
 
-	int pos = 0;
-	int div, rem;
-	char v[2];
-
-	char kbuf[_KLEN+1];
-	memset( kbuf, 0, _KLEN+1);
-	memcpy( kbuf, pair.key.c_str(), _KLEN );
-
-	if ( _keyChecker->getValue( kbuf, v ) ) {
-		div = (jagbyte)v[0];
-		rem = (jagbyte)v[1];
-		pos = div*(JAG_BYTE_MAX+1)+rem;
-
-		rc = _darrlist[pos]->set (retpair ); 
-
-		return rc;
-	} else {
-		return 0;
-	}
+	return _darrlist[pos]->set( retpair ); 
 }
 
 
@@ -489,6 +705,15 @@ void JagDiskArrayFamily::drop()
 		_darrlist[i]->drop();
 	}
 	_keyChecker->removeAllKey();
+
+	pthread_mutex_lock( &_mergeDeltaMutex );
+	_mergeDeltaMap->clear();
+	_numMergeDeltas = 0;
+	pthread_mutex_unlock( &_mergeDeltaMutex );
+
+	_rangeDeletes.clear();
+	_rangeDeletedRows = -1;
+	jagunlink( (_pathname + ".rdel").c_str() );
 }
 
 void JagDiskArrayFamily::flushBlockIndexToDisk()
@@ -547,6 +772,14 @@ void JagDiskArrayFamily::flushKeyCheckerString()
 
 jagint JagDiskArrayFamily::setFamilyRead( JagMergeReader *&nts, const char *minbuf, const char *maxbuf ) 
 {
+	// files stay unchanged until the reader is deleted (endScan); buffer rows are copied
+	if ( nts ) {
+		delete nts;
+		nts = NULL;
+	}
+	pthread_rwlock_rdlock( &_scanLock );
+	pthread_rwlock_rdlock( &_familyLock );
+
 	bool startFlag = false;
     jagint index = 0, rc, slimit, rlimit;
     JagDBPair retpair;
@@ -599,17 +832,13 @@ jagint JagDiskArrayFamily::setFamilyRead( JagMergeReader *&nts, const char *minb
 		}
 	}
 	
-	if ( nts ) {
-		delete nts;
-		nts = NULL;
-	}
-	
-	if ( fRange.size() >= 0 ) {
-		nts = new JagMergeReader(this->_insertBufferMap, fRange, fRange.size(), 
-								 _KLEN, _VLEN, minbuf, maxbuf );
-	} else {
-		nts = NULL;
-	}
+	JagDBMap *bufmap = copyInsertBuffer( minbuf, maxbuf );
+	pthread_rwlock_unlock( &_familyLock );
+
+	nts = new JagMergeReader( bufmap, fRange, fRange.size(), 
+							 _KLEN, _VLEN, minbuf, maxbuf );
+	nts->setFamily( this );
+	nts->setSnapshot( bufmap );
 
 	if ( lminbuf ) { free( lminbuf ); }
 	if ( lmaxbuf ) { free( lmaxbuf ); }
@@ -619,6 +848,13 @@ jagint JagDiskArrayFamily::setFamilyRead( JagMergeReader *&nts, const char *minb
 jagint JagDiskArrayFamily::setFamilyReadPartial( JagMergeReader *&nts, const char *minbuf, const char *maxbuf, 
 												  jagint spos, jagint epos, jagint mmax ) 
 {
+	if ( nts ) {
+		delete nts;
+		nts = NULL;
+	}
+	pthread_rwlock_rdlock( &_scanLock );
+	pthread_rwlock_rdlock( &_familyLock );
+
 	if ( spos < 0 ) spos = 0;
 	if ( epos >= _darrlist.size() ) epos = _darrlist.size()-1;
 	if ( epos < 0 ) epos = 0;
@@ -677,17 +913,13 @@ jagint JagDiskArrayFamily::setFamilyReadPartial( JagMergeReader *&nts, const cha
 		}
 	}
 
-	if ( nts ) {
-		delete nts;
-		nts = NULL;
-	}
-	
-	if ( fRange.size() >= 0 ) {
-		nts = new JagMergeReader( this->_insertBufferMap, fRange, fRange.size(), 
-								  _KLEN, _VLEN, minbuf, maxbuf );
-	} else {
-		nts = NULL;
-	}
+	JagDBMap *bufmap = copyInsertBuffer( minbuf, maxbuf );
+	pthread_rwlock_unlock( &_familyLock );
+
+	nts = new JagMergeReader( bufmap, fRange, fRange.size(), 
+							  _KLEN, _VLEN, minbuf, maxbuf );
+	nts->setFamily( this );
+	nts->setSnapshot( bufmap );
 
 	if ( lminbuf ) { free( lminbuf ); }
 	if ( lmaxbuf ) { free( lmaxbuf ); }
@@ -697,6 +929,13 @@ jagint JagDiskArrayFamily::setFamilyReadPartial( JagMergeReader *&nts, const cha
 jagint JagDiskArrayFamily::setFamilyReadBackPartial( JagMergeBackReader *&nts, const char *minbuf, const char *maxbuf, 
 												  	  jagint spos, jagint epos, jagint mmax ) 
 {
+	if ( nts ) {
+		delete nts;
+		nts = NULL;
+	}
+	pthread_rwlock_rdlock( &_scanLock );
+	pthread_rwlock_rdlock( &_familyLock );
+
 	int  darrsize = _darrlist.size();
 
 	if ( spos > epos ) spos = epos;
@@ -752,17 +991,13 @@ jagint JagDiskArrayFamily::setFamilyReadBackPartial( JagMergeBackReader *&nts, c
 		}
 	}
 
-	if ( nts ) {
-		delete nts;
-		nts = NULL;
-	}
-	
-	if ( fRange.size() >= 0 ) {
-		nts = new JagMergeBackReader( this->_insertBufferMap, fRange, fRange.size(), 
-									  _KLEN, _VLEN, minbuf, maxbuf );
-	} else {
-		nts = NULL;
-	}
+	JagDBMap *bufmap = copyInsertBuffer( minbuf, maxbuf );
+	pthread_rwlock_unlock( &_familyLock );
+
+	nts = new JagMergeBackReader( bufmap, fRange, fRange.size(), 
+								  _KLEN, _VLEN, minbuf, maxbuf );
+	nts->setFamily( this );
+	nts->setSnapshot( bufmap );
 
 	if ( lminbuf ) { free( lminbuf ); }
 	if ( lmaxbuf ) { free( lmaxbuf ); }
@@ -779,6 +1014,17 @@ JagDiskArrayServer* JagDiskArrayFamily::flushBufferToNewFile( )
 	int darrlistlen = _darrlist.size();
 	prt(("s40726 JagDiskArrayFamily::flushBufferToNewFile darrlistlen=%d\n", darrlistlen ));
 	jagint len = _insertBufferMap->size();
+	Jstr filePathName = newFilePathName( darrlistlen );
+
+	JagDiskArrayServer *darr = new JagDiskArrayServer( _servobj, this, darrlistlen, filePathName, _schemaRecord, len, false );
+	darr->flushBufferToNewFile( _insertBufferMap );
+
+	return darr;
+}
+
+// path of the darrlistlen-th file of the family
+Jstr JagDiskArrayFamily::newFilePathName( int darrlistlen )
+{
 	JagStrSplit sp(_pathname, '/');
 	int slen = sp.length();
 	Jstr fname= sp[slen-1];
@@ -791,27 +1037,770 @@ JagDiskArrayServer* JagDiskArrayFamily::flushBufferToNewFile( )
 		filePathName = newpathname + "." + intToStr( darrlistlen );
 		prt(("s220184 filePathName=[%s]\n", filePathName.s() ));
 	}
+	return filePathName;
+}
 
-	JagDiskArrayServer *darr = new JagDiskArrayServer( _servobj, this, darrlistlen, filePathName, _schemaRecord, len, false );
-	darr->flushBufferToNewFile( _insertBufferMap );
+// Bulk load: create an empty file, fill it in key order with darr->flushSortedToNewFile(),
+// then addSortedFile(). Keys must not exist in the family.
+JagDiskArrayServer* JagDiskArrayFamily::newSortedFile( jagint length )
+{
+	pthread_rwlock_rdlock( &_familyLock );
+	int darrlistlen = _darrlist.size();
+	pthread_rwlock_unlock( &_familyLock );
+	Jstr filePathName = newFilePathName( darrlistlen );
+	return new JagDiskArrayServer( _servobj, this, darrlistlen, filePathName, _schemaRecord, length, false );
+}
 
-	return darr;
+// key is in a file or the insert buffer of the family
+bool JagDiskArrayFamily::keyExist( const char *kbuf )
+{
+	JagFixString value;
+	JagDBPair pair( JagFixString( kbuf, _KLEN, _KLEN ), value );
+	if ( ! _keyChecker ) {
+		return exist( pair );
+	}
+
+	pthread_rwlock_rdlock( &_familyLock );
+	bool rc = ( _keyChecker->exist( kbuf ) && ! rangeDeleted( kbuf ) ) || _insertBufferMap->exist( pair );
+	pthread_rwlock_unlock( &_familyLock );
+	return rc;
+}
+
+void JagDiskArrayFamily::addSortedFile( JagDiskArrayServer *darr )
+{
+	pthread_rwlock_wrlock( &_familyLock );
+	darr->_arrlen = darr->size()/_KVLEN;
+	_darrlist.append( darr );
+	if ( _keyChecker ) {
+		addKeyCheckerFromJDB( darr, _darrlist.size() - 1 );
+	}
+	_rangeDeletedRows = -1;
+	pthread_rwlock_unlock( &_familyLock );
+}
+
+// numeric column types whose values can be merged by adding deltas
+bool JagDiskArrayFamily::isMergeType( const Jstr &type )
+{
+	if ( type == JAG_C_COL_TYPE_DBOOLEAN || type == JAG_C_COL_TYPE_DBIT ) return false;
+	return isInteger( type ) || isFloat( type );
+}
+
+// 1 if delta can be added to the row of its key: the row with its pending delta plus delta, and the
+// pending delta plus delta, fit the counter columns; 0 if the key has no row; -1 if a sum does not fit
+// caller holds the key stripe of delta from here to addMergeDelta(), so no other delta of the key comes between
+int JagDiskArrayFamily::checkMergeDelta( const JagDBPair &delta )
+{
+	JagDBPair pair( delta.key );
+	if ( ! get( pair ) ) return 0;
+
+	char *kvbuf = (char*)jagmalloc( 2*_KVLEN+2 );
+	char *deltakv = kvbuf + _KVLEN+1;
+	memcpy( kvbuf, pair.key.c_str(), _KLEN );
+	memcpy( kvbuf+_KLEN, pair.value.c_str(), _VLEN );
+	memcpy( deltakv, delta.key.c_str(), _KLEN );
+	memcpy( deltakv+_KLEN, delta.value.c_str(), _VLEN );
+	int rc = addColumnDeltas( kvbuf, deltakv ) ? 1 : -1;
+
+	if ( rc > 0 && _numMergeDeltas > 0 ) {
+		JagDBPair pend( delta.key );
+		pthread_mutex_lock( &_mergeDeltaMutex );
+		if ( _mergeDeltaMap->get( pend ) ) {
+			memcpy( kvbuf+_KLEN, pend.value.c_str(), _VLEN );
+			if ( ! addColumnDeltas( kvbuf, deltakv ) ) rc = -1;
+		}
+		pthread_mutex_unlock( &_mergeDeltaMutex );
+	}
+
+	free( kvbuf );
+	return rc;
+}
+
+// combine delta (key+value, counter columns formatted, others zero) with the pending delta of its key
+// caller holds lockInsertKeys() of delta from checkMergeDelta() and the wallog append to here
+void JagDiskArrayFamily::addMergeDelta( const JagDBPair &delta )
+{
+	JagFixMapIterator iter;
+	pthread_mutex_lock( &_mergeDeltaMutex );
+	if ( _mergeDeltaMap->insertIfAbsent( delta, iter ) ) {
+		++ _numMergeDeltas;
+	} else {
+		char *kvbuf = (char*)jagmalloc( 2*_KVLEN+2 );
+		char *deltakv = kvbuf + _KVLEN+1;
+		memcpy( kvbuf, iter->first.c_str(), _KLEN );
+		memcpy( kvbuf+_KLEN, iter->second.c_str(), _VLEN );
+		memcpy( deltakv, delta.key.c_str(), _KLEN );
+		memcpy( deltakv+_KLEN, delta.value.c_str(), _VLEN );
+		addColumnDeltas( kvbuf, deltakv );
+		iter->second = JagFixString( kvbuf+_KLEN, _VLEN, _VLEN );
+		free( kvbuf );
+	}
+	pthread_mutex_unlock( &_mergeDeltaMutex );
+}
+
+// add pending delta of the key to a row read from the family (kvbuf: db format key+value)
+void JagDiskArrayFamily::applyMergeDelta( char *kvbuf )
+{
+	if ( _numMergeDeltas < 1 ) return;
+
+	JagDBPair pair( kvbuf, _KLEN );
+	pthread_mutex_lock( &_mergeDeltaMutex );
+	if ( _mergeDeltaMap->get( pair ) ) {
+		char *deltakv = (char*)jagmalloc( _KVLEN+1 );
+		memcpy( deltakv, pair.key.c_str(), _KLEN );
+		memcpy( deltakv+_KLEN, pair.value.c_str(), _VLEN );
+		addColumnDeltas( kvbuf, deltakv );
+		free( deltakv );
+	}
+	pthread_mutex_unlock( &_mergeDeltaMutex );
+}
+
+void JagDiskArrayFamily::applyMergeDelta( JagDBPair &pair )
+{
+	if ( _numMergeDeltas < 1 ) return;
+
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1 );
+	memcpy( kvbuf, pair.key.c_str(), _KLEN );
+	memcpy( kvbuf+_KLEN, pair.value.c_str(), _VLEN );
+	applyMergeDelta( kvbuf );
+	pair.value = JagFixString( kvbuf+_KLEN, _VLEN, _VLEN );
+	free( kvbuf );
+}
+
+void JagDiskArrayFamily::dropMergeDelta( const JagDBPair &pair )
+{
+	if ( _numMergeDeltas < 1 ) return;
+
+	pthread_mutex_lock( &_mergeDeltaMutex );
+	if ( _mergeDeltaMap->remove( JagDBPair( pair.key ) ) ) {
+		-- _numMergeDeltas;
+	}
+	pthread_mutex_unlock( &_mergeDeltaMutex );
+}
+
+// write pending deltas into their rows in the insert buffer or the files
+// called by processFlushInsertBuffer(), before the wallog is reset
+// return number of rows changed
+jagint JagDiskArrayFamily::foldMergeDeltas()
+{
+	if ( _numMergeDeltas < 1 ) return 0;
+
+	char v[2];
+	int  pos, div, rem;
+	jagint cnt = 0;
+	char *kvbuf = (char*)jagmalloc( 2*_KVLEN+2 );
+	char *deltakv = kvbuf + _KVLEN+1;
+	bool inbuf;
+
+	pthread_mutex_lock( &_mergeDeltaMutex );
+	JagFixMapIterator iter = _mergeDeltaMap->_map->begin();
+	while ( iter != _mergeDeltaMap->_map->end() ) {
+		JagDBPair pair( iter->first );
+		JagFixMapIterator bufiter = _insertBufferMap->find( pair );
+		inbuf = ! _insertBufferMap->isAtEnd( bufiter );
+		if ( inbuf ) _insertBufferMap->iterToPair( bufiter, pair );
+		pos = -1;
+		if ( ! inbuf && _keyChecker ) {
+			memset( kvbuf, 0, _KLEN+1 );
+			memcpy( kvbuf, pair.key.c_str(), _KLEN );
+			if ( _keyChecker->getValue( kvbuf, v ) ) {
+				div = (jagbyte)v[0];
+				rem = (jagbyte)v[1];
+				pos = div*(JAG_BYTE_MAX+1)+rem;
+				if ( ! _darrlist[pos]->get( pair ) ) pos = -1;
+			}
+		}
+
+		if ( inbuf || pos >= 0 ) {
+			memcpy( kvbuf, pair.key.c_str(), _KLEN );
+			memcpy( kvbuf+_KLEN, pair.value.c_str(), _VLEN );
+			memcpy( deltakv, iter->first.c_str(), _KLEN );
+			memcpy( deltakv+_KLEN, iter->second.c_str(), _VLEN );
+			if ( ! addColumnDeltas( kvbuf, deltakv ) ) {
+				raydebug( stdout, JAG_LOG_LOW, "s40383 %s counter delta does not fit its row\n", _objname.c_str() );
+			}
+			if ( inbuf ) {
+				bufiter->second = JagFixString( kvbuf+_KLEN, _VLEN, _VLEN );
+			} else {
+				_darrlist[pos]->set( JagDBPair( kvbuf, _KLEN, kvbuf+_KLEN, _VLEN, true ) );
+			}
+			++cnt;
+		}
+		++iter;
+	}
+
+	_mergeDeltaMap->clear();
+	_numMergeDeltas = 0;
+	pthread_mutex_unlock( &_mergeDeltaMutex );
+	free( kvbuf );
+
+	raydebug( stdout, JAG_LOG_LOW, "s40381 %s folded %l counter deltas\n", _objname.c_str(), cnt );
+	return cnt;
+}
+
+// add each counter column set in deltakv to the same column of kvbuf
+// return false if a sum does not fit its column; that column keeps its old value
+bool JagDiskArrayFamily::addColumnDeltas( char *kvbuf, const char *deltakv )
+{
+	const JagVector<JagColumn> &cv = *(_schemaRecord->columnVector);
+	char  numbuf[256];
+	Jstr  errmsg, sumstr;
+	const char *d;
+	int   len;
+	bool  fits = true;
+
+	for ( int i = 0; i < cv.size(); ++i ) {
+		if ( cv[i].iskey || cv[i].offset < _KLEN ) continue;
+		d = deltakv + cv[i].offset;
+		if ( '\0' == *d || ! isMergeType( cv[i].type ) ) continue;
+
+		len = cv[i].length;
+		if ( len >= (int)sizeof(numbuf) ) { fits = false; continue; }
+		if ( isInteger( cv[i].type ) ) {
+			memcpy( numbuf, d, len ); numbuf[len] = '\0';
+			jagint sum = jagatoll( numbuf );
+			memcpy( numbuf, kvbuf+cv[i].offset, len ); numbuf[len] = '\0';
+			sum += jagatoll( numbuf );
+			sumstr = longToStr( sum );
+		} else {
+			memcpy( numbuf, d, len ); numbuf[len] = '\0';
+			abaxdouble sum = jagstrtold( numbuf, NULL );
+			memcpy( numbuf, kvbuf+cv[i].offset, len ); numbuf[len] = '\0';
+			sum += jagstrtold( numbuf, NULL );
+			sumstr = longDoubleToStr( sum );
+		}
+
+		memcpy( numbuf, kvbuf+cv[i].offset, len );
+		memset( kvbuf+cv[i].offset, 0, len );
+		if ( ! formatOneCol( 0, 0, kvbuf, sumstr.c_str(), errmsg, cv[i].name.c_str(), cv[i].offset, len, cv[i].sig, cv[i].type ) ) {
+			memcpy( kvbuf+cv[i].offset, numbuf, len );
+			fits = false;
+		}
+	}
+	return fits;
+}
+
+bool JagRangeDelete::covers( const char *kbuf ) const
+{
+	int rc = memcmp( kbuf, lo.c_str(), cmplen );
+	if ( rc < 0 || ( 0 == rc && ! loIncl ) ) return false;
+	rc = memcmp( kbuf, hi.c_str(), cmplen );
+	if ( rc > 0 || ( 0 == rc && ! hiIncl ) ) return false;
+	return true;
+}
+
+// Delete all rows in range rd. Rows in the insert buffer and pending counter deltas are
+// removed now; rows in files are hidden by the saved range until their simpfile is merged.
+// rows: if not NULL, gets the number of rows deleted; a range without rows is not saved
+// The file rows are counted after the family lock is released. The scan lock, taken before
+// the family lock as readers do, keeps the files unchanged until then.
+// caller holds the table write lock
+// return false if the range could not be saved; nothing is deleted then
+bool JagDiskArrayFamily::deleteRange( const JagRangeDelete &rd, jagint *rows )
+{
+	if ( rd.cmplen < 1 || rd.cmplen > _KLEN || rd.lo.size() != _KLEN || rd.hi.size() != _KLEN ) {
+		return false;
+	}
+
+	jagint bufrows = 0;
+	pthread_rwlock_rdlock( &_scanLock );
+	pthread_rwlock_wrlock( &_familyLock );
+	if ( rows ) {
+		bufrows = countBufferRangeRows( rd );
+		if ( bufrows < 1 && ! rangeHasFileRows( rd ) ) {
+			*rows = 0;
+			pthread_rwlock_unlock( &_familyLock );
+			pthread_rwlock_unlock( &_scanLock );
+			return true;
+		}
+	}
+
+	// saved ranges inside the new range are replaced by it
+	JagVector<JagRangeDelete> saved = _rangeDeletes;
+	for ( int i = _rangeDeletes.size()-1; i >= 0; --i ) {
+		if ( rd.covers( _rangeDeletes[i].lo.c_str() ) && rd.covers( _rangeDeletes[i].hi.c_str() ) ) {
+			_rangeDeletes.removepos( i );
+		}
+	}
+
+	if ( _rangeDeletes.size() >= JAG_MAX_RANGE_DELETES ) {
+		_rangeDeletes = saved;
+		pthread_rwlock_unlock( &_familyLock );
+		pthread_rwlock_unlock( &_scanLock );
+		return false;
+	}
+
+	_rangeDeletes.append( rd );
+	if ( ! saveRangeDeletes() ) {
+		_rangeDeletes = saved;
+		pthread_rwlock_unlock( &_familyLock );
+		pthread_rwlock_unlock( &_scanLock );
+		return false;
+	}
+	_rangeDeletedRows = -1;
+
+	JagDBPair lopair( rd.lo );
+	JagFixMapIterator iter = _insertBufferMap->getSuccOrEqual( lopair );
+	while ( ! _insertBufferMap->isAtEnd( iter ) && memcmp( iter->first.c_str(), rd.hi.c_str(), _KLEN ) <= 0 ) {
+		if ( rd.covers( iter->first.c_str() ) ) {
+			iter = _insertBufferMap->_map->erase( iter );
+		} else {
+			++iter;
+		}
+	}
+
+	if ( _numMergeDeltas > 0 ) {
+		pthread_mutex_lock( &_mergeDeltaMutex );
+		iter = _mergeDeltaMap->getSuccOrEqual( lopair );
+		while ( ! _mergeDeltaMap->isAtEnd( iter ) && memcmp( iter->first.c_str(), rd.hi.c_str(), _KLEN ) <= 0 ) {
+			if ( rd.covers( iter->first.c_str() ) ) {
+				iter = _mergeDeltaMap->_map->erase( iter );
+				-- _numMergeDeltas;
+			} else {
+				++iter;
+			}
+		}
+		pthread_mutex_unlock( &_mergeDeltaMutex );
+	}
+	pthread_rwlock_unlock( &_familyLock );
+
+	if ( rows ) {
+		*rows = bufrows + countRangeFileRows( rd, saved );
+	}
+	pthread_rwlock_unlock( &_scanLock );
+
+	raydebug( stdout, JAG_LOG_LOW, "s40392 %s range delete %d saved\n", _objname.c_str(), _rangeDeletes.size() );
+	return true;
+}
+
+// key is in a deleted range; only rows of files can be hidden
+// caller holds the family lock or the table lock
+bool JagDiskArrayFamily::rangeDeleted( const char *kbuf )
+{
+	for ( int i = 0; i < _rangeDeletes.size(); ++i ) {
+		if ( _rangeDeletes[i].covers( kbuf ) ) return true;
+	}
+	return false;
+}
+
+// all keys from minkbuf to maxkbuf are in one deleted range
+bool JagDiskArrayFamily::rangeDeleted( const char *minkbuf, const char *maxkbuf )
+{
+	for ( int i = 0; i < _rangeDeletes.size(); ++i ) {
+		if ( _rangeDeletes[i].covers( minkbuf ) && _rangeDeletes[i].covers( maxkbuf ) ) return true;
+	}
+	return false;
+}
+
+// Remove simpfiles with all rows in a deleted range, then the ranges without file rows left.
+// With time partitioned files, expiring old rows mostly unlinks whole files.
+// caller holds the table write lock
+// return number of rows dropped
+jagint JagDiskArrayFamily::dropCoveredFiles()
+{
+	if ( _rangeDeletes.size() < 1 ) return 0;
+
+	jagint cnt = 0;
+	pthread_rwlock_wrlock( &_familyLock );
+	for ( int i = 0; i < _darrlist.size(); ++i ) {
+		cnt += _darrlist[i]->_compf->dropCoveredSimpFiles();
+		_darrlist[i]->_arrlen = _darrlist[i]->size()/_KVLEN;
+	}
+
+	bool changed = false;
+	for ( int i = _rangeDeletes.size()-1; i >= 0; --i ) {
+		if ( ! rangeHasFileRows( _rangeDeletes[i] ) ) {
+			_rangeDeletes.removepos( i );
+			changed = true;
+		}
+	}
+	if ( changed ) saveRangeDeletes();
+	_rangeDeletedRows = -1;
+	pthread_rwlock_unlock( &_familyLock );
+
+	raydebug( stdout, JAG_LOG_LOW, "s40397 %s dropped %l rows in files, %d range deletes left\n", 
+			  _objname.c_str(), cnt, _rangeDeletes.size() );
+	return cnt;
+}
+
+// keys are partitioned by the datetime value at offset (length digits) divided by bucketLen
+void JagDiskArrayFamily::setTimePartition( int offset, int length, jagint bucketLen )
+{
+	_timeOffset = offset;
+	_timeLength = length;
+	_timeBucketLen = bucketLen;
+	raydebug( stdout, JAG_LOG_LOW, "s40399 %s time partition %l\n", _objname.c_str(), bucketLen );
+}
+
+// existing files keep their format until they are rewritten by a merge
+void JagDiskArrayFamily::setBlockCompress( bool compress )
+{
+	_blockCompress = compress;
+	raydebug( stdout, JAG_LOG_LOW, "s40400 %s block compress %d\n", _objname.c_str(), (int)compress );
+}
+
+// time bucket of key; -1 if files are not time partitioned
+jagint JagDiskArrayFamily::timeBucket( const char *kbuf ) const
+{
+	if ( _timeBucketLen < 1 ) return -1;
+	return rayatol( kbuf+_timeOffset, _timeLength )/_timeBucketLen;
+}
+
+// file row kvbuf is dropped by a simpfile merge if it is in a deleted range
+// caller holds the family write lock (buffer flush)
+bool JagDiskArrayFamily::reclaimDeleted( const char *kvbuf )
+{
+	if ( ! rangeDeleted( kvbuf ) ) return false;
+	if ( _keyChecker ) {
+		_keyChecker->removeKey( kvbuf );
+	}
+	return true;
+}
+
+// remove all rows hidden by range deletes from the files and drop the ranges
+// done before rows are added to files directly (bulk ingest)
+jagint JagDiskArrayFamily::purgeRangeDeletes()
+{
+	if ( _rangeDeletes.size() < 1 ) return 0;
+
+	jagint cnt = 0;
+	pthread_rwlock_wrlock( &_familyLock );
+	for ( int i = 0; i < _rangeDeletes.size(); ++i ) {
+		cnt += purgeRangeDelete( _rangeDeletes[i] );
+	}
+	_rangeDeletes.clear();
+	_rangeDeletedRows = -1;
+	saveRangeDeletes();
+	pthread_rwlock_unlock( &_familyLock );
+
+	raydebug( stdout, JAG_LOG_LOW, "s40393 %s purged %l range deleted rows\n", _objname.c_str(), cnt );
+	return cnt;
+}
+
+// Before a buffer flush: buffered rows in a deleted range would be hidden once they are in a file.
+// Such a range is split around the key prefixes of its buffered rows; only the file rows of
+// the slice between the first and last buffered prefix are removed, and the parts on either
+// side stay saved. If the split leaves too many ranges, the whole range is purged.
+// A range without file rows left (all merged away) is dropped.
+// caller holds the family write lock
+jagint JagDiskArrayFamily::purgeBufferedRangeDeletes()
+{
+	if ( _rangeDeletes.size() < 1 ) return 0;
+
+	jagint cnt = 0;
+	bool changed = false;
+	char *kbuf = (char*)jagmalloc( _KLEN+1 );
+	for ( int i = _rangeDeletes.size()-1; i >= 0; --i ) {
+		JagRangeDelete rd = _rangeDeletes[i];
+		JagFixMapIterator iter = _insertBufferMap->getSuccOrEqual( JagDBPair( rd.lo ) );
+		const char *firstKey = NULL, *lastKey = NULL;
+		while ( ! _insertBufferMap->isAtEnd( iter ) && memcmp( iter->first.c_str(), rd.hi.c_str(), _KLEN ) <= 0 ) {
+			if ( rd.covers( iter->first.c_str() ) ) {
+				if ( ! firstKey ) firstKey = iter->first.c_str();
+				lastKey = iter->first.c_str();
+			}
+			++iter;
+		}
+
+		if ( ! firstKey ) {
+			if ( rangeHasFileRows( rd ) ) continue;
+			_rangeDeletes.removepos( i );
+			changed = true;
+			continue;
+		}
+
+		// slice of the buffered prefixes: its file rows are removed
+		JagRangeDelete slice = rd;
+		memset( kbuf, 0, _KLEN );
+		memcpy( kbuf, firstKey, rd.cmplen );
+		slice.lo = JagFixString( kbuf, _KLEN, _KLEN );
+		slice.loIncl = true;
+		memset( kbuf, 255, _KLEN );
+		memcpy( kbuf, lastKey, rd.cmplen );
+		slice.hi = JagFixString( kbuf, _KLEN, _KLEN );
+		slice.hiIncl = true;
+
+		// parts of rd before and after the slice
+		JagRangeDelete before = rd, after = rd;
+		memset( kbuf, 255, _KLEN );
+		memcpy( kbuf, firstKey, rd.cmplen );
+		before.hi = JagFixString( kbuf, _KLEN, _KLEN );
+		before.hiIncl = false;
+		memset( kbuf, 0, _KLEN );
+		memcpy( kbuf, lastKey, rd.cmplen );
+		after.lo = JagFixString( kbuf, _KLEN, _KLEN );
+		after.loIncl = false;
+		bool hasBefore = memcmp( firstKey, rd.lo.c_str(), rd.cmplen ) > 0 && rangeHasFileRows( before );
+		bool hasAfter = memcmp( lastKey, rd.hi.c_str(), rd.cmplen ) < 0 && rangeHasFileRows( after );
+
+		_rangeDeletes.removepos( i );
+		changed = true;
+		if ( _rangeDeletes.size() + (int)hasBefore + (int)hasAfter > JAG_MAX_RANGE_DELETES ) {
+			cnt += purgeRangeDelete( rd );
+			continue;
+		}
+
+		cnt += purgeRangeDelete( slice );
+		if ( hasBefore ) _rangeDeletes.append( before );
+		if ( hasAfter ) _rangeDeletes.append( after );
+	}
+	free( kbuf );
+
+	if ( changed ) {
+		_rangeDeletedRows = -1;
+		saveRangeDeletes();
+	}
+	return cnt;
+}
+
+// remove rows of files in range rd; caller holds the family write lock
+jagint JagDiskArrayFamily::purgeRangeDelete( const JagRangeDelete &rd )
+{
+	// keys are removed in batches after the reader is closed
+	const int batch = 1024;
+	JagDBMap emptyMap;
+	JagVector<JagFixString> keys;
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1 );
+	char *minbuf = (char*)jagmalloc( _KLEN+1 );
+	memcpy( minbuf, rd.lo.c_str(), _KLEN );
+	minbuf[_KLEN] = '\0';
+
+	jagint cnt = 0;
+	while ( true ) {
+		keys.clear();
+		JagMergeReader *ntr = fileReader( &emptyMap, minbuf, rd.hi.c_str() );
+		while ( keys.size() < batch && ntr->getNext( kvbuf ) ) {
+			if ( rd.covers( kvbuf ) ) {
+				keys.append( JagFixString( kvbuf, _KLEN, _KLEN ) );
+			}
+		}
+		delete ntr;
+
+		jagint removed = 0;
+		for ( int i = 0; i < keys.size(); ++i ) {
+			if ( removeFileRow( keys[i].c_str() ) ) ++removed;
+		}
+		cnt += removed;
+		if ( keys.size() < batch || removed < 1 ) break;
+		memcpy( minbuf, keys[keys.size()-1].c_str(), _KLEN );
+	}
+
+	free( minbuf );
+	free( kvbuf );
+	return cnt;
+}
+
+// a file has a row in range rd; caller holds the family lock
+bool JagDiskArrayFamily::rangeHasFileRows( const JagRangeDelete &rd )
+{
+	JagDBMap emptyMap;
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1 );
+	JagMergeReader *ntr = fileReader( &emptyMap, rd.lo.c_str(), rd.hi.c_str() );
+	bool found = false;
+	while ( ntr->getNext( kvbuf ) ) {
+		if ( rd.covers( kvbuf ) ) {
+			found = true;
+			break;
+		}
+	}
+	delete ntr;
+	free( kvbuf );
+	return found;
+}
+
+// rows of the insert buffer in range rd; caller holds the family lock
+jagint JagDiskArrayFamily::countBufferRangeRows( const JagRangeDelete &rd )
+{
+	jagint cnt = 0;
+	JagDBPair lopair( rd.lo );
+	JagFixMapIterator iter = _insertBufferMap->getSuccOrEqual( lopair );
+	while ( ! _insertBufferMap->isAtEnd( iter ) && memcmp( iter->first.c_str(), rd.hi.c_str(), _KLEN ) <= 0 ) {
+		if ( rd.covers( iter->first.c_str() ) ) ++cnt;
+		++iter;
+	}
+	return cnt;
+}
+
+// rows of files in range rd not hidden by the ranges in prior
+// caller holds the scan lock, so no flush changes the files; the family lock is not needed
+jagint JagDiskArrayFamily::countRangeFileRows( const JagRangeDelete &rd, const JagVector<JagRangeDelete> &prior )
+{
+	jagint cnt = 0;
+	JagDBMap emptyMap;
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1 );
+	JagMergeReader *ntr = fileReader( &emptyMap, rd.lo.c_str(), rd.hi.c_str() );
+	while ( ntr->getNext( kvbuf ) ) {
+		if ( ! rd.covers( kvbuf ) ) continue;
+		bool hidden = false;
+		for ( int i = 0; i < prior.size(); ++i ) {
+			if ( prior[i].covers( kvbuf ) ) { hidden = true; break; }
+		}
+		if ( ! hidden ) ++cnt;
+	}
+	delete ntr;
+	free( kvbuf );
+	return cnt;
+}
+
+// number of file rows hidden by range deletes; kept until files or ranges change
+jagint JagDiskArrayFamily::countRangeDeleted()
+{
+	jagint cnt = _rangeDeletedRows;
+	if ( cnt >= 0 ) return cnt;
+
+	cnt = 0;
+	JagDBMap emptyMap;
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1 );
+	for ( int i = 0; i < _rangeDeletes.size(); ++i ) {
+		const JagRangeDelete &rd = _rangeDeletes[i];
+		JagMergeReader *ntr = fileReader( &emptyMap, rd.lo.c_str(), rd.hi.c_str() );
+		while ( ntr->getNext( kvbuf ) ) {
+			if ( ! rd.covers( kvbuf ) ) continue;
+			// counted once if ranges overlap
+			bool earlier = false;
+			for ( int j = 0; j < i; ++j ) {
+				if ( _rangeDeletes[j].covers( kvbuf ) ) { earlier = true; break; }
+			}
+			if ( ! earlier ) ++cnt;
+		}
+		delete ntr;
+	}
+	free( kvbuf );
+
+	_rangeDeletedRows = cnt;
+	return cnt;
+}
+
+// reader of rows in files between minbuf and maxbuf, including rows hidden by range deletes
+// rows before minbuf may be returned
+JagMergeReader* JagDiskArrayFamily::fileReader( const JagDBMap *emptyMap, const char *minbuf, const char *maxbuf )
+{
+    jagint index = 0, slimit, rlimit;
+    JagDBPair retpair;
+	JagFixString value;
+	JagVector<OnefileRange> fRange(8);
+	OnefileRange tempRange;
+
+	JagDBPair minpair( JagFixString( minbuf, _KLEN, _KLEN ), value );
+	JagDBPair maxpair( JagFixString( maxbuf, _KLEN, _KLEN ), value );
+	for ( int i = _darrlist.size()-1; i >= 0; --i ) {
+		_darrlist[i]->exist( minpair, &index, retpair );
+		slimit = index;
+		if ( slimit < 0 ) slimit = 0;
+		_darrlist[i]->exist( maxpair, &index, retpair );
+		rlimit = index - slimit + 1;
+		if ( rlimit > 0 ) {
+			tempRange.darr = _darrlist[i];
+			tempRange.startpos = slimit;
+			tempRange.readlen = rlimit;
+			tempRange.memmax = 128;
+			fRange.append( tempRange );
+		}
+	}
+
+	return new JagMergeReader( emptyMap, fRange, fRange.size(), _KLEN, _VLEN, minbuf, maxbuf );
+}
+
+// copy of the insert buffer rows in [minbuf, maxbuf], all rows if no bounds
+// caller holds the family lock; the copy is read without it
+JagDBMap* JagDiskArrayFamily::copyInsertBuffer( const char *minbuf, const char *maxbuf )
+{
+	JagDBMap *bufmap = new JagDBMap();
+	JagFixMapIterator iter;
+	if ( minbuf ) {
+		JagFixString value;
+		iter = _insertBufferMap->getSuccOrEqual( JagDBPair( JagFixString( minbuf, _KLEN, _KLEN ), value ) );
+	} else {
+		iter = _insertBufferMap->getFirst();
+	}
+
+	while ( ! _insertBufferMap->isAtEnd( iter ) ) {
+		if ( maxbuf && memcmp( iter->first.c_str(), maxbuf, _KLEN ) > 0 ) break;
+		bufmap->_map->emplace_hint( bufmap->_map->end(), iter->first, iter->second );
+		++iter;
+	}
+	return bufmap;
+}
+
+// file of range deletes: records [flags:1][cmplen:4][lo:KLEN][hi:KLEN]
+// flags: 1 lo inclusive, 2 hi inclusive. Written to a temp file and renamed.
+bool JagDiskArrayFamily::saveRangeDeletes()
+{
+	Jstr fpath = _pathname + ".rdel";
+	if ( _rangeDeletes.size() < 1 ) {
+		jagunlink( fpath.c_str() );
+		return true;
+	}
+
+	Jstr tmppath = fpath + ".tmp";
+	int fd = jagopen( tmppath.c_str(), O_CREAT|O_TRUNC|O_WRONLY|JAG_NOATIME, S_IRWXU );
+	if ( fd < 0 ) {
+		raydebug( stdout, JAG_LOG_LOW, "s40394 error open %s for write\n", tmppath.c_str() );
+		return false;
+	}
+
+	jagint reclen = 5 + 2*_KLEN;
+	char *rec = (char*)jagmalloc( reclen );
+	bool ok = true;
+	for ( int i = 0; ok && i < _rangeDeletes.size(); ++i ) {
+		const JagRangeDelete &rd = _rangeDeletes[i];
+		rec[0] = ( rd.loIncl ? 1 : 0 ) | ( rd.hiIncl ? 2 : 0 );
+		memcpy( rec+1, &rd.cmplen, 4 );
+		memcpy( rec+5, rd.lo.c_str(), _KLEN );
+		memcpy( rec+5+_KLEN, rd.hi.c_str(), _KLEN );
+		ok = ( raysafewrite( fd, rec, reclen ) == reclen );
+	}
+	free( rec );
+	if ( ok ) ok = ( 0 == jagfdatasync( fd ) );
+	jagclose( fd );
+	if ( ok ) ok = ( 0 == jagrename( tmppath.c_str(), fpath.c_str() ) );
+
+	if ( ! ok ) {
+		raydebug( stdout, JAG_LOG_LOW, "s40395 error write %s\n", tmppath.c_str() );
+		jagunlink( tmppath.c_str() );
+	}
+	return ok;
+}
+
+void JagDiskArrayFamily::loadRangeDeletes()
+{
+	Jstr fpath = _pathname + ".rdel";
+	int fd = jagopen( fpath.c_str(), O_RDONLY|JAG_NOATIME );
+	if ( fd < 0 ) return;
+
+	jagint reclen = 5 + 2*_KLEN;
+	char *rec = (char*)jagmalloc( reclen );
+	JagRangeDelete rd;
+	while ( raysaferead( fd, rec, reclen ) == reclen ) {
+		rd.loIncl = ( rec[0] & 1 ) ? true : false;
+		rd.hiIncl = ( rec[0] & 2 ) ? true : false;
+		memcpy( &rd.cmplen, rec+1, 4 );
+		if ( rd.cmplen < 1 || rd.cmplen > _KLEN ) break;
+		rd.lo = JagFixString( rec+5, _KLEN, _KLEN );
+		rd.hi = JagFixString( rec+5+_KLEN, _KLEN, _KLEN );
+		_rangeDeletes.append( rd );
+	}
+	free( rec );
+	jagclose( fd );
+
+	raydebug( stdout, JAG_LOG_LOW, "s40396 %s loaded %d range deletes\n", _objname.c_str(), _rangeDeletes.size() );
 }
 
 void JagDiskArrayFamily::removeAndReopenWalLog()
 {
 	Jstr dbtab = _dbname + "." + _taboridxname;
     Jstr walfpath = _servobj->_cfg->getWalLogHOME() + "/" + dbtab + ".wallog";
+
+	// updates and removes held in dirty compressed blocks are only in the wallog until written
+	for ( int i = 0; i < _darrlist.size(); ++i ) {
+		if ( _darrlist[i]->flushDirtyBlocks() < 0 ) {
+			raydebug( stdout, JAG_LOG_LOW, "s40401 error write blocks of %s, wallog %s kept\n", _objname.s(), walfpath.s() );
+			return;
+		}
+	}
 	prt(("s201226 reset wallog file %s ...\n", walfpath.c_str() ));
 	raydebug(stdout, JAG_LOG_LOW, "cleanup wagllog %s \n", walfpath.s() ); 
 
-    FILE *walFile = _servobj->_walLogMap.ensureFile( walfpath );
-	fclose( walFile );
-    _servobj->_walLogMap.removeKey( walfpath );
-	jagunlink( walfpath.c_str() );
-
-    _servobj->_walLogMap.ensureFile( walfpath );
-
+	_servobj->_walWriter->resetFile( walfpath );
 }
 
 jagint JagDiskArrayFamily::memoryBufferSize() 
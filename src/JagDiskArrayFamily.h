@@ -43,6 +43,25 @@
 #include <JagFamilyKeyChecker.h>
 #include <JagDBMap.h>
 
+// number of key lock stripes of a family; inserts of the same key hash to the same stripe
+#define JAG_FAMILY_KEY_STRIPES  64
+
+// max saved range deletes of a family; each read row of a file is checked against all
+#define JAG_MAX_RANGE_DELETES  32
+
+// deleted key range of a family: keys whose first cmplen bytes are between lo and hi
+class JagRangeDelete
+{
+  public:
+	JagRangeDelete() { cmplen = 0; loIncl = hiIncl = true; }
+	bool 	covers( const char *kbuf ) const;
+
+	JagFixString	lo;   // db format keys; bytes after cmplen are 0 in lo, 255 in hi
+	JagFixString	hi;
+	int				cmplen;
+	bool			loIncl;
+	bool			hiIncl;
+};
 
 class JagDiskArrayFamily
 {
@@ -80,10 +99,46 @@ class JagDiskArrayFamily
 	jagint addKeyCheckerFromJDB( JagDiskArrayServer *darr, int activepos );
 	jagint processFlushInsertBuffer();
 	JagDiskArrayServer* flushBufferToNewFile( );
+	JagDiskArrayServer* newSortedFile( jagint length );
+	bool	keyExist( const char *kbuf );
+	void	addSortedFile( JagDiskArrayServer *darr );
 	int  	findMinCostFile( JagVector<JagMergeSeg> &vec, bool forceFlush, int &mtype );
 	jagint memoryBufferSize(); // size of _insertBufferMap
 	void    removeAndReopenWalLog();
 	jagint addKeyCheckerFromInsertBuffer( int darrNum );
+
+	// concurrent inserts
+	void	setPreFlushHook( void (*hook)(void*), void *arg ) { _preFlushHook = hook; _preFlushArg = arg; }
+	void	lockInsertKeys( const JagVector<JagDBPair> &pairVec );
+	void	unlockInsertKeys( const JagVector<JagDBPair> &pairVec );
+	bool 	flushIfFull( bool canWait );
+	void	endScan() { pthread_rwlock_unlock( &_scanLock ); }
+
+	// counter merge: blind per-column deltas of existing rows, folded into the rows at flush
+	int		checkMergeDelta( const JagDBPair &delta );
+	void	addMergeDelta( const JagDBPair &delta );
+	void	applyMergeDelta( char *kvbuf );
+	void	applyMergeDelta( JagDBPair &pair );
+	void	dropMergeDelta( const JagDBPair &pair );
+	jagint	foldMergeDeltas();
+	static bool isMergeType( const Jstr &type );
+
+	// range deletes: file rows in a deleted range are hidden, then dropped when their file is merged
+	bool	deleteRange( const JagRangeDelete &rd, jagint *rows=NULL );
+	bool	rangeDeleted( const char *kbuf );
+	bool	reclaimDeleted( const char *kvbuf );
+	jagint	purgeRangeDeletes();
+	int		numRangeDeletes() const { return _rangeDeletes.size(); }
+	bool	rangeDeleted( const char *minkbuf, const char *maxkbuf );
+	jagint	dropCoveredFiles();
+
+	// time partitions: new simpfiles of a time-series table hold keys of one time bucket
+	void	setTimePartition( int offset, int length, jagint bucketLen );
+	jagint	timeBucket( const char *kbuf ) const;
+
+	// block compression: new simpfiles of the family are written as snappy blocks
+	void	setBlockCompress( bool compress );
+	bool	blockCompress() const { return _blockCompress; }
 	
 	JagDBMap    					*_insertBufferMap;
 	int         					_KLEN;
@@ -111,6 +166,40 @@ class JagDiskArrayFamily
 	jagint  						_insdircnt;
 	std::atomic<int>  				_isFlushing;
 	std::atomic<bool>				_doForceFlush;
+	std::atomic<jagint>				_numMergeDeltas;
+
+  protected:
+	void	getKeyStripes( const JagVector<JagDBPair> &pairVec, JagVector<int> &stripes );
+	Jstr	newFilePathName( int darrlistlen );
+	bool	addColumnDeltas( char *kvbuf, const char *deltakv );
+	bool	removeFileRow( const char *kbuf );
+	bool	removeFileRow( const char *kbuf, int pos );
+	JagMergeReader *fileReader( const JagDBMap *emptyMap, const char *minbuf, const char *maxbuf );
+	JagDBMap *copyInsertBuffer( const char *minbuf, const char *maxbuf );
+	bool	rangeHasFileRows( const JagRangeDelete &rd );
+	jagint	purgeRangeDelete( const JagRangeDelete &rd );
+	jagint	purgeBufferedRangeDeletes();
+	jagint	spillInsertBuffer();
+	jagint	countRangeDeleted();
+	jagint	countBufferRangeRows( const JagRangeDelete &rd );
+	jagint	countRangeFileRows( const JagRangeDelete &rd, const JagVector<JagRangeDelete> &prior );
+	void	loadRangeDeletes();
+	bool	saveRangeDeletes();
+
+	pthread_rwlock_t				_familyLock;  // insert buffer, keychecker and darrlist
+	pthread_rwlock_t				_flushLock;   // held shared from wallog append to buffer insert
+	pthread_rwlock_t				_scanLock;    // held shared by merge readers; a buffer flush skips or spills while held
+	pthread_mutex_t					_keyMutex[JAG_FAMILY_KEY_STRIPES];
+	void							(*_preFlushHook)(void*);  // called before buffer flush resets wallog
+	void							*_preFlushArg;
+	JagDBMap						*_mergeDeltaMap;    // key -> value with deltas in counter columns, other bytes zero
+	pthread_mutex_t					_mergeDeltaMutex;
+	JagVector<JagRangeDelete>		_rangeDeletes;      // saved in _pathname.rdel
+	std::atomic<jagint>				_rangeDeletedRows;  // file rows hidden by _rangeDeletes; -1 unknown
+	int								_timeOffset;     // first key column, datetime digits
+	int								_timeLength;
+	jagint							_timeBucketLen;  // in units of the column; 0 not partitioned
+	bool							_blockCompress;
 
 };
 
@@ -279,6 +279,11 @@ void JagDiskArrayServer::flushBlockIndexToDisk()
 	_compf->flushBlockIndexToDisk();
 }
 
+int JagDiskArrayServer::flushDirtyBlocks()
+{
+	return _compf->flushDirtyBlocks();
+}
+
 void JagDiskArrayServer::removeBlockIndexIndDisk()
 {
 	_compf->removeBlockIndexIndDisk();
@@ -66,6 +66,7 @@ class JagDiskArrayServer : public JagDiskArrayBase
 		// bool getLimitStartPos( jagint &startlen, jagint limitstart, jagint &soffset );
 
 		void flushBlockIndexToDisk();
+		int  flushDirtyBlocks();
 		void removeBlockIndexIndDisk();
 		//void separateResizeForce();
 		//void separateMergeForce();
@@ -123,26 +123,23 @@ void JagFixHashArray::reDistributeShrink()
 	_arr = _newarr;
 }
 
+// insert-if-absent: one probe sequence finds either the key or the empty slot for it
 bool JagFixHashArray::insert( const char *newpair )
 {
-	bool rc;
 	jagint index;
 
 	if ( *newpair == NBT  ) { 
 		return 0; 
 	}
 
-	jagint retindex;
-	rc = exist( newpair, &retindex );
-	if ( rc ) {
-		return false;
-	}
-
 	if ( ( _GEO*_elements ) >=  _arrlen-4 ) {
 		reAllocDistribute();
 	}
 
-	index = hashLocation( newpair, _arr, _arrlen ); 
+	if ( probeKey( newpair, &index ) ) {
+		return false;
+	}
+
 	memcpy( _arr+index*kvlen, newpair, kvlen );
 	++_elements;
 
@@ -224,6 +221,22 @@ bool JagFixHashArray::set( const char *pair )
 	return true;
 }
 
+// walk the probe sequence of search once
+// returns true and slot of key in index if found; else false and the empty slot ending the cluster
+bool JagFixHashArray::probeKey( const char *search, jagint *index )
+{
+	jagint idx = hashKey( search, _arrlen );
+   	while ( _arr[idx*kvlen] != NBT ) {
+   		if ( 0==memcmp( search, _arr+idx*kvlen, klen) ) {
+			*index = idx;
+   			return true;
+   		}
+   		idx = nextHC( idx, _arrlen );
+   	}
+	*index = idx;
+   	return false;
+}
+
 jagint JagFixHashArray::hashLocation( const char *pair, const char *arr, jagint arrlen )
 {
 	jagint index = hashKey( pair, arrlen ); 
@@ -61,6 +61,7 @@ class JagFixHashArray
 		jagint	hashKey( const char *key, jagint arrlen ) const;
     	inline jagint 	probeLocation( jagint hc, const char *arr, jagint arrlen );
     	inline jagint 	findProbedLocation( const char *search, jagint hc ) ;
+    	bool 			probeKey( const char *search, jagint *index );
     	inline void 	findCluster( jagint hc, jagint *start, jagint *end );
     	inline jagint 	prevHC ( jagint hc, jagint arrlen );
     	inline jagint 	nextHC( jagint hc, jagint arrlen );
@@ -26,6 +26,9 @@
 #include <JagDiskArrayClient.h>
 #include <JagDBConnector.h>
 #include <JagParser.h>
+#include <JagTime.h>
+#include <algorithm>
+#include <vector>
 
 JagIndex::JagIndex( int replicateType, const JagDBServer *servobj, const Jstr &wholePathName, 
 					const JagSchemaRecord &trecord, 
@@ -50,12 +53,29 @@ JagIndex::JagIndex( int replicateType, const JagDBServer *servobj, const Jstr &w
 	KEYLEN = 0;
 	VALLEN = 0;
 	KEYVALLEN = 0;
+	_pendingCnt = 0;
+	_pendingSince = 0;
+	_deferRegistered = false;
+	pthread_mutex_init( &_pendingMutex, NULL );
+	pthread_mutex_init( &_applyMutex, NULL );
 
 	init( buildInitIndex );
+
+	if ( _servobj->_indexDeferred ) {
+		((JagDBServer*)_servobj)->addDeferIndex( this );
+		_deferRegistered = true;
+	}
 }
 
 JagIndex::~JagIndex ()
 {
+	if ( _deferRegistered ) {
+		((JagDBServer*)_servobj)->removeDeferIndex( this );
+	}
+	clearPending();
+	pthread_mutex_destroy( &_pendingMutex );
+	pthread_mutex_destroy( &_applyMutex );
+
 	/***
 	if ( _marr ) {
 		delete _marr;
@@ -226,6 +246,11 @@ bool JagIndex::bufchange( char *indexbuf, char *tablebuf )
 
 int JagIndex::formatIndexCmdFromTable( const char *tablebuf, int type )
 {
+	if ( 0 != type && _pendingCnt > 0 && _darrFamily ) {
+		// deferred inserts must be in the index before a removal
+		applyPending();
+	}
+
 	char *indexbuf = (char*)jagmalloc(KEYVALLEN+1);
 	memset(indexbuf, 0, KEYVALLEN+1);
 	int rc = bufchange( indexbuf, (char*)tablebuf );
@@ -250,6 +275,107 @@ int JagIndex::formatIndexCmdFromTable( const char *tablebuf, int type )
 	return rc;
 }
 
+// tablebuf: table record in natural format
+// indexbuf: KEYVALLEN+1 bytes, gets the index record in db format
+bool JagIndex::formatIndexKVFromTable( const char *tablebuf, char *indexbuf )
+{
+	memset( indexbuf, 0, KEYVALLEN+1 );
+	if ( ! bufchange( indexbuf, (char*)tablebuf ) || *indexbuf == '\0' ) return false;
+	dbNaturalFormatExchange( indexbuf, _numKeys, _schAttr,0,0, " " ); // natural format -> db format
+	return true;
+}
+
+// queue a table record for the index; the index thread, readers of the index
+// or a flush of the table apply the queue in key order
+void JagIndex::deferFromTable( const char *tablebuf )
+{
+	JagFixString rec( tablebuf, TABKEYLEN+TABVALLEN );
+	pthread_mutex_lock( &_pendingMutex );
+	if ( _pendingVec.size() < 1 ) {
+		_pendingSince = JagTime::nowMilliSeconds();
+	}
+	_pendingVec.append( rec );
+	++ _pendingCnt;
+	pthread_mutex_unlock( &_pendingMutex );
+}
+
+// apply queued table records to the index in key order
+// maxRecs: 0 applies all queued records; otherwise at most maxRecs of the newest ones,
+// and nothing if another thread is applying (a reader does not wait for a large apply)
+// caller must not hold the family read lock of this index
+// return number of index pairs inserted
+jagint JagIndex::applyPending( jagint maxRecs )
+{
+	if ( _pendingCnt < 1 ) return 0;
+
+	if ( maxRecs > 0 ) {
+		if ( pthread_mutex_trylock( &_applyMutex ) != 0 ) return 0;
+	} else {
+		pthread_mutex_lock( &_applyMutex );
+	}
+
+	JagVector<JagFixString> recVec;
+	pthread_mutex_lock( &_pendingMutex );
+	if ( maxRecs < 1 || _pendingVec.size() <= maxRecs ) {
+		recVec = _pendingVec;
+		_pendingVec.clean();
+	} else {
+		for ( jagint i = _pendingVec.size() - maxRecs; i < _pendingVec.size(); ++i ) {
+			recVec.append( _pendingVec[i] );
+		}
+		for ( jagint i = 0; i < maxRecs; ++i ) {
+			_pendingVec.removepos( _pendingVec.size()-1 );
+		}
+	}
+	pthread_mutex_unlock( &_pendingMutex );
+
+	jagint cnt = 0;
+	if ( _darrFamily && recVec.size() > 0 ) {
+		jagint tabkvlen = TABKEYLEN+TABVALLEN;
+		char *tablebuf = (char*)jagmalloc( tabkvlen+1 );
+		char *indexbuf = (char*)jagmalloc( KEYVALLEN+1 );
+		std::vector<JagDBPair> pairVec;
+		pairVec.reserve( recVec.size() );
+		for ( jagint i = 0; i < recVec.size(); ++i ) {
+			memcpy( tablebuf, recVec[i].c_str(), tabkvlen );
+			tablebuf[tabkvlen] = '\0';
+			if ( ! formatIndexKVFromTable( tablebuf, indexbuf ) ) continue;
+			pairVec.push_back( JagDBPair( indexbuf, KEYLEN, indexbuf+KEYLEN, VALLEN ) );
+		}
+		free( tablebuf );
+		free( indexbuf );
+
+		std::stable_sort( pairVec.begin(), pairVec.end() );
+		JagDBPair retpair;
+		for ( jagint i = 0; i < pairVec.size(); ++i ) {
+			if ( _darrFamily->insert( pairVec[i], true, retpair ) ) ++cnt;
+		}
+	}
+
+	_pendingCnt -= recVec.size();
+	pthread_mutex_unlock( &_applyMutex );
+	return cnt;
+}
+
+// discard queued records, e.g. the index is dropped
+void JagIndex::clearPending()
+{
+	pthread_mutex_lock( &_applyMutex );
+	pthread_mutex_lock( &_pendingMutex );
+	_pendingCnt -= _pendingVec.size();
+	_pendingVec.clean();
+	pthread_mutex_unlock( &_pendingMutex );
+	pthread_mutex_unlock( &_applyMutex );
+}
+
+// index lag: age of oldest record not yet applied to the index
+jagint JagIndex::pendingLagMillis() const
+{
+	if ( _pendingCnt < 1 ) return 0;
+	jagint lag = JagTime::nowMilliSeconds() - _pendingSince;
+	return lag > 0 ? lag : 0;
+}
+
 int JagIndex::insertPair( JagDBPair &pair )
 {
 	JagDBPair retpair;
@@ -670,6 +796,7 @@ jagint JagIndex::select( JagDataAggregate *&jda, const char *cmd, const JagReque
 
 int JagIndex::drop()
 {
+	clearPending();
 	if ( _darrFamily ) {
 		_darrFamily->drop();
 		delete _darrFamily;
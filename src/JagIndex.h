@@ -23,6 +23,7 @@
 #include <JagTableUtil.h>
 #include <JagMergeReader.h>
 #include <JagBuffReader.h>
+#include <atomic>
 
 class JagDataAggregate;
 
@@ -62,7 +63,14 @@ class JagIndex
 	void 	setGetFileAttributes( const Jstr &hdir, JagParseParam *parseParam, char *buffers[] );
 
 	int 	formatIndexCmdFromTable( const char *tablebuf, int type );
+	bool 	formatIndexKVFromTable( const char *tablebuf, char *indexbuf );
 
+	// deferred index maintenance (INDEX_DEFERRED=yes)
+	void	deferFromTable( const char *tablebuf );
+	jagint	applyPending( jagint maxRecs=0 );
+	void	clearPending();
+	jagint	pendingCount() const { return _pendingCnt; }
+	jagint	pendingLagMillis() const;
 
 	JagDiskArrayFamily *_darrFamily;
 	Jstr 			_dbobj;
@@ -91,6 +99,13 @@ class JagIndex
 	Jstr 			_indexName;
 
 	void 			init( bool buildInitIndex );
+
+	JagVector<JagFixString>	_pendingVec;     // table records (natural format) not applied yet
+	pthread_mutex_t			_pendingMutex;   // protects _pendingVec
+	pthread_mutex_t			_applyMutex;     // one applier at a time
+	std::atomic<jagint>		_pendingCnt;     // queued or being applied
+	std::atomic<jagint>		_pendingSince;   // msec time of oldest queued record
+	bool					_deferRegistered;
 	
 };
 
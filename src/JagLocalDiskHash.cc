@@ -294,12 +294,6 @@ bool JagLocalDiskHash::_insertHash( const JagDBPair &jagDBPair, int current )
 		return 0;
 	}
 
-	jagint hloc;
-	bool rc = _exist( current, jagDBPair, &hloc );
-	if ( rc ) {
-		return false;
-	}
-
 	jagint arrlen = _arrlen;
 	int  fdHash = _fdHash;
 	if ( ! current ) {
@@ -309,15 +303,22 @@ bool JagLocalDiskHash::_insertHash( const JagDBPair &jagDBPair, int current )
 
 	char *kvbuf = (char*)jagmalloc(KVLEN+1);
 	memset( kvbuf, 0, KVLEN+1 );
+	// one pass over the probe sequence: stop at the key (duplicate) or at the empty slot for it
 	jagint hc = hashKey( jagDBPair, arrlen );
-	ssize_t n = raysafepread( fdHash, (char *)kvbuf, KVLEN, hc*KVLEN );
-	if ( n <= 0 ) { 
-		free( kvbuf ); 
-		return 0; 
-	}
+	ssize_t n;
+	while ( 1 ) {
+		n = raysafepread( fdHash, (char *)kvbuf, KVLEN, hc*KVLEN );
+		if ( n <= 0 ) { 
+			free( kvbuf ); 
+			return 0; 
+		}
 
-	if ( '\0' != *kvbuf ) {
-		hc = probeLocation( hc, fdHash, arrlen );
+		if ( '\0' == *kvbuf ) break;
+		if ( 0 == memcmp( kvbuf, p, KEYLEN ) ) {
+			free( kvbuf ); 
+			return false;
+		}
+		hc = nextHC( hc, arrlen );
 	}
 	free( kvbuf );
 
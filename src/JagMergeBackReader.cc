@@ -21,6 +21,7 @@
 #include <JagMergeBackReader.h>
 #include <JagBuffBackReader.h>
 #include <JagUtil.h>
+#include <JagDiskArrayFamily.h>
 
 
 JagMergeBackReader::JagMergeBackReader( const JagDBMap *dbmap, const JagVector<OnefileRange> &fRange, 
@@ -182,42 +183,49 @@ bool JagMergeBackReader::getNext( char *buf )
 	jagint pos;
 	int rc;
 
-	if ( ! _pqueue->pop( filenum, pair ) ) {
-		return false;
-		// break;
-	}
-	//use pair
-	memcpy(buf, pair.key.c_str(), KEYLEN);
-	memcpy(buf+KEYLEN, pair.value.c_str(), VALLEN);
-
-	// push next item
-	if ( filenum == -1 ) {
-		// get next item from memory
-		if ( ! memReadDone ) {
-			prevPos = currentPos;
-			++currentPos;
-			JagDBPair nextpair; // backward next
-			nextpair.key = currentPos->first;
-			nextpair.value = currentPos->second;
-			_pqueue->push( -1, nextpair );
-			if ( currentPos == endPos ) {
-				memReadDone = true;
-			}
+	// rows of files in a deleted range of the family are skipped
+	do {
+		if ( ! _pqueue->pop( filenum, pair ) ) {
+			return false;
+			// break;
 		}
-	} else {
-		// get next item from filenum
-		_goNext[filenum] = 1; 
-		rc = _buffBackReaderPtr[filenum]->getNext( _buf, pos );
-		if ( rc ) {
-			JagDBPair nextpair(_buf, KEYLEN, VALLEN );
-			if ( nextpair >= endPair ) {
-				_pqueue->push( filenum, nextpair );
+		//use pair
+		memcpy(buf, pair.key.c_str(), KEYLEN);
+		memcpy(buf+KEYLEN, pair.value.c_str(), VALLEN);
+
+		// push next item
+		if ( filenum == -1 ) {
+			// get next item from memory
+			if ( ! memReadDone ) {
+				prevPos = currentPos;
+				++currentPos;
+				JagDBPair nextpair; // backward next
+				nextpair.key = currentPos->first;
+				nextpair.value = currentPos->second;
+				_pqueue->push( -1, nextpair );
+				if ( currentPos == endPos ) {
+					memReadDone = true;
+				}
+			}
+		} else {
+			// get next item from filenum
+			_goNext[filenum] = 1; 
+			rc = _buffBackReaderPtr[filenum]->getNext( _buf, pos );
+			if ( rc ) {
+				JagDBPair nextpair(_buf, KEYLEN, VALLEN );
+				if ( nextpair >= endPair ) {
+					_pqueue->push( filenum, nextpair );
+				} else {
+					_goNext[filenum] = -1;  // end of file for this filenum
+				}
 			} else {
 				_goNext[filenum] = -1;  // end of file for this filenum
 			}
-		} else {
-			_goNext[filenum] = -1;  // end of file for this filenum
 		}
+	} while ( filenum >= 0 && _family && _family->rangeDeleted( buf ) );
+
+	if ( _family ) {
+		_family->applyMergeDelta( buf );
 	}
 	return true;
 }
@@ -21,6 +21,7 @@
 #include <JagMergeReader.h>
 #include <JagBuffReader.h>
 #include <JagUtil.h>
+#include <JagDiskArrayFamily.h>
 
 
 JagMergeReader::JagMergeReader( const JagDBMap *dbmap, const JagVector<OnefileRange> &fRange, int veclen, int keylen, int vallen, 
@@ -109,42 +110,49 @@ bool JagMergeReader::getNext( char *buf )
 	jagint pos;
 	int rc;
 
-	if ( ! _pqueue->pop( filenum, pair ) ) {
-		return false;
-	}
-
-	memcpy(buf, pair.key.c_str(), KEYLEN);
-	memcpy(buf+KEYLEN, pair.value.c_str(), VALLEN);
-
-	if ( filenum == -1 ) {
-		if ( ! memReadDone  ) {
-			prevPos = currentPos;
-			//print("in getNext() prevPos: ", prevPos );
-    		++currentPos;
+	// rows of files in a deleted range of the family are skipped
+	do {
+		if ( ! _pqueue->pop( filenum, pair ) ) {
+			return false;
+		}
 
-    		JagDBPair nextpair;
-    		nextpair.key = currentPos->first;
-    		nextpair.value = currentPos->second;
-    		_pqueue->push( -1, nextpair );
-    		if ( currentPos == endPos ) {
-    			memReadDone = true;
+		memcpy(buf, pair.key.c_str(), KEYLEN);
+		memcpy(buf+KEYLEN, pair.value.c_str(), VALLEN);
+
+		if ( filenum == -1 ) {
+			if ( ! memReadDone  ) {
+				prevPos = currentPos;
+				//print("in getNext() prevPos: ", prevPos );
+    			++currentPos;
+
+    			JagDBPair nextpair;
+    			nextpair.key = currentPos->first;
+    			nextpair.value = currentPos->second;
+    			_pqueue->push( -1, nextpair );
+    			if ( currentPos == endPos ) {
+    				memReadDone = true;
+				}
 			}
-		}
-	} else {
-		_goNext[filenum] = 1; 
+		} else {
+			_goNext[filenum] = 1; 
 
-		rc = _buffReaderPtr[filenum]->getNext( _buf, pos );
+			rc = _buffReaderPtr[filenum]->getNext( _buf, pos );
 
-		if ( rc ) {
-			JagDBPair nextpair(_buf, KEYLEN, VALLEN );
-			if ( nextpair <= endPair ) {
-				_pqueue->push( filenum, nextpair );
+			if ( rc ) {
+				JagDBPair nextpair(_buf, KEYLEN, VALLEN );
+				if ( nextpair <= endPair ) {
+					_pqueue->push( filenum, nextpair );
+				} else {
+					_goNext[filenum] = -1; 
+				}
 			} else {
-				_goNext[filenum] = -1; 
+				_goNext[filenum] = -1;  // end of file for this filenum
 			}
-		} else {
-			_goNext[filenum] = -1;  // end of file for this filenum
 		}
+	} while ( filenum >= 0 && _family && _family->rangeDeleted( buf ) );
+
+	if ( _family ) {
+		_family->applyMergeDelta( buf );
 	}
 	return true;
 }
@@ -22,6 +22,7 @@
 #include <JagUtil.h>
 #include <JagDBPair.h>
 #include <JagDBMap.h>
+#include <JagDiskArrayFamily.h>
 
 JagMergeReaderBase::JagMergeReaderBase( const JagDBMap *dbmap, int veclen, int keylen, int vallen, 
 										const char *minbuf, const char *maxbuf )
@@ -44,6 +45,8 @@ JagMergeReaderBase::JagMergeReaderBase( const JagDBMap *dbmap, int veclen, int k
 
 	memReadDone = false;
 	_pqueue = NULL;
+	_family = NULL;
+	_snapshot = NULL;
 }
 
 JagMergeReaderBase::~JagMergeReaderBase()
@@ -63,7 +66,11 @@ JagMergeReaderBase::~JagMergeReaderBase()
 	if ( _pqueue ) {
 		delete _pqueue;
 	}
-	
+
+	if ( _snapshot ) {
+		delete _snapshot;
+		_family->endScan();
+	}
 }
 
 void JagMergeReaderBase::putBack( const char *buf )
@@ -25,6 +25,8 @@
 #include <JagDBMap.h>
 #include <JagPriorityQueue.h>
 
+class JagDiskArrayFamily;
+
 class JagMergeReaderBase
 {
   public:
@@ -35,6 +37,8 @@ class JagMergeReaderBase
 	void         	putBack( const char *buf );
 	void 			unsetMark();
 	bool 			isMarked() const;
+	void			setFamily( JagDiskArrayFamily *family ) { _family = family; }
+	void			setSnapshot( JagDBMap *bufmap ) { _snapshot = bufmap; }
 
 	jagint KEYLEN;
 	jagint VALLEN;
@@ -54,6 +58,8 @@ class JagMergeReaderBase
 	bool 		_setRestartPos;
 	char 		*_cacheBuf;
 	bool  		_isMarkSet;
+	JagDiskArrayFamily  *_family;  // file rows in its deleted ranges are skipped; rows get its counter deltas
+	JagDBMap	*_snapshot;  // copy of family buffer rows, owned; family scan lock held while set
 
 };
 
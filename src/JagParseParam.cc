@@ -93,6 +93,7 @@ void JagParseParam::clean()
 	orderVec.clean(); 
 	groupVec.clean(); 
 	otherVec.clean(); 
+	insertRowsVec.clean(); 
 	createAttrVec.clean(); 
 	updSetVec.clean(); 
 	selColVec.clean(); 
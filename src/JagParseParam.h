@@ -456,6 +456,7 @@ class JagParseParam
 	JagVector<GroupOrderVecAttribute> groupVec;
 
 	JagVector<OtherAttribute> otherVec;
+	JagVector<JagVector<OtherAttribute> > insertRowsVec; // rows after the first of insert values (...),(...)
 
 	JagVector<CreateAttribute> createAttrVec;
 
@@ -2105,11 +2105,10 @@ int JagParser::setInsertVector()
 {
 	int rc;
 	char *p, *q;
-	short c1 = 0, c2 = 0, endSignal = 0, paraCount = 0;
+	short c1 = 0, c2 = 0, endSignal = 0;
 	// c1 relates to first parenthesis: insert into t (c1) values (c2), c2 relates to second 
 	ObjectNameAttribute oname;
 	OtherAttribute other;
-	Jstr outStr;
 	p = _saveptr;
 	while ( isspace(*p) ) ++p;
 	q = p;
@@ -2208,14 +2207,55 @@ int JagParser::setInsertVector()
 	}
 		
 	q += 6;
+
+	// insert into t values (...), (...), ... : every row starts from the same column list
+	JagVector<OtherAttribute> colTemplate = _ptrParam->otherVec;
+	JagVector<OtherAttribute> firstRow;
+	int  numRows = 0;
+	while ( 1 ) {
+		rc = setInsertRow( q, c1, other );
+		if ( rc < 0 ) return rc;
+
+		while ( isspace(*q) ) ++q;
+		if ( *q == ')' ) { ++q; while ( isspace(*q) ) ++q; }
+		if ( *q != ',' ) break;
+		++q;
+		if ( JAG_INSERT_OP != _ptrParam->opcode ) return -2833;
+
+		if ( 0 == numRows ) {
+			firstRow = _ptrParam->otherVec;
+		} else {
+			_ptrParam->insertRowsVec.append( _ptrParam->otherVec );
+		}
+		_ptrParam->otherVec = colTemplate;
+		++numRows;
+	}
+
+	if ( numRows > 0 ) {
+		// first row stays in otherVec
+		_ptrParam->insertRowsVec.append( _ptrParam->otherVec );
+		_ptrParam->otherVec = firstRow;
+	}
+
+	return 1;
+}
+
+// one value row of insert: ( v1, v2, ... )
+// q: points to ( at start; after the row on return. c1: number of columns given in insert column list
+int JagParser::setInsertRow( char *&q, short c1, OtherAttribute &other )
+{
+	int rc;
+	char *p;
+	short c2 = 0, endSignal = 0, paraCount = 0;
+	ObjectNameAttribute oname;
+	Jstr outStr;
+
 	while ( isspace(*q) ) ++q;
 	if ( *q != '(' ) return -2830;
 	paraCount = 1;
 	++q;  // values (q
 	if ( *q == '\0' ) return -2831;
 	
-	endSignal = 0;
-	c2 = 0;
 	bool hquote;
 	int dim;
 	while ( 1 ) {
@@ -112,6 +112,7 @@ class JagParser
 	int setLoadLine();
 	int setLoadQuote();
 	int setInsertVector();
+	int setInsertRow( char *&q, short c1, OtherAttribute &other );
 	int setUpdateVector();
 	int setCreateVector( short setType );
 	int setOneCreateColumnAttribute( CreateAttribute &cattr );
@@ -19,7 +19,9 @@
 #ifndef _jag_pass_h_
 #define _jag_pass_h_
 
+#include <atomic>
 #include <JagNet.h>
+#include <JagVector.h>
 class JagDBServer;
 class JaguarCPPClient;
 
@@ -38,4 +40,17 @@ class JagCliCmdPass {
 		Jstr cmd;
 };
 
+// shared by wallog recovery workers
+class JagRecoverPass {
+	public:
+		JagDBServer *servobj;
+		const JagVector<Jstr> *fpaths;
+		const JagVector<jagint> *fsizes;
+		std::atomic<jagint> *nextFile;
+		std::atomic<jagint> *doneFiles;
+		std::atomic<jagint> *doneBytes;
+		std::atomic<jagint> *doneRecords;
+		jagint totalBytes;
+};
+
 #endif
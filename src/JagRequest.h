@@ -25,7 +25,7 @@ class JagRequest
 {
    public:
 	JagRequest() { hasReply = true; batchReply = false; doCompress = false; 
-				   opcode = 0; session = NULL; dorep=true; syncDataCenter = false; }
+				   opcode = 0; session = NULL; dorep=true; syncDataCenter = false; redoOnly = false; }
 	~JagRequest() {}
 	inline JagRequest& operator=( const JagRequest& req ) 
 	{	
@@ -35,6 +35,7 @@ class JagRequest
 		opcode = req.opcode;
 		session = req.session;
 		syncDataCenter = req.syncDataCenter;
+		redoOnly = req.redoOnly;
 		return *this;
 	}
 
@@ -43,6 +44,7 @@ class JagRequest
 	bool batchReply;
 	bool dorep;
 	bool syncDataCenter;
+	bool redoOnly;  // replaying logs, do not write wallog
 	short opcode;
 	JagSession *session;
 };
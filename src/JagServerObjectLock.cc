@@ -351,8 +351,35 @@ int JagServerObjectLock::writeUnlockDatabase( jagint opcode, const Jstr &dbName,
 	return 1;	
 }
 
+// table lock for selects: shared table lock only
+// merge readers take the family lock themselves while they copy the insert buffer
 JagTable *JagServerObjectLock::readLockTable( jagint opcode, const Jstr &dbName, 
 							   const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
+{
+	return sharedLockTable( opcode, dbName, tableName, replicateType, lockSelfLevelOnly );
+}
+
+int JagServerObjectLock::readUnlockTable( jagint opcode, const Jstr &dbName, 
+	const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
+{
+	return sharedUnlockTable( opcode, dbName, tableName, replicateType, lockSelfLevelOnly );
+}
+
+// table lock for inserts: shared table lock only; many inserts run at the same time
+JagTable *JagServerObjectLock::insertLockTable( jagint opcode, const Jstr &dbName, 
+							   const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
+{
+	return sharedLockTable( opcode, dbName, tableName, replicateType, lockSelfLevelOnly );
+}
+
+int JagServerObjectLock::insertUnlockTable( jagint opcode, const Jstr &dbName, 
+	const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
+{
+	return sharedUnlockTable( opcode, dbName, tableName, replicateType, lockSelfLevelOnly );
+}
+
+JagTable *JagServerObjectLock::sharedLockTable( jagint opcode, const Jstr &dbName, 
+							   const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
 {
 	Jstr repstr = intToStr( replicateType );
 	AbaxString lockdb = dbName + "." + repstr;
@@ -409,7 +436,7 @@ JagTable *JagServerObjectLock::readLockTable( jagint opcode, const Jstr &dbName,
 	return ptab;
 }
 
-int JagServerObjectLock::readUnlockTable( jagint opcode, const Jstr &dbName, 
+int JagServerObjectLock::sharedUnlockTable( jagint opcode, const Jstr &dbName, 
 	const Jstr &tableName, int replicateType, bool lockSelfLevelOnly )
 {
 	Jstr repstr = intToStr( replicateType );
@@ -712,6 +739,10 @@ JagIndex *JagServerObjectLock::readLockIndex( jagint opcode, const Jstr &dbName,
 		return NULL;
 	}
 	JagIndex *pindex = (JagIndex*) bfr.addr();
+	if ( pindex && pindex->_darrFamily ) {
+		// readers apply a bounded part of the deferred index records; the index thread applies the rest
+		pindex->applyPending( pindex->_servobj->_indexDeferReadMax );
+	}
 	return pindex;
 }
 int JagServerObjectLock::readUnlockIndex( jagint opcode, const Jstr &dbName, const Jstr &tableName, const Jstr &indexName,
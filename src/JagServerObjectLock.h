@@ -52,6 +52,10 @@ class JagServerObjectLock
 	JagTable *readLockTable( jagint opcode, const Jstr &db, const Jstr &table, int repType, bool lockSelfLevel=0 );
 	int readUnlockTable( jagint opcode, const Jstr &dbName, const Jstr &table, int repType, bool lockSelfLevel=0 );
 
+	// shared table lock for concurrent inserts; family data is locked by the inserts
+	JagTable *insertLockTable( jagint opcode, const Jstr &db, const Jstr &table, int repType, bool lockSelfLevel=0 );
+	int insertUnlockTable( jagint opcode, const Jstr &dbName, const Jstr &table, int repType, bool lockSelfLevel=0 );
+
 	JagTable *writeLockTable( jagint opcode, const Jstr &db, const Jstr &table, const JagTableSchema *tschema, int repType, bool lockSelfLevel=0 );
 	int writeUnlockTable( jagint opcode, const Jstr &db, const Jstr &table, int repType, bool lockSelfLevel=0 );
 
@@ -73,6 +77,9 @@ class JagServerObjectLock
 
 	
   protected:
+	JagTable *sharedLockTable( jagint opcode, const Jstr &db, const Jstr &table, int repType, bool lockSelfLevel );
+	int sharedUnlockTable( jagint opcode, const Jstr &dbName, const Jstr &table, int repType, bool lockSelfLevel );
+
 	const JagDBServer					*_servobj;
 	JagHashLock							*_hashLock;
 	JagHashMap<AbaxString, AbaxBuffer>	*_databases;
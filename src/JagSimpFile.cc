@@ -23,6 +23,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
+#include <atomic>
+#include <snappy.h>
 
 #include <abax.h>
 #include <JagUtil.h>
@@ -35,6 +37,30 @@
 #include <JagSingleBuffWriter.h>
 #include <JagDiskArrayFamily.h>
 
+// every block record read or written gets a new seq, so a cached block is never stale
+static std::atomic<jaguint> _simpBlockSeq(0);
+
+// last decompressed block of the thread
+class JagSimpBlockCache
+{
+  public:
+	JagSimpBlockCache() { seq = 0; buf = NULL; cap = 0; cbuf = NULL; ccap = 0; }
+	~JagSimpBlockCache() { if ( buf ) free( buf ); if ( cbuf ) free( cbuf ); }
+	jaguint	seq;
+	char	*buf;
+	jagint	cap;
+	char	*cbuf;  // compressed record
+	jagint	ccap;
+};
+static thread_local JagSimpBlockCache _simpBlockCache;
+
+// bytes of rawlen logical bytes of rows when prefix encoded, at most
+static jagint encodedBlockCap( jagint rawlen, jagint kvlen )
+{
+	jagint nrows = ( rawlen + kvlen - 1 ) / kvlen;
+	return 4 + 4*( nrows/JAG_SIMP_COMP_RESTART_ROWS + 1 ) + nrows*( 4 + kvlen );
+}
+
 
 JagSimpFile::JagSimpFile( JagCompFile *compf,  const Jstr &path, jagint KLEN, jagint VLEN )
 {
@@ -52,6 +78,25 @@ JagSimpFile::JagSimpFile( JagCompFile *compf,  const Jstr &path, jagint KLEN, ja
 	_maxindex = 0;
 	_minindex = -1;
 
+	_compressed = false;
+	_prefixKeys = false;
+	_blockBytes = 0;
+	_dataLength = 0;
+	_fileBytes = 0;
+	_liveBytes = 0;
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		_dirty[i].blockno = -1;
+		_dirty[i].rawlen = 0;
+		_dirty[i].rows = NULL;
+	}
+	_nextDirty = 0;
+	// writer preferred: a stream of scan reads must not hold off point updates
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init( &attr );
+	pthread_rwlockattr_setkind_np( &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+	pthread_rwlock_init( &_blockLock, &attr );
+	pthread_rwlockattr_destroy( &attr );
+
 	_open();
 
 	_doneIndex = false;
@@ -72,31 +117,581 @@ void JagSimpFile::_open()
 	} else {
 		_length = 0;
 	}
-	
+
+	// a raw file never starts with the magic: an empty row is all zero bytes
+	_compressed = false;
+	_prefixKeys = false;
+	_blockLocs.clean();
+	char hdr[JAG_SIMP_COMP_HDR_LEN];
+	if ( _length >= JAG_SIMP_COMP_HDR_LEN ) {
+		if ( raysafepread( _fd, hdr, JAG_SIMP_COMP_HDR_LEN, 0 ) == JAG_SIMP_COMP_HDR_LEN 
+			 && 0 == memcmp( hdr, JAG_SIMP_COMP_MAGIC, JAG_SIMP_COMP_MAGIC_LEN ) ) {
+			int rows, flags;
+			memcpy( &rows, hdr+JAG_SIMP_COMP_MAGIC_LEN, 4 );
+			memcpy( &flags, hdr+JAG_SIMP_COMP_MAGIC_LEN+4, 4 );
+			_compressed = true;
+			_prefixKeys = ( flags & JAG_SIMP_COMP_PREFIX_KEYS );
+			_blockBytes = (jagint)rows * _KVLEN;
+			_length = loadBlockLocs( _length );
+		}
+	} else if ( 0 == _length && _compf && _compf->_family && _compf->_family->blockCompress() ) {
+		jagint rows = JAG_SIMP_COMP_BLOCK_BYTES/_KVLEN/JAG_BLOCK_SIZE*JAG_BLOCK_SIZE;
+		if ( rows < JAG_BLOCK_SIZE ) rows = JAG_BLOCK_SIZE;
+		int irows = rows;
+		int flags = ( _KLEN < JAG_SIMP_COMP_EMPTY_ROW ) ? JAG_SIMP_COMP_PREFIX_KEYS : 0;
+		memset( hdr, 0, JAG_SIMP_COMP_HDR_LEN );
+		memcpy( hdr, JAG_SIMP_COMP_MAGIC, JAG_SIMP_COMP_MAGIC_LEN );
+		memcpy( hdr+JAG_SIMP_COMP_MAGIC_LEN, &irows, 4 );
+		memcpy( hdr+JAG_SIMP_COMP_MAGIC_LEN+4, &flags, 4 );
+		if ( raysafepwrite( _fd, hdr, JAG_SIMP_COMP_HDR_LEN, 0 ) == JAG_SIMP_COMP_HDR_LEN ) {
+			_compressed = true;
+			_prefixKeys = ( flags & JAG_SIMP_COMP_PREFIX_KEYS );
+			_blockBytes = rows * _KVLEN;
+			_dataLength = 0;
+			_fileBytes = _liveBytes = JAG_SIMP_COMP_HDR_LEN;
+		}
+	}
+}
+
+// scan the block records of a compressed file; a torn record at the end is cut off
+// returns logical length of the file
+jagint JagSimpFile::loadBlockLocs( jagint fsize )
+{
+	char rhdr[JAG_SIMP_COMP_REC_HDR_LEN];
+	jagint pos = JAG_SIMP_COMP_HDR_LEN;
+	jagint blockno, rawlen, clen;
+	int i4;
+	JagSimpBlockLoc loc;
+
+	_dataLength = 0;
+	_liveBytes = JAG_SIMP_COMP_HDR_LEN;
+	while ( pos + JAG_SIMP_COMP_REC_HDR_LEN <= fsize ) {
+		if ( raysafepread( _fd, rhdr, JAG_SIMP_COMP_REC_HDR_LEN, pos ) != JAG_SIMP_COMP_REC_HDR_LEN ) break;
+		memcpy( &blockno, rhdr, 8 );
+		memcpy( &i4, rhdr+8, 4 ); rawlen = i4;
+		memcpy( &i4, rhdr+12, 4 ); clen = i4;
+		if ( blockno < 0 || rawlen < 1 || rawlen > _blockBytes || clen < 1 
+			 || pos + JAG_SIMP_COMP_REC_HDR_LEN + clen > fsize ) {
+			break;
+		}
+
+		loc.offset = -1; loc.clen = loc.rawlen = 0; loc.seq = 0;
+		while ( _blockLocs.size() <= blockno ) _blockLocs.push_back( loc );
+		if ( _blockLocs[blockno].offset >= 0 ) {
+			_liveBytes -= JAG_SIMP_COMP_REC_HDR_LEN + _blockLocs[blockno].clen;
+		}
+		loc.offset = pos;
+		loc.clen = clen;
+		loc.rawlen = rawlen;
+		loc.seq = 0;
+		_blockLocs[blockno] = loc;
+		_liveBytes += JAG_SIMP_COMP_REC_HDR_LEN + clen;
+		pos += JAG_SIMP_COMP_REC_HDR_LEN + clen;
+	}
+
+	if ( pos < fsize ) {
+		raydebug( stdout, JAG_LOG_LOW, "s30281 %s torn block record at %l, truncated from %l\n", _fpath.s(), pos, fsize );
+		jagftruncate( _fd, pos );
+	}
+	_fileBytes = pos;
+
+	for ( jagint i = 0; i < _blockLocs.size(); ++i ) {
+		if ( _blockLocs[i].offset < 0 ) continue;
+		_blockLocs[i].seq = ++_simpBlockSeq;
+		_dataLength = i*_blockBytes + _blockLocs[i].rawlen;
+	}
+	return _dataLength;
 }
 
 void JagSimpFile::close()
 {
+	flushDirtyBlocks();
 	::close( _fd );
 }
 
 JagSimpFile::~JagSimpFile() 
 {
+	flushDirtyBlocks();
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		if ( _dirty[i].rows ) free( _dirty[i].rows );
+	}
 	free( _nullbuf );
+	if ( _blockIndex ) delete _blockIndex;
+	pthread_rwlock_destroy( &_blockLock );
 }
 
+// a row pread and pwrite of a raw file are independent syscalls; blocks of a compressed file
+// are shared state (dirty slots, block locations, _fd after compact), so they take _blockLock
 jagint JagSimpFile::pread( char *buf, jagint localOffset, jagint nbytes ) const
 {
+	if ( _compressed ) {
+		pthread_rwlock_rdlock( &_blockLock );
+		jagint rc = compressedPread( buf, localOffset, nbytes );
+		pthread_rwlock_unlock( &_blockLock );
+		return rc;
+	}
 	return raysafepread( _fd, buf, nbytes, localOffset );
 }
 
 jagint JagSimpFile::pwrite( const char *buf, jagint localOffset, jagint nbytes )
 {
+	if ( _compressed ) {
+		pthread_rwlock_wrlock( &_blockLock );
+		jagint rc = compressedPwrite( buf, localOffset, nbytes );
+		pthread_rwlock_unlock( &_blockLock );
+		return rc;
+	}
 	return raysafepwrite( _fd, buf, nbytes, localOffset );
 }
 
+// bytes of a block past its rawlen, and of blocks never written, read as zero (empty rows)
+jagint JagSimpFile::compressedPread( char *buf, jagint localOffset, jagint nbytes ) const
+{
+	if ( localOffset < 0 ) return -1;
+	if ( localOffset >= _dataLength ) return 0;
+	if ( localOffset + nbytes > _dataLength ) nbytes = _dataLength - localOffset;
+
+	jagint done = 0, pos, blockno, inoff, take, rawlen;
+	const char *blk;
+	int d;
+	while ( done < nbytes ) {
+		pos = localOffset + done;
+		blockno = pos / _blockBytes;
+		inoff = pos % _blockBytes;
+		take = _blockBytes - inoff;
+		if ( take > nbytes - done ) take = nbytes - done;
+
+		d = dirtyBlock( blockno );
+		if ( d >= 0 ) {
+			rawlen = _dirty[d].rawlen;
+			if ( inoff >= rawlen ) {
+				memset( buf+done, 0, take );
+			} else if ( inoff + take <= rawlen ) {
+				memcpy( buf+done, _dirty[d].rows+inoff, take );
+			} else {
+				memcpy( buf+done, _dirty[d].rows+inoff, rawlen-inoff );
+				memset( buf+done+rawlen-inoff, 0, take-(rawlen-inoff) );
+			}
+			done += take;
+			continue;
+		}
+
+		blk = getBlock( blockno, rawlen );
+		if ( NULL == blk ) {
+			if ( rawlen < 0 ) return -1;
+			rawlen = 0;
+		}
+
+		if ( inoff >= rawlen ) {
+			memset( buf+done, 0, take );
+		} else if ( inoff + take <= rawlen ) {
+			readBlockRows( blk, rawlen, inoff, take, buf+done );
+		} else {
+			readBlockRows( blk, rawlen, inoff, rawlen-inoff, buf+done );
+			memset( buf+done+rawlen-inoff, 0, take-(rawlen-inoff) );
+		}
+		done += take;
+	}
+	return nbytes;
+}
+
+// a whole block is appended as a new record at once
+// a partially written block is read into a dirty slot and patched there; point updates and
+// removes of one block share one record, appended when the slot is reused or flushDirtyBlocks()
+jagint JagSimpFile::compressedPwrite( const char *buf, jagint localOffset, jagint nbytes )
+{
+	if ( localOffset < 0 ) return -1;
+	jagint done = 0, pos, blockno, inoff, take;
+	int d, rc = 0;
+	while ( done < nbytes ) {
+		pos = localOffset + done;
+		blockno = pos / _blockBytes;
+		inoff = pos % _blockBytes;
+		take = _blockBytes - inoff;
+		if ( take > nbytes - done ) take = nbytes - done;
+
+		d = dirtyBlock( blockno );
+		if ( d < 0 && 0 == inoff && take == _blockBytes ) {
+			if ( writeBlock( blockno, buf+done, take ) < 0 ) {
+				rc = -1;
+				break;
+			}
+			done += take;
+			continue;
+		}
+
+		if ( d < 0 && ( d = newDirtyBlock( blockno ) ) < 0 ) {
+			rc = -1;
+			break;
+		}
+		memcpy( _dirty[d].rows+inoff, buf+done, take );
+		if ( inoff + take > _dirty[d].rawlen ) _dirty[d].rawlen = inoff + take;
+		if ( blockno*_blockBytes + _dirty[d].rawlen > _dataLength ) _dataLength = blockno*_blockBytes + _dirty[d].rawlen;
+		done += take;
+	}
+
+	if ( _fileBytes > 2*_liveBytes + JAG_SIMP_COMP_SLACK_BYTES ) {
+		compact();
+	}
+
+	if ( rc < 0 ) return -1;
+	return nbytes;
+}
+
+// slot of blockno in the dirty blocks, -1 if it is not dirty
+int JagSimpFile::dirtyBlock( jagint blockno ) const
+{
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		if ( _dirty[i].blockno == blockno ) return i;
+	}
+	return -1;
+}
+
+// read blockno into a free slot, or into the oldest slot after appending its block
+// return slot, -1 on error
+int JagSimpFile::newDirtyBlock( jagint blockno )
+{
+	int d = -1;
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		if ( _dirty[i].blockno < 0 ) { d = i; break; }
+	}
+	if ( d < 0 ) {
+		d = _nextDirty;
+		_nextDirty = ( _nextDirty + 1 ) % JAG_SIMP_COMP_DIRTY_BLOCKS;
+		if ( writeBlock( _dirty[d].blockno, _dirty[d].rows, _dirty[d].rawlen ) < 0 ) return -1;
+		_dirty[d].blockno = -1;
+	}
+
+	if ( NULL == _dirty[d].rows ) _dirty[d].rows = (char*)jagmalloc( _blockBytes );
+	memset( _dirty[d].rows, 0, _blockBytes );
+	jagint rawlen = 0;
+	const char *blk = getBlock( blockno, rawlen );
+	if ( blk ) {
+		readBlockRows( blk, rawlen, 0, rawlen, _dirty[d].rows );
+	} else if ( rawlen < 0 ) {
+		return -1;
+	} else {
+		rawlen = 0;
+	}
+	_dirty[d].rawlen = rawlen;
+	_dirty[d].blockno = blockno;
+	return d;
+}
+
+// append the records of all dirty blocks
+// return 0: OK  -1: error, the blocks not written stay dirty
+int JagSimpFile::flushDirtyBlocks()
+{
+	if ( ! _compressed ) return 0;
+	pthread_rwlock_wrlock( &_blockLock );
+	int rc = writeDirtyBlocks();
+	pthread_rwlock_unlock( &_blockLock );
+	return rc;
+}
+
+int JagSimpFile::writeDirtyBlocks()
+{
+	int rc = 0;
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		if ( _dirty[i].blockno < 0 ) continue;
+		if ( writeBlock( _dirty[i].blockno, _dirty[i].rows, _dirty[i].rawlen ) < 0 ) {
+			rc = -1;
+			continue;
+		}
+		_dirty[i].blockno = -1;
+	}
+
+	if ( _fileBytes > 2*_liveBytes + JAG_SIMP_COMP_SLACK_BYTES ) {
+		compact();
+	}
+	return rc;
+}
+
+// forget dirty blocks of a file that is removed or replaced
+void JagSimpFile::dropDirtyBlocks()
+{
+	pthread_rwlock_wrlock( &_blockLock );
+	for ( int i = 0; i < JAG_SIMP_COMP_DIRTY_BLOCKS; ++i ) {
+		_dirty[i].blockno = -1;
+	}
+	pthread_rwlock_unlock( &_blockLock );
+}
+
+// decompressed content of block (rows or prefix encoded rows); rawlen is its logical bytes
+// NULL if block is not written (rawlen 0) or on error (rawlen -1)
+// the returned buffer is valid until the next call in this thread
+const char *JagSimpFile::getBlock( jagint blockno, jagint &rawlen ) const
+{
+	rawlen = 0;
+	if ( blockno >= _blockLocs.size() ) return NULL;
+	const JagSimpBlockLoc &loc = _blockLocs[blockno];
+	if ( loc.offset < 0 ) return NULL;
+
+	JagSimpBlockCache &cache = _simpBlockCache;
+	if ( cache.seq == loc.seq ) {
+		rawlen = loc.rawlen;
+		return cache.buf;
+	}
+
+	jagint ucap = _prefixKeys ? encodedBlockCap( _blockBytes, _KVLEN ) : _blockBytes;
+	if ( cache.cap < ucap ) {
+		if ( cache.buf ) free( cache.buf );
+		cache.buf = (char*)jagmalloc( ucap );
+		cache.cap = ucap;
+	}
+	if ( cache.ccap < loc.clen ) {
+		if ( cache.cbuf ) free( cache.cbuf );
+		cache.cbuf = (char*)jagmalloc( loc.clen );
+		cache.ccap = loc.clen;
+	}
+	cache.seq = 0;
+
+	size_t unlen = 0;
+	if ( raysafepread( _fd, cache.cbuf, loc.clen, loc.offset+JAG_SIMP_COMP_REC_HDR_LEN ) != loc.clen 
+		 || ! snappy::GetUncompressedLength( cache.cbuf, loc.clen, &unlen ) || (jagint)unlen > ucap
+		 || ( ! _prefixKeys && (jagint)unlen != loc.rawlen )
+		 || ! snappy::RawUncompress( cache.cbuf, loc.clen, cache.buf ) ) {
+		raydebug( stdout, JAG_LOG_LOW, "s30283 error %s block %l at %l is corrupt\n", _fpath.s(), blockno, loc.offset );
+		rawlen = -1;
+		return NULL;
+	}
+
+	cache.seq = loc.seq;
+	rawlen = loc.rawlen;
+	return cache.buf;
+}
+
+// prefix encode the rows of a block, see JagSimpFile.h; returns encoded bytes
+jagint JagSimpFile::encodeBlock( const char *rows, jagint rawlen, char *out ) const
+{
+	jagint nrows = ( rawlen + _KVLEN - 1 ) / _KVLEN;
+	jagint nrestarts = ( nrows + JAG_SIMP_COMP_RESTART_ROWS - 1 ) / JAG_SIMP_COMP_RESTART_ROWS;
+	char *row = (char*)jagmalloc( _KVLEN );
+	char *prev = (char*)jagmalloc( _KLEN );
+	char *p = out + 4 + 4*nrestarts;
+	jagint prevlen = 0, klen, shared, i, j;
+	int i4;
+	unsigned short u2;
+
+	i4 = nrows; memcpy( out, &i4, 4 );
+	for ( i = 0; i < nrows; ++i ) {
+		if ( ( i+1 ) * _KVLEN <= rawlen ) {
+			memcpy( row, rows + i*_KVLEN, _KVLEN );
+		} else {
+			memset( row, 0, _KVLEN );
+			memcpy( row, rows + i*_KVLEN, rawlen - i*_KVLEN );
+		}
+
+		if ( 0 == i % JAG_SIMP_COMP_RESTART_ROWS ) {
+			i4 = p - out; memcpy( out + 4 + 4*(i/JAG_SIMP_COMP_RESTART_ROWS), &i4, 4 );
+			prevlen = 0;
+		}
+
+		for ( j = 0; j < _KVLEN && '\0' == row[j]; ++j ) ;
+		if ( j == _KVLEN ) {
+			u2 = JAG_SIMP_COMP_EMPTY_ROW; memcpy( p, &u2, 2 ); p += 2;
+			continue;
+		}
+
+		klen = _KLEN;
+		while ( klen > 0 && '\0' == row[klen-1] ) --klen;
+		shared = 0;
+		while ( shared < prevlen && shared < klen && prev[shared] == row[shared] ) ++shared;
+		u2 = shared; memcpy( p, &u2, 2 ); p += 2;
+		u2 = klen - shared; memcpy( p, &u2, 2 ); p += 2;
+		memcpy( p, row+shared, klen-shared ); p += klen-shared;
+		memcpy( p, row+_KLEN, _VLEN ); p += _VLEN;
+		memcpy( prev, row, klen );
+		prevlen = klen;
+	}
+	free( row );
+	free( prev );
+	return p - out;
+}
+
+// decode nrows rows from row of a prefix encoded block; rows past its end are zero
+void JagSimpFile::decodeRows( const char *enc, jagint row, jagint nrows, char *out ) const
+{
+	int i4;
+	unsigned short shared, nonshared;
+	memcpy( &i4, enc, 4 );
+	jagint total = i4;
+	jagint endrow = row + nrows;
+	if ( endrow > total ) {
+		jagint from = ( total > row ) ? total : row;
+		memset( out + (from-row)*_KVLEN, 0, (endrow-from)*_KVLEN );
+		endrow = total;
+	}
+	if ( row >= endrow ) return;
+
+	char *key = (char*)jagmalloc( _KLEN );
+	jagint r = row / JAG_SIMP_COMP_RESTART_ROWS * JAG_SIMP_COMP_RESTART_ROWS;
+	memcpy( &i4, enc + 4 + 4*(r/JAG_SIMP_COMP_RESTART_ROWS), 4 );
+	const char *p = enc + i4;
+	jagint klen;
+	char *o;
+	for ( ; r < endrow; ++r ) {
+		memcpy( &shared, p, 2 ); p += 2;
+		if ( JAG_SIMP_COMP_EMPTY_ROW == shared ) {
+			if ( r >= row ) memset( out + (r-row)*_KVLEN, 0, _KVLEN );
+			continue;
+		}
+		memcpy( &nonshared, p, 2 ); p += 2;
+		memcpy( key+shared, p, nonshared ); p += nonshared;
+		klen = shared + nonshared;
+		if ( r >= row ) {
+			o = out + (r-row)*_KVLEN;
+			memcpy( o, key, klen );
+			memset( o+klen, 0, _KLEN-klen );
+			memcpy( o+_KLEN, p, _VLEN );
+		}
+		p += _VLEN;
+	}
+	free( key );
+}
+
+// copy nbytes at inoff of a block from its decompressed content blk
+void JagSimpFile::readBlockRows( const char *blk, jagint rawlen, jagint inoff, jagint nbytes, char *out ) const
+{
+	if ( ! _prefixKeys ) {
+		memcpy( out, blk+inoff, nbytes );
+		return;
+	}
+
+	jagint row = inoff / _KVLEN;
+	jagint endrow = ( inoff + nbytes + _KVLEN - 1 ) / _KVLEN;
+	if ( 0 == inoff % _KVLEN && 0 == nbytes % _KVLEN ) {
+		decodeRows( blk, row, endrow - row, out );
+		return;
+	}
+
+	char *rows = (char*)jagmalloc( (endrow-row)*_KVLEN );
+	decodeRows( blk, row, endrow - row, rows );
+	memcpy( out, rows + inoff - row*_KVLEN, nbytes );
+	free( rows );
+}
+
+// append a record with the new content of block
+int JagSimpFile::writeBlock( jagint blockno, const char *buf, jagint rawlen )
+{
+	char *enc = NULL;
+	jagint enclen = rawlen;
+	if ( _prefixKeys ) {
+		enc = (char*)jagmalloc( encodedBlockCap( rawlen, _KVLEN ) );
+		enclen = encodeBlock( buf, rawlen, enc );
+		buf = enc;
+	}
+
+	jagint cap = JAG_SIMP_COMP_REC_HDR_LEN + snappy::MaxCompressedLength( enclen );
+	char *rec = (char*)jagmalloc( cap );
+	size_t clen = 0;
+	snappy::RawCompress( buf, enclen, rec+JAG_SIMP_COMP_REC_HDR_LEN, &clen );
+	if ( enc ) free( enc );
+	int i4;
+	memcpy( rec, &blockno, 8 );
+	i4 = rawlen; memcpy( rec+8, &i4, 4 );
+	i4 = clen; memcpy( rec+12, &i4, 4 );
+
+	jagint reclen = JAG_SIMP_COMP_REC_HDR_LEN + clen;
+	if ( raysafepwrite( _fd, rec, reclen, _fileBytes ) != reclen ) {
+		raydebug( stdout, JAG_LOG_LOW, "s30285 error write %s block %l\n", _fpath.s(), blockno );
+		free( rec );
+		return -1;
+	}
+	free( rec );
+
+	JagSimpBlockLoc loc;
+	loc.offset = -1; loc.clen = loc.rawlen = 0; loc.seq = 0;
+	while ( _blockLocs.size() <= blockno ) _blockLocs.push_back( loc );
+	if ( _blockLocs[blockno].offset >= 0 ) {
+		_liveBytes -= JAG_SIMP_COMP_REC_HDR_LEN + _blockLocs[blockno].clen;
+	}
+	loc.offset = _fileBytes;
+	loc.clen = clen;
+	loc.rawlen = rawlen;
+	loc.seq = ++_simpBlockSeq;
+	_blockLocs[blockno] = loc;
+	_liveBytes += reclen;
+	_fileBytes += reclen;
+	if ( blockno*_blockBytes + rawlen > _dataLength ) _dataLength = blockno*_blockBytes + rawlen;
+	return 0;
+}
+
+// copy current block records to a new file when replaced records take most of the file
+void JagSimpFile::compact()
+{
+	Jstr tpath = _fpath + ".compact";
+	jagunlink( tpath.c_str() );
+	int fd = jagopen( tpath.c_str(), O_CREAT|O_RDWR|JAG_NOATIME, S_IRWXU );
+	if ( fd < 0 ) return;
+
+	char hdr[JAG_SIMP_COMP_HDR_LEN];
+	jagint pos = JAG_SIMP_COMP_HDR_LEN;
+	bool ok = ( raysafepread( _fd, hdr, JAG_SIMP_COMP_HDR_LEN, 0 ) == JAG_SIMP_COMP_HDR_LEN 
+				&& raysafepwrite( fd, hdr, JAG_SIMP_COMP_HDR_LEN, 0 ) == JAG_SIMP_COMP_HDR_LEN );
+	JagVector<jagint> newOffsets;
+	char *rec = NULL;
+	jagint reccap = 0, reclen;
+	for ( jagint i = 0; ok && i < _blockLocs.size(); ++i ) {
+		if ( _blockLocs[i].offset < 0 ) {
+			newOffsets.push_back( -1 );
+			continue;
+		}
+		reclen = JAG_SIMP_COMP_REC_HDR_LEN + _blockLocs[i].clen;
+		if ( reccap < reclen ) {
+			if ( rec ) free( rec );
+			rec = (char*)jagmalloc( reclen );
+			reccap = reclen;
+		}
+		if ( raysafepread( _fd, rec, reclen, _blockLocs[i].offset ) != reclen
+			 || raysafepwrite( fd, rec, reclen, pos ) != reclen ) {
+			ok = false;
+			break;
+		}
+		newOffsets.push_back( pos );
+		pos += reclen;
+	}
+	if ( rec ) free( rec );
+
+	if ( ! ok || ::fsync( fd ) < 0 ) {
+		jagclose( fd );
+		jagunlink( tpath.c_str() );
+		return;
+	}
+
+	raydebug( stdout, JAG_LOG_LOW, "s30287 compact %s %l -> %l bytes\n", _fpath.s(), _fileBytes, pos );
+	jagrename( tpath.c_str(), _fpath.c_str() );
+	::close( _fd );
+	_fd = fd;
+	for ( jagint i = 0; i < _blockLocs.size(); ++i ) {
+		_blockLocs[i].offset = newOffsets[i];
+	}
+	_fileBytes = _liveBytes = pos;
+}
+
+// append nbytes of src at localOffset after the data of this file
+jagint JagSimpFile::appendFrom( const JagSimpFile *src, jagint srcOffset, jagint nbytes )
+{
+	jagint dstOffset = _compressed ? _dataLength : _length;
+	jagint chunk = 1024*1024/_KVLEN*_KVLEN;
+	if ( chunk < _KVLEN ) chunk = _KVLEN;
+	char *buf = (char*)jagmalloc( chunk );
+	jagint done = 0, n, rc;
+	while ( done < nbytes ) {
+		n = nbytes - done;
+		if ( n > chunk ) n = chunk;
+		rc = src->pread( buf, srcOffset+done, n );
+		if ( rc <= 0 ) break;
+		if ( pwrite( buf, dstOffset+done, rc ) < 0 ) break;
+		done += rc;
+	}
+	free( buf );
+	return done;
+}
+
 void JagSimpFile::removeFile()
 {
+	dropDirtyBlocks();
 	::close( _fd );
 	jagunlink( _fpath.c_str() );
 }
@@ -104,12 +699,15 @@ void JagSimpFile::removeFile()
 
 void JagSimpFile::renameTo( const Jstr &newName )
 {
+	flushDirtyBlocks();
+	pthread_rwlock_wrlock( &_blockLock );
 	::close( _fd );
 	Jstr dirname = JagFileMgr::dirName( _fpath );
 	Jstr newfpath = dirname + "/" + newName;
 	jagrename( _fpath.c_str(), newfpath.c_str() );
 	_fpath = newfpath;
 	_open();
+	pthread_rwlock_unlock( &_blockLock );
 }
 
 int JagSimpFile::seekTo( jagint pos)
@@ -176,9 +774,12 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
     JagFixMapIterator endIter = ++ rightIter;  
     JagFixMapIterator iter;
 
+	// merged file is written in the current format of the family
 	Jstr fpath = _fpath + ".merging";
-	int fd = jagopen( fpath.c_str(), O_CREAT|O_RDWR|JAG_NOATIME, S_IRWXU );
-	if ( fd < 0 ) {
+	jagunlink( fpath.c_str() );
+	JagSimpFile *mergef = new JagSimpFile( _compf, fpath, _KLEN, _VLEN );
+	if ( mergef->_fd < 0 ) {
+		delete mergef;
 		return -1;
 	}
 
@@ -190,7 +791,7 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
     JagSingleBuffWriter *sbw = NULL;
     jagint dblimit = 64;
 	_elements = 0;
-    sbw = new JagSingleBuffWriter( fd, _KVLEN, dblimit );
+    sbw = new JagSingleBuffWriter( mergef, _KVLEN, dblimit );
 
 	char *kvbuf = (char*)jagmalloc(_KVLEN+1);
 	char *dbuf = (char*)jagmalloc(_KVLEN+1);
@@ -198,7 +799,7 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
 	memset( dbuf, 0, _KVLEN+1 );
 
 	jagint rlimit = getBuffReaderWriterMemorySize( _length/1024/1024 );
-	JagSingleBuffReader dbr( (int)_fd, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
+	JagSingleBuffReader dbr( this, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
 	JagDBPair tmppair;
 	jagint length = 0;
 	JagDBPair mpair;
@@ -210,6 +811,8 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
 	jagint wpos = 0;
 	jagint lastBlock = -1;
 	int drc;
+	// rows of the file in a deleted range of the family are not copied
+	JagDiskArrayFamily *family = _compf->_family;
 
 	drc = dbr.getNext( dbuf );
 	while ( true ) {
@@ -238,6 +841,7 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
 		} else {
 			memcpy( kvbuf, dbuf, _KVLEN );
 			drc = dbr.getNext( dbuf );
+			if ( family && family->reclaimDeleted( kvbuf ) ) continue;
 		}
 		
 		sbw->writeit( wpos, kvbuf, _KVLEN );
@@ -249,19 +853,18 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
 
 	if (  memDone && diskDone ) {
 	} else if ( memDone ) {
-		while ( true ) {
+		while ( drc ) {
 			memcpy( kvbuf, dbuf, _KVLEN );
+			drc = dbr.getNext( dbuf );
+			if ( family && family->reclaimDeleted( kvbuf ) ) continue;
 			sbw->writeit( wpos, kvbuf, _KVLEN );
 			++ _elements;
 			insertMergeUpdateBlockIndex( kvbuf, wpos, lastBlock );
 			wpos += 1;
 			length += _KVLEN;
-			drc = dbr.getNext( dbuf );
-			if ( 0 == drc ) {
-				break;
-			}
 		}
 	} else {
+		mpair.point( iter->first, iter->second);
 		while ( true ) {
 			memcpy( kvbuf, mpair.key.c_str(), _KLEN );
 			memcpy( kvbuf+ _KLEN, mpair.value.c_str(), _VLEN );
@@ -279,20 +882,43 @@ jagint JagSimpFile::mergeSegment( const JagMergeSeg& seg )
 	}
 
 	if ( sbw ) sbw->flushBuffer();
+	delete sbw;
+	sbw = NULL;
 
+	// rows of dirty blocks were read into the merged file
+	dropDirtyBlocks();
 	::close( _fd );
-	::close( fd );
+	mergef->close();
+	delete mergef;
 	jagrename( fpath.c_str(), _fpath.c_str() );
 
-	_fd = jagopen( _fpath.c_str(), O_CREAT|O_RDWR|JAG_NOATIME, S_IRWXU );
+	_open();
 	_length = length;
 
-	delete sbw;
 	free( kvbuf );
 	free( dbuf );
     return length;
 }
 
+// rows of a file about to be dropped leave the key checker of the family
+// caller holds the family write lock
+jagint JagSimpFile::reclaimRows()
+{
+	JagDiskArrayFamily *family = _compf->_family;
+	if ( ! family || _length < _KVLEN ) return 0;
+
+	char *kvbuf = (char*)jagmalloc(_KVLEN+1);
+	memset( kvbuf, 0, _KVLEN+1 );
+	jagint rlimit = getBuffReaderWriterMemorySize( _length/1024/1024 );
+	JagSingleBuffReader dbr( this, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
+	jagint cnt = 0;
+	while ( dbr.getNext( kvbuf ) ) {
+		if ( family->reclaimDeleted( kvbuf ) ) ++cnt;
+	}
+	free( kvbuf );
+	return cnt;
+}
+
 void JagSimpFile::insertMergeUpdateBlockIndex( char *kvbuf, jagint ipos, jagint &lastBlock )
 {
     JagDBPair tpair;
@@ -345,7 +971,7 @@ void JagSimpFile::buildInitIndex( bool force )
 	memset( keyvalbuf, 0,  _KVLEN + 1 );
 	
 	jagint rlimit = getBuffReaderWriterMemorySize( _length/1024/1024 );
-	JagSingleBuffReader nav( _fd, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
+	JagSingleBuffReader nav( this, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
 	_minindex = -1;
 	while ( nav.getNext( keyvalbuf, _KVLEN, ipos ) ) { 
 		++ _elements;
@@ -463,6 +1089,7 @@ int JagSimpFile::buildInitIndexFromIdxFile()
 
 void JagSimpFile::flushBlockIndexToDisk()
 {
+	flushDirtyBlocks();
     Jstr idxPath = _fpath + ".bid";
     if ( _blockIndex ) {
 		raydebug( stdout, JAG_LOG_LOW, "s308123 flushBottomLevel idxPath=%s _elements=%d ...\n", idxPath.s(), _elements );
@@ -491,7 +1118,7 @@ void JagSimpFile::flushBufferToNewFile( const JagDBMap *pairmap )
 	char *kvbuf = (char*)jagmalloc( _KVLEN+1);
 	memset(kvbuf, 0, _KVLEN+1);
 
-	sbw = new JagSingleBuffWriter( _fd, _KVLEN, dblimit );
+	sbw = new JagSingleBuffWriter( this, _KVLEN, dblimit );
 	jagint wpos = 0;
 	jagint lastBlock = -1;
 	JagFixMapIterator it;
@@ -518,6 +1145,39 @@ void JagSimpFile::flushBufferToNewFile( const JagDBMap *pairmap )
 	free( kvbuf );		
 	delete sbw;
 
+	flushDirtyBlocks();
+	::fsync( _fd );
+}
+
+// kvbufs: num records of _KVLEN bytes each, sorted by key
+void JagSimpFile::flushSortedToNewFile( const char *kvbufs, jagint num )
+{
+	if ( num < 1 ) { return; }
+	jagint dblimit = 64; 
+
+	char *kvbuf = (char*)jagmalloc( _KVLEN+1);
+	memset(kvbuf, 0, _KVLEN+1);
+
+	JagSingleBuffWriter *sbw = new JagSingleBuffWriter( this, _KVLEN, dblimit );
+	jagint wpos = 0;
+	jagint lastBlock = -1;
+
+	for ( jagint i = 0; i < num; ++i ) {
+		memcpy( kvbuf, kvbufs + i*_KVLEN, _KVLEN );
+		sbw->writeit( wpos, kvbuf, _KVLEN );
+		insertMergeUpdateBlockIndex( kvbuf, wpos, lastBlock );
+		++wpos;
+
+		++_elements;
+		_length += _KVLEN;
+	}
+
+	sbw->flushBuffer();
+
+	free( kvbuf );		
+	delete sbw;
+
+	flushDirtyBlocks();
 	::fsync( _fd );
 }
 
@@ -558,7 +1218,7 @@ int JagSimpFile::removePair( const JagDBPair &pair )
 	if ( _elements > 0 ) --_elements;
 
 	memset( _nullbuf, 0, _KVLEN+1 );
-	raysafepwrite( _fd, _nullbuf, _KVLEN, retindex*_KVLEN);
+	pwrite( _nullbuf, retindex*_KVLEN, _KVLEN );
 	free( diskbuf );
 	return 0;
 }
@@ -582,7 +1242,7 @@ int JagSimpFile::updatePair( const JagDBPair &pair )
 		return 0;
 	}
 
-	raysafepwrite( _fd, pair.value.c_str(), _VLEN, retindex*_KVLEN+_KLEN);
+	pwrite( pair.value.c_str(), retindex*_KVLEN+_KLEN, _VLEN );
 	free( diskbuf );
 	return 0;
 }
@@ -633,13 +1293,24 @@ jagint JagSimpFile::getPartElements(jagint pos) const
 
 bool JagSimpFile::findPred( const JagDBPair &pair, jagint *index, jagint first, jagint last, JagDBPair &retpair, char *diskbuf )
 {
+	// a dirty block is searched on its decoded rows below
+	if ( _prefixKeys ) {
+		pthread_rwlock_rdlock( &_blockLock );
+		if ( dirtyBlock( first*_KVLEN / _blockBytes ) < 0 ) {
+			bool rc = findPredEncoded( pair, index, first, last, retpair, diskbuf );
+			pthread_rwlock_unlock( &_blockLock );
+			return rc;
+		}
+		pthread_rwlock_unlock( &_blockLock );
+	}
+
 	bool found = 0;
 
 	*index = -1;
     JagDBPair arr[JagCfg::_BLOCK];
     JagFixString key, val;
 
-   	raysafepread( _fd, diskbuf, (JagCfg::_BLOCK)*_KVLEN, first*_KVLEN);
+   	pread( diskbuf, first*_KVLEN, (JagCfg::_BLOCK)*_KVLEN );
 
    	for (int i = 0; i < JagCfg::_BLOCK; ++i ) {
    		key.point( diskbuf+i*_KVLEN, _KLEN );
@@ -670,7 +1341,7 @@ void JagSimpFile::print()
 	jagint ipos;
 	jagint elements = 0;
 	jagint rlimit = 1;
-	JagSingleBuffReader nav( _fd, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
+	JagSingleBuffReader nav( this, _length/_KVLEN, _KLEN, _VLEN, 0, 0, rlimit );
 	_minindex = -1;
 	while ( nav.getNext( keyvalbuf, _KVLEN, ipos ) ) { 
 		prints(("i=%04d pos=%04d [%s][%s]\n", elements, ipos, keyvalbuf, keyvalbuf+_KLEN ));
@@ -680,3 +1351,96 @@ void JagSimpFile::print()
 	free( keyvalbuf );
 	prints(("\n"));
 }
+
+// findPred on a prefix encoded block: restart keys (stored whole) are binary searched, then keys
+// are rebuilt from their shared prefix and compared one by one. Values are not decoded.
+// rows first..first+JagCfg::_BLOCK-1 are in one block; they are decoded to diskbuf for the caller
+bool JagSimpFile::findPredEncoded( const JagDBPair &pair, jagint *index, jagint first, jagint last, 
+								   JagDBPair &retpair, char *diskbuf )
+{
+	*index = -1;
+	jagint blockno = first*_KVLEN / _blockBytes;
+	jagint row0 = ( first*_KVLEN % _blockBytes ) / _KVLEN;
+	jagint rawlen;
+	const char *enc = getBlock( blockno, rawlen );
+	if ( NULL == enc ) {
+		memset( diskbuf, 0, JagCfg::_BLOCK*_KVLEN );
+		*index += first;
+		retpair = JagDBPair::NULLVALUE;
+		return false;
+	}
+
+	int i4;
+	unsigned short shared, nonshared;
+	memcpy( &i4, enc, 4 );
+	jagint endrow = row0 + JagCfg::_BLOCK;
+	if ( endrow > i4 ) endrow = i4;
+
+	// last restart in the rows whose first key is not greater than pair
+	jagint lo = row0/JAG_SIMP_COMP_RESTART_ROWS, hi = (endrow-1)/JAG_SIMP_COMP_RESTART_ROWS;
+	jagint start = lo, mid, r;
+	const char *p;
+	char *key = (char*)jagmalloc( _KLEN );
+	JagDBPair kpair;
+	kpair.point( key, _KLEN );
+	while ( lo <= hi ) {
+		mid = ( lo + hi ) / 2;
+		memcpy( &i4, enc + 4 + 4*mid, 4 );
+		p = enc + i4;
+		for ( r = mid*JAG_SIMP_COMP_RESTART_ROWS; r < endrow && r < (mid+1)*JAG_SIMP_COMP_RESTART_ROWS; ++r ) {
+			memcpy( &shared, p, 2 ); 
+			if ( JAG_SIMP_COMP_EMPTY_ROW != shared ) break;
+			p += 2;
+		}
+
+		if ( r < endrow && r < (mid+1)*JAG_SIMP_COMP_RESTART_ROWS ) {
+			memcpy( &nonshared, p+2, 2 );
+			memcpy( key, p+4, nonshared );
+			memset( key+nonshared, 0, _KLEN-nonshared );
+			if ( pair < kpair ) {
+				hi = mid - 1;
+				continue;
+			}
+		}
+		start = mid;
+		lo = mid + 1;
+	}
+
+	bool found = false;
+	jagint klen, cmp;
+	memcpy( &i4, enc + 4 + 4*start, 4 );
+	p = enc + i4;
+	memset( key, 0, _KLEN );
+	klen = 0;
+	for ( r = start*JAG_SIMP_COMP_RESTART_ROWS; r < endrow; ++r ) {
+		memcpy( &shared, p, 2 ); p += 2;
+		if ( JAG_SIMP_COMP_EMPTY_ROW == shared ) continue;
+		memcpy( &nonshared, p, 2 ); p += 2;
+		memcpy( key+shared, p, nonshared );
+		if ( shared + nonshared < klen ) memset( key+shared+nonshared, 0, klen-shared-nonshared );
+		klen = shared + nonshared;
+		p += nonshared + _VLEN;
+		if ( r < row0 ) continue;
+
+		cmp = kpair.compareKeys( pair );
+		if ( cmp > 0 ) break;
+		*index = r - row0;
+		if ( 0 == cmp ) {
+			found = true;
+			break;
+		}
+	}
+	free( key );
+
+	decodeRows( enc, row0, JagCfg::_BLOCK, diskbuf );
+	JagFixString k, v;
+	JagDBPair tpair;
+	jagint i = ( *index >= 0 ) ? *index : 0;
+	k.point( diskbuf+i*_KVLEN, _KLEN );
+	v.point( diskbuf+i*_KVLEN+_KLEN, _VLEN );
+	tpair.point( k, v );
+	retpair = tpair;
+
+	*index += first;
+	return found;
+}
@@ -28,6 +28,43 @@ class JagReadWriteLock;
 class JagCompFile;
 class JagDBPair;
 
+// block-compressed simpfile: [magic:8][blockRows:4][flags:4] then appended block records
+// [blockno:8][rawlen:4][clen:4][snappy data]; the last record of a block is its current content
+// with JAG_SIMP_COMP_PREFIX_KEYS the snappy data of a block is
+//   [nrows:4][offset of restart row:4 each JAG_SIMP_COMP_RESTART_ROWS rows] then one entry per row
+//   [shared:2][nonshared:2][nonshared key bytes][value]  or [0xFFFF] for an empty (all zero) row
+// shared is the prefix length common with the previous key, 0 at restart rows; trailing zeros of keys are dropped
+#define JAG_SIMP_COMP_MAGIC        "\0JAGSNP1"
+#define JAG_SIMP_COMP_MAGIC_LEN    8
+#define JAG_SIMP_COMP_HDR_LEN      16
+#define JAG_SIMP_COMP_REC_HDR_LEN  16
+#define JAG_SIMP_COMP_BLOCK_BYTES  65536
+#define JAG_SIMP_COMP_SLACK_BYTES  (4*1024*1024)
+#define JAG_SIMP_COMP_PREFIX_KEYS  1
+#define JAG_SIMP_COMP_RESTART_ROWS 16
+#define JAG_SIMP_COMP_EMPTY_ROW    0xFFFF
+#define JAG_SIMP_COMP_DIRTY_BLOCKS 4
+
+// file location of the current record of one compressed block
+class JagSimpBlockLoc
+{
+  public:
+	jagint	offset;   // -1 if the block was never written
+	jagint	clen;
+	jagint	rawlen;
+	jaguint	seq;      // unique per record written, keys the decompression cache
+};
+
+// block patched by partial writes and not yet appended to the file
+// rows stays allocated while the file is open, so a reader never sees it freed
+class JagSimpDirtyBlock
+{
+  public:
+	jagint	blockno;  // -1 if the slot is free
+	jagint	rawlen;
+	char	*rows;    // _blockBytes of rows
+};
+
 class JagSimpFile
 {
   public:
@@ -41,6 +78,7 @@ class JagSimpFile
 	void renameTo( const Jstr &newName );
 	jagint size() const { return _length; }
 	jagint mergeSegment( const JagMergeSeg& seg );
+	jagint reclaimRows();
 	int getNextMemDarrMergePair( const JagDBMap *pairmap, JagDBPair &ppair, char *kvbuf, char *dbuf,
 	                             JagSingleBuffReader &dbr, JagFixMapIterator &iter,
 		                         int &dgoNext, int &mgoNext );
@@ -52,14 +90,17 @@ class JagSimpFile
 	void buildInitIndex( bool force );
 	int buildInitIndexFromIdxFile();
 	void flushBlockIndexToDisk();
+	int  flushDirtyBlocks();
 	void removeBlockIndexIndDisk();
 	void flushBufferToNewFile( const JagDBMap *pairmap );
+	void flushSortedToNewFile( const char *kvbufs, jagint num );
 	int  removePair( const JagDBPair &pair );
 	int  updatePair( const JagDBPair &pair );
 	int  exist( const JagDBPair &pair, JagDBPair &retpair );
 	bool getFirstLast( const JagDBPair &pair, jagint &first, jagint &last );
 	bool findPred( const JagDBPair &pair, jagint *index, jagint first, jagint last, JagDBPair &retpair, char *diskbuf );
 	jagint getPartElements(jagint) const;
+	jagint appendFrom( const JagSimpFile *src, jagint srcOffset, jagint nbytes );
 	void print();
 
 
@@ -84,6 +125,35 @@ class JagSimpFile
 	JagCompFile *_compf;
 	char   *_nullbuf;
 
+	// block compression: pread/pwrite see the same fixed-width rows, the file holds snappy blocks
+	bool	_compressed;
+	bool	_prefixKeys;   // keys in blocks are prefix encoded
+	jagint	_blockBytes;   // logical bytes per block, a multiple of JAG_BLOCK_SIZE rows
+	jagint	_dataLength;   // logical bytes covered by written blocks
+	jagint	_fileBytes;    // physical size of file
+	jagint	_liveBytes;    // physical bytes of current block records
+	JagVector<JagSimpBlockLoc>  _blockLocs;
+	JagSimpDirtyBlock  _dirty[JAG_SIMP_COMP_DIRTY_BLOCKS];
+	int		_nextDirty;    // slot to reuse when all are taken
+	mutable pthread_rwlock_t _blockLock;  // block state: shared by reads, exclusive by writes and compact
+
+  protected:
+	jagint	 loadBlockLocs( jagint fsize );
+	const char *getBlock( jagint blockno, jagint &rawlen ) const;
+	jagint	 encodeBlock( const char *rows, jagint rawlen, char *out ) const;
+	void	 decodeRows( const char *enc, jagint row, jagint nrows, char *out ) const;
+	void	 readBlockRows( const char *blk, jagint rawlen, jagint inoff, jagint nbytes, char *out ) const;
+	bool	 findPredEncoded( const JagDBPair &pair, jagint *index, jagint first, jagint last, JagDBPair &retpair, char *diskbuf );
+	int		 writeBlock( jagint blockno, const char *buf, jagint rawlen );
+	// called with _blockLock held
+	jagint	 compressedPread( char *buf, jagint localOffset, jagint nbytes ) const;
+	jagint	 compressedPwrite( const char *buf, jagint localOffset, jagint nbytes );
+	void	 compact();
+	int		 dirtyBlock( jagint blockno ) const;
+	int		 newDirtyBlock( jagint blockno );
+	int		 writeDirtyBlocks();
+	void	 dropDirtyBlocks();
+
 };
 
 #endif
@@ -25,6 +25,7 @@
 #include <JagCfg.h>
 #include <JagUtil.h>
 #include <JagCompFile.h>
+#include <JagSimpFile.h>
 
 
 // readlen is number of KEYVAL records, not bytes
@@ -32,6 +33,7 @@ JagSingleBuffReader::JagSingleBuffReader ( JagCompFile *compf, jagint readlen, i
 										   jagint start, jagint headoffset, jagint bufferSize ) 
 {
 	_intfd = -1;
+	_simpf = NULL;
 	_superbuf = NULL;
 	if ( NULL == compf ) {
 		prt(("s1029292 error fd is NULL !!!!!!!!!!!!!!!!!!!!!\n"));
@@ -52,6 +54,7 @@ JagSingleBuffReader::JagSingleBuffReader ( int fd, jagint readlen, int keylen, i
 										   jagint start, jagint headoffset, jagint bufferSize ) 
 {
 	_compf = NULL;
+	_simpf = NULL;
 	_intfd = fd;
 	_superbuf = NULL;
 	if ( _intfd < 0 ) { 
@@ -72,6 +75,28 @@ JagSingleBuffReader::JagSingleBuffReader ( int fd, jagint readlen, int keylen, i
 
 }
 
+// rows of a simpfile, plain or block compressed
+JagSingleBuffReader::JagSingleBuffReader ( const JagSimpFile *simpf, jagint readlen, int keylen, int vallen, 
+										   jagint start, jagint headoffset, jagint bufferSize ) 
+{
+	_compf = NULL;
+	_simpf = simpf;
+	_intfd = simpf->_fd;
+	_superbuf = NULL;
+	if ( _intfd < 0 ) { 
+		prt(("s1029295 error _intfd <0 !!!!!!!!!!!!!!!!!!!!! abort\n"));
+		abort();
+		exit(42);
+	}
+	_readlen = readlen;
+	KEYLEN = keylen;
+	VALLEN = vallen;
+	KEYVALLEN = KEYLEN + VALLEN;
+	if ( readlen < 0 || readlen > simpf->size()/KEYVALLEN ) _readlen = simpf->size()/KEYVALLEN;
+
+	init( _readlen, keylen, vallen, start, headoffset, bufferSize );
+}
+
 void JagSingleBuffReader::init ( jagint readlen, int keylen, int vallen, 
 								 jagint start, jagint headoffset, jagint bufferSize ) 
 {
@@ -165,17 +190,9 @@ bool JagSingleBuffReader::getNext ( char *buf, int len, jagint &i )
 	}
     if ( -1 == _lastSuperBlock ) {
 		if ( _readlen <= _elements ) {  // total is smaller than a single superblock
-			if ( NULL == _compf ) {
-				rc = raysafepread( _intfd, _superbuf, _readlen*KEYVALLEN, _start*KEYVALLEN+_headoffset );
-			} else {
-				rc = _compf->pread( _superbuf, _readlen*KEYVALLEN, _start*KEYVALLEN+_headoffset );
-			}
+			rc = readAt( _readlen*KEYVALLEN, _start*KEYVALLEN+_headoffset );
 		} else {
-			if ( NULL == _compf ) {
-			 	rc = raysafepread( _intfd, _superbuf, _elements*KEYVALLEN, _start*KEYVALLEN+_headoffset );
-			} else {
-				rc = _compf->pread( _superbuf, _elements*KEYVALLEN, _start*KEYVALLEN+_headoffset );
-			}
+			rc = readAt( _elements*KEYVALLEN, _start*KEYVALLEN+_headoffset );
 		}
 		if ( rc < 0 ) { return false; }
         _lastSuperBlock = 0; 
@@ -187,6 +204,18 @@ bool JagSingleBuffReader::getNext ( char *buf, int len, jagint &i )
 }
 
 
+// read bytes at offset into _superbuf
+jagint JagSingleBuffReader::readAt( jagint bytes, jagint offset )
+{
+	if ( _simpf ) {
+		return _simpf->pread( _superbuf, offset, bytes );
+	} else if ( _compf ) {
+		return _compf->pread( _superbuf, bytes, offset );
+	} else {
+		return raysafepread( _intfd, _superbuf, bytes, offset );
+	}
+}
+
 bool JagSingleBuffReader::findNonblankElement( char *buf, jagint &i )
 {
 	jagint readbytes;
@@ -228,11 +257,7 @@ bool JagSingleBuffReader::findNonblankElement( char *buf, jagint &i )
 				readbytes = _elements*KEYVALLEN;
         	}
 
-			if ( NULL == _compf ) {
-				rc = raysafepread( _intfd, _superbuf, readbytes, (_start+_lastSuperBlock*_elements)*KEYVALLEN+_headoffset );
-			} else {
-				rc = _compf->pread( _superbuf, readbytes, (_start+_lastSuperBlock*_elements)*KEYVALLEN+_headoffset );
-			}
+			rc = readAt( readbytes, (_start+_lastSuperBlock*_elements)*KEYVALLEN+_headoffset );
 			if ( rc < 0 ) { return false; }
 		}
 		continue;
@@ -22,6 +22,7 @@
 #include <abax.h>
 
 class JagCompFile;
+class JagSimpFile;
 
 class JagSingleBuffReader
 {
@@ -29,6 +30,7 @@ class JagSingleBuffReader
   public:
 	JagSingleBuffReader( JagCompFile *compf, jagint readlen, int keylen, int vallen, jagint start=0, jagint headoffset=0, jagint bufferSize=8 );
 	JagSingleBuffReader( int fd, jagint readlen, int keylen, int vallen, jagint start=0, jagint headoffset=0, jagint bufferSize=8 );
+	JagSingleBuffReader( const JagSimpFile *simpf, jagint readlen, int keylen, int vallen, jagint start=0, jagint headoffset=0, jagint bufferSize=8 );
   	~JagSingleBuffReader( ); 
 	
   	bool getNext ( char *buf, int len, jagint &i );
@@ -40,10 +42,12 @@ class JagSingleBuffReader
 	void 	init( jagint readlen, int keylen, int vallen, jagint start=0, jagint headoffset=0, jagint bufferSize=8 );
 	bool 	findNonblankElement( char *buf, jagint &i );
 	jagint 	getNumBlocks( int kvlen, jagint bufferSize );
+	jagint 	readAt( jagint bytes, jagint offset );
 
   	jagint 		_elements;
   	jagint 		_headoffset;
 	JagCompFile *_compf;
+	const JagSimpFile *_simpf;
 	int 		_intfd;
 	jagint 		_start;
 	jagint 		_readlen;
@@ -23,11 +23,13 @@
 #include <JagCfg.h>
 #include <JagDef.h>
 #include <JagCompFile.h>
+#include <JagSimpFile.h>
 
 JagSingleBuffWriter::JagSingleBuffWriter( JagCompFile *compf, int kvlen, jagint bufferSize )
 {
 	KVLEN = kvlen;
 	_compf = compf;
+	_simpf = NULL;
 	_superbuf = NULL;
 	if ( ! _compf ) { 
 		prt(("s502348 JagSingleBuffWriter ctor1 return\n"));
@@ -47,6 +49,22 @@ JagSingleBuffWriter::JagSingleBuffWriter( int fd, int kvlen, jagint bufferSize )
 		return; 
 	}
 	_compf = nullptr;
+	_simpf = NULL;
+
+	init( kvlen, bufferSize );
+}
+
+// rows of a simpfile, plain or block compressed
+JagSingleBuffWriter::JagSingleBuffWriter( JagSimpFile *simpf, int kvlen, jagint bufferSize )
+{
+	_simpf = simpf;
+	_compf = nullptr;
+	_fd = simpf->_fd;
+	_superbuf = NULL;
+	if ( _fd < 0 ) { 
+		prt(("s502359 JagSingleBuffWriter ctor3 return\n"));
+		return; 
+	}
 
 	init( kvlen, bufferSize );
 }
@@ -103,7 +121,6 @@ void JagSingleBuffWriter::writeit( jagint pos, const char *keyvalbuf, jagint KVL
 {
 	//prt(("s33222 JagSingleBuffWriter::writeit pos=%d keyvalbuf=[%s] KVLEN=%d ...\n", pos, keyvalbuf, KVLEN));
 	_relpos = pos % SUPERBLOCK;  // relative positon inside a superblock (SUPERBLOCKLEN = SUPERBLOCK * KVLEN)
-	jagint rc; 
 	int newBlock = pos / SUPERBLOCK;
 	if ( -1 == _lastSuperBlock ) {
 		memcpy( _superbuf+_relpos*KVLEN, keyvalbuf, KVLEN );
@@ -120,13 +137,7 @@ void JagSingleBuffWriter::writeit( jagint pos, const char *keyvalbuf, jagint KVL
 
 	// moved to new block, flush old block
 	// rc = raysafepwrite( _compf, _superbuf, SUPERBLOCKLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	if ( _compf ) {
-		//prt(("s440293 _compf->pwrite ...\n"));
-		rc = _compf->pwrite( _superbuf, SUPERBLOCKLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	} else {
-		//prt(("s440294 raysafepwrite _fd=%d ...\n", _fd ));
-		rc = raysafepwrite( _fd, _superbuf, SUPERBLOCKLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	}
+	writeAt( SUPERBLOCKLEN, _lastSuperBlock*SUPERBLOCKLEN );
 
 	memset( _superbuf, 0, SUPERBLOCKLEN );
 	memcpy( _superbuf+_relpos*KVLEN, keyvalbuf, KVLEN );
@@ -138,13 +149,20 @@ void JagSingleBuffWriter::flushBuffer()
 {
 	if ( _lastSuperBlock == -1 ) { return; }
 	//jagint rc = raysafepwrite( _compf, _superbuf, (_relpos+1)*KVLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	if ( _compf ) {
-		_compf->pwrite( _superbuf, (_relpos+1)*KVLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	} else {
-		//prt(("s322287 flushBuffer _relpos+1=%d _lastSuperBlock=%d \n", _relpos+1, _lastSuperBlock ));
-		raysafepwrite( _fd, _superbuf, (_relpos+1)*KVLEN, _lastSuperBlock*SUPERBLOCKLEN );
-	}
+	writeAt( (_relpos+1)*KVLEN, _lastSuperBlock*SUPERBLOCKLEN );
 	_lastSuperBlock = -1;
 	_relpos = -1;
 	return;
 }
+
+// write bytes of _superbuf at offset
+void JagSingleBuffWriter::writeAt( jagint bytes, jagint offset )
+{
+	if ( _simpf ) {
+		_simpf->pwrite( _superbuf, offset, bytes );
+	} else if ( _compf ) {
+		_compf->pwrite( _superbuf, bytes, offset );
+	} else {
+		raysafepwrite( _fd, _superbuf, bytes, offset );
+	}
+}
@@ -23,6 +23,7 @@
 #include <JagCfg.h>
 
 class JagCompFile;
+class JagSimpFile;
 
 class JagSingleBuffWriter
 {
@@ -30,6 +31,7 @@ class JagSingleBuffWriter
 
 		JagSingleBuffWriter( JagCompFile *compf, int keyvallen, jagint bufferSize=-1 ); 
 		JagSingleBuffWriter( int fd, int keyvallen, jagint bufferSize=-1 );
+		JagSingleBuffWriter( JagSimpFile *simpf, int keyvallen, jagint bufferSize=-1 );
 
 		~JagSingleBuffWriter();
 		
@@ -39,9 +41,11 @@ class JagSingleBuffWriter
 
 	protected:
 		void init( int keyvallen, jagint bufferSize );
+		void writeAt( jagint bytes, jagint offset );
 
 		int  _fd;
 		JagCompFile *_compf;
+		JagSimpFile *_simpf;
 		char *_superbuf; 
 		jagint  KVLEN;
 		jagint _lastSuperBlock;
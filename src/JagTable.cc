@@ -19,6 +19,8 @@
 #include <JagGlobalDef.h>
 
 #include <malloc.h>
+#include <algorithm>
+#include <vector>
 #include <JagTable.h>
 #include <JagIndex.h>
 #include <JaguarCPPClient.h>
@@ -37,6 +39,8 @@
 #include <JagParser.h>
 #include <JagLineFile.h>
 #include <JagPriorityQueue.h>
+#include <JagTime.h>
+#include <JagTextFileBuffReader.h>
 
 JagTable::JagTable( int replicateType, const JagDBServer *servobj, const Jstr &dbname, const Jstr &tableName, 
 					  const JagSchemaRecord &record, bool buildInitIndex ) 
@@ -60,11 +64,30 @@ JagTable::JagTable( int replicateType, const JagDBServer *servobj, const Jstr &d
 	KEYLEN = 0;
 	VALLEN = 0;
 	KEYVALLEN = 0;
+	_rollupBuf = NULL;
+	_rollupPending = 0;
+	_lazyStars = false;
 	init( buildInitIndex );
+
+	// rollup table tab@window of a time series
+	if ( _servobj->_rollupBuffered && _tableName.containsChar('@') ) {
+		_rollupBuf = new JagDBMap();
+		((JagDBServer*)_servobj)->addRollupTable( this );
+	}
+	if ( _servobj->_rollupLazyStars && _tableName.containsChar('@') ) {
+		_lazyStars = true;
+		loadStarPatterns();
+	}
 }
 
 JagTable::~JagTable ()
 {
+	if ( _rollupBuf ) {
+		((JagDBServer*)_servobj)->removeRollupTable( this );
+		delete _rollupBuf;
+		_rollupBuf = NULL;
+	}
+
 	if ( _darrFamily ) {
 		delete _darrFamily;
 		_darrFamily = NULL;
@@ -117,6 +140,23 @@ void JagTable::init( bool buildInitIndex )
 	}
 
 	_darrFamily = new JagDiskArrayFamily ( _servobj, fpath, &_tableRecord, 0, buildInitIndex );
+	if ( _servobj->_indexDeferred ) {
+		_darrFamily->setPreFlushHook( applyIndexPendingStatic, (void*)this );
+	}
+
+	// new simpfiles of a time-series table hold one time bucket of the first key column
+	Jstr firstType;
+	if ( _servobj->_timeSeriesPartition > 0 && ( hasTimeSeries() || hasRollupColumn() ) 
+		 && _tableRecord.isFirstColumnDateTime( firstType ) ) {
+		const JagColumn &tcol = (*_tableRecord.columnVector)[0];
+		jagint bucketLen = JagTime::getTypeTime( _servobj->_timeSeriesPartition, firstType );
+		if ( bucketLen > 0 ) {
+			_darrFamily->setTimePartition( tcol.offset, tcol.length, bucketLen );
+		}
+	}
+	if ( _servobj->isBlockCompressed( _dbname, _tableName ) ) {
+		_darrFamily->setBlockCompress( true );
+	}
 	prt(("s210822 jagtable init() new _darrFamily\n"));
 
 	KEYLEN = _tableRecord.keyLength;
@@ -189,7 +229,29 @@ bool JagTable::getPair( JagDBPair &pair )
 	else return false;
 }
 
+// parse value rows of insert into db pairs
+// insert into t values (...),(...): the rows after the first are in parseParam->insertRowsVec
 int JagTable::parsePair( int tzdiff, JagParseParam *parseParam, JagVector<JagDBPair> &retpair, Jstr &errmsg ) const
+{
+	if ( parseParam->insertRowsVec.size() < 1 ) {
+		return parseRowPair( tzdiff, parseParam, retpair, errmsg );
+	}
+
+	// column mapping of all rows is the same; parse one row at a time in otherVec
+	JagVector<OtherAttribute> firstRow = parseParam->otherVec;
+	int rc = parseRowPair( tzdiff, parseParam, retpair, errmsg );
+	for ( int i = 0; rc && i < parseParam->insertRowsVec.size(); ++i ) {
+		parseParam->otherVec = parseParam->insertRowsVec[i];
+		rc = parseRowPair( tzdiff, parseParam, retpair, errmsg );
+		if ( ! rc ) {
+			errmsg += Jstr(" in row ") + intToStr( i+2 );
+		}
+	}
+	parseParam->otherVec = firstRow;
+	return rc;
+}
+
+int JagTable::parseRowPair( int tzdiff, JagParseParam *parseParam, JagVector<JagDBPair> &retpair, Jstr &errmsg ) const
 {
 	int getpos = 0;
 	int metrics;
@@ -1447,25 +1509,91 @@ int JagTable::insert( const JagRequest &req, JagParseParam *parseParam, Jstr &er
 	int rc = parsePair( req.session->timediff, parseParam, pairVec, errmsg );
 	prt(("s14920 rc=%d\n", rc ));
 	// pair.print();
-	if ( rc ) {
-		for ( int i=0; i < pairVec.length(); ++i ) {
-			//rc = insertPair( pair[i], 0, true );
-			rc = insertPair( pairVec[i], 0, false );
-			prt(("s3481 insertPair rc=%d\n", rc ));
-			if ( !rc ) {
-				errmsg = Jstr("E2108 InsertPair error key: ") + pairVec[i].key.s();
-			} else {
-				prt(("s33308 insertPair OK rc=%d\n", rc ));
-			}
-		}
-	} else {
+	if ( ! rc ) {
 		// errmsg is from parsePair 
 		prt(("s222201 parsePair error [%s] rc=%d\n", errmsg.s(), rc ));
+		return rc;
+	}
+
+	JagVector<int> okVec;
+	insertPairs( req, pairVec, okVec );
+	for ( int i=0; i < okVec.size(); ++i ) {
+		rc = okVec[i];
+		prt(("s3481 insertPair rc=%d\n", rc ));
+		if ( !rc ) {
+			errmsg = Jstr("E2108 InsertPair error key: ") + pairVec[i].key.s();
+		}
 	}
 
 	return rc;
 }
 
+// insert pairs of one or more insert statements into the table
+// pairs are applied in key order with one wallog append; pairs of the same key keep their order
+// okVec[i] is set to 1 if pairVec[i] was inserted, 0 if not (e.g. duplicate key)
+// return number of inserted pairs
+jagint JagTable::insertPairs( const JagRequest &req, const JagVector<JagDBPair> &pairVec, JagVector<int> &okVec )
+{
+	okVec.clean();
+	jagint n = pairVec.size();
+	if ( n < 1 ) return 0;
+
+	std::vector<jagint> order( n );
+	for ( jagint i=0; i < n; ++i ) {
+		order[i] = i;
+		okVec.append( 0 );
+	}
+	if ( n > 1 ) {
+		std::stable_sort( order.begin(), order.end(), 
+			[&pairVec]( jagint a, jagint b ) { return pairVec[a].compareKeys( pairVec[b] ) < 0; } );
+	}
+
+	JagVector<JagDBPair> sortedVec( n );
+	for ( jagint i=0; i < n; ++i ) {
+		sortedVec.append( pairVec[ order[i] ] );
+	}
+
+	// concurrent inserts: keys stay locked from wallog append to buffer insert
+	_darrFamily->lockInsertKeys( sortedVec );
+	if ( ! req.redoOnly && ! hasTimeSeries() 
+		 && ! _servobj->logInsertPairs( _dbname, _tableName, req.session, sortedVec ) ) {
+		// not durable: report every pair as not inserted
+		_darrFamily->unlockInsertKeys( sortedVec );
+		return 0;
+	}
+
+	jagint cnt = 0;
+	for ( jagint i=0; i < n; ++i ) {
+		if ( insertPair( sortedVec[i], 0, false ) ) {
+			okVec[ order[i] ] = 1;
+			++cnt;
+		}
+	}
+	_darrFamily->unlockInsertKeys( sortedVec );
+	_darrFamily->flushIfFull( true );
+
+	return cnt;
+}
+
+// deferred index records are applied before the table buffer is flushed and its wallog is reset
+// static
+void JagTable::applyIndexPendingStatic( void *ptr )
+{
+	JagTable *ptab = (JagTable*)ptr;
+	ptab->applyIndexPending();
+}
+
+void JagTable::applyIndexPending()
+{
+	JagIndex *pindex;
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		pindex = _objectLock->getIndex( _dbname, _indexlist[i], _replicateType );
+		if ( pindex ) {
+			pindex->applyPending();
+		}
+	}
+}
+
 // mode 0: insert; 
 // mode 1: cinsert( check insert ); 
 // mode 2: dinsert ( delete insert );
@@ -1602,8 +1730,15 @@ int JagTable::formatIndexCmd( JagDBPair &pair, int mode, bool doIndexLock  )
 		}
 
 		if ( pindex ) {
-
-			pindex->formatIndexCmdFromTable( tablebuf, mode );
+			if ( 0 == mode && ! doIndexLock && _servobj->_indexDeferred ) {
+				// insert path: index thread applies the record later
+				pindex->deferFromTable( tablebuf );
+				if ( pindex->pendingCount() >= _servobj->_indexDeferMax ) {
+					pindex->applyPending();
+				}
+			} else {
+				pindex->formatIndexCmdFromTable( tablebuf, mode );
+			}
 
 			++ cnt;
 			if ( doIndexLock ) {
@@ -1617,199 +1752,808 @@ int JagTable::formatIndexCmd( JagDBPair &pair, int mode, bool doIndexLock  )
 	return cnt;
 }
 
-// method to do create index concurrently
-// pindex was writelock protected
-int JagTable::formatCreateIndex( JagIndex *pindex ) 
+// Attach a file of rows as a new data file of the table, bypassing the insert buffer
+// and the wallog. The rows are written once, in key order, as simpfiles; block index
+// and key checker entries are built in bulk. Existing data files are not rewritten.
+//   format "kv":  records of KEYVALLEN bytes in db format, sorted by key
+//   format "csv": one row per line in the syntax of insert values (...), parsed in parallel
+//                 and sorted here
+// Keys must be unique and must not exist in the table.
+// table is write-locked by caller
+// return number of rows attached; -1 error with errmsg
+jagint JagTable::ingestSortedFile( const JagRequest &req, const Jstr &fpath, const Jstr &format, Jstr &errmsg )
 {
-	ParallelCmdPass *psp = newObject<ParallelCmdPass>();
-	psp->ptab = this;
-	psp->pindex = pindex;
-	parallelCreateIndexStatic ((void*)psp );
-	return 1;
+	if ( hasTimeSeries() || JAG_CHAINTABLE_TYPE == _objectType ) {
+		errmsg = "E5030 ingest of sorted file is not supported for timeseries tables or chains";
+		return -1;
+	}
+
+	// ingested rows must not fall in a deleted range of the files
+	_darrFamily->purgeRangeDeletes();
+
+	jagint cnt;
+	if ( format == "kv" || format == "KV" ) {
+		cnt = ingestKVFile( fpath, errmsg );
+	} else if ( format == "csv" || format == "CSV" ) {
+		cnt = ingestCSVFile( req, fpath, errmsg );
+	} else {
+		errmsg = Jstr("E5031 unknown format ") + format + ". Use kv or csv";
+		return -1;
+	}
+
+	return cnt;
 }
 
-void *JagTable::parallelCreateIndexStatic( void * ptr )
-{	
-	ParallelCmdPass *pass = (ParallelCmdPass*)ptr;
+jagint JagTable::ingestKVFile( const Jstr &fpath, Jstr &errmsg )
+{
+	FILE *fp = jagfopen( fpath.c_str(), "rb" );
+	if ( ! fp ) {
+		errmsg = Jstr("E5032 cannot open file ") + fpath;
+		return -1;
+	}
 
-	int KLEN = pass->ptab->_darrFamily->_KLEN;
-	int KVLEN = pass->ptab->_darrFamily->_KVLEN;
+	struct stat sbuf;
+	if ( fstat( fileno(fp), &sbuf ) != 0 || sbuf.st_size % KEYVALLEN != 0 ) {
+		errmsg = Jstr("E5033 size of ") + fpath + " is not a multiple of record length " + longToStr( KEYVALLEN );
+		jagfclose( fp );
+		return -1;
+	}
 
-	char *tablebuf = (char*)jagmalloc(KVLEN+1);
-	memset( tablebuf, 0, KVLEN+1 );
+	jagint total = sbuf.st_size/KEYVALLEN;
+	if ( total < 1 ) {
+		jagfclose( fp );
+		return 0;
+	}
 
-	char minbuf[KLEN+1];
-	char maxbuf[KLEN+1];
-	memset( minbuf, 0,   KLEN+1 );
-	memset( maxbuf, 255, KLEN+1 );
+	jagint chunkrecs = JAG_SIMPFILE_LIMIT_BYTES/KEYVALLEN;
+	if ( chunkrecs < 1 ) chunkrecs = 1;
+	if ( chunkrecs > total ) chunkrecs = total;
+	char *chunk = (char*)jagmalloc( chunkrecs*KEYVALLEN );
+	char *lastkey = (char*)jagmalloc( KEYLEN+1 );
+
+	// validate all keys before any file is written
+	jagint n, pos = 0;
+	bool ok = true;
+	while ( ok && ( n = fread( chunk, KEYVALLEN, chunkrecs, fp ) ) > 0 ) {
+		for ( jagint i = 0; i < n; ++i ) {
+			if ( ! checkIngestKey( chunk + i*KEYVALLEN, lastkey, pos, errmsg ) ) {
+				ok = false;
+				break;
+			}
+			++pos;
+		}
+	}
 
-	JagMergeReader *ntu = NULL;
-	pass->ptab->_darrFamily->setFamilyRead( ntu, minbuf, maxbuf );
-	if ( ntu ) {
-		while ( ntu->getNext( tablebuf ) ) {
-			dbNaturalFormatExchange( tablebuf, pass->ptab->_numKeys, pass->ptab->_schAttr, 0, 0, " " ); 
-			pass->pindex->formatIndexCmdFromTable( tablebuf, 0 );
+	jagint cnt = 0;
+	if ( ok ) {
+		rewind( fp );
+		JagDiskArrayServer *darr = _darrFamily->newSortedFile( total );
+		while ( ( n = fread( chunk, KEYVALLEN, chunkrecs, fp ) ) > 0 ) {
+			cnt += darr->flushSortedToNewFile( chunk, n );
+			indexIngested( chunk, n );
 		}
+		_darrFamily->addSortedFile( darr );
 	}
 
-	free( tablebuf );
-	delete pass;
+	free( lastkey );
+	free( chunk );
+	jagfclose( fp );
+	return ok ? cnt : -1;
 }
 
-
-// return 0 for error; > 0 OK
-jagint JagTable::update( const JagRequest &req, const JagParseParam *parseParam, bool upsert, Jstr &errmsg )
+jagint JagTable::ingestCSVFile( const JagRequest &req, const Jstr &fpath, Jstr &errmsg )
 {
-	// chain not able to update
-	if ( JAG_CHAINTABLE_TYPE == _objectType ) {
-		errmsg = "E23072 Chain cannot be updated";
-		return 0;
+	JagVector<JagDBPair> pairVec;
+	if ( parseCSVFileParallel( req, fpath, false, pairVec, errmsg ) < 0 ) {
+		return -1;
 	}
 
-	prt(("s344082 JagTable::update parseParam->updSetVec.print():\n" ));
-	//parseParam->updSetVec.print();
+	jagint total = pairVec.size();
+	if ( total < 1 ) return 0;
 
-	prt(("s344083 JagTable::update parseParam->otherVec.print():\n" ));
-	//parseParam->otherVec.print();
+	std::vector<JagDBPair> sorted( pairVec.array(), pairVec.array() + total );
+	pairVec.clean();
+	std::stable_sort( sorted.begin(), sorted.end() );
 
+	bool ok = true;
+	char *lastkey = (char*)jagmalloc( KEYLEN+1 );
+	for ( jagint i = 0; ok && i < total; ++i ) {
+		ok = checkIngestKey( sorted[i].key.c_str(), lastkey, i, errmsg );
+	}
+	free( lastkey );
+	if ( ! ok ) return -1;
+
+	jagint chunkrecs = JAG_SIMPFILE_LIMIT_BYTES/KEYVALLEN;
+	if ( chunkrecs < 1 ) chunkrecs = 1;
+	if ( chunkrecs > total ) chunkrecs = total;
+	char *chunk = (char*)jagmalloc( chunkrecs*KEYVALLEN );
+	JagDiskArrayServer *darr = _darrFamily->newSortedFile( total );
+	jagint n = 0, cnt = 0;
+	for ( jagint i = 0; i < total; ++i ) {
+		memcpy( chunk + n*KEYVALLEN, sorted[i].key.c_str(), KEYLEN );
+		memcpy( chunk + n*KEYVALLEN + KEYLEN, sorted[i].value.c_str(), VALLEN );
+		if ( ++n == chunkrecs || i == total-1 ) {
+			cnt += darr->flushSortedToNewFile( chunk, n );
+			indexIngested( chunk, n );
+			n = 0;
+		}
+	}
+	_darrFamily->addSortedFile( darr );
+	free( chunk );
+	return cnt;
+}
 
-	int 	numUpdateCols = parseParam->updSetVec.size();
-	int 	rc, collen, siglen, setindexnum = _indexlist.size(); 
-	int 	constMode = 0, typeMode = 0, tabnum = 0, treelength = 0;
-	Jstr 	treetype;
-	bool 	uniqueAndHasValueCol = 0, setKey;
-	jagint 	cnt = 0, scanned = 0;
-	const char *buffers[1];
-	jagint 	setposlist[numUpdateCols];
-	int 	getpos = 0;
-	int     numIndexes = _indexlist.size();
-	JagIndex *lpindex[ numIndexes ];
-	AbaxBuffer bfr;
-	Jstr 	dbcolumn;
+// Load rows of a csv file through the insert path. Each line has the syntax of insert values (...).
+// caller holds insertLockTable
+// return number of rows inserted; -1 error with errmsg
+jagint JagTable::loadCSVFile( const JagRequest &req, const Jstr &fpath, Jstr &errmsg )
+{
+	if ( hasTimeSeries() || JAG_CHAINTABLE_TYPE == _objectType ) {
+		errmsg = "E5038 load of csv file is not supported for timeseries tables or chains";
+		return -1;
+	}
 
-	ExprElementNode *updroot;
-	const JagHashStrInt *maps[1];
-	const JagSchemaAttribute *attrs[1];	
-	maps[0] = _tablemap;
-	attrs[0] = _schAttr;
-	
-	JagFixString strres, treestr;
-	bool needInit = true;
-	bool singleInsert = false;
-	
-	// check updSetVec validation
-	setKey = 0;
-	for ( int i = 0; i < numUpdateCols; ++i ) {
-		dbcolumn = _dbtable + "." + parseParam->updSetVec[i].colName;
-		if ( isFileColumn( parseParam->updSetVec[i].colName ) ) {
-			errmsg = Jstr("E10283 column ") + parseParam->updSetVec[i].colName + " is file type";
-			return -1;
-		}
+	JagVector<JagDBPair> pairVec;
+	return parseCSVFileParallel( req, fpath, true, pairVec, errmsg );
+}
 
-		if ( _tablemap->getValue(dbcolumn, getpos) ) {
-			setposlist[i] = getpos;
-			if ( getpos < _numKeys ) { 
-				setKey = 1;
-				errmsg = Jstr("E03875 Key column cannot be updated");
-				return -1;
-			}
+// Parse a csv file on CSV_PARSE_THREADS threads (default: number of cpus). The file is split
+// into byte ranges of equal size; each thread parses the records starting in its range.
+// A thread starts at the first line start of its range, so a range must not start inside a
+// quoted field with newlines: the threads check that their records join up.
+// Each thread parses its lines into rows in batches of 1000.
+// insert: threads insert their batches with insertPairs()
+// otherwise: rows are returned in pairVec
+// return number of rows parsed or inserted; -1 error with errmsg
+jagint JagTable::parseCSVFileParallel( const JagRequest &req, const Jstr &fpath, bool insert, 
+									   JagVector<JagDBPair> &pairVec, Jstr &errmsg )
+{
+	int fd = jagopen( fpath.c_str(), O_RDONLY );
+	if ( fd < 0 ) {
+		errmsg = Jstr("E5032 cannot open file ") + fpath;
+		return -1;
+	}
 
-			bool isAggregate = false;
-			updroot = parseParam->updSetVec[i].tree->getRoot();
-			rc = updroot->setFuncAttribute( maps, attrs, constMode, typeMode, isAggregate, treetype, collen, siglen );
-			if ( 0 == rc || isAggregate ) {
-				errmsg = Jstr("E0383 wrong update type. Char column must use single quotes.");
-				return -1;
-			}
-		} else {
-			errmsg = Jstr("E0384 column ") + dbcolumn + " not found";
-			return -1;
-		}
+	struct stat sbuf;
+	if ( fstat( fd, &sbuf ) != 0 ) {
+		errmsg = Jstr("E5032 cannot open file ") + fpath;
+		jagclose( fd );
+		return -1;
 	}
-	
-	// build init index list
-	/**
-	if ( setKey ) {
-		for ( int i = 0; i < _indexlist.size(); ++i ) {
-			lpindex[i] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
-															   _indexlist[i], _replicateType, 1 );
+
+	// ranges of at least 1MB
+	jagint num = _servobj->_cfg->getIntValue("CSV_PARSE_THREADS", _servobj->_numCPUs );
+	if ( num > sbuf.st_size/ONE_MEGA_BYTES ) num = sbuf.st_size/ONE_MEGA_BYTES;
+	if ( num < 1 ) num = 1;
+
+	JagVector<jagint> bounds;
+	num = JagTextFileBuffReader::splitRanges( sbuf.st_size, num, bounds );
+
+	ParallelCSVParsePass pass[num];
+	JagVector<JagDBPair> vecs[num];
+	pthread_t thrd[num];
+	for ( int i = 0; i < num; ++i ) {
+		pass[i].ptab = this;
+		pass[i].req = &req;
+		pass[i].fd = fd;
+		pass[i].start = bounds[i];
+		pass[i].end = bounds[i+1];
+		pass[i].insert = insert;
+		pass[i].pairVec = &vecs[i];
+		jagpthread_create( &thrd[i], NULL, parallelParseCSVStatic, (void*)&pass[i] );
+	}
+
+	jagint cnt = 0;
+	bool ok = true;
+	for ( int i = 0; i < num; ++i ) {
+		pthread_join( thrd[i], NULL );
+		cnt += pass[i].rows;
+		if ( pass[i].error && ok ) {
+			ok = false;
+			errmsg = pass[i].errmsg;
 		}
-	} else {
-		setindexnum = 0;
-		for ( int i = 0; i < _indexlist.size(); ++i ) {
-			lpindex[i] = NULL;
-			lpindex[setindexnum] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
-																	     _indexlist[i], _replicateType, 1 );
-			for ( int i = 0; i < numUpdateCols; ++i ) {
-				if ( lpindex[setindexnum] ) {
-					if ( lpindex[setindexnum]->needUpdate( parseParam->updSetVec[i].colName ) ) {
-						++setindexnum; break;
-					} else {
-						_objectLock->readUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
-																lpindex[setindexnum]->getIndexName(), _replicateType, 1 );
-					}
-				}
-			}
+	}
+	jagclose( fd );
+
+	for ( int i = 1; i < num && ok; ++i ) {
+		if ( pass[i].first != pass[i-1].last ) {
+			ok = false;
+			errmsg = Jstr("E5039 quoted field with newlines at byte ") + longToStr( pass[i].first ) 
+					 + " of file " + fpath + ", set CSV_PARSE_THREADS to 1";
 		}
 	}
-	**/
 
-	/***
-	setindexnum = 0;
-	for ( int i = 0; i < _indexlist.size(); ++i ) {
-		lpindex[i] = NULL;
-		lpindex[setindexnum] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
-		for ( int i = 0; i < numUpdateCols; ++i ) {
-			if ( lpindex[setindexnum] ) {
-				if ( lpindex[setindexnum]->needUpdate( parseParam->updSetVec[i].colName ) ) {
-					++setindexnum; 
-					break;
-				} else {
-					_objectLock->readUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, lpindex[setindexnum]->getIndexName(), _replicateType, 1 );
-				}
+	if ( ! ok ) {
+		if ( insert ) errmsg += Jstr(". ") + longToStr( cnt ) + " rows were inserted";
+		return -1;
+	}
+
+	if ( ! insert ) {
+		for ( int i = 0; i < num; ++i ) {
+			for ( jagint j = 0; j < vecs[i].size(); ++j ) {
+				pairVec.append( vecs[i][j] );
 			}
+			vecs[i].clean();
 		}
 	}
-	***/
+	return cnt;
+}
 
-	setindexnum = 0;
-	for ( int i = 0; i < numIndexes; ++i ) {
-		lpindex[i] = _objectLock->writeLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _tableschema, _indexschema, _replicateType, 1 );
-		if ( lpindex[i] ) {
-			bool needUpdate = false;
-			for ( int j = 0; j < numUpdateCols; ++j ) {
-				if ( lpindex[i]->needUpdate( parseParam->updSetVec[j].colName ) ) {
-					needUpdate = true;
-				}
-			}
-			if ( ! needUpdate ) {
-				_objectLock->writeUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
-				lpindex[i] = NULL;
+// thread of parseCSVFileParallel
+void *JagTable::parallelParseCSVStatic( void *ptr )
+{
+	ParallelCSVParsePass *pass = (ParallelCSVParsePass*)ptr;
+	JagTable *ptab = pass->ptab;
+	JagTextFileBuffReader reader( pass->fd, pass->start, pass->end );
+	JagVector<JagDBPair> batchVec;
+	JagVector<int> okVec;
+	Jstr rec, cmd;
+	jagint rows = 0;
+	bool more = true;
+	while ( more ) {
+		more = reader.getRecord( rec );
+		if ( more && rec.size() > 0 ) {
+			if ( 0 == rows ) {
+				cmd = Jstr("insert into ") + ptab->_dbtable + " values (" + rec + ")";
 			} else {
-				++ setindexnum;
+				cmd += Jstr(",(") + rec + ")";
 			}
-		} 
-	}
-
-	// if setindexnum == 0: then all index locks are freeed, and lpindex[i] set to NULL
+			++rows;
+		}
 
-	// parse tree		
-	int keylen[1];
-	int numKeys[1];	
-	JagMinMax minmax[1];	
-	keylen[0] = KEYLEN;
-	numKeys[0] = _numKeys;
-	minmax[0].setbuflen( keylen[0] );
+		if ( rows < 1 || ( rows < 1000 && more ) ) continue;
 
-	/***
-	char 	*tableoldbuf = (char*)jagmalloc(KEYVALLEN+1);
-	char 	*tablenewbuf = (char*)jagmalloc(KEYVALLEN+1);
-	memset( tableoldbuf, 0, KEYVALLEN+1 );
-	memset( tablenewbuf, 0, KEYVALLEN+1 );
-	buffers[0] = tableoldbuf;
-	***/
+		JagVector<JagDBPair> &vec = pass->insert ? batchVec : *pass->pairVec;
+		if ( ! ptab->parseCSVBatch( *pass->req, cmd, vec, pass->errmsg ) ) {
+			pass->errmsg += Jstr(" in lines of byte range starting at ") + longToStr( pass->start );
+			pass->error = true;
+			break;
+		}
 
-	ExprElementNode *root = parseParam->whereVec[0].tree->getRoot();
+		if ( pass->insert ) {
+			pass->rows += ptab->insertPairs( *pass->req, batchVec, okVec );
+			batchVec.clean();
+		} else {
+			pass->rows += rows;
+		}
+		rows = 0;
+	}
+	pass->first = reader.rangeStart();
+	pass->last = reader.position();
+	return NULL;
+}
+
+// parse an insert command into pairs of the table
+bool JagTable::parseCSVBatch( const JagRequest &req, const Jstr &cmd, JagVector<JagDBPair> &pairVec, Jstr &errmsg )
+{
+	JagParseAttribute jpa( _servobj, req.session->timediff, _servobj->servtimediff, req.session->dbname, _servobj->_cfg );
+	JagParser parser( (void*)_servobj );
+	JagParseParam pparam( &parser );
+	if ( ! parser.parseCommand( jpa, cmd, &pparam, errmsg ) ) {
+		return false;
+	}
+	return parsePair( req.session->timediff, &pparam, pairVec, errmsg );
+}
+
+// kbuf: key of pos-th row in ascending order; lastkey: key of previous row
+bool JagTable::checkIngestKey( const char *kbuf, char *lastkey, jagint pos, Jstr &errmsg )
+{
+	if ( *kbuf == '\0' ) {
+		errmsg = Jstr("E5034 empty key in row ") + longToStr( pos+1 );
+		return false;
+	}
+
+	if ( pos > 0 && memcmp( lastkey, kbuf, KEYLEN ) >= 0 ) {
+		errmsg = Jstr("E5035 keys are not in ascending order or duplicate in row ") + longToStr( pos+1 );
+		return false;
+	}
+
+	if ( _darrFamily->keyExist( kbuf ) ) {
+		errmsg = Jstr("E5036 key of row ") + longToStr( pos+1 ) + " exists in table";
+		return false;
+	}
+
+	memcpy( lastkey, kbuf, KEYLEN );
+	return true;
+}
+
+// add ingested rows to indexes of the table
+void JagTable::indexIngested( const char *kvbufs, jagint num )
+{
+	if ( _indexlist.size() < 1 ) return;
+	for ( jagint i = 0; i < num; ++i ) {
+		JagDBPair pair( kvbufs + i*KEYVALLEN, KEYLEN, kvbufs + i*KEYVALLEN + KEYLEN, VALLEN );
+		formatIndexCmd( pair, 0, false );
+	}
+}
+
+// Build a new index from all rows of the table.
+// Workers scan slices of the table files and the insert buffer, and write the
+// index records as sorted runs to temp files. The runs are then merged in key order
+// directly into new data files of the index, instead of inserting row by row.
+// CREATE_INDEX_THREADS: number of workers (default: number of cpus)
+// CREATE_INDEX_RUN_SIZE: MB of index records sorted in memory by a worker (default 64)
+// table and pindex are write-locked by caller
+int JagTable::formatCreateIndex( JagIndex *pindex ) 
+{
+	if ( ! pindex->_darrFamily ) return 0;
+
+	int numThreads = _servobj->_cfg->getIntValue("CREATE_INDEX_THREADS", _servobj->_numCPUs );
+	if ( numThreads < 1 ) numThreads = 1;
+	jagint runBytes = _servobj->_cfg->getLongValue("CREATE_INDEX_RUN_SIZE", 64 ) * ONE_MEGA_BYTES;
+	jagint maxrecs = runBytes/pindex->KEYVALLEN;
+	if ( maxrecs < JAG_BLOCK_SIZE ) maxrecs = JAG_BLOCK_SIZE;
+
+	// slices of table files, at least 64 blocks each
+	JagVector<OnefileRange> taskVec;
+	OnefileRange range;
+	jagint slots, step;
+	for ( int i = 0; i < _darrFamily->_darrlist.size(); ++i ) {
+		JagDiskArrayServer *darr = _darrFamily->_darrlist[i];
+		slots = darr->size()/KEYVALLEN;
+		if ( slots < 1 ) continue;
+		step = ( slots + numThreads - 1 )/numThreads;
+		if ( step < 64*JAG_BLOCK_SIZE ) step = 64*JAG_BLOCK_SIZE;
+		for ( jagint pos = 0; pos < slots; pos += step ) {
+			range.darr = darr;
+			range.startpos = pos;
+			range.readlen = ( pos + step <= slots ) ? step : slots - pos;
+			range.memmax = 16;
+			taskVec.append( range );
+		}
+	}
+
+	if ( _darrFamily->_insertBufferMap->elements() > 0 ) {
+		range.darr = NULL;
+		range.startpos = 0;
+		range.readlen = _darrFamily->_insertBufferMap->elements();
+		taskVec.append( range );
+	}
+
+	if ( taskVec.size() < 1 ) return 1;
+	if ( numThreads > taskVec.size() ) numThreads = taskVec.size();
+
+	Jstr tmpdir = _servobj->_cfg->getTEMPDataHOME( _replicateType );
+	JagFileMgr::makedirPath( tmpdir );
+	Jstr runPrefix = tmpdir + "/" + _dbtable + "." + pindex->getIndexName() + "." + longToStr( THREADID );
+
+	jagint t1 = JagTime::nowMilliSeconds();
+	std::atomic<jagint> nextTask;
+	nextTask = 0;
+	ParallelIndexBuildPass pass[numThreads];
+	pthread_t thrd[numThreads];
+	for ( int i = 0; i < numThreads; ++i ) {
+		pass[i].ptab = this;
+		pass[i].pindex = pindex;
+		pass[i].pos = i;
+		pass[i].taskVec = &taskVec;
+		pass[i].nextTask = &nextTask;
+		pass[i].runPrefix = runPrefix;
+		pass[i].maxrecs = maxrecs;
+		jagpthread_create( &thrd[i], NULL, parallelCreateIndexStatic, (void*)&pass[i] );
+	}
+
+	JagVector<Jstr> runVec;
+	jagint rows = 0;
+	bool ok = true;
+	for ( int i = 0; i < numThreads; ++i ) {
+		pthread_join( thrd[i], NULL );
+		for ( int j = 0; j < pass[i].runVec.size(); ++j ) {
+			runVec.append( pass[i].runVec[j] );
+		}
+		rows += pass[i].rows;
+		if ( pass[i].error ) ok = false;
+	}
+
+	jagint t2 = JagTime::nowMilliSeconds();
+	jagint cnt = 0;
+	if ( ok ) {
+		cnt = mergeIndexRuns( pindex, runVec, rows );
+		if ( cnt < 0 ) ok = false;
+	}
+
+	for ( int i = 0; i < runVec.size(); ++i ) {
+		jagunlink( runVec[i].c_str() );
+	}
+
+	if ( ! ok ) {
+		raydebug( stdout, JAG_LOG_LOW, "E5024 create index %s.%s sorted runs failed, build by rows\n", 
+				  _dbtable.s(), pindex->getIndexName().s() );
+		return formatCreateIndexByRow( pindex );
+	}
+
+	raydebug( stdout, JAG_LOG_LOW, "create index %s.%s rows=%l threads=%d runs=%d sort=%l ms merge=%l ms\n", 
+			  _dbtable.s(), pindex->getIndexName().s(), cnt, numThreads, runVec.size(), t2-t1, JagTime::nowMilliSeconds()-t2 );
+	return 1;
+}
+
+// insert table rows into the index one by one
+int JagTable::formatCreateIndexByRow( JagIndex *pindex ) 
+{
+	char *tablebuf = (char*)jagmalloc(KEYVALLEN+1);
+	memset( tablebuf, 0, KEYVALLEN+1 );
+
+	char minbuf[KEYLEN+1];
+	char maxbuf[KEYLEN+1];
+	memset( minbuf, 0,   KEYLEN+1 );
+	memset( maxbuf, 255, KEYLEN+1 );
+
+	JagMergeReader *ntu = NULL;
+	_darrFamily->setFamilyRead( ntu, minbuf, maxbuf );
+	if ( ntu ) {
+		while ( ntu->getNext( tablebuf ) ) {
+			dbNaturalFormatExchange( tablebuf, _numKeys, _schAttr, 0, 0, " " ); 
+			pindex->formatIndexCmdFromTable( tablebuf, 0 );
+		}
+		delete ntu;
+	}
+
+	free( tablebuf );
+	return 1;
+}
+
+// worker of formatCreateIndex: takes slices until none left
+void *JagTable::parallelCreateIndexStatic( void * ptr )
+{	
+	ParallelIndexBuildPass *pass = (ParallelIndexBuildPass*)ptr;
+	JagTable *ptab = pass->ptab;
+
+	char *tablebuf = (char*)jagmalloc( ptab->KEYVALLEN+1 );
+	memset( tablebuf, 0, ptab->KEYVALLEN+1 );
+	pass->runbuf = (char*)jagmalloc( pass->maxrecs*pass->pindex->KEYVALLEN+1 );
+	pass->nrecs = 0;
+
+	jagint t;
+	while ( ! pass->error ) {
+		t = (*pass->nextTask)++;
+		if ( t >= pass->taskVec->size() ) break;
+		const OnefileRange &range = (*pass->taskVec)[t];
+		if ( range.darr ) {
+			// file rows hidden by range deletes are skipped, as JagMergeReader does
+			JagBuffReader nav( range.darr, range.readlen, ptab->KEYLEN, ptab->VALLEN, range.startpos, 0, range.memmax );
+			while ( nav.getNext( tablebuf ) ) {
+				if ( ptab->_darrFamily->rangeDeleted( tablebuf ) ) continue;
+				addIndexBuildRow( pass, tablebuf );
+			}
+		} else {
+			const JagDBMap *pairmap = ptab->_darrFamily->_insertBufferMap;
+			for ( JagFixMapIterator it = pairmap->_map->begin(); it != pairmap->_map->end(); ++it ) {
+				memcpy( tablebuf, it->first.c_str(), ptab->KEYLEN );
+				memcpy( tablebuf+ptab->KEYLEN, it->second.c_str(), ptab->VALLEN );
+				addIndexBuildRow( pass, tablebuf );
+			}
+		}
+	}
+	writeIndexBuildRun( pass );
+
+	free( pass->runbuf );
+	pass->runbuf = NULL;
+	free( tablebuf );
+	return NULL;
+}
+
+// tablebuf: table record in db format
+void JagTable::addIndexBuildRow( ParallelIndexBuildPass *pass, char *tablebuf )
+{
+	JagTable *ptab = pass->ptab;
+	JagIndex *pindex = pass->pindex;
+	tablebuf[ptab->KEYVALLEN] = '\0';
+	// pending counter deltas are not in the rows yet; readers add them, so does the index
+	ptab->_darrFamily->applyMergeDelta( tablebuf );
+	dbNaturalFormatExchange( tablebuf, ptab->_numKeys, ptab->_schAttr, 0, 0, " " ); 
+	if ( ! pindex->formatIndexKVFromTable( tablebuf, pass->runbuf + pass->nrecs*pindex->KEYVALLEN ) ) {
+		return;
+	}
+
+	++ pass->rows;
+	if ( ++ pass->nrecs >= pass->maxrecs ) {
+		writeIndexBuildRun( pass );
+	}
+}
+
+// orders fixed-length records by their key bytes
+class JagRecordKeyLess
+{
+  public:
+	JagRecordKeyLess( jagint klen ) : _klen( klen ) {}
+	bool operator() ( const char *a, const char *b ) const { return memcmp( a, b, _klen ) < 0; }
+	jagint _klen;
+};
+
+// sort records in runbuf and write them as a run file
+void JagTable::writeIndexBuildRun( ParallelIndexBuildPass *pass )
+{
+	if ( pass->nrecs < 1 || pass->error ) return;
+	jagint kvlen = pass->pindex->KEYVALLEN;
+
+	std::vector<const char*> recs( pass->nrecs );
+	for ( jagint i = 0; i < pass->nrecs; ++i ) {
+		recs[i] = pass->runbuf + i*kvlen;
+	}
+	std::sort( recs.begin(), recs.end(), JagRecordKeyLess( pass->pindex->KEYLEN ) );
+
+	Jstr fpath = pass->runPrefix + "." + intToStr( pass->pos ) + "." + intToStr( pass->runVec.size() ) + ".run";
+	FILE *fp = jagfopen( fpath.c_str(), "wb" );
+	if ( ! fp ) {
+		raydebug( stdout, JAG_LOG_LOW, "E5025 error open %s\n", fpath.s() );
+		pass->error = true;
+		return;
+	}
+	pass->runVec.append( fpath );
+
+	for ( jagint i = 0; i < pass->nrecs; ++i ) {
+		if ( 1 != fwrite( recs[i], kvlen, 1, fp ) ) {
+			raydebug( stdout, JAG_LOG_LOW, "E5026 error write %s\n", fpath.s() );
+			pass->error = true;
+			break;
+		}
+	}
+	if ( jagfclose( fp ) != 0 ) pass->error = true;
+	pass->nrecs = 0;
+}
+
+// min-heap order of runs by their current record
+class JagRunKeyGreater
+{
+  public:
+	JagRunKeyGreater( const char *cur, jagint kvlen, jagint klen ) : _cur( cur ), _kvlen( kvlen ), _klen( klen ) {}
+	bool operator() ( int a, int b ) const { return memcmp( _cur + a*_kvlen, _cur + b*_kvlen, _klen ) > 0; }
+	const char *_cur;
+	jagint _kvlen;
+	jagint _klen;
+};
+
+// merge sorted runs into new data files of the index
+// return number of index records written; -1 if a run can not be read, nothing is added to the index
+jagint JagTable::mergeIndexRuns( JagIndex *pindex, const JagVector<Jstr> &runVec, jagint rows )
+{
+	int nruns = runVec.size();
+	if ( nruns < 1 ) return 0;
+
+	jagint klen = pindex->KEYLEN;
+	jagint kvlen = pindex->KEYVALLEN;
+	FILE *fps[nruns];
+	char *cur = (char*)jagmalloc( nruns*kvlen );
+	JagRunKeyGreater greater( cur, kvlen, klen );
+	std::vector<int> heap;
+	bool ok = true;
+	int i;
+	for ( i = 0; i < nruns; ++i ) {
+		fps[i] = NULL;
+	}
+	for ( i = 0; i < nruns && ok; ++i ) {
+		fps[i] = jagfopen( runVec[i].c_str(), "rb" );
+		if ( ! fps[i] ) {
+			raydebug( stdout, JAG_LOG_LOW, "E5027 error open %s\n", runVec[i].s() );
+			ok = false;
+			continue;
+		}
+		setvbuf( fps[i], NULL, _IOFBF, 1024*1024 );
+		if ( 1 == fread( cur + i*kvlen, kvlen, 1, fps[i] ) ) {
+			heap.push_back( i );
+		} else if ( ferror( fps[i] ) ) {
+			raydebug( stdout, JAG_LOG_LOW, "E5028 error read %s\n", runVec[i].s() );
+			ok = false;
+		}
+	}
+
+	if ( ! ok ) {
+		for ( i = 0; i < nruns; ++i ) {
+			if ( fps[i] ) jagfclose( fps[i] );
+		}
+		free( cur );
+		return -1;
+	}
+	std::make_heap( heap.begin(), heap.end(), greater );
+
+	// output is cut into simpfiles of JAG_SIMPFILE_LIMIT_BYTES
+	jagint chunkrecs = JAG_SIMPFILE_LIMIT_BYTES/kvlen;
+	if ( chunkrecs < 1 ) chunkrecs = 1;
+	if ( chunkrecs > rows ) chunkrecs = rows;
+	char *chunk = (char*)jagmalloc( chunkrecs*kvlen );
+	JagDiskArrayServer *darr = pindex->_darrFamily->newSortedFile( rows );
+
+	jagint n = 0, cnt = 0;
+	const char *last = NULL;
+	while ( heap.size() > 0 ) {
+		std::pop_heap( heap.begin(), heap.end(), greater );
+		i = heap.back();
+		heap.pop_back();
+
+		// index keys contain the table keys and are unique
+		if ( ! last || memcmp( last, cur + i*kvlen, klen ) != 0 ) {
+			memcpy( chunk + n*kvlen, cur + i*kvlen, kvlen );
+			last = chunk + n*kvlen;
+			if ( ++n == chunkrecs ) {
+				cnt += darr->flushSortedToNewFile( chunk, n );
+				n = 0;
+			}
+		}
+
+		if ( 1 == fread( cur + i*kvlen, kvlen, 1, fps[i] ) ) {
+			heap.push_back( i );
+			std::push_heap( heap.begin(), heap.end(), greater );
+		} else if ( ferror( fps[i] ) ) {
+			raydebug( stdout, JAG_LOG_LOW, "E5028 error read %s\n", runVec[i].s() );
+			ok = false;
+			break;
+		}
+	}
+
+	if ( ok ) {
+		if ( n > 0 ) {
+			cnt += darr->flushSortedToNewFile( chunk, n );
+		}
+		pindex->_darrFamily->addSortedFile( darr );
+	} else {
+		// rows of the missing run would be lost; drop the partial file
+		Jstr dpath = darr->getFilePath();
+		delete darr;
+		JagFileMgr::rmdir( dpath );
+		cnt = -1;
+	}
+
+	for ( i = 0; i < nruns; ++i ) {
+		if ( fps[i] ) jagfclose( fps[i] );
+	}
+	free( chunk );
+	free( cur );
+	return cnt;
+}
+
+// return 0 for error; > 0 OK
+jagint JagTable::update( const JagRequest &req, const JagParseParam *parseParam, bool upsert, Jstr &errmsg )
+{
+	// chain not able to update
+	if ( JAG_CHAINTABLE_TYPE == _objectType ) {
+		errmsg = "E23072 Chain cannot be updated";
+		return 0;
+	}
+
+	prt(("s344082 JagTable::update parseParam->updSetVec.print():\n" ));
+	//parseParam->updSetVec.print();
+
+	prt(("s344083 JagTable::update parseParam->otherVec.print():\n" ));
+	//parseParam->otherVec.print();
+
+
+	int 	numUpdateCols = parseParam->updSetVec.size();
+	int 	rc, collen, siglen, setindexnum = _indexlist.size(); 
+	int 	constMode = 0, typeMode = 0, tabnum = 0, treelength = 0;
+	Jstr 	treetype;
+	bool 	uniqueAndHasValueCol = 0, setKey;
+	jagint 	cnt = 0, scanned = 0;
+	const char *buffers[1];
+	jagint 	setposlist[numUpdateCols];
+	int 	getpos = 0;
+	int     numIndexes = _indexlist.size();
+	JagIndex *lpindex[ numIndexes ];
+	AbaxBuffer bfr;
+	Jstr 	dbcolumn;
+
+	ExprElementNode *updroot;
+	const JagHashStrInt *maps[1];
+	const JagSchemaAttribute *attrs[1];	
+	maps[0] = _tablemap;
+	attrs[0] = _schAttr;
+	
+	JagFixString strres, treestr;
+	bool needInit = true;
+	bool singleInsert = false;
+	
+	// check updSetVec validation
+	setKey = 0;
+	for ( int i = 0; i < numUpdateCols; ++i ) {
+		dbcolumn = _dbtable + "." + parseParam->updSetVec[i].colName;
+		if ( isFileColumn( parseParam->updSetVec[i].colName ) ) {
+			errmsg = Jstr("E10283 column ") + parseParam->updSetVec[i].colName + " is file type";
+			return -1;
+		}
+
+		if ( _tablemap->getValue(dbcolumn, getpos) ) {
+			setposlist[i] = getpos;
+			if ( getpos < _numKeys ) { 
+				setKey = 1;
+				errmsg = Jstr("E03875 Key column cannot be updated");
+				return -1;
+			}
+
+			bool isAggregate = false;
+			updroot = parseParam->updSetVec[i].tree->getRoot();
+			rc = updroot->setFuncAttribute( maps, attrs, constMode, typeMode, isAggregate, treetype, collen, siglen );
+			if ( 0 == rc || isAggregate ) {
+				errmsg = Jstr("E0383 wrong update type. Char column must use single quotes.");
+				return -1;
+			}
+		} else {
+			errmsg = Jstr("E0384 column ") + dbcolumn + " not found";
+			return -1;
+		}
+	}
+	
+	// build init index list
+	/**
+	if ( setKey ) {
+		for ( int i = 0; i < _indexlist.size(); ++i ) {
+			lpindex[i] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
+															   _indexlist[i], _replicateType, 1 );
+		}
+	} else {
+		setindexnum = 0;
+		for ( int i = 0; i < _indexlist.size(); ++i ) {
+			lpindex[i] = NULL;
+			lpindex[setindexnum] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
+																	     _indexlist[i], _replicateType, 1 );
+			for ( int i = 0; i < numUpdateCols; ++i ) {
+				if ( lpindex[setindexnum] ) {
+					if ( lpindex[setindexnum]->needUpdate( parseParam->updSetVec[i].colName ) ) {
+						++setindexnum; break;
+					} else {
+						_objectLock->readUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, 
+																lpindex[setindexnum]->getIndexName(), _replicateType, 1 );
+					}
+				}
+			}
+		}
+	}
+	**/
+
+	/***
+	setindexnum = 0;
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		lpindex[i] = NULL;
+		lpindex[setindexnum] = _objectLock->readLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
+		for ( int i = 0; i < numUpdateCols; ++i ) {
+			if ( lpindex[setindexnum] ) {
+				if ( lpindex[setindexnum]->needUpdate( parseParam->updSetVec[i].colName ) ) {
+					++setindexnum; 
+					break;
+				} else {
+					_objectLock->readUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, lpindex[setindexnum]->getIndexName(), _replicateType, 1 );
+				}
+			}
+		}
+	}
+	***/
+
+	setindexnum = 0;
+	for ( int i = 0; i < numIndexes; ++i ) {
+		lpindex[i] = _objectLock->writeLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _tableschema, _indexschema, _replicateType, 1 );
+		if ( lpindex[i] ) {
+			bool needUpdate = false;
+			for ( int j = 0; j < numUpdateCols; ++j ) {
+				if ( lpindex[i]->needUpdate( parseParam->updSetVec[j].colName ) ) {
+					needUpdate = true;
+				}
+			}
+			if ( ! needUpdate ) {
+				_objectLock->writeUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
+				lpindex[i] = NULL;
+			} else {
+				++ setindexnum;
+			}
+		} 
+	}
+
+	// if setindexnum == 0: then all index locks are freeed, and lpindex[i] set to NULL
+
+	// parse tree		
+	int keylen[1];
+	int numKeys[1];	
+	JagMinMax minmax[1];	
+	keylen[0] = KEYLEN;
+	numKeys[0] = _numKeys;
+	minmax[0].setbuflen( keylen[0] );
+
+	/***
+	char 	*tableoldbuf = (char*)jagmalloc(KEYVALLEN+1);
+	char 	*tablenewbuf = (char*)jagmalloc(KEYVALLEN+1);
+	memset( tableoldbuf, 0, KEYVALLEN+1 );
+	memset( tablenewbuf, 0, KEYVALLEN+1 );
+	buffers[0] = tableoldbuf;
+	***/
+
+	ExprElementNode *root = parseParam->whereVec[0].tree->getRoot();
 	rc = root->setWhereRange( maps, attrs, keylen, numKeys, 1, uniqueAndHasValueCol, minmax, treestr, typeMode, tabnum );
 	if ( rc < 0 ) {
 		//if ( tableoldbuf ) free ( tableoldbuf );
@@ -1952,6 +2696,149 @@ jagint JagTable::update( const JagRequest &req, const JagParseParam *parseParam,
 	return cnt;
 }
 
+// Blind counter update:  update t set c=c+n [, d=d-m ...] where k1=.. and k2=..
+// The deltas are kept by the table family and added to the row when it is read or flushed,
+// so the row is not read here. Caller holds the table insert lock (shared).
+// return -2 if the command is not a blind counter update; -1 wallog error; else number of updated rows
+jagint JagTable::mergeUpdate( const JagRequest &req, const JagParseParam *parseParam, const char *cmd, Jstr &errmsg )
+{
+	if ( JAG_CHAINTABLE_TYPE == _objectType || hasTimeSeries() || hasRollupColumn() ) return -2;
+	int numUpdateCols = parseParam->updSetVec.size();
+	if ( numUpdateCols < 1 || parseParam->whereVec.size() < 1 ) return -2;
+
+	int  getpos;
+	Jstr dbcolumn, delta;
+	JagIndex *pindex;
+	char *deltabuf = (char*)jagmalloc(KEYVALLEN+1);
+	memset( deltabuf, 0, KEYVALLEN+1 );
+
+	for ( int i = 0; i < numUpdateCols; ++i ) {
+		const Jstr &colName = parseParam->updSetVec[i].colName;
+		dbcolumn = _dbtable + "." + colName;
+		if ( ! _tablemap->getValue( dbcolumn, getpos ) || getpos < _numKeys 
+			 || ! JagDiskArrayFamily::isMergeType( _schAttr[getpos].type )
+			 || ! getMergeDelta( parseParam->updSetVec[i].tree->getRoot(), colName, delta ) ) {
+			free( deltabuf );
+			return -2;
+		}
+
+		if ( isInteger( _schAttr[getpos].type ) && strchr( delta.c_str(), '.' ) ) {
+			free( deltabuf );
+			return -2;
+		}
+
+		// a column read by an index needs the old and new row
+		for ( int j = 0; j < _indexlist.size(); ++j ) {
+			pindex = _objectLock->getIndex( _dbname, _indexlist[j], _replicateType );
+			if ( pindex && pindex->needUpdate( colName ) ) {
+				free( deltabuf );
+				return -2;
+			}
+		}
+
+		if ( ! formatOneCol( req.session->timediff, _servobj->servtimediff, deltabuf, delta.c_str(), errmsg, colName,
+							 _schAttr[getpos].offset, _schAttr[getpos].length, _schAttr[getpos].sig, _schAttr[getpos].type ) ) {
+			errmsg = "";
+			free( deltabuf );
+			return -2;
+		}
+	}
+
+	// where must give values of all keys
+	int 	keylen[1], numKeys[1];
+	int 	typeMode = 0, tabnum = 0;
+	bool 	uniqueAndHasValueCol = 0;
+	const JagHashStrInt *maps[1];
+	const JagSchemaAttribute *attrs[1];	
+	JagMinMax minmax[1];	
+	JagFixString treestr;
+	maps[0] = _tablemap;
+	attrs[0] = _schAttr;
+	keylen[0] = KEYLEN;
+	numKeys[0] = _numKeys;
+	minmax[0].setbuflen( keylen[0] );
+
+	ExprElementNode *root = parseParam->whereVec[0].tree->getRoot();
+	int rc = root->setWhereRange( maps, attrs, keylen, numKeys, 1, uniqueAndHasValueCol, minmax, treestr, typeMode, tabnum );
+	if ( rc <= 0 || uniqueAndHasValueCol || memcmp( minmax[0].minbuf, minmax[0].maxbuf, KEYLEN ) != 0 ) {
+		free( deltabuf );
+		return -2;
+	}
+
+	char kbuf[KEYLEN+1];
+	memcpy( kbuf, minmax[0].minbuf, KEYLEN );
+	kbuf[KEYLEN] = '\0';
+	memcpy( deltabuf, kbuf, KEYLEN );
+	JagDBPair deltapair( deltabuf, KEYLEN, deltabuf+KEYLEN, VALLEN, true );
+
+	// wallog append and delta stay on the same side of a buffer flush; the key stripe keeps
+	// other deltas of the key out between the check and the add
+	// a sum that may not fit its column goes to the read-modify-write update, which reports it
+	jagint cnt = 0;
+	JagVector<JagDBPair> pairVec;
+	pairVec.append( deltapair );
+	_darrFamily->lockInsertKeys( pairVec );
+	rc = _darrFamily->checkMergeDelta( deltapair );
+	if ( rc < 0 ) {
+		cnt = -2;
+	} else if ( rc > 0 ) {
+		if ( req.redoOnly || _servobj->logCommand( parseParam, req.session, cmd, strlen(cmd), 1 ) ) {
+			_darrFamily->addMergeDelta( deltapair );
+			cnt = 1;
+		} else {
+			errmsg = "E20316 Error write wallog";
+			cnt = -1;
+		}
+	}
+	_darrFamily->unlockInsertKeys( pairVec );
+	free( deltabuf );
+	if ( -2 == cnt ) return cnt;
+
+	_darrFamily->flushIfFull( true );
+	return cnt;
+}
+
+// delta of colName if root is "colName + number", "number + colName" or "colName - number"
+bool JagTable::getMergeDelta( ExprElementNode *root, const Jstr &colName, Jstr &delta )
+{
+	if ( ! root || root->_isElement ) return false;
+	int op = root->getBinaryOp();
+	if ( op != JAG_NUM_ADD && op != JAG_NUM_SUB ) return false;
+
+	ExprElementNode *colnode = ((BinaryOpNode*)root)->_left;
+	ExprElementNode *numnode = ((BinaryOpNode*)root)->_right;
+	if ( ! colnode || ! numnode || ! colnode->_isElement || ! numnode->_isElement ) return false;
+	if ( JAG_NUM_ADD == op && colnode->_name.size() < 1 ) {
+		ExprElementNode *t = colnode; colnode = numnode; numnode = t;
+	}
+	if ( colnode->_name.size() < 1 || numnode->_name.size() > 0 ) return false;
+
+	const char *p = strrchr( colnode->_name.c_str(), '.' );
+	if ( p ) ++p; else p = colnode->_name.c_str();
+	if ( colName != p ) return false;
+
+	const char *val;
+	if ( ! numnode->getValue( val ) ) return false;
+	const char *q = val;
+	if ( '+' == *q || '-' == *q ) ++q;
+	if ( '\0' == *q ) return false;
+	int dots = 0;
+	for ( ; *q; ++q ) {
+		if ( '.' == *q ) ++dots;
+		else if ( ! isdigit(*q) ) return false;
+	}
+	if ( dots > 1 ) return false;
+
+	if ( '+' == *val ) ++val;
+	if ( JAG_NUM_SUB == op ) {
+		if ( '-' == *val ) delta = val+1;
+		else delta = Jstr("-") + val;
+	} else {
+		delta = val;
+	}
+	return true;
+}
+
 // return 0 error; > 0 OK
 jagint JagTable::remove( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg )	
 {
@@ -1961,6 +2848,13 @@ jagint JagTable::remove( const JagRequest &req, JagParseParam *parseParam, Jstr
 		return 0;
 	}
 
+	// a key range is deleted at once; its rows are counted, not removed one by one
+	JagRangeDelete rd;
+	jagint rows = 0;
+	if ( getDeleteRange( req, parseParam, rd ) && _darrFamily->deleteRange( rd, &rows ) ) {
+		return rows;
+	}
+
 	int rc, retval, typeMode = 0, tabnum = 0, treelength = 0;
 	bool uniqueAndHasValueCol = 0, needInit = true;
 	jagint cnt = 0;
@@ -2049,6 +2943,176 @@ jagint JagTable::remove( const JagRequest &req, JagParseParam *parseParam, Jstr
 	return cnt;
 }
 
+// rows of tables with indexes or file columns are deleted one by one
+bool JagTable::canRangeDelete() const
+{
+	if ( ! _servobj->_rangeDelete || _indexlist.size() > 0 ) return false;
+	for ( int i = 0; i < _numCols; ++i ) {
+		if ( _schAttr[i].isFILE ) return false;
+	}
+	return true;
+}
+
+// Range delete:  delete from t where k1=.. and k2=.. [and k3 > .. and k3 <= ..]
+// The where clause must be an AND of comparisons of key columns with constants: equalities
+// on the leading keys, then optionally bounds of the next key, without giving all keys.
+// Tables with indexes or file columns delete row by row.
+// return false if the delete is not a range delete; else rd is the deleted range
+bool JagTable::getDeleteRange( const JagRequest &req, const JagParseParam *parseParam, JagRangeDelete &rd )
+{
+	if ( ! canRangeDelete() || parseParam->whereVec.size() < 1 ) return false;
+
+	// flatten the AND tree into comparisons
+	JagVector<ExprElementNode*> stack, terms;
+	stack.append( parseParam->whereVec[0].tree->getRoot() );
+	while ( stack.size() > 0 ) {
+		ExprElementNode *node = stack[stack.size()-1];
+		stack.removepos( stack.size()-1 );
+		if ( ! node || node->_isElement ) return false;
+		if ( JAG_LOGIC_AND == node->getBinaryOp() ) {
+			stack.append( ((BinaryOpNode*)node)->_left );
+			stack.append( ((BinaryOpNode*)node)->_right );
+		} else {
+			terms.append( node );
+		}
+	}
+
+	// per key column: 1 equal, 2 lower bound, 4 upper bound
+	int  *has = (int*)calloc( _numKeys, sizeof(int) );
+	Jstr *eqval = new Jstr[_numKeys];
+	Jstr loval, hival;
+	int  bcol = -1;
+	bool ok = true;
+	int  op, pos;
+	const char *val, *p;
+	Jstr dbcolumn;
+	for ( int i = 0; ok && i < terms.size(); ++i ) {
+		op = terms[i]->getBinaryOp();
+		ExprElementNode *colnode = ((BinaryOpNode*)terms[i])->_left;
+		ExprElementNode *valnode = ((BinaryOpNode*)terms[i])->_right;
+		ok = false;
+		if ( ! colnode || ! valnode || ! colnode->_isElement || ! valnode->_isElement ) break;
+		if ( colnode->_name.size() < 1 ) {
+			// constant op column
+			ExprElementNode *t = colnode; colnode = valnode; valnode = t;
+			if ( JAG_FUNC_LESSTHAN == op ) op = JAG_FUNC_GREATERTHAN;
+			else if ( JAG_FUNC_LESSEQUAL == op ) op = JAG_FUNC_GREATEREQUAL;
+			else if ( JAG_FUNC_GREATERTHAN == op ) op = JAG_FUNC_LESSTHAN;
+			else if ( JAG_FUNC_GREATEREQUAL == op ) op = JAG_FUNC_LESSEQUAL;
+		}
+		if ( colnode->_name.size() < 1 || valnode->_name.size() > 0 || ! valnode->getValue( val ) ) break;
+
+		p = strrchr( colnode->_name.c_str(), '.' );
+		if ( p ) ++p; else p = colnode->_name.c_str();
+		dbcolumn = _dbtable + "." + p;
+		if ( ! _tablemap->getValue( dbcolumn, pos ) || pos >= _numKeys ) break;
+		if ( ! isRangeDeleteValue( _schAttr[pos], val ) ) break;
+
+		if ( JAG_FUNC_EQUAL == op ) {
+			if ( has[pos] ) break;
+			has[pos] |= 1;
+			eqval[pos] = val;
+		} else if ( JAG_FUNC_GREATERTHAN == op || JAG_FUNC_GREATEREQUAL == op ) {
+			if ( ( has[pos] & 3 ) || ( bcol >= 0 && bcol != pos ) ) break;
+			has[pos] |= 2;
+			bcol = pos;
+			loval = val;
+			rd.loIncl = ( JAG_FUNC_GREATEREQUAL == op );
+		} else if ( JAG_FUNC_LESSTHAN == op || JAG_FUNC_LESSEQUAL == op ) {
+			if ( ( has[pos] & 5 ) || ( bcol >= 0 && bcol != pos ) ) break;
+			has[pos] |= 4;
+			bcol = pos;
+			hival = val;
+			rd.hiIncl = ( JAG_FUNC_LESSEQUAL == op );
+		} else {
+			break;
+		}
+		ok = true;
+	}
+
+	// equalities on keys 0..np-1, bounds on key np only
+	int np = 0;
+	while ( ok && np < _numKeys && ( has[np] & 1 ) ) ++np;
+	if ( ok ) {
+		if ( np == _numKeys || ( bcol >= 0 && bcol != np ) || ( np == 0 && bcol < 0 ) ) ok = false;
+		for ( int k = np+1; ok && k < _numKeys; ++k ) {
+			if ( has[k] ) ok = false;
+		}
+	}
+
+	char *lobuf = NULL, *hibuf = NULL;
+	Jstr errmsg;
+	if ( ok ) {
+		lobuf = (char*)jagmalloc( KEYVALLEN+1 );
+		hibuf = (char*)jagmalloc( KEYVALLEN+1 );
+		memset( lobuf, 0, KEYVALLEN+1 );
+		memset( hibuf, 0, KEYVALLEN+1 );
+		for ( int k = 0; ok && k < np; ++k ) {
+			ok = formatOneCol( req.session->timediff, _servobj->servtimediff, lobuf, eqval[k].c_str(), errmsg, 
+							   _schAttr[k].colname, _schAttr[k].offset, _schAttr[k].length, _schAttr[k].sig, _schAttr[k].type )
+				 && formatOneCol( req.session->timediff, _servobj->servtimediff, hibuf, eqval[k].c_str(), errmsg, 
+							   _schAttr[k].colname, _schAttr[k].offset, _schAttr[k].length, _schAttr[k].sig, _schAttr[k].type );
+		}
+		if ( ok && ( has[np] & 2 ) ) {
+			ok = formatOneCol( req.session->timediff, _servobj->servtimediff, lobuf, loval.c_str(), errmsg, 
+							   _schAttr[np].colname, _schAttr[np].offset, _schAttr[np].length, _schAttr[np].sig, _schAttr[np].type );
+		}
+		if ( ok && ( has[np] & 4 ) ) {
+			ok = formatOneCol( req.session->timediff, _servobj->servtimediff, hibuf, hival.c_str(), errmsg, 
+							   _schAttr[np].colname, _schAttr[np].offset, _schAttr[np].length, _schAttr[np].sig, _schAttr[np].type );
+		}
+	}
+
+	if ( ok ) {
+		dbNaturalFormatExchange( lobuf, _numKeys, _schAttr, 0,0, " " ); // natural format -> db format
+		dbNaturalFormatExchange( hibuf, _numKeys, _schAttr, 0,0, " " );
+		if ( bcol >= 0 ) {
+			rd.cmplen = _schAttr[np].offset + _schAttr[np].length;
+			if ( ! ( has[np] & 4 ) ) {
+				memset( hibuf + _schAttr[np].offset, 255, _schAttr[np].length );
+				rd.hiIncl = true;
+			}
+			if ( ! ( has[np] & 2 ) ) rd.loIncl = true;
+		} else {
+			rd.cmplen = _schAttr[np-1].offset + _schAttr[np-1].length;
+			rd.loIncl = rd.hiIncl = true;
+		}
+		memset( hibuf + rd.cmplen, 255, KEYLEN - rd.cmplen );
+		rd.lo = JagFixString( lobuf, KEYLEN, KEYLEN );
+		rd.hi = JagFixString( hibuf, KEYLEN, KEYLEN );
+	}
+
+	if ( lobuf ) free( lobuf );
+	if ( hibuf ) free( hibuf );
+	free( has );
+	delete [] eqval;
+	return ok;
+}
+
+// constant val of a key column compares the same before and after it is formatted
+bool JagTable::isRangeDeleteValue( const JagSchemaAttribute &attr, const char *val )
+{
+	if ( attr.type == JAG_C_COL_TYPE_STR ) {
+		return strlen( val ) <= attr.length;
+	}
+
+	if ( isDateTime( attr.type ) ) return '*' != *val;
+	if ( ! isInteger( attr.type ) && ! isFloat( attr.type ) ) return false;
+
+	// plain decimal number without more fraction digits than the column keeps
+	const char *q = val;
+	if ( '+' == *q || '-' == *q ) ++q;
+	if ( ! isdigit( *q ) ) return false;
+	int dots = 0, frac = 0;
+	for ( ; *q; ++q ) {
+		if ( '.' == *q ) ++dots;
+		else if ( ! isdigit( *q ) ) return false;
+		else if ( dots ) ++frac;
+	}
+	if ( dots > 1 || ( frac > 0 && isInteger( attr.type ) ) ) return false;
+	return frac <= attr.sig;
+}
+
 // select count  from ...
 jagint JagTable::getCount( const char *cmd, const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg )
 {
@@ -2587,6 +3651,13 @@ void *JagTable::parallelSelectStatic( void * ptr )
 	formatInsertSelectCmdHeader( pass->parseParam, iscmd );
 	prt(("s20488 after formatInsertSelectCmdHeader...\n"));
 
+	// window(period, col) of the select: each row is moved to the start of its window
+	Jstr period, pcolName;
+	bool hasWindow = false;
+	if ( pass->ptab && pass->parseParam->window.size() > 0 ) {
+		hasWindow = pass->parseParam->getWindowPeriod( pass->parseParam->window, period, pcolName );
+	}
+
 	char *buf = (char*)jagmalloc(pass->kvlen+1); 
 	memset(buf, 0, pass->kvlen+1);
 	char *sendbuf = (char*)jagmalloc(pass->sendlen+1); 
@@ -2628,14 +3699,8 @@ void *JagTable::parallelSelectStatic( void * ptr )
 				}
 
 				if ( rc == 1 ) {
-					// buf: if pass->parseParam.window.size() > 0 : converToWindow()
-					if ( pass->parseParam->window.size() > 0 ) {
-						Jstr period, pcolName;
-						bool prc =  pass->parseParam->getWindowPeriod( pass->parseParam->window, period, pcolName );
-						if ( prc ) {
-							prt(("s552238 convertTimeToWindow period=[%s] pcolName=[%s]\n", period.s(), pcolName.s() ));
-							pass->ptab->convertTimeToWindow( pass->req->session->timediff, period, buf, pcolName );
-						}
+					if ( hasWindow ) {
+						pass->ptab->convertTimeToWindow( pass->req->session->timediff, period, buf, pcolName );
 					}
 
 					if ( pass->gmdarr ) { // has group by
@@ -2757,14 +3822,8 @@ void *JagTable::parallelSelectStatic( void * ptr )
 				}
 
 				if ( rc == 1 ) {
-					// buf: if pass->parseParam.window.size() > 0 : converToWindow()
-					if ( pass->parseParam->window.size() > 0 ) {
-						Jstr period, pcolName;
-						bool prc =  pass->parseParam->getWindowPeriod( pass->parseParam->window, period, pcolName );
-						if ( prc ) {
-							prt(("s552238 convertTimeToWindow period=[%s] pcolName=[%s]\n", period.s(), pcolName.s() ));
-							pass->ptab->convertTimeToWindow( pass->req->session->timediff, period, buf, pcolName );
-						}
+					if ( hasWindow ) {
+						pass->ptab->convertTimeToWindow( pass->req->session->timediff, period, buf, pcolName );
 					}
 
 					if ( pass->gmdarr ) { // has group by
@@ -3041,6 +4100,14 @@ Jstr JagTable::drop( Jstr &errmsg, bool isTruncate )
 	JagIndex *pindex = NULL;
 	Jstr idxNames;
 	if ( ! _darrFamily ) return idxNames;
+	if ( _rollupBuf ) {
+		_rollupBuf->clear();
+		_rollupPending = 0;
+	}
+	if ( _lazyStars ) {
+		_starPatterns.clean();
+		jagunlink( _starPath.c_str() );
+	}
 	if ( _indexlist.size() > 0 ) {
 		if ( isTruncate ) {	
 			// if isTruncate, store names to indexNames
@@ -3838,6 +4905,9 @@ int JagTable
 	
 	setindexnum = 0;
 	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		lpindex[i] = NULL;
+		// buffered rollup rows reach the indexes when they are flushed
+		if ( _rollupBuf ) continue;
 		lpindex[i] = _objectLock->writeLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], 
 										   	    _tableschema, _indexschema, _replicateType, 1 );
 		++setindexnum; 
@@ -3874,8 +4944,17 @@ int JagTable
 		}
 		++ nonDateTimeCols;
 	}
-	for ( int K = 1; K <= nonDateTimeCols; ++K ) {
-		starCombinations( nonDateTimeCols, K, inspair, getDBpair, tableoldbuf, tablenewbuf, setindexnum, lpindex );
+	if ( _lazyStars ) {
+		// star patterns not queried yet are aggregated from the finest rows when they are
+		JagVector<int> pointer;
+		for ( int i = 0; i < _starPatterns.size(); ++i ) {
+			starPositions( _starPatterns[i], pointer );
+			fillStarsAndRollup( pointer, inspair, getDBpair, tableoldbuf, tablenewbuf, setindexnum, lpindex );
+		}
+	} else {
+		for ( int K = 1; K <= nonDateTimeCols; ++K ) {
+			starCombinations( nonDateTimeCols, K, inspair, getDBpair, tableoldbuf, tablenewbuf, setindexnum, lpindex );
+		}
 	}
 	free( tableoldbuf );
 	free( tablenewbuf );
@@ -3887,6 +4966,23 @@ int JagTable
 }
 
 void JagTable::doRollUp( const JagDBPair &inspair, const char *dbBuf, char *newbuf )
+{
+	if ( ! rollUpRow( inspair, dbBuf, newbuf ) ) {
+		return;
+	}
+
+	JagDBPair resPair;
+	resPair.point( newbuf, KEYLEN, newbuf+KEYLEN, VALLEN );
+	if ( _darrFamily->set( resPair ) ) {
+		prt(("s443010 _darrFamily->set OK\n" )); 
+	} else {
+		prt(("s444014 _darrFamily->set error\n" )); 
+	}
+}
+
+// newbuf: row dbBuf with the raw row inspair rolled up into it
+// return false if nothing was rolled up
+bool JagTable::rollUpRow( const JagDBPair &inspair, const char *dbBuf, char *newbuf )
 {
 	Jstr  colType, errmsg;
 	int   offset, length, sig;
@@ -3897,7 +4993,7 @@ void JagTable::doRollUp( const JagDBPair &inspair, const char *dbBuf, char *newb
 	memcpy( newbuf, dbBuf, KEYLEN+VALLEN );
 
 	if ( _counterOffset < 0 ) {
-		return;
+		return false;
 	}
 	char *inBuf = inspair.newBuffer(); 
 	double dbCounter = rayatof( dbBuf + _counterOffset, _counterLength );
@@ -3942,40 +5038,105 @@ void JagTable::doRollUp( const JagDBPair &inspair, const char *dbBuf, char *newb
 		rc = rollupType( name, colType, inv, dbCounter, dbBuf, newbuf, errmsg );
 		if ( rc ) { hasValidCol = true; }
 
-		name = rootname + "::avg";
-		rc = rollupType( name, colType, inv, dbCounter, dbBuf, newbuf, errmsg );
-		if ( rc ) { hasValidCol = true; }
+		name = rootname + "::avg";
+		rc = rollupType( name, colType, inv, dbCounter, dbBuf, newbuf, errmsg );
+		if ( rc ) { hasValidCol = true; }
+
+		if ( isInteger( colType ) ) {
+			sprintf( cbuf, "%lld", (long long)(round(inv)) );
+		} else { 
+			sprintf( cbuf, "%.10f", inv );
+		} 
+		formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", offset, length, sig, colType );
+
+	}
+
+	free( inBuf );
+
+	if ( ! hasValidCol ) {
+		prt(("s444034 rollup not done\n" )); 
+		return false;
+	}
+
+	dbCounter = dbCounter + 1.0; 
+	sprintf( cbuf, "%lld", (long long)(round(dbCounter)) );
+	rc = formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", _counterOffset, _counterLength, 0, JAG_C_COL_TYPE_DBIGINT );
+	if ( 1 != rc ) {
+		prt(("s402339 formatOneCol error\n"));
+		return false;
+	}
+	return true;
+}
+
+// merge buffered aggregate row aggpair into row dbBuf of the table and write it
+void JagTable::mergeRollUp( const JagDBPair &aggpair, const char *dbBuf, char *newbuf )
+{
+	if ( ! mergeRollupRow( aggpair, dbBuf, newbuf ) ) {
+		return;
+	}
+
+	JagDBPair resPair;
+	resPair.point( newbuf, KEYLEN, newbuf+KEYLEN, VALLEN );
+	if ( ! _darrFamily->set( resPair ) ) {
+		prt(("s444015 _darrFamily->set error\n" )); 
+	}
+}
+
+// newbuf: rollup row dbBuf merged with aggregate rollup row aggpair
+// return false if nothing was merged
+bool JagTable::mergeRollupRow( const JagDBPair &aggpair, const char *dbBuf, char *newbuf )
+{
+	Jstr  colType, errmsg, rootname;
+	int   offset, length, rc;
+	bool  hasValidCol = false;
+	char  cbuf[64];
+	memcpy( newbuf, dbBuf, KEYLEN+VALLEN );
+
+	if ( _counterOffset < 0 ) {
+		return false;
+	}
+	char *aggBuf = aggpair.newBuffer(); 
+	double dbCounter = rayatof( dbBuf + _counterOffset, _counterLength );
+	double aggCounter = rayatof( aggBuf + _counterOffset, _counterLength );
+
+	int totCols = _tableRecord.columnVector->size();
+	for ( int i = 0; i < totCols; i ++ ) {
+		if ( (*(_tableRecord.columnVector))[i].iskey ) continue;  
 
-		if ( isInteger( colType ) ) {
-			sprintf( cbuf, "%lld", (long long)(round(inv)) );
-		} else { 
-			sprintf( cbuf, "%.10f", inv );
+		colType = (*(_tableRecord.columnVector))[i].type;
+		if ( !isInteger( colType ) && ! isFloat( colType ) ) {
+			continue;
 		} 
-		formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", offset, length, sig, colType );
+		rootname = (*(_tableRecord.columnVector))[i].name.s();
+		if ( rootname.containsStr("::") || rootname == "counter" || rootname == "spare_" ) {
+			continue;
+		}
+
+		if ( mergeRollupType( rootname + "::sum", colType, aggCounter, dbCounter, aggBuf, dbBuf, newbuf, errmsg ) ) hasValidCol = true;
+		if ( mergeRollupType( rootname + "::min", colType, aggCounter, dbCounter, aggBuf, dbBuf, newbuf, errmsg ) ) hasValidCol = true;
+		if ( mergeRollupType( rootname + "::max", colType, aggCounter, dbCounter, aggBuf, dbBuf, newbuf, errmsg ) ) hasValidCol = true;
+		if ( mergeRollupType( rootname + "::var", colType, aggCounter, dbCounter, aggBuf, dbBuf, newbuf, errmsg ) ) hasValidCol = true;
+		if ( mergeRollupType( rootname + "::avg", colType, aggCounter, dbCounter, aggBuf, dbBuf, newbuf, errmsg ) ) hasValidCol = true;
 
+		// the column itself keeps the latest value
+		offset = (*(_tableRecord.columnVector))[i].offset;
+		length = (*(_tableRecord.columnVector))[i].length;
+		memcpy( newbuf+offset, aggBuf+offset, length );
 	}
+	free( aggBuf );
 
-	free( inBuf );
+	if ( ! hasValidCol ) {
+		prt(("s444035 rollup merge not done\n" )); 
+		return false;
+	}
 
-	if ( hasValidCol ) {
-		dbCounter = dbCounter + 1.0; 
-		sprintf( cbuf, "%lld", (long long)(round(dbCounter)) );
-		rc = formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", _counterOffset, _counterLength, 0, JAG_C_COL_TYPE_DBIGINT );
-		if ( 1 == rc ) { // OK
-			JagDBPair resPair;
-			resPair.point( newbuf, KEYLEN, newbuf+KEYLEN, VALLEN );
-			rc = _darrFamily->set( resPair );
-			if ( rc ) {
-				prt(("s443010 _darrFamily->set OK\n" )); 
-			} else {
-				prt(("s444014 _darrFamily->set error\n" )); 
-			}
-		} else {
-			prt(("s402339 formatOneCol error\n"));
-		}
-	} else {
-		prt(("s444034 rollup not done\n" )); 
+	sprintf( cbuf, "%lld", (long long)(round(dbCounter + aggCounter)) );
+	rc = formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", _counterOffset, _counterLength, 0, JAG_C_COL_TYPE_DBIGINT );
+	if ( 1 != rc ) {
+		prt(("s402340 formatOneCol error\n"));
+		return false;
 	}
+	return true;
 }
 
 bool JagTable
@@ -3983,7 +5144,7 @@ bool JagTable
               double dbCounter, const char *dbBuf, char *newbuf, Jstr &errmsg )
 {
 	double finv;
-	int rc, offset, length, sig, getpos;
+	int rc, offset, length, getpos;
 
 	Jstr dbcolName = _dbtable + "." + name;
 	rc = _tablemap->getValue( dbcolName, getpos);
@@ -3995,7 +5156,6 @@ bool JagTable
 	length = (*(_tableRecord.columnVector))[getpos].length;
 	double dbv = rayatof( dbBuf + offset, length );
 
-	char  cbuf[64];
 	if ( name.containsStr("::sum") ) {
 		finv = inv + dbv;
 	} else if ( name.containsStr("::avg") ) {
@@ -4018,7 +5178,7 @@ bool JagTable
 		int avgoffset = (*(_tableRecord.columnVector))[avgpos].offset;
 		int avglength = (*(_tableRecord.columnVector))[avgpos].length;
 		double avgVal = rayatof( dbBuf + avgoffset, avglength );
-		double avgNew = avgVal + ( double(inv) - avgVal)/dbCounter;
+		double avgNew = avgVal + ( double(inv) - avgVal)/( dbCounter + 1.0 );
 		finv = dbv + (inv - avgVal ) * ( inv - avgNew );
 		prt(("s43220 ::var dbv=%.3f inv=%.3f avgOff=%d avgL=%d avgV=%.5f avgN=%.4f finv=%.4f Cnt=%.4f\n", 
 			  dbv, inv, avgoffset, avglength, avgVal, avgNew, finv, dbCounter ));
@@ -4026,8 +5186,72 @@ bool JagTable
 		return false;
 	}
 
+	return formatRollupCol( getpos, colType, finv, newbuf, errmsg );
+}
+
+// merge statistic name of a buffered aggregate row (aggBuf, aggCounter raw rows) with
+// the statistic of the table row (dbBuf, dbCounter raw rows)
+bool JagTable
+::mergeRollupType( const Jstr &name, const Jstr &colType, double aggCounter, double dbCounter, 
+				   const char *aggBuf, const char *dbBuf, char *newbuf, Jstr &errmsg )
+{
+	double finv;
+	int rc, offset, length, getpos;
+
+	Jstr dbcolName = _dbtable + "." + name;
+	rc = _tablemap->getValue( dbcolName, getpos);
+	if ( ! rc ) {
+		return false;
+	}
+
+	double totCounter = dbCounter + aggCounter;
+	if ( totCounter < 1.0 ) return false;
+
+	offset = (*(_tableRecord.columnVector))[getpos].offset;
+	length = (*(_tableRecord.columnVector))[getpos].length;
+	double dbv = rayatof( dbBuf + offset, length );
+	double agv = rayatof( aggBuf + offset, length );
+
+	if ( name.containsStr("::sum") ) {
+		finv = dbv + agv;
+	} else if ( name.containsStr("::avg") ) {
+		finv = ( dbv*dbCounter + agv*aggCounter )/totCounter;
+	} else if ( name.containsStr("::min") ) {
+		finv = ( agv < dbv ) ? agv : dbv;
+	} else if ( name.containsStr("::max")  ) {
+		finv = ( agv > dbv ) ? agv : dbv;
+	} else if ( name.containsStr("::var")  ) {
+		// sums of squared deviations of two groups combine with their difference of means
+		const char *pc = strchr( name.s(), ':');
+		Jstr avgname(name.s(), pc-name.s() );
+		avgname += "::avg";
+		Jstr dbcolName = _dbtable + "." + avgname;
+		int avgpos;
+		rc = _tablemap->getValue( dbcolName, avgpos);
+		if ( ! rc ) {
+			return false;
+		}
+
+		int avgoffset = (*(_tableRecord.columnVector))[avgpos].offset;
+		int avglength = (*(_tableRecord.columnVector))[avgpos].length;
+		double dbAvg = rayatof( dbBuf + avgoffset, avglength );
+		double aggAvg = rayatof( aggBuf + avgoffset, avglength );
+		double d = aggAvg - dbAvg;
+		finv = dbv + agv + d*d*dbCounter*aggCounter/totCounter;
+	} else {
+		return false;
+	}
+
+	return formatRollupCol( getpos, colType, finv, newbuf, errmsg );
+}
+
+bool JagTable::formatRollupCol( int getpos, const Jstr &colType, double finv, char *newbuf, Jstr &errmsg )
+{
+	char  cbuf[64];
+	int offset = (*(_tableRecord.columnVector))[getpos].offset;
+	int length = (*(_tableRecord.columnVector))[getpos].length;
+	int sig = (*(_tableRecord.columnVector))[getpos].sig;
 	if ( length >= 63 ) return false;
-	sig = (*(_tableRecord.columnVector))[getpos].sig;
 
 	if ( isInteger( colType ) ) {
 		sprintf( cbuf, "%lld", (long long)(round(finv)) );
@@ -4037,7 +5261,7 @@ bool JagTable
 		return false;
 	}
 
-	rc = formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", offset, length, sig, colType );
+	int rc = formatOneCol( 0, 0, newbuf, cbuf, errmsg, "dummy", offset, length, sig, colType );
 	if ( 1 == rc ) {
 		return true;
 	} else {
@@ -4045,64 +5269,30 @@ bool JagTable
 	}
 }
 
+// replace the first datetime key (or key givenColName) in kbuf by the start of its window twindow
+// the key is read and written as an integer count of its time units
 bool JagTable::convertTimeToWindow( int tzdiff, const Jstr &twindow, char *kbuf, const Jstr &givenColName )
 {
-	bool 	iskey;
-	Jstr 	colType;
-	jagint  tval;
-	int  	offset, len;
-	jagint 	startTime;
-	Jstr 	errmsg, name;
 	char  	inbuf[32];
-	bool 	rc;
-	int 	srvtmdiff  = _servobj->servtimediff;
+	jagint  tval, units, startTime;
 
 	for ( int i = 0; i < (*_tableRecord.columnVector).size(); ++i ) {
-		iskey = (*(_tableRecord.columnVector))[i].iskey;
-		if ( ! iskey ) break; 
-		colType = (*_tableRecord.columnVector)[i].type;
-		if ( ! isDateAndTime( colType ) ) { continue; }
+		const JagColumn &col = (*_tableRecord.columnVector)[i];
+		if ( ! col.iskey ) break; 
+		if ( ! isDateAndTime( col.type ) ) { continue; }
+		if ( givenColName.size() > 0 && givenColName != col.name.s() ) { continue; }
 
-		name = (*_tableRecord.columnVector)[i].name.s();
-		if ( givenColName.size() > 0 ) {
-			if ( name != givenColName ) {
-				continue; 
-			}
-		} else {
-		}
+		units = JagTime::getTypeTime( 1, col.type );  // time units per second
+		if ( units < 1 ) { break; }
+
+		tval = rayatol( kbuf+col.offset, col.length ); 
+		startTime = segmentTime( tzdiff, tval/units, twindow ) * units;
 
-		offset = (*_tableRecord.columnVector)[i].offset;
-		len = (*_tableRecord.columnVector)[i].length;
-		tval = rayatol( kbuf+offset, len ); 
-
-		if ( colType == JAG_C_COL_TYPE_TIMESTAMPSEC  || colType == JAG_C_COL_TYPE_DATETIMESEC ) {
-			startTime = segmentTime( tzdiff, tval, twindow ); // seconds
-		} else if ( colType == JAG_C_COL_TYPE_TIMESTAMPMILL || colType == JAG_C_COL_TYPE_DATETIMESEC ) {
-			tval = tval / 1000; // to seconds
-			startTime = segmentTime( tzdiff, tval, twindow ); // seconds
-			startTime *= 1000;
-		} else if ( colType == JAG_C_COL_TYPE_DATETIME || colType == JAG_C_COL_TYPE_TIMESTAMP ) {
-			tval = tval / 1000000; // to seconds
-			startTime = segmentTime( tzdiff, tval, twindow ); // seconds
-			startTime *= 1000000;
-		} else if ( colType == JAG_C_COL_TYPE_TIMESTAMPNANO || colType == JAG_C_COL_TYPE_DATETIMENANO ) {
-			tval = tval / 1000000000; // to seconds
-			startTime = segmentTime( tzdiff, tval, twindow ); // seconds
-			startTime *= 1000000000;
-		}
-		prt(("s353402 process this col cvted tval=%lld\n", tval));
-
-		sprintf(inbuf, "%lld", startTime );
-		rc = formatOneCol( tzdiff, srvtmdiff, kbuf, inbuf, errmsg, name, offset, len, 0, colType );
-		if ( 1 != rc ) {
-			prt(("s0391838 error formatOneCol name=[%s] colType=[%s] rc=%d\n", name.s(), colType.s(), rc ));
+		if ( snprintf( inbuf, sizeof(inbuf), "%0*lld", col.length, startTime ) != col.length ) {
+			prt(("s0391838 error window key name=[%s] startTime=%lld\n", col.name.s(), startTime ));
 			return false;
-		} else {
-			prt(("s333301 formatOneCol name=[%s] colType=[%s] offset=%d len=%d tval=%lld startTime=%lld\n", 
-					name.s(), colType.s(), offset, len, tval, startTime, startTime ));
 		}
-		prt(("s033204 inbuf=[%s]\n", inbuf ));
-
+		memcpy( kbuf+col.offset, inbuf, col.length );
 		break;
 	}
 
@@ -4141,9 +5331,16 @@ jagint JagTable::segmentTime( int tzdiff, jagint tval, const Jstr &twindow )
 	return seg;
 }
 
+// isAggregate: inspair is a flushed row of the rollup buffer, not one raw row
 int JagTable::findPairRollupOrInsert( JagDBPair &inspair, JagDBPair &getDBpair, 
-									  char *tableoldbuf, char *tablenewbuf, int setindexnum, JagIndex *lpindex[] )
+									  char *tableoldbuf, char *tablenewbuf, int setindexnum, JagIndex *lpindex[],
+									  bool isAggregate )
 {
+	if ( _rollupBuf && ! isAggregate ) {
+		addRollupBuffer( inspair );
+		return 0;
+	}
+
 	int cnt;
 	bool didRollUp;
 	if (  ! _darrFamily->get( getDBpair ) ) {
@@ -4155,7 +5352,11 @@ int JagTable::findPairRollupOrInsert( JagDBPair &inspair, JagDBPair &getDBpair,
 		memset( tablenewbuf, 0, KEYVALLEN+1 );
 		getDBpair.toBuffer( tableoldbuf );
 
-		doRollUp( inspair, tableoldbuf, tablenewbuf );
+		if ( isAggregate ) {
+			mergeRollUp( inspair, tableoldbuf, tablenewbuf );
+		} else {
+			doRollUp( inspair, tableoldbuf, tablenewbuf );
+		}
 
 		cnt = 1;
 		didRollUp = true;
@@ -4174,6 +5375,488 @@ int JagTable::findPairRollupOrInsert( JagDBPair &inspair, JagDBPair &getDBpair,
 	return cnt;
 }
 
+// roll one row (window key, stars filled) up into its buffered row
+// caller holds the write lock of the table
+void JagTable::addRollupBuffer( const JagDBPair &inspair )
+{
+	JagFixMapIterator iter;
+	if ( _rollupBuf->insertIfAbsent( inspair, iter ) ) {
+		++ _rollupPending;
+		if ( _rollupPending >= _servobj->_rollupBufferMax ) {
+			flushRollupBuffer();
+		}
+		return;
+	}
+
+	char *kvbuf = (char*)jagmalloc( 2*KEYVALLEN+2 );
+	char *newbuf = kvbuf + KEYVALLEN+1;
+	memcpy( kvbuf, iter->first.c_str(), KEYLEN );
+	memcpy( kvbuf+KEYLEN, iter->second.c_str(), VALLEN );
+	if ( rollUpRow( inspair, kvbuf, newbuf ) ) {
+		iter->second = JagFixString( newbuf+KEYLEN, VALLEN, VALLEN );
+	}
+	free( kvbuf );
+}
+
+// write buffered rollup rows in key order, merged with the rows in the table
+// caller holds the write lock of the table
+// return number of rows written
+jagint JagTable::flushRollupBuffer()
+{
+	if ( ! _rollupBuf || _rollupPending < 1 ) return 0;
+
+	int setindexnum = 0;
+	JagIndex *lpindex[_indexlist.size()];
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		lpindex[i] = _objectLock->writeLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], 
+										   	    _tableschema, _indexschema, _replicateType, 1 );
+		++setindexnum; 
+	}
+
+	char *tableoldbuf = (char*)jagmalloc(KEYVALLEN+1);
+	char *tablenewbuf = (char*)jagmalloc(KEYVALLEN+1);
+	jagint cnt = 0;
+	JagFixMapIterator iter = _rollupBuf->getFirst();
+	while ( ! _rollupBuf->isAtEnd( iter ) ) {
+		JagDBPair aggpair( iter->first, iter->second );
+		JagDBPair getDBpair( iter->first );
+		findPairRollupOrInsert( aggpair, getDBpair, tableoldbuf, tablenewbuf, setindexnum, lpindex, true );
+		++cnt;
+		++iter;
+	}
+	_rollupBuf->clear();
+	_rollupPending = 0;
+	free( tableoldbuf );
+	free( tablenewbuf );
+
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		if ( ! lpindex[i] ) { continue; }
+		_objectLock->writeUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
+	}
+	return cnt;
+}
+
+// star pattern of a select on a lazy rollup table: key columns compared to '*' in the where
+// return true if the pattern has no rows yet
+bool JagTable::missingStarPattern( const JagParseParam *parseParam, jagint &mask )
+{
+	mask = 0;
+	if ( ! _lazyStars || parseParam->whereVec.size() < 1 || ! parseParam->whereVec[0].tree ) return false;
+
+	JagVector<ExprElementNode*> stack;
+	stack.append( parseParam->whereVec[0].tree->getRoot() );
+	const char *val, *p;
+	Jstr dbcolumn;
+	int  pos;
+	while ( stack.size() > 0 ) {
+		ExprElementNode *node = stack[stack.size()-1];
+		stack.removepos( stack.size()-1 );
+		if ( ! node || node->_isElement ) continue;
+		ExprElementNode *left = ((BinaryOpNode*)node)->_left;
+		ExprElementNode *right = ((BinaryOpNode*)node)->_right;
+		if ( JAG_FUNC_EQUAL != node->getBinaryOp() ) {
+			stack.append( left );
+			stack.append( right );
+			continue;
+		}
+		if ( ! left || ! right || ! left->_isElement || ! right->_isElement ) continue;
+		if ( left->_name.size() < 1 ) { ExprElementNode *t = left; left = right; right = t; }
+		if ( left->_name.size() < 1 || right->_name.size() > 0 || ! right->getValue( val ) ) continue;
+		if ( *val != JAG_STARC || *(val+1) != '\0' ) continue;
+
+		p = strrchr( left->_name.c_str(), '.' );
+		if ( p ) ++p; else p = left->_name.c_str();
+		dbcolumn = _dbtable + "." + p;
+		if ( ! _tablemap->getValue( dbcolumn, pos ) || pos >= _numKeys || pos >= 63 ) continue;
+		if ( isDateAndTime( (*(_tableRecord.columnVector))[pos].type ) ) continue;
+		mask |= ( (jagint)1 << pos );
+	}
+
+	return mask != 0 && ! hasStarPattern( mask );
+}
+
+bool JagTable::hasStarPattern( jagint mask ) const
+{
+	for ( int i = 0; i < _starPatterns.size(); ++i ) {
+		if ( _starPatterns[i] == mask ) return true;
+	}
+	return false;
+}
+
+// key columns of star pattern mask
+void JagTable::starPositions( jagint mask, JagVector<int> &pointer ) const
+{
+	pointer.clean();
+	for ( int i = 0; i < _numKeys && i < 63; ++i ) {
+		if ( mask & ( (jagint)1 << i ) ) pointer.append( i );
+	}
+}
+
+// kbuf (db format) is a star row
+bool JagTable::hasStars( const char *kbuf ) const
+{
+	for ( int i = 0; i < _numKeys; ++i ) {
+		if ( isDateAndTime( (*(_tableRecord.columnVector))[i].type ) ) continue;
+		if ( *(kbuf + (*(_tableRecord.columnVector))[i].offset) == JAG_STARC ) return true;
+	}
+	return false;
+}
+
+void JagTable::loadStarPatterns()
+{
+	_starPath = _cfg->getJDBDataHOME( _replicateType ) + "/" + _dbname + "/" + _tableName + "/" + _tableName + ".stars";
+	_starPatterns.clean();
+	if ( ! JagFileMgr::exist( _starPath ) ) return;
+
+	Jstr content;
+	JagFileMgr::readTextFile( _starPath, content );
+	JagStrSplit sp( content, '\n', true );
+	for ( int i = 0; i < sp.length(); ++i ) {
+		jagint mask = jagatoll( sp[i].c_str() );
+		if ( mask > 0 && ! hasStarPattern( mask ) ) _starPatterns.append( mask );
+	}
+}
+
+// build the rows of star pattern mask by aggregating the finest rows of the table;
+// from now on inserts keep them up to date
+// caller holds the write lock of the table
+// return number of star rows written
+jagint JagTable::materializeStars( jagint mask )
+{
+	if ( ! _lazyStars || mask <= 0 || hasStarPattern( mask ) ) return 0;
+
+	// buffered rollups must be in the finest rows
+	flushRollupBuffer();
+
+	JagVector<int> pointer;
+	starPositions( mask, pointer );
+	JagDBMap starmap;
+	JagFixMapIterator iter;
+	char *buf = (char*)jagmalloc(KEYVALLEN+1);
+	char *tableoldbuf = (char*)jagmalloc(KEYVALLEN+1);
+	char *tablenewbuf = (char*)jagmalloc(KEYVALLEN+1);
+
+	JagMinMax minmax;	
+	minmax.setbuflen( KEYLEN );
+	JagMergeReader *ntr = NULL;
+	_darrFamily->setFamilyRead( ntr, minmax.minbuf, minmax.maxbuf );
+	if ( ntr ) {
+		while ( ntr->getNext( buf ) ) {
+			dbNaturalFormatExchange( buf, _numKeys, _schAttr, 0,0, " " ); // natural format -> db format
+			if ( hasStars( buf ) ) continue;
+			JagDBPair row( buf, KEYLEN, buf+KEYLEN, VALLEN );
+			fillStars( pointer, row );
+			if ( starmap.insertIfAbsent( row, iter ) ) continue;
+
+			memcpy( tableoldbuf, iter->first.c_str(), KEYLEN );
+			memcpy( tableoldbuf+KEYLEN, iter->second.c_str(), VALLEN );
+			if ( mergeRollupRow( row, tableoldbuf, tablenewbuf ) ) {
+				iter->second = JagFixString( tablenewbuf+KEYLEN, VALLEN, VALLEN );
+			}
+		}
+		delete ntr;
+	}
+
+	int setindexnum = 0;
+	JagIndex *lpindex[_indexlist.size()];
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		lpindex[i] = _objectLock->writeLockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], 
+										   	    _tableschema, _indexschema, _replicateType, 1 );
+		++setindexnum; 
+	}
+
+	jagint cnt = 0;
+	iter = starmap.getFirst();
+	while ( ! starmap.isAtEnd( iter ) ) {
+		JagDBPair pair( iter->first, iter->second );
+		JagDBPair getDBpair( iter->first );
+		if ( ! _darrFamily->get( getDBpair ) ) {
+			insertPair( pair, 0, false );
+		} else {
+			// left by eager rollups; the rebuilt row replaces it
+			memset( tableoldbuf, 0, KEYVALLEN+1 );
+			memset( tablenewbuf, 0, KEYVALLEN+1 );
+			getDBpair.toBuffer( tableoldbuf );
+			pair.toBuffer( tablenewbuf );
+			_darrFamily->set( pair );
+			if ( setindexnum > 0 ) {
+				dbNaturalFormatExchange( tableoldbuf, _numKeys, _schAttr, 0,0, " " ); // db format -> natural format
+				dbNaturalFormatExchange( tablenewbuf, _numKeys, _schAttr, 0,0, " " ); // db format -> natural format
+				for ( int i = 0; i < setindexnum; ++i ) {
+					if ( lpindex[i] ) lpindex[i]->updateFromTable( tableoldbuf, tablenewbuf );
+				}
+			}
+		}
+		++cnt;
+		++iter;
+	}
+
+	for ( int i = 0; i < _indexlist.size(); ++i ) {
+		if ( ! lpindex[i] ) { continue; }
+		_objectLock->writeUnlockIndex( JAG_UPDATE_OP, _dbname, _tableName, _indexlist[i], _replicateType, 1 );
+	}
+	free( buf );
+	free( tableoldbuf );
+	free( tablenewbuf );
+
+	_starPatterns.append( mask );
+	Jstr content;
+	for ( int i = 0; i < _starPatterns.size(); ++i ) {
+		content += longToStr( _starPatterns[i] ) + "\n";
+	}
+	JagFileMgr::writeTextFile( _starPath, content );
+	raydebug( stdout, JAG_LOG_LOW, "rollup %s star pattern %l materialized with %l rows\n", _dbtable.s(), mask, cnt );
+	return cnt;
+}
+
+// position of key column colName, -1 if it is not a key column
+int JagTable::keyPosition( const Jstr &colName ) const
+{
+	int pos;
+	if ( colName.size() < 1 || colName.containsChar('.') ) return -1;
+	if ( ! _tablemap->getValue( _dbtable + "." + colName, pos ) || pos >= _numKeys ) return -1;
+	return pos;
+}
+
+// val of time key column pos starts a window twindow and the instant before it is in an earlier window,
+// so a bound on val selects whole rollup rows
+bool JagTable::isWindowStart( int tzdiff, const Jstr &twindow, int pos, const char *val )
+{
+	const JagColumn &col = (*(_tableRecord.columnVector))[pos];
+	Jstr	errmsg;
+	Jstr	name = col.name.s();
+	char 	inbuf[32];
+	bool 	rc = false;
+	char 	*kbuf = (char*)jagmalloc( KEYLEN+1 );
+	memset( kbuf, 0, KEYLEN+1 );
+
+	if ( 1 == formatOneCol( tzdiff, _servobj->servtimediff, kbuf, val, errmsg, name, col.offset, col.length, 0, col.type ) ) {
+		jagint tval = rayatol( kbuf+col.offset, col.length );
+		convertTimeToWindow( tzdiff, twindow, kbuf, name );
+		if ( rayatol( kbuf+col.offset, col.length ) == tval ) {
+			sprintf( inbuf, "%lld", tval - 1 );
+			if ( 1 == formatOneCol( tzdiff, _servobj->servtimediff, kbuf, inbuf, errmsg, name, col.offset, col.length, 0, col.type ) ) {
+				convertTimeToWindow( tzdiff, twindow, kbuf, name );
+				rc = rayatol( kbuf+col.offset, col.length ) < tval;
+			}
+		}
+	}
+
+	free( kbuf );
+	return rc;
+}
+
+// no row at or after stored time value qlo of time key column pos is expired under retention
+// ("0": rows are kept); qlo -1: no lower bound, so only kept rows are safe
+bool JagTable::retainsFrom( const Jstr &retention, int pos, jagint qlo )
+{
+	if ( retention.size() < 1 || retention == "0" ) return true;
+	time_t secs = JagSchemaRecord::getRetentionSeconds( retention );
+	if ( secs <= 0 ) return true;
+	if ( qlo < 0 ) return false;
+	const JagColumn &col = (*(_tableRecord.columnVector))[pos];
+	return qlo >= (jagint)JagTime::getTypeTime( time(NULL) - secs, col.type );
+}
+
+// rewrite an aggregate select of this table to the coarsest rollup table that answers it
+// routed: sum/min/max of rollup columns and count, grouped by dimension keys or window() of the time key,
+//         filtered by '=' on dimension keys and by ">=" and "<" on the time key at window boundaries
+// dimension keys neither grouped nor filtered read the '*' rows of the rollup table
+// the raw table and the rollup table each expire rows by their own retention; a window is used
+// only if neither can have expired rows of the queried range
+// rollupTable: "table@window"  rollupCmd: select to run on it
+bool JagTable::routeToRollup( int tzdiff, const JagParseParam *parseParam, Jstr &rollupTable, Jstr &rollupCmd )
+{
+	Jstr tser;
+	if ( _tableName.containsChar('@') || ! hasTimeSeries( tser ) ) return false;
+	if ( JAG_SELECT_OP != parseParam->opcode || parseParam->objectVec.size() != 1 ) return false;
+	if ( parseParam->_selectStar || parseParam->hasHaving || parseParam->hasPivot || parseParam->hasExport ) return false;
+	if ( parseParam->selColVec.size() < 1 ) return false;
+	if ( parseParam->hasWhere && parseParam->whereVec.size() != 1 ) return false;
+
+	int tpos = _tableRecord.getFirstDateTimeKeyCol();
+	if ( tpos < 0 || tpos >= _numKeys ) return false;
+	Jstr tname = (*(_tableRecord.columnVector))[tpos].name.s();
+
+	Jstr period, wcol;
+	if ( parseParam->window.size() > 0 ) {
+		if ( ! ((JagParseParam*)parseParam)->getWindowPeriod( parseParam->window, period, wcol ) || wcol != tname ) return false;
+	}
+
+	// key usage: 1 grouped  2 equal to a value
+	JagVector<int> keyUse;
+	for ( int i = 0; i < _numKeys; ++i ) keyUse.append( 0 );
+
+	int pos;
+	for ( int i = 0; i < parseParam->groupVec.size(); ++i ) {
+		pos = keyPosition( parseParam->groupVec[i].name );
+		if ( pos < 0 || pos == tpos ) return false;
+		keyUse[pos] |= 1;
+	}
+
+	for ( int i = 0; i < parseParam->orderVec.size(); ++i ) {
+		pos = keyPosition( parseParam->orderVec[i].name );
+		if ( pos < 0 ) return false;
+		if ( pos == tpos ) { 
+			if ( period.size() < 1 ) return false; 
+		} else if ( ! ( keyUse[pos] & 1 ) ) {
+			return false;
+		}
+	}
+
+	Jstr cols, item, expr, fname, arg;
+	const char *p;
+	for ( int i = 0; i < parseParam->selColVec.size(); ++i ) {
+		const SelColAttribute &scol = parseParam->selColVec[i];
+		if ( scol.asName.containsChar('\'') ) return false;
+		expr = trimChar( scol.origFuncStr, ' ' );
+		p = strchr( expr.s(), '(' );
+		if ( ! p ) {
+			// grouped key column
+			pos = keyPosition( expr );
+			if ( pos < 0 ) return false;
+			if ( pos == tpos ) { 
+				if ( period.size() < 1 ) return false; 
+			} else if ( ! ( keyUse[pos] & 1 ) ) {
+				return false;
+			}
+			item = expr;
+			if ( scol.givenAsName ) item += Jstr(" as '") + scol.asName + "'";
+		} else {
+			if ( expr.lastChar() != ')' || strchr( p+1, '(' ) ) return false;
+			fname = makeLowerString( trimChar( Jstr( expr.s(), p-expr.s() ), ' ' ) );
+			arg = trimChar( expr.substrc( '(', ')' ), ' ' );
+			if ( fname == "count" ) {
+				if ( arg != "*" && arg != "1" && ! _tablemap->keyExist( _dbtable + "." + arg ) ) return false;
+				item = "sum(counter)";
+			} else if ( fname == "sum" || fname == "min" || fname == "max" ) {
+				if ( arg.containsChar('.') || ! _tablemap->getValue( _dbtable + "." + arg, pos ) ) return false;
+				if ( pos < _numKeys || ! (*(_tableRecord.columnVector))[pos].isrollup ) return false;
+				item = fname + "(" + arg + "::" + fname + ")";
+			} else {
+				return false;
+			}
+			item += Jstr(" as '") + scol.asName + "'";
+		}
+
+		if ( cols.size() < 1 ) {
+			cols = item;
+		} else {
+			cols += Jstr(", ") + item;
+		}
+	}
+
+	// where: conjunction of key conditions
+	JagVector<Jstr> bounds;
+	jagint qlo = -1, tval;
+	Jstr errmsg;
+	char *kbuf = (char*)jagmalloc( KEYLEN+1 );
+	if ( parseParam->hasWhere ) {
+		if ( ! parseParam->whereVec[0].tree ) return false;
+		JagVector<ExprElementNode*> stack;
+		stack.append( parseParam->whereVec[0].tree->getRoot() );
+		const char *val;
+		int  op;
+		while ( stack.size() > 0 ) {
+			ExprElementNode *node = stack[stack.size()-1];
+			stack.removepos( stack.size()-1 );
+			if ( ! node || node->_isElement ) { free( kbuf ); return false; }
+			ExprElementNode *left = ((BinaryOpNode*)node)->_left;
+			ExprElementNode *right = ((BinaryOpNode*)node)->_right;
+			op = node->getBinaryOp();
+			if ( JAG_LOGIC_AND == op ) {
+				stack.append( left );
+				stack.append( right );
+				continue;
+			}
+			if ( ! left || ! right || ! left->_isElement || ! right->_isElement 
+				 || left->_name.size() < 1 || right->_name.size() > 0 || ! right->getValue( val ) 
+				 || ( pos = keyPosition( left->_name ) ) < 0 ) {
+				free( kbuf );
+				return false;
+			}
+			if ( pos == tpos ) {
+				if ( JAG_FUNC_GREATEREQUAL != op && JAG_FUNC_LESSTHAN != op ) { free( kbuf ); return false; }
+				bounds.append( val );
+				if ( JAG_FUNC_GREATEREQUAL == op ) {
+					const JagColumn &col = (*(_tableRecord.columnVector))[tpos];
+					memset( kbuf, 0, KEYLEN+1 );
+					if ( 1 == formatOneCol( tzdiff, _servobj->servtimediff, kbuf, val, errmsg, tname, col.offset, col.length, 0, col.type ) ) {
+						tval = rayatol( kbuf+col.offset, col.length );
+						if ( tval > qlo ) qlo = tval;
+					}
+				}
+			} else if ( isDateAndTime( (*(_tableRecord.columnVector))[pos].type ) ) {
+				// other time keys are not windowed
+				if ( op < JAG_FUNC_EQUAL || op > JAG_FUNC_GREATEREQUAL ) { free( kbuf ); return false; }
+			} else {
+				if ( JAG_FUNC_EQUAL != op || ( *val == JAG_STARC && *(val+1) == '\0' ) ) { free( kbuf ); return false; }
+				keyUse[pos] |= 2;
+			}
+		}
+	}
+	free( kbuf );
+	if ( ! retainsFrom( timeSeriesRentention(), tpos, qlo ) ) return false;
+
+	// coarsest window that divides the query window and whose boundaries are the time bounds
+	JagStrSplit sp( tser, ',', true );
+	Jstr  best;
+	time_t bestSecs = 0, secs;
+	int	  j;
+	for ( int i = 0; i < sp.length(); ++i ) {
+		secs = JagSchemaRecord::getRetentionSeconds( sp[i] );
+		if ( secs <= bestSecs ) continue;
+		if ( period.size() > 0 ) {
+			if ( period.lastChar() != sp[i].lastChar() || sp[i].toInt() < 1 || period.toInt() % sp[i].toInt() != 0 ) continue;
+		}
+		for ( j = 0; j < bounds.size(); ++j ) {
+			if ( ! isWindowStart( tzdiff, sp[i], tpos, bounds[j].s() ) ) break;
+		}
+		if ( j < bounds.size() ) continue;
+		const JagSchemaRecord *rrec = _tableschema->getAttr( _dbtable + "@" + sp[i] );
+		if ( ! rrec || ! retainsFrom( rrec->timeSeriesRentention(), tpos, qlo ) ) continue;
+		best = sp[i];
+		bestSecs = secs;
+	}
+	if ( best.size() < 1 ) return false;
+
+	Jstr stars;
+	for ( int i = 0; i < _numKeys; ++i ) {
+		if ( keyUse[i] & 2 ) continue;
+		if ( isDateAndTime( (*(_tableRecord.columnVector))[i].type ) ) continue;
+		item = (*(_tableRecord.columnVector))[i].name.s();
+		if ( keyUse[i] & 1 ) {
+			item += " <> '*'";
+		} else {
+			item += " = '*'";
+		}
+
+		if ( stars.size() < 1 ) {
+			stars = item;
+		} else {
+			stars += Jstr(" and ") + item;
+		}
+	}
+
+	rollupTable = _tableName + "@" + best;
+	rollupCmd = "select ";
+	if ( parseParam->window.size() > 0 ) rollupCmd += parseParam->window + ", ";
+	rollupCmd += cols + " from " + _dbname + "." + rollupTable;
+	if ( parseParam->hasWhere && stars.size() > 0 ) {
+		rollupCmd += Jstr(" where (") + parseParam->selectWhereClause + ") and " + stars;
+	} else if ( parseParam->hasWhere ) {
+		rollupCmd += Jstr(" where ") + parseParam->selectWhereClause;
+	} else if ( stars.size() > 0 ) {
+		rollupCmd += Jstr(" where ") + stars;
+	}
+
+	if ( parseParam->hasGroup ) rollupCmd += Jstr(" group by ") + parseParam->selectGroupClause;
+	if ( parseParam->hasOrder ) rollupCmd += Jstr(" order by ") + parseParam->selectOrderClause;
+	if ( parseParam->hasLimit ) rollupCmd += Jstr(" limit ") + parseParam->selectLimitClause;
+	if ( parseParam->hasTimeout ) rollupCmd += Jstr(" timeout ") + parseParam->selectTimeoutClause;
+	return true;
+}
+
 void JagTable::initStarPositions( JagVector<int> &pointer, int K )
 {
 	bool iskey;
@@ -4302,7 +5985,10 @@ jagint JagTable::cleanupOldRecords( time_t tsec )
 			return 0;
 		}
 
-		jagint cnt = cleanupOldRecordsByOrderOrScan( 0, ttime, true );
+		jagint cnt = cleanupOldRecordsByRange( ttime );
+		if ( cnt < 0 ) {
+			cnt = cleanupOldRecordsByOrderOrScan( 0, ttime, true );
+		}
 		return cnt;
 	} else {
 		int colidx = _tableRecord.getFirstDateTimeKeyCol();
@@ -4321,6 +6007,35 @@ jagint JagTable::cleanupOldRecords( time_t tsec )
 	}
 }
 
+// Rows with first key column before ttime are deleted as one key range. Data files with
+// only such rows are removed; other rows are hidden and dropped when their file is merged.
+// return number of rows removed from files, -1 if the range can not be deleted
+jagint JagTable::cleanupOldRecordsByRange( time_t ttime )
+{
+	if ( ! canRangeDelete() ) return -1;
+
+	const JagColumn &tcol = (*_tableRecord.columnVector)[0];
+	char numbuf[32];
+	if ( tcol.offset != 0 || tcol.length < 1 || tcol.length >= sizeof(numbuf)
+		 || snprintf( numbuf, sizeof(numbuf), "%0*lld", (int)tcol.length, (long long)ttime ) != (int)tcol.length ) {
+		return -1;
+	}
+
+	JagRangeDelete rd;
+	rd.cmplen = tcol.length;
+	char *buf = (char*)jagmalloc( KEYLEN+1 );
+	memset( buf, 0, KEYLEN+1 );
+	rd.lo = JagFixString( buf, KEYLEN, KEYLEN );
+	memset( buf, 255, KEYLEN );
+	memcpy( buf, numbuf, tcol.length );
+	rd.hi = JagFixString( buf, KEYLEN, KEYLEN );
+	rd.hiIncl = false;
+	free( buf );
+
+	if ( ! _darrFamily->deleteRange( rd ) ) return -1;
+	return _darrFamily->dropCoveredFiles();
+}
+
 jagint JagTable::cleanupOldRecordsByOrderOrScan( int idx, time_t ttime, bool byOrder )
 {
 	jagint cnt = 0;
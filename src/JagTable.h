@@ -74,11 +74,13 @@ class JagTable
 	void 	getlimitStart( jagint &startlen, jagint limitstart, jagint& soffset, jagint &foffset ); 
 
 	int 	insert( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
+	jagint 	insertPairs( const JagRequest &req, const JagVector<JagDBPair> &pairVec, JagVector<int> &okVec );
 	int 	finsert( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
 	int 	cinsert( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
 	int 	dinsert( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
 
 	int 	parsePair( int tzdiff, JagParseParam *parseParam, JagVector<JagDBPair> &pairVec, Jstr &errmsg ) const;
+	int 	parseRowPair( int tzdiff, JagParseParam *parseParam, JagVector<JagDBPair> &pairVec, Jstr &errmsg ) const;
 	static int 	parseSimplePair( int tzdiff, int srvtmdiff, int numCols, int numKeys,
 								jagint KEYLEN, jagint VALLEN, jagint KVLEN,
                                 const JagHashStrInt *tablemap,
@@ -90,6 +92,8 @@ class JagTable
                                 JagDBPair &retpair, Jstr &errmsg );
 
 	int 	insertPair( JagDBPair &pair, int mode, bool doIndexLock ); 
+	void 	applyIndexPending();
+	static void applyIndexPendingStatic( void *ptr );
 	Jstr 	drop( Jstr &errmsg, bool isTruncate=false );
 	int 	renameIndexColumn ( const JagParseParam *parseParam, Jstr &errmsg );
 	int 	setIndexColumn ( const JagParseParam *parseParam, Jstr &errmsg );
@@ -98,11 +102,21 @@ class JagTable
 	void 	setGetFileAttributes( const Jstr &hdir, JagParseParam *parseParam, const char *buffers[] );
 	int 	rollupPair( const JagRequest &req, JagDBPair &inpair, const JagVector<OtherAttribute> &rollupVec );
 	void 	doRollUp( const JagDBPair &inspair, const char *dbBuf, char *newbuf );
+	jagint	flushRollupBuffer();
+	jagint	rollupPending() const { return _rollupPending; }
+	bool	missingStarPattern( const JagParseParam *parseParam, jagint &mask );
+	jagint	materializeStars( jagint mask );
+	bool	routeToRollup( int tzdiff, const JagParseParam *parseParam, Jstr &rollupTable, Jstr &rollupCmd );
 	bool 	convertTimeToWindow( int timediff, const Jstr &twindow, char *kbuf, const Jstr &colName );
 	jagint  segmentTime( int tzdiff, jagint tval, const Jstr &twindow ); // seconds
 
 	jagint update( const JagRequest &req, const JagParseParam *parseParam, bool upsert, Jstr &errmsg );
+	jagint mergeUpdate( const JagRequest &req, const JagParseParam *parseParam, const char *cmd, Jstr &errmsg );
+	static bool getMergeDelta( ExprElementNode *root, const Jstr &colName, Jstr &delta );
 	jagint remove( const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );	
+	bool 	canRangeDelete() const;
+	bool 	getDeleteRange( const JagRequest &req, const JagParseParam *parseParam, JagRangeDelete &rd );
+	static bool isRangeDeleteValue( const JagSchemaAttribute &attr, const char *val );
 	jagint getCount( const char *cmd, const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
 	jagint getElements( const char *cmd, const JagRequest &req, JagParseParam *parseParam, Jstr &errmsg );
 	jagint select( JagDataAggregate *&jda, const char *cmd, const JagRequest &req, JagParseParam *parseParam, 
@@ -132,8 +146,21 @@ class JagTable
 				JaguarCPPClient *pcli, const Jstr &iscmd );
 
 	int formatIndexCmd( JagDBPair &pair, int mode, bool doIndexLock );
+	jagint ingestSortedFile( const JagRequest &req, const Jstr &fpath, const Jstr &format, Jstr &errmsg );
+	jagint ingestKVFile( const Jstr &fpath, Jstr &errmsg );
+	jagint ingestCSVFile( const JagRequest &req, const Jstr &fpath, Jstr &errmsg );
+	bool   parseCSVBatch( const JagRequest &req, const Jstr &cmd, JagVector<JagDBPair> &pairVec, Jstr &errmsg );
+	jagint parseCSVFileParallel( const JagRequest &req, const Jstr &fpath, bool insert, JagVector<JagDBPair> &pairVec, Jstr &errmsg );
+	jagint loadCSVFile( const JagRequest &req, const Jstr &fpath, Jstr &errmsg );
+	static void *parallelParseCSVStatic( void *ptr );
+	bool   checkIngestKey( const char *kbuf, char *lastkey, jagint pos, Jstr &errmsg );
+	void   indexIngested( const char *kvbufs, jagint num );
 	int formatCreateIndex( JagIndex *pindex );
+	int formatCreateIndexByRow( JagIndex *pindex );
+	jagint mergeIndexRuns( JagIndex *pindex, const JagVector<Jstr> &runVec, jagint rows );
 	static void *parallelCreateIndexStatic( void * ptr );
+	static void addIndexBuildRow( ParallelIndexBuildPass *pass, char *tablebuf );
+	static void writeIndexBuildRun( ParallelIndexBuildPass *pass );
 
 	void   	flushBlockIndexToDisk();
 	Jstr 	getIndexNameList();
@@ -195,7 +222,19 @@ class JagTable
                          int &getid, int &getcol, int &getm, int &getn, int &geti ) const;
 
 	int     findPairRollupOrInsert( JagDBPair &inspair, JagDBPair &getDBPair,
-                                    char *tableoldbuf, char *tablenewbuf, int setindexnum, JagIndex *lpindex[] );
+                                    char *tableoldbuf, char *tablenewbuf, int setindexnum, JagIndex *lpindex[],
+									bool isAggregate=false );
+	void 	addRollupBuffer( const JagDBPair &inspair );
+	bool 	rollUpRow( const JagDBPair &inspair, const char *dbBuf, char *newbuf );
+	void 	mergeRollUp( const JagDBPair &aggpair, const char *dbBuf, char *newbuf );
+	bool 	mergeRollupRow( const JagDBPair &aggpair, const char *dbBuf, char *newbuf );
+	bool 	hasStarPattern( jagint mask ) const;
+	void 	starPositions( jagint mask, JagVector<int> &pointer ) const;
+	bool 	hasStars( const char *kbuf ) const;
+	void 	loadStarPatterns();
+	int 	keyPosition( const Jstr &colName ) const;
+	bool 	isWindowStart( int tzdiff, const Jstr &twindow, int pos, const char *val );
+	bool	retainsFrom( const Jstr &retention, int pos, jagint qlo );
 
 	void 	initStarPositions( JagVector<int> &pointer, int K );
 	void 	fillStarsAndRollup( const JagVector<int> &pointer, JagDBPair &inspair, JagDBPair &getDBpair,
@@ -208,8 +247,18 @@ class JagTable
 	int 	findNextFreePosition( int startPosition );
 	void 	fillStars( const JagVector<int> &pointer, JagDBPair &starDBPair );
 	jagint 	cleanupOldRecordsByOrderOrScan( int colidx, time_t ttime, bool byOrder );
+	jagint 	cleanupOldRecordsByRange( time_t ttime );
 	bool    rollupType( const Jstr &name, const Jstr &colType, double inv, double dbCounter, 
 					    const char *dbBuf, char *newbuf, Jstr &errmsg );
+	bool    mergeRollupType( const Jstr &name, const Jstr &colType, double aggCounter, double dbCounter, 
+					    	 const char *aggBuf, const char *dbBuf, char *newbuf, Jstr &errmsg );
+	bool    formatRollupCol( int getpos, const Jstr &colType, double finv, char *newbuf, Jstr &errmsg );
+
+	JagDBMap					*_rollupBuf;      // buffered rollup rows of a rollup table; NULL if not buffered
+	std::atomic<jagint>			_rollupPending;   // rows in _rollupBuf
+	bool						_lazyStars;       // star rows only for patterns in _starPatterns
+	JagVector<jagint>			_starPatterns;    // bit i set: key column i is '*'
+	Jstr						_starPath;        // file of _starPatterns, one per line
 
 
 };
@@ -26,6 +26,7 @@
 #include <JagSchemaAttribute.h>
 #include <JagParseAttribute.h>
 #include <JagMinMax.h>
+#include <JagVector.h>
 
 class JagCfg;
 class JagSchemaRecord;
@@ -40,6 +41,7 @@ class JagParseParam;
 class JagMemDiskSortArray;
 class JagDiskArrayServer;
 class JagDiskArrayFamily;
+class JagDBPair;
 class JagDataAggregate;
 class JagSchemaAttribute;
 class JagHashStrInt;
@@ -183,6 +185,67 @@ class ParallelCmdPass
 	}
 };
 
+// one worker of a parallel index build
+class ParallelIndexBuildPass
+{
+  public:
+	JagTable *ptab;
+	JagIndex *pindex;
+	int pos;
+	const JagVector<OnefileRange> *taskVec;  // table file slices; darr NULL is the insert buffer
+	std::atomic<jagint> *nextTask;
+	Jstr runPrefix;
+	JagVector<Jstr> runVec;  // sorted run files written
+	char *runbuf;
+	jagint nrecs;  // records in runbuf
+	jagint maxrecs;
+	jagint rows;
+	bool error;
+
+	ParallelIndexBuildPass() {
+		ptab = NULL;
+		pindex = NULL;
+		pos = 0;
+		taskVec = NULL;
+		nextTask = NULL;
+		runbuf = NULL;
+		nrecs = 0;
+		maxrecs = 0;
+		rows = 0;
+		error = false;
+	}
+};
+
+// one parser thread of a byte range of a csv file
+class ParallelCSVParsePass
+{
+  public:
+	JagTable *ptab;
+	const JagRequest *req;
+	int fd;
+	jagint start;
+	jagint end;
+	jagint first;  // offsets of first record and after last record parsed
+	jagint last;
+	bool insert;  // insert parsed rows, or keep them in pairVec
+	JagVector<JagDBPair> *pairVec;
+	jagint rows;
+	bool error;
+	Jstr errmsg;
+
+	ParallelCSVParsePass() {
+		ptab = NULL;
+		req = NULL;
+		fd = -1;
+		start = end = 0;
+		first = last = 0;
+		insert = false;
+		pairVec = NULL;
+		rows = 0;
+		error = false;
+	}
+};
+
 class ParallelJoinPass
 {
   public:
@@ -54,6 +54,30 @@ JagTextFileBuffReader::JagTextFileBuffReader ( int fd, char linesep )
 	_buf = (char*)jagmalloc(2*NB);
 	_inDoubleQuote = 0;
 	_connectNextlineDQ = 0;
+	_end = -1;
+	_start = 0;
+	_quote = 0;
+	_escaped = false;
+}
+
+// reader of the records starting in byte range [start, end) of a file, for getRecord()
+// start need not be a line start: the reader skips to the next line start, and the
+// last record may run past end
+JagTextFileBuffReader::JagTextFileBuffReader ( int fd, jagint start, jagint end, char linesep )
+{
+	_fd = fd;
+	_sep = linesep;
+	_cursor = 0;
+	_buflen = 0;
+	_eof = false;
+	_fdPos = start;
+	_buf = (char*)jagmalloc(2*NB);
+	_inDoubleQuote = 0;
+	_connectNextlineDQ = 0;
+	_end = end;
+	_start = -1;
+	_quote = 0;
+	_escaped = false;
 }
 
 void JagTextFileBuffReader::connectNextlineDQ()
@@ -285,3 +309,108 @@ bool JagTextFileBuffReader::readNextBlock( int length )
 	return true;
 }
 
+// get next record without the separator and a trailing \r
+// a record may span lines inside quotes; a quote escaped by \ does not count
+bool JagTextFileBuffReader::getRecord( Jstr &rec )
+{
+	rec = "";
+	if ( _start < 0 && ! syncRange() ) {
+		return false;
+	}
+	if ( _end >= 0 && position() >= _end ) {
+		return false;
+	}
+
+	bool got = false;
+	bool esc;
+	char c;
+	jagint from;
+	while ( 1 ) {
+		if ( _cursor >= _buflen ) {
+			if ( ! readRangeBlock() ) {
+				return got;
+			}
+		}
+
+		got = true;
+		from = _cursor;
+		while ( _cursor < _buflen ) {
+			c = _buf[_cursor];
+			esc = _escaped;
+			_escaped = ( '\\' == c && ! esc );
+			if ( _quote ) {
+				if ( c == _quote && ! esc ) _quote = 0;
+			} else if ( ( '\'' == c || '"' == c ) && ! esc ) {
+				_quote = c;
+			} else if ( c == _sep ) {
+				rec.append( _buf+from, _cursor-from );
+				++ _cursor;
+				if ( rec.size() > 0 && '\r' == rec[rec.size()-1] ) {
+					rec = Jstr( rec.c_str(), rec.size()-1, rec.size()-1 );
+				}
+				return true;
+			}
+			++ _cursor;
+		}
+		rec.append( _buf+from, _cursor-from );
+	}
+}
+
+// skip the line that the byte range starts in, unless the range starts a line
+// return false if no line starts in the rest of the file
+bool JagTextFileBuffReader::syncRange()
+{
+	_start = _fdPos;
+	if ( 0 == _fdPos ) return true;
+
+	-- _fdPos;
+	char *p;
+	while ( 1 ) {
+		if ( ! readRangeBlock() ) {
+			_start = _fdPos;
+			return false;
+		}
+		p = (char*)memchr( _buf, _sep, _buflen );
+		if ( p ) {
+			_cursor = p - _buf + 1;
+			_start = position();
+			return true;
+		}
+		_cursor = _buflen;
+	}
+}
+
+// read the next block; past the end of the range, only small blocks to finish the last record
+bool JagTextFileBuffReader::readRangeBlock()
+{
+	jagint len = NB;
+	if ( _end >= 0 && _fdPos >= _end ) {
+		len = 64*1024;
+	}
+
+	ssize_t n = jagpread( _fd, _buf, len, _fdPos );
+	if ( n <= 0 ) {
+		_eof = true;
+		return false;
+	}
+	_fdPos += n;
+	_buflen = n;
+	_cursor = 0;
+	return true;
+}
+
+// Split a text file of fsize bytes into num byte ranges of equal size for parallel
+// readers. Ranges are not aligned to lines: a reader of a range skips to its first
+// line start and finishes the record running past its end, see syncRange().
+// bounds: range i is [bounds[i], bounds[i+1])
+// return number of ranges
+int JagTextFileBuffReader::splitRanges( jagint fsize, int num, JagVector<jagint> &bounds )
+{
+	bounds.clean();
+	if ( num < 1 || fsize < num ) num = 1;
+	for ( int i = 0; i < num; ++i ) {
+		bounds.append( fsize/num*i );
+	}
+	bounds.append( fsize );
+	return num;
+}
@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <JagUtil.h>
+#include <JagVector.h>
 
 //class JDFS;
 
@@ -31,12 +32,21 @@ class JagTextFileBuffReader
   public:
   	JagTextFileBuffReader( const JDFS *jdfs, char linesep );
   	JagTextFileBuffReader( int fd, char linesep='\n' );
+  	JagTextFileBuffReader( int fd, jagint start, jagint end, char linesep='\n' );
   	~JagTextFileBuffReader( ); 
   	bool getLine ( char *keyvalbuf, int length, int *size );
 	void connectNextlineDQ();
 
+	// records starting in a byte range; linesep inside single or double quotes does not end a record
+	bool getRecord( Jstr &rec );
+	jagint position() const { return _fdPos - _buflen + _cursor; }
+	jagint rangeStart() const { return _start; }
+	static int splitRanges( jagint fsize, int num, JagVector<jagint> &bounds );
+
   protected:
 	bool readNextBlock( int length );
+	bool readRangeBlock();
+	bool syncRange();
 	char   _sep;
 	// char   _qsep;
 	int    _fd;
@@ -51,6 +61,11 @@ class JagTextFileBuffReader
 	//const JDFS  *_jdfs;
 	bool  _inDoubleQuote;
 	bool _connectNextlineDQ;
+
+	jagint  _end;   // end of byte range, -1 is end of file
+	jagint  _start; // first line start at or after start of byte range; -1 not synced yet
+	char    _quote;
+	bool    _escaped;
 };
 
 #endif
@@ -918,145 +918,162 @@ bool JagTime::getDateFromStr( const char *instr, char *outstr )
 	return res;
 }
 
-// cycle: 1,2,3,4,6,8,12
-jagint JagTime::getStartTimeSecOfSecond( time_t tsec, int cycle )
+// Window start times are computed with integer arithmetic on epoch seconds.
+// The fields of the UTC time are truncated to the window and read back as server standard
+// time, as a gmtime_r() and mktime() pair would, so the result is the UTC window start
+// minus the offset of the server zone.
+
+// days since 1970-01-01 of proleptic Gregorian date y-m-d (m: 1-12, d: 1-31)
+jagint JagTime::daysFromCivil( jagint y, int m, int d )
 {
-	struct tm result;
-	gmtime_r( &tsec, &result );
-	int startsec = (result.tm_sec/cycle) * cycle;
+	y -= ( m <= 2 );
+	jagint era = ( y >= 0 ? y : y - 399 ) / 400;
+	jagint yoe = y - era * 400;
+	jagint doy = ( 153 * ( m + ( m > 2 ? -3 : 9 ) ) + 2 ) / 5 + d - 1;
+	jagint doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+	return era * 146097 + doe - 719468;
+}
 
-	result.tm_sec = startsec;
-	time_t  t = mktime( &result );
-	return t;
+// date y-m-d of days since 1970-01-01
+void JagTime::civilFromDays( jagint z, jagint &y, int &m, int &d )
+{
+	z += 719468;
+	jagint era = ( z >= 0 ? z : z - 146096 ) / 146097;
+	jagint doe = z - era * 146097;
+	jagint yoe = ( doe - doe/1460 + doe/36524 - doe/146096 ) / 365;
+	jagint doy = doe - ( 365*yoe + yoe/4 - yoe/100 );
+	jagint mp = ( 5*doy + 2 ) / 153;
+	d = doy - ( 153*mp + 2 )/5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = yoe + era * 400 + ( m <= 2 );
 }
 
-// cycle: 1,2,3,4,6,8,12
-jagint JagTime::getStartTimeSecOfMinute( time_t tsec, int cycle )
+// offset of server standard time for the UTC fields of t, as gmtime_r() and mktime() give it
+static inline jagint stdOffset( jagint t )
 {
 	struct tm result;
-	
-	gmtime_r( &tsec, &result );
-	int startmin = (result.tm_min/cycle) * cycle; 
-	prt(("s22220 tm_isdst=%d\n", result.tm_isdst ));
+	time_t tt = t;
+	gmtime_r( &tt, &result );
+	return t - (jagint)mktime( &result );
+}
 
-	result.tm_sec = 0;
-	result.tm_min = startmin;
+// UTC window start utcStart read as server standard time
+// the offset of the zone is taken from mktime() once per hour of time, cached per thread.
+// An hour whose offset differs at its two ends holds a zone change: every window start in
+// it goes through mktime(). The cache is also dropped when TZ is set to another zone.
+static inline jagint serverStdTime( jagint utcStart )
+{
+	static thread_local jagint t_hour = -1;
+	static thread_local jagint t_offset = 0;
+	static thread_local bool t_exact = false;
+	static thread_local const char *t_tz = NULL;
+	if ( utcStart < 0 ) return utcStart - stdOffset( utcStart );
+
+	jagint hour = utcStart / 3600;
+	const char *tz = getenv("TZ");
+	if ( hour != t_hour || tz != t_tz ) {
+		t_offset = stdOffset( hour * 3600 );
+		t_exact = ( stdOffset( hour * 3600 + 3599 ) != t_offset );
+		t_hour = hour;
+		t_tz = tz;
+	}
+	if ( t_exact ) return utcStart - stdOffset( utcStart );
+	return utcStart - t_offset;
+}
 
-	time_t  t = mktime( &result );
-	return t;
+// days since 1970-01-01 of epoch seconds tsec, and seconds into that day
+static inline jagint splitDay( jagint tsec, jagint &sod )
+{
+	jagint day = tsec / 86400;
+	sod = tsec - day * 86400;
+	if ( sod < 0 ) { sod += 86400; --day; }
+	return day;
 }
 
-jagint JagTime::getStartTimeSecOfHour( time_t tsec, int cycle )
+// cycle: 1,2,3,4,6,8,12
+jagint JagTime::getStartTimeSecOfSecond( time_t tsec, int cycle )
 {
-	struct tm result;
-	
-	gmtime_r( &tsec, &result );
-	int starthour = (result.tm_hour/cycle) * cycle;  // 0 --30
-	prt(("s22220 tm_isdst=%d\n", result.tm_isdst ));
+	jagint sod;
+	jagint day = splitDay( tsec, sod );
+	jagint sec = sod % 60;
+	return serverStdTime( day * 86400 + sod - sec + (sec/cycle) * cycle );
+}
 
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = starthour;
+// cycle: 1,2,3,4,6,8,12
+jagint JagTime::getStartTimeSecOfMinute( time_t tsec, int cycle )
+{
+	jagint sod;
+	jagint day = splitDay( tsec, sod );
+	jagint startmin = ( ( (sod/60) % 60 ) / cycle ) * cycle;
+	return serverStdTime( day * 86400 + (sod/3600) * 3600 + startmin * 60 );
+}
 
-	time_t  t = mktime( &result );
-	return t;
+jagint JagTime::getStartTimeSecOfHour( time_t tsec, int cycle )
+{
+	jagint sod;
+	jagint day = splitDay( tsec, sod );
+	jagint starthour = ( (sod/3600) / cycle ) * cycle;  // 0 --23
+	return serverStdTime( day * 86400 + starthour * 3600 );
 }
 
 jagint JagTime::getStartTimeSecOfDay( time_t tsec, int cycle )
 {
-	struct tm result;
-	gmtime_r( &tsec, &result );
-
-	int startday = ((result.tm_mday-1)/cycle) * cycle;  // 0 --30
-
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-	result.tm_mday = startday + 1;  // 1--31
-
-	time_t  t = mktime( &result );
-	return t;
+	jagint sod, y;
+	int m, d;
+	jagint day = splitDay( tsec, sod );
+	civilFromDays( day, y, m, d );
+	jagint startday = ( (d-1)/cycle ) * cycle;  // 0 --30
+	return serverStdTime( ( day - (d-1) + startday ) * 86400 );
 }
 
 // cycle: 1 only
 jagint JagTime::getStartTimeSecOfWeek( time_t tsec )
 {
-	struct tm result;
-	
-	gmtime_r( &tsec, &result );
-	tsec = tsec - jagint(result.tm_wday) * 86400;  // back to sunday
-
-	gmtime_r( &tsec, &result );
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-
-	time_t  t = mktime( &result );
-	return t;
+	jagint sod;
+	jagint day = splitDay( tsec, sod );
+	jagint wday = ( day + 4 ) % 7;  // 1970-01-01 is a Thursday
+	if ( wday < 0 ) wday += 7;
+	return serverStdTime( ( day - wday ) * 86400 );  // back to sunday
 }
 
 // cycle: 1,2,3,4,6
 jagint JagTime::getStartTimeSecOfMonth( time_t tsec, int cycle )
 {
-	struct tm result;
-	
-	gmtime_r( &tsec, &result );
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-	result.tm_mday = 1;
-	// result.tm_mon  0 --11
-	result.tm_mon = (result.tm_mon/cycle) * cycle; 
-
-	time_t  t = mktime( &result ); // ignores tm_wday and tm_yday
-	return t;
+	jagint sod, y;
+	int m, d;
+	civilFromDays( splitDay( tsec, sod ), y, m, d );
+	int startmon = ( (m-1)/cycle ) * cycle;  // 0 --11
+	return serverStdTime( daysFromCivil( y, startmon + 1, 1 ) * 86400 );
 }
 
-
 // cycle: 1, 2
 jagint JagTime::getStartTimeSecOfQuarter( time_t tsec, int cycle )
 {
-	struct tm result;
-	gmtime_r( &tsec, &result );
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-	result.tm_mday = 1;
-	// result.tm_mon  0-11
-	result.tm_mon = (result.tm_mon/(3*cycle)) * 3*cycle;
-	time_t  t = mktime( &result );
-	return t;
+	jagint sod, y;
+	int m, d;
+	civilFromDays( splitDay( tsec, sod ), y, m, d );
+	int startmon = ( (m-1)/(3*cycle) ) * 3*cycle;
+	return serverStdTime( daysFromCivil( y, startmon + 1, 1 ) * 86400 );
 }
 
 // cycle: any
 jagint JagTime::getStartTimeSecOfYear( time_t tsec, int cycle )
 {
-	struct tm result;
-	
-	gmtime_r( &tsec, &result );
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-	result.tm_mday = 1;
-	result.tm_mon = 0;
-	result.tm_year = (result.tm_year/cycle) * cycle;
-	time_t  t = mktime( &result );
-	return t;
+	jagint sod, y;
+	int m, d;
+	civilFromDays( splitDay( tsec, sod ), y, m, d );
+	jagint startyear = ( (y-1900)/cycle ) * cycle + 1900;  // cycles count from 1900 as tm_year
+	return serverStdTime( daysFromCivil( startyear, 1, 1 ) * 86400 );
 }
 
 // cycle: any
 jagint JagTime::getStartTimeSecOfDecade( time_t tsec, int cycle )
 {
-	struct tm result;
-	gmtime_r( &tsec, &result );
-	result.tm_sec = 0;
-	result.tm_min = 0;
-	result.tm_hour = 0;
-	result.tm_mday = 1;
-	result.tm_mon = 0;
-	result.tm_year = (result.tm_year/(cycle*10)) * cycle*10;
-	time_t  t = mktime( &result );
-	return t;
+	jagint sod, y;
+	int m, d;
+	civilFromDays( splitDay( tsec, sod ), y, m, d );
+	jagint startyear = ( (y-1900)/(cycle*10) ) * cycle*10 + 1900;
+	return serverStdTime( daysFromCivil( startyear, 1, 1 ) * 86400 );
 }
 
 void JagTime::print( struct tm &t )
@@ -65,6 +65,8 @@ class JagTime
 		static jagint getStartTimeSecOfQuarter( time_t tsec, int cycle );
 		static jagint getStartTimeSecOfYear( time_t tsec, int cycle );
 		static jagint getStartTimeSecOfDecade( time_t tsec, int cycle );
+		static jagint daysFromCivil( jagint y, int m, int d );
+		static void   civilFromDays( jagint z, jagint &y, int &m, int &d );
 		static int fillTimeBuffer ( time_t tsec, const Jstr &colType, char *buf ); 
 		static time_t getTypeTime( time_t tsec, const Jstr &colType ); 
 		static Jstr getLocalTime( time_t  tsec );
@@ -4874,3 +4874,30 @@ bool endWithSQLRightBra( const char *sql )
 
 }
 
+
+// CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320)
+// crc: value of previous call to continue a running checksum, 0 to start
+struct JagCrc32Table
+{
+	unsigned int t[256];
+	JagCrc32Table() {
+		for ( unsigned int i = 0; i < 256; ++i ) {
+			unsigned int c = i;
+			for ( int k = 0; k < 8; ++k ) {
+				c = ( c & 1 ) ? ( 0xEDB88320U ^ (c >> 1) ) : ( c >> 1 );
+			}
+			t[i] = c;
+		}
+	}
+};
+
+unsigned int jagcrc32( const char *buf, jagint len, unsigned int crc )
+{
+	static const JagCrc32Table table;
+	crc = ~crc;
+	const unsigned char *p = (const unsigned char*)buf;
+	for ( jagint i = 0; i < len; ++i ) {
+		crc = table.t[ (crc ^ p[i]) & 0xFF ] ^ (crc >> 8);
+	}
+	return ~crc;
+}
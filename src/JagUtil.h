@@ -468,4 +468,6 @@ void ellipseBoundBox( double x0, double y0, double a, double b, double nx,
 void ellipseMinMax(int op, double x0, double y0, double a, double b, double nx,
                       double &xmin, double &xmax, double &ymin, double &ymax );
 
+unsigned int jagcrc32( const char *buf, jagint len, unsigned int crc=0 );
+
 #endif
@@ -0,0 +1,552 @@
+/*
+ * Copyright (C) 2018 DataJaguar, Inc.
+ *
+ * This file is part of JaguarDB.
+ *
+ * JaguarDB is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JaguarDB is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JaguarDB (LICENSE.txt). If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <JagGlobalDef.h>
+#include <time.h>
+#include <JagDef.h>
+#include <JagUtil.h>
+#include <JagWalWriter.h>
+
+JagWalFile::JagWalFile( const Jstr &fpath )
+{
+	_fpath = fpath;
+	_fd = -1;
+	_buf = NULL;
+	_len = 0;
+	_cap = 0;
+	_appendSeq = 0;
+	_takenSeq = 0;
+	_doneSeq = 0;
+	_waiters = 0;
+	pthread_mutex_init( &_mutex, NULL );
+	pthread_cond_init( &_cond, NULL );
+	pthread_mutex_init( &_ioMutex, NULL );
+}
+
+JagWalFile::~JagWalFile()
+{
+	if ( _fd >= 0 ) {
+		jagclose( _fd );
+		_fd = -1;
+	}
+	if ( _buf ) {
+		free( _buf );
+		_buf = NULL;
+	}
+	pthread_mutex_destroy( &_mutex );
+	pthread_cond_destroy( &_cond );
+	pthread_mutex_destroy( &_ioMutex );
+}
+
+// caller holds _mutex
+bool JagWalFile::failed( jaguint seq ) const
+{
+	for ( int i = 0; i+1 < _failSeqs.size(); i += 2 ) {
+		if ( seq >= _failSeqs[i] && seq <= _failSeqs[i+1] ) return true;
+	}
+	return false;
+}
+
+JagWalWriter::JagWalWriter( int durability, int flushIntervalMs, jagint maxBufBytes )
+{
+	_durability = durability;
+	_flushIntervalMs = flushIntervalMs;
+	if ( _flushIntervalMs < 1 ) _flushIntervalMs = 1;
+	_maxBufBytes = maxBufBytes;
+	if ( _maxBufBytes < 4096 ) _maxBufBytes = 4096;
+	_started = false;
+	_stop = false;
+	_pendingWork = 0;
+	_numAppends = 0;
+	_numWrites = 0;
+	_numSyncs = 0;
+	pthread_mutex_init( &_workMutex, NULL );
+	pthread_cond_init( &_workCond, NULL );
+	pthread_rwlock_init( &_mapLock, NULL );
+	_map = new JagHashStrPtr( JAG_OUTLINE_STORE );
+}
+
+JagWalWriter::~JagWalWriter()
+{
+	stop();
+	for ( int i = 0; i < _files.size(); ++i ) {
+		delete _files[i];
+	}
+	_files.clean();
+	delete _map;
+	pthread_mutex_destroy( &_workMutex );
+	pthread_cond_destroy( &_workCond );
+	pthread_rwlock_destroy( &_mapLock );
+}
+
+// start the writer thread. Before start() appends are written synchronously
+void JagWalWriter::start()
+{
+	if ( _started ) return;
+	_stop = false;
+	jagpthread_create( &_thread, NULL, writerThreadStatic, (void*)this );
+	_started = true;
+	raydebug( stdout, JAG_LOG_LOW, "WAL writer started durability=%s interval=%d ms\n",
+			  durabilityStr(_durability), _flushIntervalMs );
+}
+
+// stop the writer thread and drain all buffers
+void JagWalWriter::stop()
+{
+	if ( _started ) {
+		_stop = true;
+		jaguar_mutex_lock( &_workMutex );
+		++ _pendingWork;
+		pthread_cond_signal( &_workCond );
+		jaguar_mutex_unlock( &_workMutex );
+		pthread_join( _thread, NULL );
+		_started = false;
+	}
+	flushAll();
+}
+
+// append one record to log file fpath
+// returns when the record has reached the configured durability
+// return 1: OK  0: error
+int JagWalWriter::append( const Jstr &fpath, const char *data, jagint len )
+{
+	if ( len < 1 ) return 1;
+	JagWalFile *wf = getFile( fpath, true );
+	if ( ! wf ) return 0;
+	++ _numAppends;
+
+	jaguar_mutex_lock( &wf->_mutex );
+	if ( wf->_len + len > wf->_cap ) {
+		jagint newcap = wf->_cap * 2;
+		if ( newcap < 65536 ) newcap = 65536;
+		if ( newcap < wf->_len + len ) newcap = wf->_len + len;
+		char *newbuf = (char*)realloc( wf->_buf, newcap );
+		if ( ! newbuf ) {
+			jaguar_mutex_unlock( &wf->_mutex );
+			raydebug( stdout, JAG_LOG_LOW, "E20310 WAL buffer alloc error %s len=%l\n", fpath.s(), newcap );
+			return 0;
+		}
+		wf->_buf = newbuf;
+		wf->_cap = newcap;
+	}
+	memcpy( wf->_buf + wf->_len, data, len );
+	wf->_len += len;
+	jaguint seq = ++ wf->_appendSeq;
+	bool full = ( wf->_len >= _maxBufBytes );
+
+	if ( ! _started ) {
+		// no writer thread yet (startup) or stopped: write directly
+		jaguar_mutex_unlock( &wf->_mutex );
+		jaguar_mutex_lock( &wf->_ioMutex );
+		int rc = drainFile( wf, JAG_WAL_SYNC == _durability );
+		jaguar_mutex_unlock( &wf->_ioMutex );
+		return ( rc < 0 ) ? 0 : 1;
+	}
+
+	if ( JAG_WAL_ASYNC == _durability && ! full ) {
+		jaguar_mutex_unlock( &wf->_mutex );
+		return 1;
+	}
+
+	jaguar_mutex_lock( &_workMutex );
+	++ _pendingWork;
+	pthread_cond_signal( &_workCond );
+	jaguar_mutex_unlock( &_workMutex );
+
+	if ( JAG_WAL_ASYNC == _durability ) {
+		jaguar_mutex_unlock( &wf->_mutex );
+		return 1;
+	}
+
+	// group commit: all waiters on this file are woken by one write/sync
+	++ wf->_waiters;
+	while ( wf->_doneSeq < seq ) {
+		jaguar_cond_wait( &wf->_cond, &wf->_mutex );
+	}
+	bool bad = wf->failed( seq );
+	if ( 0 == -- wf->_waiters ) {
+		// every waiter of a failed drain has seen it
+		wf->_failSeqs.clean();
+	}
+	jaguar_mutex_unlock( &wf->_mutex );
+	if ( bad ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20313 wallog record %l of %s was not written\n", seq, fpath.s() );
+		return 0;
+	}
+	return 1;
+}
+
+// write pending records of fpath to disk now
+void JagWalWriter::flushFile( const Jstr &fpath )
+{
+	JagWalFile *wf = getFile( fpath, false );
+	if ( ! wf ) return;
+	jaguar_mutex_lock( &wf->_ioMutex );
+	drainFile( wf, _durability != JAG_WAL_ASYNC );
+	jaguar_mutex_unlock( &wf->_ioMutex );
+}
+
+void JagWalWriter::flushAll()
+{
+	JagVector<JagWalFile*> vec;
+	pthread_rwlock_rdlock( &_mapLock );
+	vec = _files;
+	pthread_rwlock_unlock( &_mapLock );
+
+	for ( int i = 0; i < vec.size(); ++i ) {
+		jaguar_mutex_lock( &vec[i]->_ioMutex );
+		drainFile( vec[i], _durability != JAG_WAL_ASYNC );
+		jaguar_mutex_unlock( &vec[i]->_ioMutex );
+	}
+}
+
+// discard pending records, close and remove the log file
+// (after the data it protects has been persisted, or the object is dropped)
+void JagWalWriter::resetFile( const Jstr &fpath )
+{
+	JagWalFile *wf = getFile( fpath, false );
+	if ( ! wf ) {
+		jagunlink( fpath.s() );
+		return;
+	}
+
+	jaguar_mutex_lock( &wf->_ioMutex );
+	jaguar_mutex_lock( &wf->_mutex );
+	wf->_len = 0;
+	wf->_takenSeq = wf->_doneSeq = wf->_appendSeq;
+	pthread_cond_broadcast( &wf->_cond );
+	jaguar_mutex_unlock( &wf->_mutex );
+
+	if ( wf->_fd >= 0 ) {
+		jagclose( wf->_fd );
+		wf->_fd = -1;
+	}
+	jagunlink( fpath.s() );
+	jaguar_mutex_unlock( &wf->_ioMutex );
+}
+
+// drain and close the file, and keep it from being written until resumeFile()
+// caller may then read, rewrite or rename the file on disk
+void JagWalWriter::suspendFile( const Jstr &fpath )
+{
+	JagWalFile *wf = getFile( fpath, true );
+	if ( ! wf ) return;
+	jaguar_mutex_lock( &wf->_ioMutex );
+	drainFile( wf, _durability != JAG_WAL_ASYNC );
+	if ( wf->_fd >= 0 ) {
+		jagclose( wf->_fd );
+		wf->_fd = -1;
+	}
+}
+
+void JagWalWriter::resumeFile( const Jstr &fpath )
+{
+	JagWalFile *wf = getFile( fpath, false );
+	if ( ! wf ) return;
+	jaguar_mutex_unlock( &wf->_ioMutex );
+}
+
+jagint JagWalWriter::pendingBytes()
+{
+	jagint sum = 0;
+	pthread_rwlock_rdlock( &_mapLock );
+	for ( int i = 0; i < _files.size(); ++i ) {
+		sum += _files[i]->_len;
+	}
+	pthread_rwlock_unlock( &_mapLock );
+	return sum;
+}
+
+JagWalFile *JagWalWriter::getFile( const Jstr &fpath, bool create )
+{
+	pthread_rwlock_rdlock( &_mapLock );
+	JagWalFile *wf = (JagWalFile*)_map->getValue( fpath );
+	pthread_rwlock_unlock( &_mapLock );
+	if ( wf || ! create ) return wf;
+
+	pthread_rwlock_wrlock( &_mapLock );
+	wf = (JagWalFile*)_map->getValue( fpath );
+	if ( ! wf ) {
+		wf = new JagWalFile( fpath );
+		_map->addKeyValue( fpath, (void*)wf );
+		_files.append( wf );
+	}
+	pthread_rwlock_unlock( &_mapLock );
+	return wf;
+}
+
+// caller holds wf->_ioMutex
+int JagWalWriter::openFile( JagWalFile *wf )
+{
+	if ( wf->_fd >= 0 ) return wf->_fd;
+	wf->_fd = jagopen( wf->_fpath.s(), O_CREAT|O_WRONLY|O_APPEND|JAG_NOATIME, S_IRWXU );
+	if ( wf->_fd < 0 ) {
+		raydebug( stdout, JAG_LOG_LOW, "E20311 error open wallog %s [%s]\n", wf->_fpath.s(), strerror(errno) );
+		return wf->_fd;
+	}
+
+	// new file starts with the format header
+	if ( _fileHeader.size() > 0 && 0 == ::lseek( wf->_fd, 0, SEEK_END ) ) {
+		raysafewrite( wf->_fd, _fileHeader.s(), _fileHeader.size() );
+	}
+	return wf->_fd;
+}
+
+// write out everything buffered for wf with a single write() call
+// caller holds wf->_ioMutex but not wf->_mutex
+// A failed write or sync is cut off the file and its records are marked failed, so
+// their appenders return error instead of reporting them durable.
+// return bytes written, -1 for error
+int JagWalWriter::drainFile( JagWalFile *wf, bool doSync )
+{
+	jaguar_mutex_lock( &wf->_mutex );
+	if ( wf->_len < 1 ) {
+		jaguar_mutex_unlock( &wf->_mutex );
+		return 0;
+	}
+	char *buf = wf->_buf;
+	jagint len = wf->_len;
+	jaguint fromSeq = wf->_takenSeq + 1;
+	jaguint seq = wf->_appendSeq;
+	wf->_takenSeq = seq;
+	wf->_buf = NULL;
+	wf->_len = 0;
+	wf->_cap = 0;
+	jaguar_mutex_unlock( &wf->_mutex );
+
+	jagint rc = -1;
+	if ( openFile( wf ) >= 0 ) {
+		off_t before = ::lseek( wf->_fd, 0, SEEK_END );
+		rc = raysafewrite( wf->_fd, buf, len );
+		++ _numWrites;
+		if ( rc != len ) {
+			raydebug( stdout, JAG_LOG_LOW, "E20312 error write wallog %s len=%l [%s]\n", wf->_fpath.s(), len, strerror(errno) );
+			rc = -1;
+		} else if ( doSync ) {
+			++ _numSyncs;
+			if ( jagfdatasync( wf->_fd ) < 0 ) {
+				raydebug( stdout, JAG_LOG_LOW, "E20314 error sync wallog %s [%s]\n", wf->_fpath.s(), strerror(errno) );
+				rc = -1;
+			}
+		}
+
+		if ( rc < 0 && before >= 0 && ftruncate( wf->_fd, before ) < 0 ) {
+			// leave no torn record in front of later good ones
+			raydebug( stdout, JAG_LOG_LOW, "E20315 error truncate wallog %s [%s]\n", wf->_fpath.s(), strerror(errno) );
+		}
+	}
+	free( buf );
+
+	jaguar_mutex_lock( &wf->_mutex );
+	if ( rc < 0 && wf->_waiters > 0 ) {
+		wf->_failSeqs.append( fromSeq );
+		wf->_failSeqs.append( seq );
+	}
+	if ( seq > wf->_doneSeq ) wf->_doneSeq = seq;
+	pthread_cond_broadcast( &wf->_cond );
+	jaguar_mutex_unlock( &wf->_mutex );
+	return rc;
+}
+
+// one pass over all files; files busy in suspend/reset are skipped till next round
+void JagWalWriter::writeRound()
+{
+	JagVector<JagWalFile*> vec;
+	pthread_rwlock_rdlock( &_mapLock );
+	vec = _files;
+	pthread_rwlock_unlock( &_mapLock );
+
+	for ( int i = 0; i < vec.size(); ++i ) {
+		if ( vec[i]->_len < 1 ) continue;
+		if ( 0 != pthread_mutex_trylock( &vec[i]->_ioMutex ) ) continue;
+		drainFile( vec[i], JAG_WAL_SYNC == _durability );
+		jaguar_mutex_unlock( &vec[i]->_ioMutex );
+	}
+}
+
+void *JagWalWriter::writerThreadStatic( void *ptr )
+{
+	JagWalWriter *w = (JagWalWriter*)ptr;
+	struct timespec ts;
+	while ( ! w->_stop ) {
+		jaguar_mutex_lock( &w->_workMutex );
+		if ( w->_pendingWork < 1 ) {
+			clock_gettime( CLOCK_REALTIME, &ts );
+			ts.tv_nsec += (long)w->_flushIntervalMs * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec = ts.tv_nsec % 1000000000L;
+			pthread_cond_timedwait( &w->_workCond, &w->_workMutex, &ts );
+		}
+		w->_pendingWork = 0;
+		jaguar_mutex_unlock( &w->_workMutex );
+
+		w->writeRound();
+	}
+	w->writeRound();
+	return NULL;
+}
+
+// WAL_DURABILITY: async | write | sync
+int JagWalWriter::durabilityFromStr( const Jstr &str )
+{
+	Jstr s = makeLowerString( str );
+	if ( s == "async" || s == "none" || s == "0" ) {
+		return JAG_WAL_ASYNC;
+	} else if ( s == "sync" || s == "fsync" || s == "fdatasync" || s == "2" ) {
+		return JAG_WAL_SYNC;
+	}
+	return JAG_WAL_WRITE;
+}
+
+const char *JagWalWriter::durabilityStr( int durability )
+{
+	if ( JAG_WAL_ASYNC == durability ) return "async";
+	if ( JAG_WAL_SYNC == durability ) return "sync";
+	return "write";
+}
+
+
+JagWalRecord::JagWalRecord()
+{
+	_buf = NULL;
+	_len = 0;
+	_cap = 0;
+}
+
+JagWalRecord::~JagWalRecord()
+{
+	if ( _buf ) free( _buf );
+}
+
+// reserve a record of bodylen bytes at the end of buffer; header is filled by caller
+char *JagWalRecord::beginRecord( jagint bodylen )
+{
+	jagint need = _len + JAG_WAL_REC_HDR_LEN + bodylen;
+	if ( need > _cap ) {
+		jagint newcap = _cap * 2;
+		if ( newcap < 1024 ) newcap = 1024;
+		if ( newcap < need ) newcap = need;
+		_buf = (char*)realloc( _buf, newcap );
+		_cap = newcap;
+	}
+	char *p = _buf + _len;
+	_len = need;
+	return p;
+}
+
+void JagWalRecord::addSQL( int replicateType, int timediff, int isBatch, const char *sql, jagint len )
+{
+	jagint bodylen = JAG_WAL_REC_BODY_HDR + 1 + len;
+	char *rec = beginRecord( bodylen );
+	char *body = rec + JAG_WAL_REC_HDR_LEN;
+	int  td = timediff;
+	body[0] = JAG_WAL_REC_SQL;
+	body[1] = (char)replicateType;
+	memcpy( body+2, &td, 4 );
+	body[JAG_WAL_REC_BODY_HDR] = (char)isBatch;
+	memcpy( body+JAG_WAL_REC_BODY_HDR+1, sql, len );
+
+	unsigned int blen = bodylen;
+	unsigned int crc = jagcrc32( body, bodylen );
+	memcpy( rec, &blen, 4 );
+	memcpy( rec+4, &crc, 4 );
+}
+
+void JagWalRecord::addKV( int replicateType, int timediff, const char *key, jagint klen, const char *val, jagint vlen )
+{
+	jagint bodylen = JAG_WAL_REC_BODY_HDR + 4 + klen + vlen;
+	char *rec = beginRecord( bodylen );
+	char *body = rec + JAG_WAL_REC_HDR_LEN;
+	int  td = timediff;
+	unsigned int kl = klen;
+	body[0] = JAG_WAL_REC_KV;
+	body[1] = (char)replicateType;
+	memcpy( body+2, &td, 4 );
+	memcpy( body+JAG_WAL_REC_BODY_HDR, &kl, 4 );
+	memcpy( body+JAG_WAL_REC_BODY_HDR+4, key, klen );
+	memcpy( body+JAG_WAL_REC_BODY_HDR+4+klen, val, vlen );
+
+	unsigned int blen = bodylen;
+	unsigned int crc = jagcrc32( body, bodylen );
+	memcpy( rec, &blen, 4 );
+	memcpy( rec+4, &crc, 4 );
+}
+
+// true if the file starts with the binary wallog header
+bool JagWalRecord::isBinaryLog( const Jstr &fpath )
+{
+	int fd = jagopen( fpath.s(), O_RDONLY|JAG_NOATIME );
+	if ( fd < 0 ) return false;
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+	jagint n = raysaferead( fd, magic, JAG_WAL_FILE_MAGIC_LEN );
+	jagclose( fd );
+	return ( n == JAG_WAL_FILE_MAGIC_LEN && 0 == memcmp( magic, JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN ) );
+}
+
+// read next record body from fp (positioned after magic or previous record)
+// body is grown as needed (caller frees)
+// return 1: got record  0: clean end of file  -1: torn or corrupt record
+int JagWalRecord::readRecord( FILE *fp, char *&body, jagint &bodycap, jagint &bodylen )
+{
+	char hdr[JAG_WAL_REC_HDR_LEN];
+	size_t n = fread( hdr, 1, JAG_WAL_REC_HDR_LEN, fp );
+	if ( 0 == n ) return 0;
+	if ( n < JAG_WAL_REC_HDR_LEN ) return -1;
+
+	unsigned int blen, crc;
+	memcpy( &blen, hdr, 4 );
+	memcpy( &crc, hdr+4, 4 );
+	if ( blen < JAG_WAL_REC_BODY_HDR || blen > JAG_WAL_REC_MAX_BODY ) return -1;
+
+	if ( (jagint)blen > bodycap ) {
+		body = (char*)realloc( body, blen );
+		bodycap = blen;
+	}
+	if ( fread( body, 1, blen, fp ) != blen ) return -1;
+	if ( jagcrc32( body, blen ) != crc ) return -1;
+	bodylen = blen;
+	return 1;
+}
+
+bool JagWalRecord::parseBody( const char *body, jagint bodylen, char &type, int &replicateType, int &timediff,
+							  const char *&payload, jagint &plen )
+{
+	if ( bodylen < JAG_WAL_REC_BODY_HDR ) return false;
+	type = body[0];
+	replicateType = body[1];
+	memcpy( &timediff, body+2, 4 );
+	payload = body + JAG_WAL_REC_BODY_HDR;
+	plen = bodylen - JAG_WAL_REC_BODY_HDR;
+	if ( JAG_WAL_REC_SQL == type ) return plen >= 1;
+	if ( JAG_WAL_REC_KV == type ) return plen >= 4;
+	return false;
+}
+
+// write one record (header and body) to fp
+// return 1: OK  0: error
+int JagWalRecord::writeRecord( FILE *fp, const char *body, jagint bodylen )
+{
+	char hdr[JAG_WAL_REC_HDR_LEN];
+	unsigned int blen = bodylen;
+	unsigned int crc = jagcrc32( body, bodylen );
+	memcpy( hdr, &blen, 4 );
+	memcpy( hdr+4, &crc, 4 );
+	if ( fwrite( hdr, 1, JAG_WAL_REC_HDR_LEN, fp ) != JAG_WAL_REC_HDR_LEN ) return 0;
+	if ( fwrite( body, 1, bodylen, fp ) != (size_t)bodylen ) return 0;
+	return 1;
+}
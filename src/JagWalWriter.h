@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 DataJaguar, Inc.
+ *
+ * This file is part of JaguarDB.
+ *
+ * JaguarDB is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JaguarDB is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JaguarDB (LICENSE.txt). If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _jag_wal_writer_h_
+#define _jag_wal_writer_h_
+
+#include <pthread.h>
+#include <atomic>
+#include <abax.h>
+#include <JagVector.h>
+#include <JagHashStrPtr.h>
+
+// durability of an appended log record when append() returns
+#define JAG_WAL_ASYNC    0   // buffered in memory, written by writer thread later
+#define JAG_WAL_WRITE    1   // written to the file (OS page cache)
+#define JAG_WAL_SYNC     2   // written and fdatasync'ed
+
+// binary wallog file: [magic] then records [bodylen:4][crc32(body):4][body]
+// body: [type:1][replicateType:1][timediff:4][payload]
+//   JAG_WAL_REC_SQL  payload: [isBatch:1][sql text]
+//   JAG_WAL_REC_KV   payload: [klen:4][key][value]   (encoded db pair)
+#define JAG_WAL_FILE_MAGIC       "JAGWAL01"
+#define JAG_WAL_FILE_MAGIC_LEN   8
+#define JAG_WAL_REC_HDR_LEN      8
+#define JAG_WAL_REC_BODY_HDR     6
+#define JAG_WAL_REC_MAX_BODY     1000000000
+#define JAG_WAL_REC_SQL          'S'
+#define JAG_WAL_REC_KV           'K'
+
+// one log file with its pending append buffer
+class JagWalFile
+{
+  public:
+	JagWalFile( const Jstr &fpath );
+	~JagWalFile();
+	bool	failed( jaguint seq ) const;
+
+	Jstr			_fpath;
+	int				_fd;
+	char			*_buf;
+	jagint			_len;
+	jagint			_cap;
+	jaguint			_appendSeq;  // seq of last appended record
+	jaguint			_takenSeq;   // seq of last record taken from _buf by a drain
+	jaguint			_doneSeq;    // seq of last record whose write has finished
+	JagVector<jaguint> _failSeqs; // [from, to] seq pairs of drains whose write failed
+	int				_waiters;    // appenders waiting for _doneSeq
+	pthread_mutex_t _mutex;      // protects buffer and seqs
+	pthread_cond_t  _cond;       // waiters for _doneSeq
+	pthread_mutex_t _ioMutex;    // serializes write/close/unlink of _fd
+};
+
+// Group-commit log writer
+// Appenders copy records into the per-file buffer and wait (depending on durability);
+// a dedicated writer thread drains each buffer with one write() and optional fdatasync,
+// then wakes all waiters of that file together.
+class JagWalWriter
+{
+  public:
+	JagWalWriter( int durability, int flushIntervalMs, jagint maxBufBytes );
+	~JagWalWriter();
+
+	void 	start();
+	void 	stop();
+	int 	append( const Jstr &fpath, const char *data, jagint len );
+	void	flushFile( const Jstr &fpath );
+	void 	flushAll();
+	void	resetFile( const Jstr &fpath );
+	void	suspendFile( const Jstr &fpath );
+	void	resumeFile( const Jstr &fpath );
+	jagint	pendingBytes();
+	int		durability() const { return _durability; }
+	void	setFileHeader( const Jstr &hdr ) { _fileHeader = hdr; }
+
+	static int  durabilityFromStr( const Jstr &str );
+	static const char *durabilityStr( int durability );
+
+	std::atomic<jagint>  _numAppends;
+	std::atomic<jagint>  _numWrites;
+	std::atomic<jagint>  _numSyncs;
+
+  protected:
+	JagWalFile	*getFile( const Jstr &fpath, bool create );
+	int 	 	openFile( JagWalFile *wf );
+	int 	 	drainFile( JagWalFile *wf, bool doSync );
+	void 	 	writeRound();
+	static void *writerThreadStatic( void *ptr );
+
+	Jstr				_fileHeader;
+	int					_durability;
+	int					_flushIntervalMs;
+	jagint				_maxBufBytes;
+	bool				_started;
+	std::atomic<bool>	_stop;
+	std::atomic<jagint>	_pendingWork;
+	pthread_t			_thread;
+	pthread_mutex_t		_workMutex;
+	pthread_cond_t		_workCond;
+	pthread_rwlock_t	_mapLock;
+	JagHashStrPtr		*_map;
+	JagVector<JagWalFile*>  _files;
+};
+
+// encoder and reader of binary wallog records
+class JagWalRecord
+{
+  public:
+	JagWalRecord();
+	~JagWalRecord();
+
+	void 	addSQL( int replicateType, int timediff, int isBatch, const char *sql, jagint len );
+	void 	addKV( int replicateType, int timediff, const char *key, jagint klen, const char *val, jagint vlen );
+	const char *data() const { return _buf; }
+	jagint 	size() const { return _len; }
+	void	clear() { _len = 0; }
+
+	static bool isBinaryLog( const Jstr &fpath );
+	static int  readRecord( FILE *fp, char *&body, jagint &bodycap, jagint &bodylen );
+	static bool parseBody( const char *body, jagint bodylen, char &type, int &replicateType, int &timediff,
+						   const char *&payload, jagint &plen );
+	static int  writeRecord( FILE *fp, const char *body, jagint bodylen );
+
+  protected:
+	char	*beginRecord( jagint bodylen );
+	char	*_buf;
+	jagint	_len;
+	jagint	_cap;
+};
+
+#endif
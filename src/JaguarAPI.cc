@@ -69,6 +69,11 @@ int JaguarAPI:: query( const char *query, bool reply )
 	return _jcli->query( query, reply );
 }
 
+int JaguarAPI::queryBatch( const char *querys, long len )
+{
+	return _jcli->queryDirect( 0, querys, len, true, true );
+}
+
 int JaguarAPI::reply( bool headerOnly )
 {
 	return _jcli->reply( headerOnly );
@@ -52,6 +52,10 @@ class EXP_LIB_API JaguarAPI
     // 1: OK   0: error
     int query( const char *query, bool reply=true ); 
 
+    // send commands separated by ';' to server in one batch
+    // 1: OK   0: error
+    int queryBatch( const char *querys, long len ); 
+
     // 0: error or reaching the last record
     // 1: successful and having more records
     int reply( bool headerOnly=false );
@@ -81,6 +81,10 @@
 #include <spsc_queue.h>
 
 #include <JagLockFreeDBMap.h>
+#include <JagWalWriter.h>
+#include <JagDiskArrayFamily.h>
+#include <JagDBServer.h>
+#include <JagDataCenterQueue.h>
 #include <functional>
 #include "safemap.h"
 #include "btree_map.h"
@@ -236,6 +240,10 @@ void test_jstr( int n );
 void test_parseparam( int n );
 void test_spsc_queue( int n );
 void test_numinstr();
+void test_walwriter( int N );
+void test_rangedelete();
+void test_dcqueue();
+void test_timewindow();
 
 int main(int argc, char *argv[] )
 {
@@ -328,6 +336,10 @@ int main(int argc, char *argv[] )
 	//test_safemap(N);
 
 	test_numinstr();
+	//test_walwriter( N );
+	//test_rangedelete();
+	//test_dcqueue();
+	//test_timewindow();
 }
 
 
@@ -4626,3 +4638,322 @@ void test_numinstr()
 	printf("sizeof time_t=%d\n", sizeof(t1) );
 }
 
+
+struct WalPass {
+	JagWalWriter *w;
+	const char *fpath;
+	std::atomic<int> fails;
+};
+
+void *walAppend( void *ptr )
+{
+	WalPass *pass = (WalPass*)ptr;
+	JagWalRecord rec;
+	rec.addSQL( 0, 0, 0, "insert into t values (1)", 24 );
+	if ( ! pass->w->append( pass->fpath, rec.data(), rec.size() ) ) ++ pass->fails;
+	return NULL;
+}
+
+// group commit: a failed write must fail every appender waiting on it
+void test_walwriter( int N )
+{
+	if ( N < 1 ) N = 1;
+	JagWalWriter w( JAG_WAL_SYNC, 5, 65536 );
+	w.setFileHeader( Jstr(JAG_WAL_FILE_MAGIC, JAG_WAL_FILE_MAGIC_LEN) );
+	w.start();
+
+	// every write() to /dev/full fails with ENOSPC
+	WalPass pass;
+	pass.w = &w;
+	pass.fpath = "/dev/full";
+	pass.fails = 0;
+	pthread_t thrd[N];
+	for ( int i = 0; i < N; ++i ) jagpthread_create( &thrd[i], NULL, walAppend, (void*)&pass );
+	for ( int i = 0; i < N; ++i ) pthread_join( thrd[i], NULL );
+	printf("test_walwriter /dev/full appends=%d failed=%d %s\n", N, int(pass.fails), int(pass.fails) == N ? "OK" : "FAIL" );
+
+	Jstr fpath = "/tmp/test_walwriter.wallog";
+	jagunlink( fpath.s() );
+	pass.fpath = fpath.s();
+	pass.fails = 0;
+	for ( int i = 0; i < N; ++i ) jagpthread_create( &thrd[i], NULL, walAppend, (void*)&pass );
+	for ( int i = 0; i < N; ++i ) pthread_join( thrd[i], NULL );
+	w.stop();
+
+	FILE *fp = fopen( fpath.s(), "r" );
+	char magic[JAG_WAL_FILE_MAGIC_LEN];
+	int nrec = 0;
+	if ( fp && fread( magic, 1, JAG_WAL_FILE_MAGIC_LEN, fp ) == JAG_WAL_FILE_MAGIC_LEN ) {
+		char *body = NULL;
+		jagint bodycap = 0, bodylen;
+		while ( JagWalRecord::readRecord( fp, body, bodycap, bodylen ) > 0 ) ++nrec;
+		if ( body ) free( body );
+	}
+	if ( fp ) fclose( fp );
+	jagunlink( fpath.s() );
+	printf("test_walwriter %s appends=%d failed=%d records=%d %s\n", fpath.s(), N, int(pass.fails), nrec, 
+			( 0 == pass.fails && nrec == N ) ? "OK" : "FAIL" );
+}
+
+// delete range of keys with first cmplen bytes from lo to hi; keys are 8 bytes
+// return rows reported deleted, -1 if the range was not saved
+jagint rangeDeleteRows( JagDiskArrayFamily *fam, const char *lo, const char *hi, int cmplen )
+{
+	char buf[9];
+	JagRangeDelete rd;
+	rd.cmplen = cmplen;
+	memset( buf, 0, 9 );
+	memcpy( buf, lo, cmplen );
+	rd.lo = JagFixString( buf, 8, 8 );
+	memset( buf, 255, 8 );
+	memcpy( buf, hi, cmplen );
+	rd.hi = JagFixString( buf, 8, 8 );
+
+	jagint rows = -1;
+	if ( ! fam->deleteRange( rd, &rows ) ) return -1;
+	return rows;
+}
+
+// range delete count: rows of files and the insert buffer, each row counted once
+void test_rangedelete()
+{
+	JagDBServer *servobj = new JagDBServer();
+	JagSchemaRecord record;
+	record.keyLength = 8;
+	record.valueLength = 8;
+	Jstr home = "/tmp/test_rangedelete";
+	JagFileMgr::rmdir( home );
+	JagFileMgr::makedirPath( home + "/test/t", 0700 );
+	JagDiskArrayFamily *fam = new JagDiskArrayFamily( servobj, home + "/test/t/t", &record, 0, false );
+
+	// keys a0000000..a0000099 in a data file
+	char *kvs = (char*)jagmalloc( 100*16+1 );
+	for ( int i = 0; i < 100; ++i ) {
+		snprintf( kvs+i*16, 17, "a%07dv%07d", i, i );
+	}
+	JagDiskArrayServer *darr = fam->newSortedFile( 100 );
+	darr->flushSortedToNewFile( kvs, 100 );
+	fam->addSortedFile( darr );
+	free( kvs );
+
+	// keys b0000000..b0000049 in the insert buffer
+	char kv[17];
+	JagDBPair retpair;
+	for ( int i = 0; i < 50; ++i ) {
+		snprintf( kv, sizeof(kv), "b%07dv%07d", i, i );
+		fam->insert( JagDBPair( kv, 8, kv+8, 8 ), false, retpair );
+	}
+
+	struct { const char *lo; const char *hi; int cmplen; jagint expect; } cases[] = {
+		{ "a000001", "a000002", 7, 20 },   // file rows a0000010..a0000029
+		{ "a000002", "a000003", 7, 10 },   // a0000020..a0000029 are deleted already
+		{ "b000000", "b000000", 7, 10 },   // buffer rows b0000000..b0000009
+		{ "a00000",  "b00000",  6, 110 },  // 70 file rows and 40 buffer rows left
+		{ "a00000",  "b00000",  6, 0 },    // nothing left; the range is not saved
+	};
+
+	int fails = 0;
+	int ncases = sizeof(cases)/sizeof(cases[0]);
+	jagint cnt;
+	for ( int i = 0; i < ncases; ++i ) {
+		int nranges = fam->numRangeDeletes();
+		cnt = rangeDeleteRows( fam, cases[i].lo, cases[i].hi, cases[i].cmplen );
+		if ( cnt != cases[i].expect ) {
+			printf("test_rangedelete FAIL case %d rows=%lld expect=%lld\n", i, cnt, cases[i].expect );
+			++fails;
+		}
+		if ( 0 == cases[i].expect && fam->numRangeDeletes() != nranges ) {
+			printf("test_rangedelete FAIL case %d empty range was saved\n", i );
+			++fails;
+		}
+	}
+
+	JagDBPair pair( JagFixString( "a0000050", 8, 8 ) );
+	if ( fam->exist( pair ) ) {
+		printf("test_rangedelete FAIL deleted file row a0000050 found\n" );
+		++fails;
+	}
+
+	printf("test_rangedelete %s\n", fails ? "FAIL" : "OK" );
+	delete fam;
+	JagFileMgr::rmdir( home );
+}
+
+// datacenter queue that records the commands it delivers instead of sending them
+// the failAt-th send fails once as if the connection dropped; command reject is refused
+class DCQueueReplay : public JagDataCenterQueue
+{
+  public:
+	DCQueueReplay( const Jstr &hostPort, int failAt, const Jstr &reject )
+		: JagDataCenterQueue( NULL, NULL, hostPort, 100, 1 ) { _failAt = failAt; _nsends = 0; _reject = reject; }
+	const Jstr &sendPath() const { return _spath; }
+	const Jstr &badPath() const { return _bpath; }
+	const Jstr &deadPath() const { return _dpath; }
+	const Jstr &posPath() const { return _ppath; }
+	JagVector<Jstr> delivered;
+
+  protected:
+	virtual int sendCommands( const Jstr &cmds, JagVector<int> &rejected ) {
+		if ( ++_nsends == _failAt ) return 0;
+		JagStrSplit sp( cmds, ';', true );
+		Jstr reply;
+		for ( int i = 0; i < sp.length(); ++i ) {
+			delivered.append( sp[i] );
+			if ( sp[i] == _reject ) reply = Jstr("E20417 rejected ") + intToStr( i );
+		}
+		if ( reply.size() > 0 && ! parseRejected( reply.s(), rejected ) ) return 0;
+		return 1;
+	}
+	virtual int sendOne( const Jstr &cmd, bool &rejected ) {
+		if ( ++_nsends == _failAt ) return 0;
+		delivered.append( cmd );
+		rejected = ( cmd == _reject );
+		return 1;
+	}
+	virtual bool connect() { return true; }
+	virtual void disconnect() {}
+	int _failAt;
+	int _nsends;
+	Jstr _reject;
+};
+
+// replay of a queue file with a dropped connection, a corrupt record in the middle and a
+// command the datacenter rejects: every good command is delivered once and in order, the
+// corrupt record goes to the _bad file and the rejected one to the _dead file
+void test_dcqueue()
+{
+	Jstr home = "/tmp/test_dcqueue";
+	JagFileMgr::rmdir( home );
+	JagFileMgr::makedirPath( home + "/log/datacenter", 0700 );
+	setenv( "JAGUAR_HOME", home.s(), 1 );
+
+	const char *cmds[] = { "insert into t values (0)", "insert into t values (1)", "update t set v=2 where k=2",
+						   "insert into t values (3)", "delete from t where k=4", "insert into t values (5)" };
+	int ncmds = sizeof(cmds)/sizeof(cmds[0]);
+	int badAfter = 3;  // corrupt record after cmds[2]
+
+	// a batch ends at the corrupt record; the 2nd batch fails once and the 1st must not be resent
+	DCQueueReplay *q = new DCQueueReplay( "127.0.0.1:8888", 2, cmds[4] );
+	FILE *fp = fopen( q->sendPath().s(), "wb" );
+	fwrite( JAG_WAL_FILE_MAGIC, 1, JAG_WAL_FILE_MAGIC_LEN, fp );
+	Jstr badrec, deadrec;
+	for ( int i = 0; i < ncmds; ++i ) {
+		if ( i == badAfter ) {
+			JagWalRecord rec;
+			rec.addSQL( 0, 0, 0, "drop table t", 12 );
+			badrec = Jstr( rec.data(), rec.size(), rec.size() );
+			((char*)badrec.c_str())[4] ^= 0x55;  // wrong crc
+			fwrite( badrec.s(), 1, badrec.size(), fp );
+		}
+		JagWalRecord rec;
+		rec.addSQL( 0, 0, 0, cmds[i], strlen(cmds[i]) );
+		JagWalRecord::writeRecord( fp, rec.data() + JAG_WAL_REC_HDR_LEN, rec.size() - JAG_WAL_REC_HDR_LEN );
+		if ( 4 == i ) deadrec = Jstr( rec.data(), rec.size(), rec.size() );
+	}
+	fclose( fp );
+
+	q->start();
+	for ( int i = 0; i < 100 && JagFileMgr::exist( q->sendPath() ); ++i ) jagsleep( 100, JAG_MSEC );
+	q->stop();
+
+	int fails = 0;
+	if ( JagFileMgr::exist( q->sendPath() ) || JagFileMgr::exist( q->posPath() ) ) {
+		printf("test_dcqueue FAIL queue file not removed after all records were sent\n" );
+		++fails;
+	}
+	if ( q->delivered.size() != ncmds ) {
+		printf("test_dcqueue FAIL delivered=%lld expect=%d\n", (jagint)q->delivered.size(), ncmds );
+		++fails;
+	}
+	for ( int i = 0; i < ncmds && i < q->delivered.size(); ++i ) {
+		if ( q->delivered[i] != cmds[i] ) {
+			printf("test_dcqueue FAIL command %d [%s] expect [%s]\n", i, q->delivered[i].s(), cmds[i] );
+			++fails;
+		}
+	}
+	if ( q->_numSent != ncmds ) {
+		printf("test_dcqueue FAIL numSent=%lld expect=%d\n", (jagint)q->_numSent, ncmds );
+		++fails;
+	}
+
+	char bad[256];
+	jagint nbad = 0;
+	fp = fopen( q->badPath().s(), "rb" );
+	if ( fp ) {
+		nbad = fread( bad, 1, sizeof(bad), fp );
+		fclose( fp );
+	}
+	if ( nbad != (jagint)badrec.size() || 0 != memcmp( bad, badrec.s(), nbad ) ) {
+		printf("test_dcqueue FAIL bad file has %lld bytes expect %lld\n", nbad, (jagint)badrec.size() );
+		++fails;
+	}
+
+	nbad = 0;
+	fp = fopen( q->deadPath().s(), "rb" );
+	if ( fp ) {
+		nbad = fread( bad, 1, sizeof(bad), fp );
+		fclose( fp );
+	}
+	if ( nbad != (jagint)deadrec.size() || 0 != memcmp( bad, deadrec.s(), nbad ) || q->_numRejected != 1 ) {
+		printf("test_dcqueue FAIL dead file has %lld bytes expect %lld, rejected=%lld\n", 
+				nbad, (jagint)deadrec.size(), (jagint)q->_numRejected );
+		++fails;
+	}
+
+	printf("test_dcqueue %s\n", fails ? "FAIL" : "OK" );
+	delete q;
+	JagFileMgr::rmdir( home );
+}
+
+// minute and hour window start the old way: truncated UTC fields read back by mktime()
+jagint mktimeWindowStart( time_t tsec, int minCycle, int hourCycle )
+{
+	struct tm result;
+	gmtime_r( &tsec, &result );
+	result.tm_sec = 0;
+	if ( minCycle > 0 ) {
+		result.tm_min = (result.tm_min/minCycle) * minCycle;
+	} else {
+		result.tm_min = 0;
+		result.tm_hour = (result.tm_hour/hourCycle) * hourCycle;
+	}
+	return mktime( &result );
+}
+
+// mismatches of window starts with mktime() for times from..to
+jagint timeWindowMismatches( time_t from, time_t to, jagint &n )
+{
+	jagint fails = 0;
+	for ( time_t t = from; t < to; t += 420 ) {
+		if ( JagTime::getStartTimeSecOfMinute( t, 5 ) != mktimeWindowStart( t, 5, 0 ) ) ++fails;
+		if ( JagTime::getStartTimeSecOfHour( t, 1 ) != mktimeWindowStart( t, 0, 1 ) ) ++fails;
+		n += 2;
+	}
+	return fails;
+}
+
+// window starts equal mktime() in zones with half-hour and standard-offset changes,
+// also when the zone changes between calls of the same thread
+void test_timewindow()
+{
+	const char *zones[] = { "UTC", "Europe/London", "Australia/Lord_Howe", "America/New_York", "Asia/Kathmandu", "Europe/London" };
+	int nzones = sizeof(zones)/sizeof(zones[0]);
+	const char *oldtz = getenv("TZ");
+	Jstr savetz = oldtz ? oldtz : "";
+
+	// 1971 (end of British Standard Time) and 2020 (Lord Howe half-hour switches)
+	time_t y1971 = 31536000, y1972 = 63072000, y2020 = 1577836800, y2021 = 1609459200;
+	jagint fails = 0, n = 0;
+	for ( int z = 0; z < nzones; ++z ) {
+		setenv( "TZ", zones[z], 1 );
+		tzset();
+		// first the hour the previous zone ended with, still cached by this thread
+		if ( z > 0 ) fails += timeWindowMismatches( y2021 - 3600, y2021, n );
+		fails += timeWindowMismatches( y1971, y1972, n );
+		fails += timeWindowMismatches( y2020, y2021, n );
+	}
+
+	if ( oldtz ) { setenv( "TZ", savetz.s(), 1 ); } else { unsetenv( "TZ" ); }
+	tzset();
+	printf("test_timewindow windows=%lld mismatches=%lld %s\n", n, fails, fails ? "FAIL" : "OK" );
+}